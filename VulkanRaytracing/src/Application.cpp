@@ -1,17 +1,28 @@
 #include "vkpch.h"
 
+#include "Core/Core.h"
 #include "Renderer/VulkanRenderer.h"
+#include "Tools/AssetArchive.h"
 
 #include "Application.h"
 
 #include "Sandbox3D.h"
 
+#include <filesystem>
+
 Application *Application::s_Instance = nullptr;
 
 Application::Application()
 {
     assert(s_Instance == nullptr);
     s_Instance = this;
+    // Shaders, models and textures that are not on disk are read from the archive when one is
+    // shipped
+    if (std::filesystem::exists(ASSET_ARCHIVE_PATH))
+    {
+        std::string error;
+        result_assert(AssetArchive::Mount(ASSET_ARCHIVE_PATH, error));
+    }
     m_Window.SetEventCallback(std::bind(&Application::OnEvent, this, std::placeholders::_1));
     VulkanRenderer::Init(&m_Window);
     m_ImGuiLayer = new ImGuiLayer();
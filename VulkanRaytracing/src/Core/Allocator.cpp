@@ -3,7 +3,12 @@
 #define VMA_IMPLEMENTATION
 #include "allocator.h"
 
+#include "Core/ThreadPool.h"
+#include "Core/UploadManager.h"
+#include "Renderer/GltfFile.h"
+#include "Renderer/TextureCache.h"
 #include "Renderer/VulkanRenderer.h"
+#include "Tools/HdrDecoder.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -46,11 +51,91 @@ BufferAllocation Allocator::CreateBuffer(const vk::DeviceSize &size,
     return bufferAllocation;
 }
 
+BufferAllocation Allocator::CreateStagingBuffer(vk::DeviceSize size, void *&mappedData)
+{
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    BufferAllocation bufferAllocation{};
+    VmaAllocationInfo allocationInfo{};
+    vmaCreateBuffer(s_Allocator.m_Allocator, &bufferInfo, &allocInfo, &bufferAllocation.buffer,
+                    &bufferAllocation.allocation, &allocationInfo);
+    mappedData = allocationInfo.pMappedData;
+    return bufferAllocation;
+}
+
+BufferAllocation Allocator::CreateDeviceLocalBuffer(const vk::CommandBuffer &commandBuffer,
+                                                    const void *data, vk::DeviceSize bufferSize,
+                                                    const vk::BufferUsageFlags &usage)
+{
+    BufferAllocation stagingBufferAllocation = CreateBuffer(
+        bufferSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    void *mappedData;
+    vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation, &mappedData);
+    memcpy(mappedData, data, (size_t)bufferSize);
+    vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation);
+
+    BufferAllocation resultBufferAllocation = CreateBuffer(
+        bufferSize, vk::BufferUsageFlagBits::eTransferDst | usage, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    vk::BufferCopy copyRegion{0, 0, bufferSize};
+
+    commandBuffer.copyBuffer(stagingBufferAllocation.buffer, resultBufferAllocation.buffer, 1,
+                             &copyRegion);
+    s_Allocator.m_StagingBuffers.push(stagingBufferAllocation);
+    return resultBufferAllocation;
+}
+
+BufferAllocation Allocator::CreateDeviceLocalBuffer(const void *data, vk::DeviceSize bufferSize,
+                                                    const vk::BufferUsageFlags &usage,
+                                                    vk::DeviceSize stagingSliceSize)
+{
+    BufferAllocation resultBufferAllocation = CreateBuffer(
+        bufferSize, vk::BufferUsageFlagBits::eTransferDst | usage, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const vk::DeviceSize sliceSize = stagingSliceSize ? stagingSliceSize : bufferSize;
+    for (vk::DeviceSize offset = 0; offset < bufferSize; offset += sliceSize)
+    {
+        UploadManager::UploadBuffer(resultBufferAllocation.buffer, offset,
+                                    static_cast<const char *>(data) + offset,
+                                    std::min(sliceSize, bufferSize - offset));
+    }
+    return resultBufferAllocation;
+}
+
+void Allocator::DestroyBuffer(const BufferAllocation &bufferAllocation)
+{
+    vmaDestroyBuffer(s_Allocator.m_Allocator, bufferAllocation.buffer,
+                     bufferAllocation.allocation);
+}
+
+void Allocator::DestroyImage(const ImageAllocation &imageAllocation)
+{
+    vmaDestroyImage(s_Allocator.m_Allocator, imageAllocation.image, imageAllocation.allocation);
+}
+
+vk::DeviceSize Allocator::GetAllocationSize(const VmaAllocation &allocation)
+{
+    if (!allocation)
+    {
+        return 0;
+    }
+    VmaAllocationInfo allocationInfo;
+    vmaGetAllocationInfo(s_Allocator.m_Allocator, allocation, &allocationInfo);
+    return allocationInfo.size;
+}
+
 ImageAllocation Allocator::CreateImage(const uint32_t width, const uint32_t height,
                                        vk::SampleCountFlagBits sampleCount,
                                        const vk::Format &format, const vk::ImageTiling &tiling,
                                        const vk::ImageUsageFlags &usage,
-                                       const VmaMemoryUsage &memoryUsage)
+                                       const VmaMemoryUsage &memoryUsage, uint32_t mipLevels,
+                                       uint32_t arrayLayers, vk::ImageCreateFlags flags)
 {
     VmaAllocationCreateInfo allocInfo = {};
     allocInfo.usage = memoryUsage;
@@ -58,8 +143,9 @@ ImageAllocation Allocator::CreateImage(const uint32_t width, const uint32_t heig
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.format = static_cast<VkFormat>(format);
     imageInfo.extent = {width, height, 1};
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = arrayLayers;
+    imageInfo.flags = static_cast<VkImageCreateFlags>(flags);
     imageInfo.samples = static_cast<VkSampleCountFlagBits>(sampleCount);
     imageInfo.tiling = static_cast<VkImageTiling>(tiling);
     imageInfo.usage = static_cast<VkImageUsageFlags>(usage);
@@ -69,13 +155,15 @@ ImageAllocation Allocator::CreateImage(const uint32_t width, const uint32_t heig
     ImageAllocation imageAllocation{};
     vmaCreateImage(s_Allocator.m_Allocator, &imageInfo, &allocInfo, &imageAllocation.image,
                    &imageAllocation.allocation, nullptr);
+    imageAllocation.mipLevels = mipLevels;
     return imageAllocation;
 }
 
 void Allocator::TransitionImageLayout(vk::Image image, vk::ImageAspectFlagBits aspect,
-                                      vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
+                                      vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                                      uint32_t mipLevels, uint32_t layerCount)
 {
-    vk::ImageSubresourceRange imgSubresourceRange{aspect, 0, 1, 0, 1};
+    vk::ImageSubresourceRange imgSubresourceRange{aspect, 0, mipLevels, 0, layerCount};
     vk::ImageMemoryBarrier barrier{{},
                                    {},
                                    oldLayout,
@@ -131,112 +219,186 @@ void Allocator::TransitionImageLayout(vk::Image image, vk::ImageAspectFlagBits a
     VulkanRenderer::EndSingleTimeCommands(commandBuffer);
 }
 
-ImageAllocation Allocator::CreateTextureImage(const std::string &filename)
+// Decodes image files and images embedded in .glb files to RGBA8
+static stbi_uc *LoadPixels(const std::string &filename, int &width, int &height)
 {
-    int texWidth, texHeight, texChannels;
-    stbi_uc *pixels =
-        stbi_load(filename.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-    if (!pixels)
+    int channels;
+    MappedFile file;
+    const uint8_t *data;
+    size_t size;
+    if (!GltfFile::OpenImage(filename, file, data, size) || size > INT_MAX)
     {
-        texWidth = texHeight = 1;
-        texChannels = 4;
-        glm::u8vec4 *color = new glm::u8vec4(255, 128, 0, 128);
-        pixels = reinterpret_cast<stbi_uc *>(color);
+        return nullptr;
     }
+    return stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels,
+                                 STBI_rgb_alpha);
+}
 
-    vk::DeviceSize imageSize =
-        static_cast<uint64_t>(texWidth) * static_cast<uint64_t>(texHeight) * sizeof(glm::u8vec4);
-
-    BufferAllocation stagingBufferAllocation =
-        CreateBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_TO_CPU);
+void Allocator::LoadTextureMips(const std::string &filename, MipChain &chain)
+{
+    int texWidth, texHeight;
+    stbi_uc *pixels = LoadPixels(filename, texWidth, texHeight);
 
-    void *mappedData;
-    vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation, &mappedData);
-    memcpy(mappedData, pixels, static_cast<size_t>(imageSize));
-    vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation);
+    if (!pixels)
+    {
+        const glm::u8vec4 color(255, 128, 0, 128);
+        MipGenerator::Generate(&color.x, 1, 1, true, MipFilter::Box, chain);
+        return;
+    }
 
+    MipGenerator::Generate(pixels, static_cast<uint32_t>(texWidth),
+                           static_cast<uint32_t>(texHeight), true, MipFilter::Box, chain);
     stbi_image_free(pixels);
+}
 
-    ImageAllocation imageAllocation =
-        CreateImage(texWidth, texHeight, vk::SampleCountFlagBits::e1, vk::Format::eR8G8B8A8Srgb,
-                    vk::ImageTiling::eOptimal,
-                    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                    VMA_MEMORY_USAGE_GPU_ONLY);
-
-    TransitionImageLayout(imageAllocation.image, vk::ImageAspectFlagBits::eColor,
-                          vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-
-    vk::ImageSubresourceLayers imgSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1};
-    vk::BufferImageCopy region{
-        0,
-        0,
-        0,
-        imgSubresourceLayers,
-        {0, 0, 0},
-        vk::Extent3D{static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1}};
+bool Allocator::LoadCompressedTexture(const std::string &filename, bool preferBC7,
+                                      CompressedChain &chain)
+{
+    if (TextureCache::Load(filename, chain) && (chain.format == BlockFormat::BC7) == preferBC7)
+    {
+        return true;
+    }
 
-    auto commandBuffer = VulkanRenderer::BeginSingleTimeCommands();
-    commandBuffer.copyBufferToImage(stagingBufferAllocation.buffer, imageAllocation.image,
-                                    vk::ImageLayout::eTransferDstOptimal, {region});
-    VulkanRenderer::EndSingleTimeCommands(commandBuffer);
+    int texWidth, texHeight;
+    stbi_uc *pixels = LoadPixels(filename, texWidth, texHeight);
+    if (!pixels)
+    {
+        return false;
+    }
 
-    TransitionImageLayout(imageAllocation.image, vk::ImageAspectFlagBits::eColor,
-                          vk::ImageLayout::eTransferDstOptimal,
-                          vk::ImageLayout::eShaderReadOnlyOptimal);
+    MipChain mips;
+    MipGenerator::Generate(pixels, static_cast<uint32_t>(texWidth),
+                           static_cast<uint32_t>(texHeight), true, MipFilter::Box, mips);
+    stbi_image_free(pixels);
 
-    s_Allocator.m_StagingBuffers.push(stagingBufferAllocation);
-    return imageAllocation;
+    BlockCompressor::Compress(mips, BlockCompressor::ChooseFormat(mips, preferBC7), chain);
+    TextureCache::Write(filename, chain);
+    return true;
 }
 
-ImageAllocation Allocator::CreateHdrTextureImage(const std::string &filename)
+ImageAllocation Allocator::CreateTextureImage(const MipChain &chain)
 {
-    int texWidth, texHeight, nrComponents;
-    float *pixels =
-        stbi_loadf(filename.c_str(), &texWidth, &texHeight, &nrComponents, 0);
-
-    vk::DeviceSize imageSize =
-        static_cast<uint64_t>(texWidth) * static_cast<uint64_t>(texHeight) * sizeof(float) * 3;
-
-    BufferAllocation stagingBufferAllocation =
-        CreateBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_TO_CPU);
-
-    void *mappedData;
-    vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation, &mappedData);
-    memcpy(mappedData, pixels, static_cast<size_t>(imageSize));
-    vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation);
+    return CreateTextureImage(vk::Format::eR8G8B8A8Srgb, chain.pixels.data(), chain.pixels.size(),
+                              chain.levels);
+}
 
-    stbi_image_free(pixels);
+ImageAllocation Allocator::CreateTextureImage(const CompressedChain &chain)
+{
+    return CreateTextureImage(BlockCompressor::GetVulkanFormat(chain.format), chain.blocks.data(),
+                              chain.blocks.size(), chain.levels);
+}
 
+ImageAllocation Allocator::CreateTextureImage(vk::Format format, const uint8_t *data,
+                                              vk::DeviceSize size,
+                                              const std::vector<MipLevel> &levels,
+                                              uint32_t faceCount)
+{
     ImageAllocation imageAllocation =
-        CreateImage(texWidth, texHeight, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32Sfloat,
-                    vk::ImageTiling::eLinear,
+        CreateImage(levels[0].width, levels[0].height, vk::SampleCountFlagBits::e1, format,
+                    vk::ImageTiling::eOptimal,
                     vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-                    VMA_MEMORY_USAGE_GPU_ONLY);
+                    VMA_MEMORY_USAGE_GPU_ONLY, static_cast<uint32_t>(levels.size()), faceCount,
+                    faceCount == 6 ? vk::ImageCreateFlagBits::eCubeCompatible
+                                   : vk::ImageCreateFlags());
+    UploadManager::UploadImage(imageAllocation.image, data, size, levels, faceCount);
+    return imageAllocation;
+}
 
-    TransitionImageLayout(imageAllocation.image, vk::ImageAspectFlagBits::eColor,
-                          vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+ImageAllocation Allocator::CreateTextureImage(const std::string &filename)
+{
+    MipChain chain;
+    LoadTextureMips(filename, chain);
+    return CreateTextureImage(chain);
+}
 
-    vk::ImageSubresourceLayers imgSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1};
-    vk::BufferImageCopy region{
-        0,
-        0,
-        0,
-        imgSubresourceLayers,
-        {0, 0, 0},
-        vk::Extent3D{static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1}};
+bool Allocator::LoadEnvironment(const std::string &filename,
+                                const EnvironmentBakeSettings &settings, EnvironmentMap &equirect,
+                                EnvironmentMap &cubemap)
+{
+    // The header tells the width the equirectangular map is reduced to
+    MappedFile file;
+    int texWidth, texHeight, nrComponents;
+    if (!file.Open(filename, IMAGE_HEADER_READ_SIZE) || file.GetSize() > INT_MAX ||
+        !stbi_info_from_memory(file.GetData(), static_cast<int>(file.GetSize()), &texWidth,
+                               &texHeight, &nrComponents))
+    {
+        return false;
+    }
+    uint32_t bakedWidth = static_cast<uint32_t>(texWidth);
+    while (bakedWidth > std::max(settings.maxWidth, 1u))
+    {
+        bakedWidth /= 2;
+    }
 
-    auto commandBuffer = VulkanRenderer::BeginSingleTimeCommands();
-    commandBuffer.copyBufferToImage(stagingBufferAllocation.buffer, imageAllocation.image,
-                                    vk::ImageLayout::eTransferDstOptimal, {region});
-    VulkanRenderer::EndSingleTimeCommands(commandBuffer);
+    const bool equirectCached = TextureCache::Load(filename, ".equirect", equirect) &&
+                                equirect.format == settings.format && equirect.faceCount == 1 &&
+                                equirect.levels[0].width == bakedWidth;
+    const bool cubemapCached = settings.cubeFaceSize == 0 ||
+                               (TextureCache::Load(filename, ".cube", cubemap) &&
+                                cubemap.format == settings.format && cubemap.faceCount == 6 &&
+                                cubemap.levels[0].width == settings.cubeFaceSize);
+    if (equirectCached && cubemapCached)
+    {
+        return true;
+    }
 
-    TransitionImageLayout(imageAllocation.image, vk::ImageAspectFlagBits::eColor,
-                          vk::ImageLayout::eTransferDstOptimal,
-                          vk::ImageLayout::eShaderReadOnlyOptimal);
+    // Only the header may have been read from an archive
+    if (!file.Open(filename) || file.GetSize() > INT_MAX)
+    {
+        return false;
+    }
+    // Radiance files are decoded in parallel, the other formats stb_image reads go through it
+    HdrImage image;
+    float *stbPixels = nullptr;
+    const float *pixels;
+    if (HdrDecoder::IsHdr(file.GetData(), file.GetSize()))
+    {
+        if (!HdrDecoder::Decode(file.GetData(), file.GetSize(), HdrFormat::Float, image))
+        {
+            return false;
+        }
+        pixels = reinterpret_cast<const float *>(image.texels.data());
+        texWidth = static_cast<int>(image.width);
+        texHeight = static_cast<int>(image.height);
+    }
+    else
+    {
+        stbPixels = stbi_loadf_from_memory(file.GetData(), static_cast<int>(file.GetSize()),
+                                           &texWidth, &texHeight, &nrComponents, STBI_rgb);
+        if (!stbPixels)
+        {
+            return false;
+        }
+        pixels = stbPixels;
+    }
 
-    s_Allocator.m_StagingBuffers.push(stagingBufferAllocation);
-    return imageAllocation;
+    const uint32_t width = static_cast<uint32_t>(texWidth);
+    const uint32_t height = static_cast<uint32_t>(texHeight);
+    {
+        TaskGroup group;
+        if (!equirectCached)
+        {
+            group.Run([&]() {
+                EnvironmentBaker::BakeEquirect(pixels, width, height, settings, equirect);
+                TextureCache::Write(filename, ".equirect", equirect);
+            });
+        }
+        if (!cubemapCached)
+        {
+            group.Run([&]() {
+                EnvironmentBaker::BakeCubemap(pixels, width, height, settings, cubemap);
+                TextureCache::Write(filename, ".cube", cubemap);
+            });
+        }
+    }
+    stbi_image_free(stbPixels);
+    return true;
+}
+
+ImageAllocation Allocator::CreateEnvironmentImage(const EnvironmentMap &map)
+{
+    return CreateTextureImage(EnvironmentBaker::GetVulkanFormat(map.format), map.texels.data(),
+                              map.texels.size(), map.levels, map.faceCount);
 }
 
 AccelerationAllocation Allocator::CreateAcceleration(vk::AccelerationStructureCreateInfoNV asInfo)
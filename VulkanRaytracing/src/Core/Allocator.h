@@ -6,6 +6,9 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "Tools/BlockCompressor.h"
+#include "Tools/EnvironmentBaker.h"
+
 struct AccelerationAllocation
 {
     vk::AccelerationStructureNV accel;
@@ -22,6 +25,7 @@ struct ImageAllocation
 {
     VkImage image;
     VmaAllocation allocation;
+    uint32_t mipLevels = 1;
 };
 
 class Allocator
@@ -33,18 +37,47 @@ class Allocator
                                          const vk::BufferUsageFlags &usage,
                                          const VmaMemoryUsage &memoryUsage);
 
+    // Host visible and mapped for its whole lifetime
+    static BufferAllocation CreateStagingBuffer(vk::DeviceSize size, void *&mappedData);
+
     static ImageAllocation CreateImage(const uint32_t width, const uint32_t height,
                                        vk::SampleCountFlagBits sampleCount,
                                        const vk::Format &format, const vk::ImageTiling &tiling,
                                        const vk::ImageUsageFlags &usage,
-                                       const VmaMemoryUsage &memoryUsage);
+                                       const VmaMemoryUsage &memoryUsage,
+                                       uint32_t mipLevels = 1, uint32_t arrayLayers = 1,
+                                       vk::ImageCreateFlags flags = {});
 
     static void TransitionImageLayout(vk::Image image, vk::ImageAspectFlagBits aspect,
-                                      vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+                                      vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                                      uint32_t mipLevels = 1, uint32_t layerCount = 1);
+
+    // Decodes an sRGB texture and builds its mip chain, safe to call from worker threads
+    static void LoadTextureMips(const std::string &filename, MipChain &chain);
+
+    // Loads the block compressed chain from the texture cache, or decodes, mipmaps and
+    // compresses the texture and writes the cache. Returns false when the texture cannot be
+    // decoded. Safe to call from worker threads.
+    static bool LoadCompressedTexture(const std::string &filename, bool preferBC7,
+                                      CompressedChain &chain);
+
+    // Texture and environment images are queued on the UploadManager, they may be used by graphics
+    // submissions made after UploadManager::Submit
+    static ImageAllocation CreateTextureImage(const MipChain &chain);
+
+    static ImageAllocation CreateTextureImage(const CompressedChain &chain);
 
     static ImageAllocation CreateTextureImage(const std::string &filename);
 
-    static ImageAllocation CreateHdrTextureImage(const std::string &filename);
+    // Loads the baked equirectangular map and, unless settings.cubeFaceSize is 0, the cubemap
+    // of an HDR environment from the texture cache. Whatever is missing is baked from the
+    // decoded source and cached. Returns false when the source cannot be decoded.
+    static bool LoadEnvironment(const std::string &filename,
+                                const EnvironmentBakeSettings &settings, EnvironmentMap &equirect,
+                                EnvironmentMap &cubemap);
+
+    // Cube compatible with six layers for maps with six faces
+    static ImageAllocation CreateEnvironmentImage(const EnvironmentMap &map);
 
     template <typename T>
     static void UpdateAllocation(const VmaAllocation &allocation, const T &data)
@@ -55,32 +88,37 @@ class Allocator
         vmaUnmapMemory(s_Allocator.m_Allocator, allocation);
     }
 
+    static BufferAllocation CreateDeviceLocalBuffer(const vk::CommandBuffer &commandBuffer,
+                                                    const void *data, vk::DeviceSize bufferSize,
+                                                    const vk::BufferUsageFlags &usage);
+
+    // Queues the upload on the UploadManager in slices of at most stagingSliceSize bytes, or in
+    // one piece when it is 0. The buffer may be used by graphics submissions made after
+    // UploadManager::Submit.
+    static BufferAllocation CreateDeviceLocalBuffer(const void *data, vk::DeviceSize bufferSize,
+                                                    const vk::BufferUsageFlags &usage,
+                                                    vk::DeviceSize stagingSliceSize = 0);
+
     template <typename T>
     static BufferAllocation CreateDeviceLocalBuffer(const vk::CommandBuffer &commandBuffer,
                                                     const std::vector<T> &data,
                                                     const vk::BufferUsageFlags &usage)
     {
-        vk::DeviceSize bufferSize = sizeof(data[0]) * data.size();
-
-        BufferAllocation stagingBufferAllocation = CreateBuffer(
-            bufferSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_TO_CPU);
-
-        void *mappedData;
-        vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation, &mappedData);
-        memcpy(mappedData, data.data(), (size_t)bufferSize);
-        vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation.allocation);
-
-        BufferAllocation resultBufferAllocation = CreateBuffer(
-            bufferSize, vk::BufferUsageFlagBits::eTransferDst | usage, VMA_MEMORY_USAGE_GPU_ONLY);
-
-        vk::BufferCopy copyRegion{0, 0, bufferSize};
+        return CreateDeviceLocalBuffer(commandBuffer, data.data(), sizeof(data[0]) * data.size(),
+                                       usage);
+    }
 
-        commandBuffer.copyBuffer(stagingBufferAllocation.buffer, resultBufferAllocation.buffer, 1,
-                                 &copyRegion);
-        s_Allocator.m_StagingBuffers.push(stagingBufferAllocation);
-        return resultBufferAllocation;
+    template <typename T>
+    static BufferAllocation CreateDeviceLocalBuffer(const std::vector<T> &data,
+                                                    const vk::BufferUsageFlags &usage)
+    {
+        return CreateDeviceLocalBuffer(data.data(), sizeof(data[0]) * data.size(), usage);
     }
 
+    static void DestroyBuffer(const BufferAllocation &bufferAllocation);
+    static void DestroyImage(const ImageAllocation &imageAllocation);
+    static vk::DeviceSize GetAllocationSize(const VmaAllocation &allocation);
+
     static AccelerationAllocation CreateAcceleration(vk::AccelerationStructureCreateInfoNV asInfo);
 
   private:
@@ -88,6 +126,11 @@ class Allocator
     Allocator(const Allocator &) = delete;
     Allocator &operator=(const Allocator &) = delete;
 
+    static ImageAllocation CreateTextureImage(vk::Format format, const uint8_t *data,
+                                              vk::DeviceSize size,
+                                              const std::vector<MipLevel> &levels,
+                                              uint32_t faceCount = 1);
+
   private:
     static Allocator s_Allocator;
 
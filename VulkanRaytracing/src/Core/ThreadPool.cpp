@@ -0,0 +1,112 @@
+#include "vkpch.h"
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    m_Workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_TaskAvailable.notify_all();
+    for (auto &worker : m_Workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::Get()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Enqueue(std::function<void()> func, TaskGroup *group)
+{
+    group->m_Pending++;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Tasks.push_back({std::move(func), group});
+    }
+    m_TaskAvailable.notify_one();
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(m_Tasks.front());
+        m_Tasks.pop_front();
+    }
+
+    task.func();
+
+    {
+        // Decrementing under the lock keeps a waiter from missing the notification
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        task.group->m_Pending--;
+    }
+    m_TaskFinished.notify_all();
+    return true;
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_TaskAvailable.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+            if (m_Stopping && m_Tasks.empty())
+            {
+                return;
+            }
+        }
+        RunPendingTask();
+    }
+}
+
+void TaskGroup::Run(std::function<void()> func)
+{
+    if (m_Pool.m_Workers.empty())
+    {
+        func();
+        return;
+    }
+    m_Pool.Enqueue(std::move(func), this);
+}
+
+void TaskGroup::Wait()
+{
+    while (m_Pending > 0)
+    {
+        if (m_Pool.RunPendingTask())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_Pool.m_Mutex);
+        m_Pool.m_TaskFinished.wait(lock, [this]() {
+            return m_Pending == 0 || !m_Pool.m_Tasks.empty();
+        });
+    }
+}
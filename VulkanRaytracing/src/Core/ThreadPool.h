@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+class ThreadPool
+{
+  public:
+    // Zero threads means one worker per hardware thread except the calling one
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &other) = delete;
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    static ThreadPool &Get();
+
+    // Workers plus the thread that waits on the work
+    inline uint32_t GetConcurrency() const
+    {
+        return static_cast<uint32_t>(m_Workers.size()) + 1;
+    }
+
+    // Calls func(i) for every i in [0, count) and returns once all calls finished. The calling
+    // thread takes part in the work, so this may be used from inside pool tasks as well.
+    template <typename Func> void ParallelFor(size_t count, Func &&func);
+
+  private:
+    friend class TaskGroup;
+
+    struct Task
+    {
+        std::function<void()> func;
+        TaskGroup *group;
+    };
+
+    void Enqueue(std::function<void()> func, TaskGroup *group);
+    bool RunPendingTask();
+    void WorkerLoop();
+
+  private:
+    std::vector<std::thread> m_Workers;
+    std::deque<Task> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_TaskAvailable;
+    std::condition_variable m_TaskFinished;
+    bool m_Stopping = false;
+};
+
+// Set of tasks that can be waited on together. Waiting executes queued tasks instead of
+// blocking, so nested groups never starve the pool.
+class TaskGroup
+{
+  public:
+    explicit TaskGroup(ThreadPool &pool = ThreadPool::Get()) : m_Pool(pool)
+    {
+    }
+    ~TaskGroup()
+    {
+        Wait();
+    }
+    TaskGroup(const TaskGroup &other) = delete;
+    TaskGroup &operator=(const TaskGroup &other) = delete;
+
+    void Run(std::function<void()> func);
+    void Wait();
+
+    // Whether every task run so far finished, without waiting or running any of them
+    bool IsDone() const
+    {
+        return m_Pending == 0;
+    }
+
+  private:
+    friend class ThreadPool;
+
+    ThreadPool &m_Pool;
+    std::atomic<uint32_t> m_Pending{0};
+};
+
+template <typename Func> void ThreadPool::ParallelFor(size_t count, Func &&func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (count == 1 || m_Workers.empty())
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&next, &func, count]() {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            func(i);
+        }
+    };
+
+    TaskGroup group(*this);
+    size_t taskCount = std::min<size_t>(count, GetConcurrency()) - 1;
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        group.Run(worker);
+    }
+    worker();
+    group.Wait();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+
+class Timer
+{
+  public:
+    Timer()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_Start = std::chrono::high_resolution_clock::now();
+    }
+
+    float ElapsedMillis() const
+    {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(
+                   std::chrono::high_resolution_clock::now() - m_Start)
+            .count();
+    }
+
+  private:
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_Start;
+};
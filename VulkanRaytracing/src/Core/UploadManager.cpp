@@ -0,0 +1,344 @@
+#include "vkpch.h"
+
+#include "UploadManager.h"
+
+// Keeps staged regions aligned for every texel and block size copied to images
+#define UPLOAD_ALIGNMENT 16
+
+UploadManager UploadManager::s_Instance;
+
+void UploadManager::Init(vk::Device device, uint32_t graphicsFamily,
+                         std::optional<uint32_t> transferFamily, vk::DeviceSize ringSize)
+{
+    UploadManager &manager = s_Instance;
+    manager.m_Device = device;
+    manager.m_GraphicsFamily = graphicsFamily;
+    manager.m_TransferFamily = transferFamily;
+    manager.m_GraphicsQueue = device.getQueue(graphicsFamily, 0);
+    manager.m_GraphicsCommandPool = device.createCommandPoolUnique(
+        {vk::CommandPoolCreateFlagBits::eTransient, graphicsFamily});
+    if (transferFamily)
+    {
+        manager.m_TransferQueue = device.getQueue(transferFamily.value(), 0);
+        manager.m_TransferCommandPool = device.createCommandPoolUnique(
+            {vk::CommandPoolCreateFlagBits::eTransient, transferFamily.value()});
+    }
+
+    void *mappedData;
+    manager.m_Ring = Allocator::CreateStagingBuffer(ringSize, mappedData);
+    manager.m_RingData = static_cast<uint8_t *>(mappedData);
+    manager.m_RingSize = ringSize;
+    manager.m_RingHead = 0;
+    manager.m_RingTail = 0;
+}
+
+void UploadManager::Shutdown()
+{
+    Flush();
+    UploadManager &manager = s_Instance;
+    Allocator::DestroyBuffer(manager.m_Ring);
+    manager.m_Ring = {};
+    manager.m_RingData = nullptr;
+    manager.m_GraphicsCommandPool.reset();
+    manager.m_TransferCommandPool.reset();
+}
+
+void UploadManager::UploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data,
+                                 vk::DeviceSize size)
+{
+    UploadManager &manager = s_Instance;
+    std::lock_guard<std::mutex> lock(manager.m_Mutex);
+    manager.RetireCompleted();
+
+    for (vk::DeviceSize copied = 0; copied < size;)
+    {
+        const vk::DeviceSize pieceSize = std::min(size - copied, manager.m_RingSize);
+        BufferUpload upload;
+        upload.buffer = buffer;
+        vk::DeviceSize sourceOffset;
+        manager.Stage(static_cast<const uint8_t *>(data) + copied, pieceSize, upload.source,
+                      sourceOffset);
+        upload.region = vk::BufferCopy{sourceOffset, offset + copied, pieceSize};
+        manager.m_Batch.buffers.push_back(upload);
+        copied += pieceSize;
+    }
+}
+
+void UploadManager::UploadImage(vk::Image image, const uint8_t *data, vk::DeviceSize size,
+                                const std::vector<MipLevel> &levels, uint32_t layerCount)
+{
+    UploadManager &manager = s_Instance;
+    std::lock_guard<std::mutex> lock(manager.m_Mutex);
+    manager.RetireCompleted();
+
+    ImageUpload upload;
+    upload.image = image;
+    upload.mipLevels = static_cast<uint32_t>(levels.size());
+    upload.layerCount = layerCount;
+    vk::DeviceSize sourceOffset;
+    manager.Stage(data, size, upload.source, sourceOffset);
+
+    // The faces of a level follow each other, so one region covers all of them
+    for (uint32_t i = 0; i < upload.mipLevels; i++)
+    {
+        const MipLevel &level = levels[i];
+        vk::ImageSubresourceLayers imgSubresourceLayers{vk::ImageAspectFlagBits::eColor, i, 0,
+                                                        layerCount};
+        upload.regions.push_back({sourceOffset + level.offset,
+                                  0,
+                                  0,
+                                  imgSubresourceLayers,
+                                  {0, 0, 0},
+                                  vk::Extent3D{level.width, level.height, 1}});
+    }
+    manager.m_Batch.images.push_back(std::move(upload));
+}
+
+UploadTicket UploadManager::Submit()
+{
+    UploadManager &manager = s_Instance;
+    std::lock_guard<std::mutex> lock(manager.m_Mutex);
+    manager.RetireCompleted();
+    if (!manager.m_Batch.images.empty() || !manager.m_Batch.buffers.empty())
+    {
+        manager.SubmitBatch();
+    }
+    return manager.m_NextTicket - 1;
+}
+
+bool UploadManager::IsComplete(UploadTicket ticket)
+{
+    UploadManager &manager = s_Instance;
+    std::lock_guard<std::mutex> lock(manager.m_Mutex);
+    manager.RetireCompleted();
+    return manager.m_CompletedTicket >= ticket;
+}
+
+void UploadManager::Wait(UploadTicket ticket)
+{
+    UploadManager &manager = s_Instance;
+    std::lock_guard<std::mutex> lock(manager.m_Mutex);
+    while (manager.m_CompletedTicket < ticket && !manager.m_InFlight.empty())
+    {
+        manager.RetireOldest();
+    }
+}
+
+void UploadManager::Flush()
+{
+    Wait(Submit());
+}
+
+bool UploadManager::AllocateRing(vk::DeviceSize size, vk::DeviceSize &offset)
+{
+    const bool empty =
+        !m_Batch.usesRing && std::none_of(m_InFlight.begin(), m_InFlight.end(),
+                                          [](const Batch &batch) { return batch.usesRing; });
+    if (empty)
+    {
+        m_RingHead = 0;
+        m_RingTail = 0;
+    }
+
+    // Used bytes run from the tail to the head, wrapping around the end of the ring
+    const vk::DeviceSize start =
+        (m_RingHead + UPLOAD_ALIGNMENT - 1) & ~vk::DeviceSize(UPLOAD_ALIGNMENT - 1);
+    if (empty || m_RingHead > m_RingTail)
+    {
+        if (start + size <= m_RingSize)
+        {
+            offset = start;
+        }
+        else if (size <= m_RingTail)
+        {
+            offset = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if (m_RingHead < m_RingTail && start + size <= m_RingTail)
+    {
+        offset = start;
+    }
+    else
+    {
+        return false;
+    }
+
+    m_RingHead = offset + size;
+    m_Batch.usesRing = true;
+    m_Batch.ringEnd = m_RingHead;
+    return true;
+}
+
+void UploadManager::Stage(const void *data, vk::DeviceSize size, vk::Buffer &source,
+                          vk::DeviceSize &offset)
+{
+    if (size > m_RingSize)
+    {
+        void *mappedData;
+        BufferAllocation staging = Allocator::CreateStagingBuffer(size, mappedData);
+        memcpy(mappedData, data, static_cast<size_t>(size));
+        m_Batch.ownStaging.push_back(staging);
+        source = staging.buffer;
+        offset = 0;
+        return;
+    }
+
+    // Waits for the oldest batch until the ring has room, submitting the current batch first
+    // when it holds all of the used space
+    while (!AllocateRing(size, offset))
+    {
+        if (m_InFlight.empty())
+        {
+            SubmitBatch();
+        }
+        RetireOldest();
+    }
+    memcpy(m_RingData + offset, data, static_cast<size_t>(size));
+    source = m_Ring.buffer;
+}
+
+void UploadManager::SubmitBatch()
+{
+    Batch &batch = m_Batch;
+    batch.ticket = m_NextTicket++;
+    const bool transferQueue = m_TransferFamily.has_value() && !batch.images.empty();
+
+    std::vector<vk::ImageMemoryBarrier> toTransferDst;
+    std::vector<vk::ImageMemoryBarrier> toShaderRead;
+    std::vector<vk::ImageMemoryBarrier> acquire;
+    for (const auto &upload : batch.images)
+    {
+        vk::ImageSubresourceRange imgSubresourceRange{vk::ImageAspectFlagBits::eColor, 0,
+                                                      upload.mipLevels, 0, upload.layerCount};
+        toTransferDst.push_back({{},
+                                 vk::AccessFlagBits::eTransferWrite,
+                                 vk::ImageLayout::eUndefined,
+                                 vk::ImageLayout::eTransferDstOptimal,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 VK_QUEUE_FAMILY_IGNORED,
+                                 upload.image,
+                                 imgSubresourceRange});
+        vk::ImageMemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                                       vk::AccessFlagBits::eShaderRead,
+                                       vk::ImageLayout::eTransferDstOptimal,
+                                       vk::ImageLayout::eShaderReadOnlyOptimal,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       VK_QUEUE_FAMILY_IGNORED,
+                                       upload.image,
+                                       imgSubresourceRange};
+        if (transferQueue)
+        {
+            // Released by the transfer queue and acquired by the graphics queue with the same
+            // layout change
+            barrier.srcQueueFamilyIndex = m_TransferFamily.value();
+            barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+            acquire.push_back(barrier);
+            acquire.back().srcAccessMask = {};
+            barrier.dstAccessMask = {};
+        }
+        toShaderRead.push_back(barrier);
+    }
+
+    vk::CommandBufferBeginInfo beginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit};
+    batch.graphicsCommands = m_Device.allocateCommandBuffers(
+        {m_GraphicsCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1})[0];
+    batch.graphicsCommands.begin(beginInfo);
+    vk::CommandBuffer imageCommands = batch.graphicsCommands;
+    if (transferQueue)
+    {
+        batch.transferCommands = m_Device.allocateCommandBuffers(
+            {m_TransferCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1})[0];
+        batch.transferCommands.begin(beginInfo);
+        imageCommands = batch.transferCommands;
+    }
+
+    if (!batch.images.empty())
+    {
+        imageCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                      vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
+                                      toTransferDst);
+        for (const auto &upload : batch.images)
+        {
+            imageCommands.copyBufferToImage(upload.source, upload.image,
+                                            vk::ImageLayout::eTransferDstOptimal, upload.regions);
+        }
+        imageCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                      transferQueue ? vk::PipelineStageFlagBits::eBottomOfPipe
+                                                    : vk::PipelineStageFlagBits::eAllCommands,
+                                      {}, {}, {}, toShaderRead);
+    }
+
+    if (transferQueue)
+    {
+        batch.graphicsCommands.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                                               vk::PipelineStageFlagBits::eAllCommands, {}, {},
+                                               {}, acquire);
+    }
+    for (const auto &upload : batch.buffers)
+    {
+        batch.graphicsCommands.copyBuffer(upload.source, upload.buffer, 1, &upload.region);
+    }
+    if (!batch.buffers.empty())
+    {
+        vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                                  vk::AccessFlagBits::eMemoryRead};
+        batch.graphicsCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                               vk::PipelineStageFlagBits::eAllCommands, {},
+                                               {barrier}, {}, {});
+    }
+
+    if (transferQueue)
+    {
+        batch.transferCommands.end();
+        batch.imagesReleased = m_Device.createSemaphore({});
+        vk::SubmitInfo submitInfo{0, nullptr, nullptr, 1, &batch.transferCommands, 1,
+                                  &batch.imagesReleased};
+        m_TransferQueue.submit(submitInfo, nullptr);
+    }
+
+    batch.graphicsCommands.end();
+    const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    vk::SubmitInfo submitInfo{transferQueue ? 1u : 0u, &batch.imagesReleased, &waitStage, 1,
+                              &batch.graphicsCommands};
+    batch.fence = m_Device.createFence({});
+    m_GraphicsQueue.submit(submitInfo, batch.fence);
+
+    m_InFlight.push_back(std::move(batch));
+    m_Batch = Batch();
+}
+
+void UploadManager::RetireOldest()
+{
+    Batch &batch = m_InFlight.front();
+    m_Device.waitForFences(batch.fence, VK_TRUE, UINT64_MAX);
+    m_Device.destroyFence(batch.fence);
+    m_Device.freeCommandBuffers(m_GraphicsCommandPool.get(), batch.graphicsCommands);
+    if (batch.transferCommands)
+    {
+        m_Device.freeCommandBuffers(m_TransferCommandPool.get(), batch.transferCommands);
+        m_Device.destroySemaphore(batch.imagesReleased);
+    }
+    for (const auto &staging : batch.ownStaging)
+    {
+        Allocator::DestroyBuffer(staging);
+    }
+    if (batch.usesRing)
+    {
+        m_RingTail = batch.ringEnd;
+    }
+    m_CompletedTicket = batch.ticket;
+    m_InFlight.pop_front();
+}
+
+void UploadManager::RetireCompleted()
+{
+    while (!m_InFlight.empty() &&
+           m_Device.getFenceStatus(m_InFlight.front().fence) == vk::Result::eSuccess)
+    {
+        RetireOldest();
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "Allocator.h"
+
+#define UPLOAD_RING_SIZE (64ull << 20)
+
+// Submitted batches complete in order, a ticket is reached once its batch and every earlier one
+// finished on the GPU
+using UploadTicket = uint64_t;
+
+// Copies data to device local buffers and images through one persistently mapped staging ring.
+// Uploads are collected into a batch that is recorded with one barrier before and one after all
+// of its copies, and batches are tracked by fences instead of draining the queue.
+//
+// With a dedicated transfer queue the image copies run there and the images are handed over to
+// the graphics queue, which waits on a semaphore before acquiring them. Buffer copies may write
+// parts of a buffer from several batches, so they always run on the graphics queue. Either way
+// later graphics submissions see the uploaded data without a wait on the host.
+//
+// All functions may be called from any thread. Submitting and retiring batches use the graphics
+// queue, so they must not run concurrently with the renderer's own submissions.
+class UploadManager
+{
+  public:
+    static void Init(vk::Device device, uint32_t graphicsFamily,
+                     std::optional<uint32_t> transferFamily,
+                     vk::DeviceSize ringSize = UPLOAD_RING_SIZE);
+    static void Shutdown();
+
+    // The data is copied into the staging ring before returning, in ring sized pieces for
+    // buffers larger than the ring
+    static void UploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data,
+                             vk::DeviceSize size);
+    // Uploads all levels and layers of an image in eUndefined layout and leaves it in
+    // eShaderReadOnlyOptimal. The faces of a level follow each other in data. Images larger
+    // than the ring get a staging buffer of their own for the batch.
+    static void UploadImage(vk::Image image, const uint8_t *data, vk::DeviceSize size,
+                            const std::vector<MipLevel> &levels, uint32_t layerCount = 1);
+
+    // Submits the current batch and returns its ticket, or the last ticket when it is empty
+    static UploadTicket Submit();
+    static bool IsComplete(UploadTicket ticket);
+    static void Wait(UploadTicket ticket);
+    // Submits the current batch and waits for all of them
+    static void Flush();
+
+    static bool HasTransferQueue()
+    {
+        return s_Instance.m_TransferFamily.has_value();
+    }
+
+  private:
+    UploadManager() = default;
+    UploadManager(const UploadManager &) = delete;
+    UploadManager &operator=(const UploadManager &) = delete;
+
+    struct ImageUpload
+    {
+        vk::Image image;
+        uint32_t mipLevels;
+        uint32_t layerCount;
+        vk::Buffer source;
+        std::vector<vk::BufferImageCopy> regions;
+    };
+
+    struct BufferUpload
+    {
+        vk::Buffer buffer;
+        vk::Buffer source;
+        vk::BufferCopy region;
+    };
+
+    struct Batch
+    {
+        UploadTicket ticket = 0;
+        // End of the ring bytes the batch uses, they are free again once it completes
+        bool usesRing = false;
+        vk::DeviceSize ringEnd = 0;
+        std::vector<ImageUpload> images;
+        std::vector<BufferUpload> buffers;
+        std::vector<BufferAllocation> ownStaging;
+        vk::CommandBuffer transferCommands;
+        vk::CommandBuffer graphicsCommands;
+        vk::Semaphore imagesReleased;
+        vk::Fence fence;
+    };
+
+    bool AllocateRing(vk::DeviceSize size, vk::DeviceSize &offset);
+    void Stage(const void *data, vk::DeviceSize size, vk::Buffer &source, vk::DeviceSize &offset);
+    void SubmitBatch();
+    void RetireOldest();
+    void RetireCompleted();
+
+  private:
+    static UploadManager s_Instance;
+
+    std::mutex m_Mutex;
+    vk::Device m_Device;
+    uint32_t m_GraphicsFamily = 0;
+    std::optional<uint32_t> m_TransferFamily;
+    vk::Queue m_GraphicsQueue;
+    vk::Queue m_TransferQueue;
+    vk::UniqueCommandPool m_GraphicsCommandPool;
+    vk::UniqueCommandPool m_TransferCommandPool;
+
+    BufferAllocation m_Ring{};
+    uint8_t *m_RingData = nullptr;
+    vk::DeviceSize m_RingSize = 0;
+    vk::DeviceSize m_RingHead = 0;
+    vk::DeviceSize m_RingTail = 0;
+
+    Batch m_Batch;
+    std::deque<Batch> m_InFlight;
+    UploadTicket m_NextTicket = 1;
+    UploadTicket m_CompletedTicket = 0;
+};
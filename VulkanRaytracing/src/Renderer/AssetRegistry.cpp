@@ -0,0 +1,562 @@
+#include "vkpch.h"
+
+#include "AssetRegistry.h"
+
+#include "TextureDecoder.h"
+#include "VulkanRenderer.h"
+
+#include <cstring>
+#include <filesystem>
+
+AssetRegistry AssetRegistry::s_Registry;
+
+static std::string NormalizePath(const std::string &path)
+{
+    if (path.empty())
+    {
+        return path;
+    }
+    return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+static vk::SamplerCreateInfo GetTextureSamplerInfo()
+{
+    vk::SamplerCreateInfo samplerInfo = {
+        {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
+    samplerInfo.setMaxLod(FLT_MAX);
+    return samplerInfo;
+}
+
+static uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+bool AssetRegistry::GetContentHash(const std::string &path, uint64_t &hash)
+{
+    FileStamp stamp;
+    if (!GetFileStamp(path, stamp))
+    {
+        return false;
+    }
+
+    auto it = m_HashedFiles.find(path);
+    if (it != m_HashedFiles.end() && it->second.stamp.size == stamp.size &&
+        it->second.stamp.writeTime == stamp.writeTime)
+    {
+        hash = it->second.hash;
+        return true;
+    }
+
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        return false;
+    }
+    hash = HashData(file.GetData(), file.GetSize());
+    m_HashedFiles[path] = {stamp, hash};
+    return true;
+}
+
+bool AssetRegistry::GetModelHash(const std::string &path, uint64_t &hash)
+{
+    if (!GetContentHash(path, hash))
+    {
+        return false;
+    }
+    const std::string directory = std::filesystem::path(path).parent_path().generic_string();
+    hash = HashData(directory.data(), directory.size(), hash);
+    return true;
+}
+
+bool AssetRegistry::AcquireModel(const std::string &filePath, ObjModel &model)
+{
+    AssetRegistry &registry = s_Registry;
+    const std::string path = NormalizePath(filePath);
+
+    auto pathIt = registry.m_ModelPaths.find(path);
+    size_t entryIndex = pathIt != registry.m_ModelPaths.end() ? pathIt->second : SIZE_MAX;
+    uint64_t contentHash;
+    if (entryIndex == SIZE_MAX && registry.GetModelHash(path, contentHash))
+    {
+        auto hashIt = registry.m_ModelHashes.find(contentHash);
+        if (hashIt != registry.m_ModelHashes.end())
+        {
+            entryIndex = hashIt->second;
+            registry.m_Models[entryIndex].paths.push_back(path);
+            registry.m_ModelPaths[path] = entryIndex;
+        }
+    }
+
+    if (entryIndex == SIZE_MAX)
+    {
+        registry.m_Stats.meshMisses++;
+        return false;
+    }
+
+    ModelEntry &entry = registry.m_Models[entryIndex];
+    entry.references++;
+    registry.m_Stats.meshHits++;
+    registry.m_Stats.bytesSaved += entry.bytes;
+    model = entry.model;
+    return true;
+}
+
+void AssetRegistry::AddModel(const std::string &filePath, const ObjModel &model)
+{
+    AssetRegistry &registry = s_Registry;
+    const std::string path = NormalizePath(filePath);
+
+    ModelEntry entry;
+    entry.model = model;
+    entry.references = 1;
+    entry.bytes = Allocator::GetAllocationSize(model.vertexBuffer.allocation) +
+                  Allocator::GetAllocationSize(model.indexBuffer.allocation) +
+                  Allocator::GetAllocationSize(model.materialBuffer.allocation) +
+                  Allocator::GetAllocationSize(model.positionBuffer.allocation) +
+                  Allocator::GetAllocationSize(model.triangleMaterialBuffer.allocation);
+    // Textures packed into the same atlas share an index
+    const std::set<uint32_t> textureIndices(model.textureIndices.begin(),
+                                            model.textureIndices.end());
+    for (uint32_t textureIndex : textureIndices)
+    {
+        entry.bytes += registry.m_Textures[textureIndex].bytes;
+    }
+    entry.hashed = registry.GetModelHash(path, entry.contentHash);
+    entry.paths.push_back(path);
+
+    size_t entryIndex = registry.m_Models.size();
+    if (!registry.m_FreeModels.empty())
+    {
+        entryIndex = registry.m_FreeModels.back();
+        registry.m_FreeModels.pop_back();
+        registry.m_Models[entryIndex] = std::move(entry);
+    }
+    else
+    {
+        registry.m_Models.push_back(std::move(entry));
+    }
+
+    registry.m_ModelPaths[path] = entryIndex;
+    if (registry.m_Models[entryIndex].hashed)
+    {
+        registry.m_ModelHashes[registry.m_Models[entryIndex].contentHash] = entryIndex;
+    }
+}
+
+void AssetRegistry::ReleaseModel(const std::string &filePath)
+{
+    AssetRegistry &registry = s_Registry;
+    auto pathIt = registry.m_ModelPaths.find(NormalizePath(filePath));
+    if (pathIt == registry.m_ModelPaths.end())
+    {
+        return;
+    }
+
+    const size_t entryIndex = pathIt->second;
+    ModelEntry &entry = registry.m_Models[entryIndex];
+    if (--entry.references > 0)
+    {
+        return;
+    }
+
+    Allocator::DestroyBuffer(entry.model.vertexBuffer);
+    Allocator::DestroyBuffer(entry.model.indexBuffer);
+    Allocator::DestroyBuffer(entry.model.materialBuffer);
+    Allocator::DestroyBuffer(entry.model.positionBuffer);
+    Allocator::DestroyBuffer(entry.model.triangleMaterialBuffer);
+    for (uint32_t textureIndex : entry.model.textureIndices)
+    {
+        ReleaseTexture(textureIndex);
+    }
+
+    for (const auto &path : entry.paths)
+    {
+        registry.m_ModelPaths.erase(path);
+    }
+    if (entry.hashed)
+    {
+        registry.m_ModelHashes.erase(entry.contentHash);
+    }
+    entry = {};
+    registry.m_FreeModels.push_back(entryIndex);
+}
+
+uint32_t AssetRegistry::FindTexture(const std::string &path, bool &hashed, uint64_t &contentHash)
+{
+    auto pathIt = m_TexturePaths.find(path);
+    uint32_t textureIndex = pathIt != m_TexturePaths.end() ? pathIt->second : UINT32_MAX;
+    hashed = false;
+    if (textureIndex == UINT32_MAX && !path.empty())
+    {
+        hashed = GetContentHash(path, contentHash);
+    }
+    if (hashed)
+    {
+        auto hashIt = m_TextureHashes.find(contentHash);
+        if (hashIt != m_TextureHashes.end())
+        {
+            textureIndex = hashIt->second;
+            m_Textures[textureIndex].paths.push_back(path);
+            m_TexturePaths[path] = textureIndex;
+        }
+    }
+    return textureIndex;
+}
+
+uint32_t AssetRegistry::TakeTextureSlot()
+{
+    if (!m_FreeTextures.empty())
+    {
+        const uint32_t textureIndex = m_FreeTextures.back();
+        m_FreeTextures.pop_back();
+        return textureIndex;
+    }
+    ObjModel::s_TextureImages.emplace_back();
+    m_Textures.emplace_back();
+    return static_cast<uint32_t>(ObjModel::s_TextureImages.size()) - 1;
+}
+
+void AssetRegistry::SetTexture(uint32_t textureIndex, const ImageAllocation &imgAllocation,
+                               vk::Format format)
+{
+    vk::ImageView textureImageView = VulkanRenderer::CreateImageView(
+        imgAllocation.image, format, vk::ImageAspectFlagBits::eColor, imgAllocation.mipLevels);
+    vk::Sampler sampler = AcquireSampler(GetTextureSamplerInfo());
+    vk::DescriptorImageInfo desc{sampler, textureImageView,
+                                 vk::ImageLayout::eShaderReadOnlyOptimal};
+    ObjModel::s_TextureImages[textureIndex] = {desc, imgAllocation};
+}
+
+uint32_t AssetRegistry::AcquireTexture(const std::string &filePath)
+{
+    return AcquireTextures({filePath})[0];
+}
+
+std::vector<uint32_t> AssetRegistry::AcquireTextures(const std::vector<std::string> &filePaths,
+                                                     const std::vector<bool> &atlasable,
+                                                     std::vector<AtlasRegion> *regions)
+{
+    struct PendingTexture
+    {
+        std::string path;
+        bool hashed = false;
+        uint64_t contentHash = 0;
+        // Every request allows the texture to be packed
+        bool atlasable = false;
+        uint32_t textureIndex = 0;
+        std::vector<size_t> requests;
+    };
+
+    AssetRegistry &registry = s_Registry;
+    std::vector<uint32_t> textureIndices(filePaths.size());
+    if (regions)
+    {
+        regions->assign(filePaths.size(), AtlasRegion());
+    }
+    const bool atlasEnabled = regions && registry.m_AtlasSettings.maxTextureSize > 0;
+    std::vector<PendingTexture> pending;
+    for (size_t i = 0; i < filePaths.size(); i++)
+    {
+        const std::string path = NormalizePath(filePaths[i]);
+        const bool packable = atlasEnabled && i < atlasable.size() && atlasable[i];
+        auto atlasIt = packable ? registry.m_AtlasPaths.find(path) : registry.m_AtlasPaths.end();
+        if (atlasIt != registry.m_AtlasPaths.end())
+        {
+            registry.m_Textures[atlasIt->second.textureIndex].references++;
+            registry.m_Stats.textureHits++;
+            registry.m_Stats.bytesSaved += atlasIt->second.bytes;
+            textureIndices[i] = atlasIt->second.textureIndex;
+            (*regions)[i] = atlasIt->second.region;
+            continue;
+        }
+
+        bool hashed;
+        uint64_t contentHash;
+        const uint32_t textureIndex = registry.FindTexture(path, hashed, contentHash);
+        if (textureIndex != UINT32_MAX)
+        {
+            TextureEntry &entry = registry.m_Textures[textureIndex];
+            entry.references++;
+            registry.m_Stats.textureHits++;
+            registry.m_Stats.bytesSaved += entry.bytes;
+            textureIndices[i] = textureIndex;
+            continue;
+        }
+
+        // Repeats within the batch share the first request's texture
+        auto same = std::find_if(pending.begin(), pending.end(), [&](const PendingTexture &p) {
+            return p.path == path || (hashed && p.hashed && p.contentHash == contentHash);
+        });
+        if (same == pending.end())
+        {
+            same = pending.insert(pending.end(), PendingTexture());
+            same->path = path;
+            same->hashed = hashed;
+            same->contentHash = contentHash;
+            same->atlasable = packable && !path.empty();
+        }
+        same->atlasable = same->atlasable && packable;
+        same->requests.push_back(i);
+    }
+
+    // Only the headers are read to find the misses small enough for an atlas
+    std::vector<size_t> packing;
+    std::vector<size_t> individual;
+    ThreadPool::Get().ParallelFor(pending.size(), [&](size_t i) {
+        uint32_t width, height;
+        pending[i].atlasable =
+            pending[i].atlasable && TextureDecoder::GetImageSize(pending[i].path, width, height) &&
+            TextureAtlas::CanPack(width, height, registry.m_AtlasSettings);
+    });
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        (pending[i].atlasable ? packing : individual).push_back(i);
+    }
+
+    // Slots are taken in request order so the indices do not depend on decode timing
+    for (size_t i : individual)
+    {
+        pending[i].textureIndex = registry.TakeTextureSlot();
+    }
+
+    auto addTexture = [&](const PendingTexture &texture, const ImageAllocation &imgAllocation,
+                          vk::Format format) {
+        const uint32_t textureIndex = texture.textureIndex;
+        registry.SetTexture(textureIndex, imgAllocation, format);
+
+        const uint32_t repeats = static_cast<uint32_t>(texture.requests.size()) - 1;
+        TextureEntry entry;
+        entry.references = repeats + 1;
+        entry.bytes = Allocator::GetAllocationSize(imgAllocation.allocation);
+        entry.hashed = texture.hashed;
+        entry.contentHash = texture.contentHash;
+        entry.paths.push_back(texture.path);
+        registry.m_Stats.textureMisses++;
+        registry.m_Stats.textureHits += repeats;
+        registry.m_Stats.bytesSaved += repeats * entry.bytes;
+
+        registry.m_Textures[textureIndex] = std::move(entry);
+        registry.m_TexturePaths[texture.path] = textureIndex;
+        if (texture.hashed)
+        {
+            registry.m_TextureHashes[texture.contentHash] = textureIndex;
+        }
+        for (size_t request : texture.requests)
+        {
+            textureIndices[request] = textureIndex;
+        }
+    };
+
+    // Decoding, mip generation and block compression of the misses run on the thread pool while
+    // this thread uploads whatever finished. Allocator::LoadTextureMips falls back to a 1x1
+    // texture for paths it cannot load.
+    TextureDecodeSettings settings;
+    settings.compress = registry.m_TextureCompression != TextureCompression::None &&
+                        VulkanRenderer::SupportsBlockCompression();
+    settings.preferBC7 = registry.m_TextureCompression == TextureCompression::HighQuality;
+    settings.memoryBudget = registry.m_DecodeMemoryBudget;
+    std::vector<std::string> paths;
+    for (size_t i : individual)
+    {
+        paths.push_back(pending[i].path);
+    }
+    {
+        TextureDecoder decoder(std::move(paths), settings);
+        DecodedTexture decoded;
+        while (decoder.Pop(decoded))
+        {
+            const PendingTexture &texture = pending[individual[decoded.index]];
+            if (decoded.compressed)
+            {
+                addTexture(texture, Allocator::CreateTextureImage(decoded.blocks),
+                           BlockCompressor::GetVulkanFormat(decoded.blocks.format));
+            }
+            else
+            {
+                addTexture(texture, Allocator::CreateTextureImage(decoded.chain),
+                           vk::Format::eR8G8B8A8Srgb);
+            }
+            decoded = DecodedTexture();
+        }
+    }
+    if (packing.empty())
+    {
+        return textureIndices;
+    }
+
+    // Packed textures are decoded to RGBA8 and the atlases are compressed once they are filled
+    TextureDecodeSettings packSettings = settings;
+    packSettings.compress = false;
+    packSettings.memoryBudget = 0;
+    paths.clear();
+    for (size_t i : packing)
+    {
+        paths.push_back(pending[i].path);
+    }
+    std::vector<MipChain> chains(packing.size());
+    {
+        TextureDecoder decoder(std::move(paths), packSettings);
+        DecodedTexture decoded;
+        while (decoder.Pop(decoded))
+        {
+            chains[decoded.index] = std::move(decoded.chain);
+        }
+    }
+
+    std::vector<const MipChain *> textures;
+    for (const auto &chain : chains)
+    {
+        textures.push_back(&chain);
+    }
+    std::vector<MipChain> atlases;
+    std::vector<AtlasRegion> packedRegions;
+    TextureAtlas::Build(textures, registry.m_AtlasSettings, atlases, packedRegions);
+
+    std::vector<uint32_t> atlasIndices;
+    for (const auto &atlas : atlases)
+    {
+        const uint32_t textureIndex = registry.TakeTextureSlot();
+        ImageAllocation imgAllocation;
+        if (settings.compress)
+        {
+            const BlockFormat format = BlockCompressor::ChooseFormat(atlas, settings.preferBC7);
+            CompressedChain blocks;
+            BlockCompressor::Compress(atlas, format, blocks);
+            imgAllocation = Allocator::CreateTextureImage(blocks);
+            registry.SetTexture(textureIndex, imgAllocation,
+                                BlockCompressor::GetVulkanFormat(format));
+        }
+        else
+        {
+            imgAllocation = Allocator::CreateTextureImage(atlas);
+            registry.SetTexture(textureIndex, imgAllocation, vk::Format::eR8G8B8A8Srgb);
+        }
+
+        TextureEntry entry;
+        entry.bytes = Allocator::GetAllocationSize(imgAllocation.allocation);
+        entry.atlas = true;
+        registry.m_Textures[textureIndex] = std::move(entry);
+        registry.m_Stats.atlases++;
+        atlasIndices.push_back(textureIndex);
+    }
+
+    for (size_t i = 0; i < packing.size(); i++)
+    {
+        PendingTexture &texture = pending[packing[i]];
+        const AtlasRegion &region = packedRegions[i];
+        if (region.atlas == UINT32_MAX)
+        {
+            // The texture did not decode to the size its header gave, it is uploaded on its own
+            texture.textureIndex = registry.TakeTextureSlot();
+            addTexture(texture, Allocator::CreateTextureImage(chains[i]),
+                       vk::Format::eR8G8B8A8Srgb);
+            continue;
+        }
+
+        const uint32_t repeats = static_cast<uint32_t>(texture.requests.size()) - 1;
+        TextureEntry &entry = registry.m_Textures[atlasIndices[region.atlas]];
+        AtlasTexture atlasTexture;
+        atlasTexture.textureIndex = atlasIndices[region.atlas];
+        atlasTexture.region = region;
+        atlasTexture.bytes =
+            static_cast<vk::DeviceSize>(entry.bytes * region.scale[0] * region.scale[1]);
+        entry.references += repeats + 1;
+        entry.paths.push_back(texture.path);
+        registry.m_Stats.textureMisses++;
+        registry.m_Stats.textureHits += repeats;
+        registry.m_Stats.bytesSaved += repeats * atlasTexture.bytes;
+        registry.m_Stats.atlasTextures++;
+        for (size_t request : texture.requests)
+        {
+            textureIndices[request] = atlasTexture.textureIndex;
+            (*regions)[request] = region;
+        }
+        registry.m_AtlasPaths[texture.path] = std::move(atlasTexture);
+    }
+    return textureIndices;
+}
+
+void AssetRegistry::ReleaseTexture(uint32_t textureIndex)
+{
+    AssetRegistry &registry = s_Registry;
+    TextureEntry &entry = registry.m_Textures[textureIndex];
+    if (entry.references == 0 || --entry.references > 0)
+    {
+        return;
+    }
+
+    // The slot keeps its stale descriptor until a new texture takes it, so it must not be
+    // referenced by any material when descriptors are next written
+    TextureImage &texture = ObjModel::s_TextureImages[textureIndex];
+    VulkanRenderer::DestroyImageView(texture.descriptor.imageView);
+    ReleaseSampler(texture.descriptor.sampler);
+    Allocator::DestroyImage(texture.textureAllocation);
+
+    for (const auto &path : entry.paths)
+    {
+        if (entry.atlas)
+        {
+            registry.m_AtlasPaths.erase(path);
+        }
+        else
+        {
+            registry.m_TexturePaths.erase(path);
+        }
+    }
+    if (entry.hashed)
+    {
+        registry.m_TextureHashes.erase(entry.contentHash);
+    }
+    entry = {};
+    registry.m_FreeTextures.push_back(textureIndex);
+}
+
+vk::Sampler AssetRegistry::AcquireSampler(const vk::SamplerCreateInfo &createInfo)
+{
+    // pNext chains are not part of the key, callers here never set one
+    const SamplerKey key = {static_cast<uint32_t>(createInfo.flags),
+                            static_cast<uint32_t>(createInfo.magFilter),
+                            static_cast<uint32_t>(createInfo.minFilter),
+                            static_cast<uint32_t>(createInfo.mipmapMode),
+                            static_cast<uint32_t>(createInfo.addressModeU),
+                            static_cast<uint32_t>(createInfo.addressModeV),
+                            static_cast<uint32_t>(createInfo.addressModeW),
+                            FloatBits(createInfo.mipLodBias),
+                            createInfo.anisotropyEnable,
+                            FloatBits(createInfo.maxAnisotropy),
+                            createInfo.compareEnable,
+                            static_cast<uint32_t>(createInfo.compareOp),
+                            FloatBits(createInfo.minLod),
+                            FloatBits(createInfo.maxLod),
+                            static_cast<uint32_t>(createInfo.borderColor),
+                            createInfo.unnormalizedCoordinates};
+
+    SamplerEntry &entry = s_Registry.m_Samplers[key];
+    if (entry.references++ > 0)
+    {
+        s_Registry.m_Stats.samplerHits++;
+        return entry.sampler;
+    }
+    s_Registry.m_Stats.samplerMisses++;
+    entry.sampler = VulkanRenderer::CreateSampler(createInfo);
+    return entry.sampler;
+}
+
+void AssetRegistry::ReleaseSampler(vk::Sampler sampler)
+{
+    for (auto it = s_Registry.m_Samplers.begin(); it != s_Registry.m_Samplers.end(); it++)
+    {
+        if (it->second.sampler == sampler)
+        {
+            if (--it->second.references == 0)
+            {
+                VulkanRenderer::DestroySampler(sampler);
+                s_Registry.m_Samplers.erase(it);
+            }
+            return;
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "ObjModel.h"
+
+#include "Tools/FileTools.h"
+#include "Tools/TextureAtlas.h"
+
+#include <array>
+#include <map>
+#include <unordered_map>
+
+enum class TextureCompression
+{
+    None,
+    // BC1 for opaque textures, BC3 for textures with alpha
+    Default,
+    // BC7 for every texture
+    HighQuality
+};
+
+struct AssetRegistryStats
+{
+    uint32_t meshHits = 0;
+    uint32_t meshMisses = 0;
+    uint32_t textureHits = 0;
+    uint32_t textureMisses = 0;
+    uint32_t samplerHits = 0;
+    uint32_t samplerMisses = 0;
+    // Atlases created and the textures packed into them
+    uint32_t atlases = 0;
+    uint32_t atlasTextures = 0;
+    // Device memory the hits would otherwise have allocated again
+    vk::DeviceSize bytesSaved = 0;
+};
+
+// Reference counted store of the device resources models share. Meshes and textures are found
+// by path first and by content hash second, so copies of a file under another name are shared
+// too, for meshes only within one directory. Samplers are shared by their create info.
+class AssetRegistry
+{
+  public:
+    // On a hit the stored model is returned and its reference count increased
+    static bool AcquireModel(const std::string &filePath, ObjModel &model);
+    static void AddModel(const std::string &filePath, const ObjModel &model);
+    static void ReleaseModel(const std::string &filePath);
+
+    // Returns the index of the texture in ObjModel::s_TextureImages. An empty path gives the
+    // fallback texture.
+    static uint32_t AcquireTexture(const std::string &filePath);
+    // Misses of the batch are decoded and mipmapped in parallel and uploaded as they finish.
+    // Small misses flagged in atlasable are packed into atlases shared by the batch when atlases
+    // are enabled, regions then tells where each texture was placed. Several requests can get the
+    // same atlas and each of them holds a reference to it.
+    static std::vector<uint32_t> AcquireTextures(const std::vector<std::string> &filePaths,
+                                                 const std::vector<bool> &atlasable = {},
+                                                 std::vector<AtlasRegion> *regions = nullptr);
+    static void ReleaseTexture(uint32_t textureIndex);
+
+    static vk::Sampler AcquireSampler(const vk::SamplerCreateInfo &createInfo);
+    static void ReleaseSampler(vk::Sampler sampler);
+
+    // Applies to textures loaded afterwards, devices without BC support always load RGBA8
+    static void SetTextureCompression(TextureCompression compression)
+    {
+        s_Registry.m_TextureCompression = compression;
+    }
+
+    // Applies to textures loaded afterwards, atlases are off by default
+    static void SetTextureAtlas(const TextureAtlasSettings &settings)
+    {
+        s_Registry.m_AtlasSettings = settings;
+    }
+
+    // Bounds the decoded textures waiting for upload, see TextureDecodeSettings::memoryBudget
+    static void SetDecodeMemoryBudget(size_t bytes)
+    {
+        s_Registry.m_DecodeMemoryBudget = bytes;
+    }
+
+    static const AssetRegistryStats &GetStats()
+    {
+        return s_Registry.m_Stats;
+    }
+
+  private:
+    AssetRegistry() = default;
+    AssetRegistry(const AssetRegistry &) = delete;
+    AssetRegistry &operator=(const AssetRegistry &) = delete;
+
+    // Files that cannot be read are only found by path
+    bool GetContentHash(const std::string &path, uint64_t &hash);
+    // Material libraries are resolved next to the model, so copies in other directories may
+    // look different and only share by content hash within one directory
+    bool GetModelHash(const std::string &path, uint64_t &hash);
+    uint32_t FindTexture(const std::string &path, bool &hashed, uint64_t &contentHash);
+    uint32_t TakeTextureSlot();
+    void SetTexture(uint32_t textureIndex, const ImageAllocation &imgAllocation,
+                    vk::Format format);
+
+  private:
+    struct ModelEntry
+    {
+        ObjModel model;
+        uint32_t references = 0;
+        vk::DeviceSize bytes = 0;
+        bool hashed = false;
+        uint64_t contentHash = 0;
+        std::vector<std::string> paths;
+    };
+
+    struct TextureEntry
+    {
+        uint32_t references = 0;
+        vk::DeviceSize bytes = 0;
+        bool hashed = false;
+        uint64_t contentHash = 0;
+        // Atlases list the paths of the textures they hold, which are found in m_AtlasPaths
+        bool atlas = false;
+        std::vector<std::string> paths;
+    };
+
+    struct AtlasTexture
+    {
+        uint32_t textureIndex = 0;
+        AtlasRegion region;
+        // Share of the atlas memory taken by the region
+        vk::DeviceSize bytes = 0;
+    };
+
+    struct SamplerEntry
+    {
+        vk::Sampler sampler;
+        uint32_t references = 0;
+    };
+
+    struct HashedFile
+    {
+        FileStamp stamp;
+        uint64_t hash = 0;
+    };
+
+    using SamplerKey = std::array<uint32_t, 16>;
+
+    static AssetRegistry s_Registry;
+
+    std::vector<ModelEntry> m_Models;
+    std::unordered_map<std::string, size_t> m_ModelPaths;
+    std::unordered_map<uint64_t, size_t> m_ModelHashes;
+    std::vector<size_t> m_FreeModels;
+
+    // Indexed like ObjModel::s_TextureImages
+    std::vector<TextureEntry> m_Textures;
+    std::unordered_map<std::string, uint32_t> m_TexturePaths;
+    std::unordered_map<uint64_t, uint32_t> m_TextureHashes;
+    std::vector<uint32_t> m_FreeTextures;
+    // Packed textures are only found by path
+    std::unordered_map<std::string, AtlasTexture> m_AtlasPaths;
+
+    std::map<SamplerKey, SamplerEntry> m_Samplers;
+
+    std::unordered_map<std::string, HashedFile> m_HashedFiles;
+
+    TextureCompression m_TextureCompression = TextureCompression::Default;
+    TextureAtlasSettings m_AtlasSettings;
+    size_t m_DecodeMemoryBudget = 256ull << 20;
+
+    AssetRegistryStats m_Stats;
+};
@@ -0,0 +1,512 @@
+#include "vkpch.h"
+
+#include "BvhBuilder.h"
+
+#include "Core/ThreadPool.h"
+
+#include <atomic>
+
+#define BVH_MAX_BINS 64
+#define BVH_TRIANGLES_PER_TASK 4096
+// Nodes with more triangles bin them on the thread pool, the top nodes would otherwise leave
+// it idle
+#define BVH_PARALLEL_BIN_TRIANGLES (16 * BVH_TRIANGLES_PER_TASK)
+// Nodes closer to the root refit one child on another task, which hands the pool up to 256
+// subtrees
+#define BVH_REFIT_TASK_DEPTH 8
+
+// Bounds and bins are left uninitialized on construction, building a node only clears the bins
+// it uses
+struct BvhBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    static BvhBounds Empty()
+    {
+        return {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    }
+
+    void Grow(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Grow(const BvhBounds &other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    float Area() const
+    {
+        const glm::vec3 extent = max - min;
+        if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+        {
+            return 0.0f;
+        }
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+};
+
+struct BvhBin
+{
+    BvhBounds bounds;
+    BvhBounds centroids;
+    uint32_t count;
+
+    static BvhBin Empty()
+    {
+        return {BvhBounds::Empty(), BvhBounds::Empty(), 0};
+    }
+
+    void Grow(const BvhBin &other)
+    {
+        bounds.Grow(other.bounds);
+        centroids.Grow(other.centroids);
+        count += other.count;
+    }
+};
+
+// Partitioned in place while building, so that the nodes read their triangles in order
+struct BvhPrimitive
+{
+    BvhBounds bounds;
+    uint32_t triangle;
+};
+
+// Bins of all three axes
+struct BvhBinSet
+{
+    BvhBin bins[3][BVH_MAX_BINS];
+};
+
+struct BvhSplit
+{
+    int axis = -1;
+    // Bins below go to the first child
+    uint32_t bin = 0;
+    // Surface area times triangle tests, not divided by the area of the node
+    float cost = FLT_MAX;
+    BvhBin children[2];
+};
+
+struct BvhBuildContext
+{
+    const BvhSettings &settings;
+    uint32_t binCount;
+    std::vector<BvhPrimitive> &primitives;
+    std::vector<BvhNode> &nodes;
+    std::atomic<uint32_t> nodeCount{1};
+};
+
+static glm::vec3 GetCentroid(const BvhBounds &bounds)
+{
+    return (bounds.min + bounds.max) * 0.5f;
+}
+
+// Maps centroids to bins, axes without extent get a scale of 0 and are skipped
+struct BvhBinMapping
+{
+    glm::vec3 offset;
+    glm::vec3 scale;
+    uint32_t binCount;
+
+    BvhBinMapping(const BvhBounds &centroids, uint32_t binCount)
+        : offset(centroids.min), binCount(binCount)
+    {
+        const glm::vec3 extent = centroids.max - centroids.min;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // Slightly less than binCount keeps the largest centroid in the last bin
+            scale[axis] = extent[axis] > 0.0f ? binCount * 0.99999f / extent[axis] : 0.0f;
+        }
+    }
+
+    uint32_t GetBin(const glm::vec3 &centroid, int axis) const
+    {
+        const float bin = (centroid[axis] - offset[axis]) * scale[axis];
+        return std::min(static_cast<uint32_t>(std::max(bin, 0.0f)), binCount - 1);
+    }
+};
+
+static void BinTriangles(const BvhBuildContext &context, const BvhBinMapping &mapping,
+                         uint32_t begin, uint32_t end, BvhBinSet &binSet)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        std::fill(binSet.bins[axis], binSet.bins[axis] + mapping.binCount, BvhBin::Empty());
+    }
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const BvhBounds &bounds = context.primitives[i].bounds;
+        const glm::vec3 centroid = GetCentroid(bounds);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            BvhBin &bin = binSet.bins[axis][mapping.GetBin(centroid, axis)];
+            bin.bounds.Grow(bounds);
+            bin.centroids.Grow(centroid);
+            bin.count++;
+        }
+    }
+}
+
+static BvhSplit FindSplit(const BvhBuildContext &context, const BvhBinMapping &mapping,
+                          uint32_t begin, uint32_t end)
+{
+    const uint32_t count = end - begin;
+    const uint32_t binCount = mapping.binCount;
+    BvhBinSet binSet;
+    if (count > BVH_PARALLEL_BIN_TRIANGLES)
+    {
+        const uint32_t chunkSize = BVH_TRIANGLES_PER_TASK;
+        const uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        std::vector<BvhBinSet> chunkBins(chunkCount);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            std::fill(binSet.bins[axis], binSet.bins[axis] + binCount, BvhBin::Empty());
+        }
+        ThreadPool::Get().ParallelFor(chunkCount, [&](size_t chunk) {
+            const uint32_t chunkBegin = begin + static_cast<uint32_t>(chunk) * chunkSize;
+            BinTriangles(context, mapping, chunkBegin, std::min(chunkBegin + chunkSize, end),
+                         chunkBins[chunk]);
+        });
+        for (const BvhBinSet &chunk : chunkBins)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                for (uint32_t b = 0; b < binCount; b++)
+                {
+                    binSet.bins[axis][b].Grow(chunk.bins[axis][b]);
+                }
+            }
+        }
+    }
+    else
+    {
+        BinTriangles(context, mapping, begin, end, binSet);
+    }
+
+    // Sweeps from the right to get the cost of every second child, then from the left
+    BvhSplit split;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (mapping.scale[axis] == 0.0f)
+        {
+            continue;
+        }
+        const BvhBin *bins = binSet.bins[axis];
+        BvhBin right[BVH_MAX_BINS];
+        for (uint32_t b = binCount - 1; b > 0; b--)
+        {
+            right[b] = bins[b];
+            if (b + 1 < binCount)
+            {
+                right[b].Grow(right[b + 1]);
+            }
+        }
+
+        BvhBin left = BvhBin::Empty();
+        for (uint32_t b = 1; b < binCount; b++)
+        {
+            left.Grow(bins[b - 1]);
+            if (left.count == 0 || right[b].count == 0)
+            {
+                continue;
+            }
+            const float cost = left.bounds.Area() * left.count +
+                               right[b].bounds.Area() * right[b].count;
+            if (cost < split.cost)
+            {
+                split.axis = axis;
+                split.bin = b;
+                split.cost = cost;
+                split.children[0] = left;
+                split.children[1] = right[b];
+            }
+        }
+    }
+    return split;
+}
+
+static BvhBin GetRangeBin(const BvhBuildContext &context, uint32_t begin, uint32_t end)
+{
+    BvhBin bin = BvhBin::Empty();
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const BvhBounds &bounds = context.primitives[i].bounds;
+        bin.bounds.Grow(bounds);
+        bin.centroids.Grow(GetCentroid(bounds));
+    }
+    bin.count = end - begin;
+    return bin;
+}
+
+static void BuildNode(BvhBuildContext &context, uint32_t nodeIndex, uint32_t begin,
+                      const BvhBin &range)
+{
+    const BvhSettings &settings = context.settings;
+    const uint32_t count = range.count;
+    const uint32_t end = begin + count;
+    BvhNode &node = context.nodes[nodeIndex];
+    node.boundsMin = range.bounds.min;
+    node.boundsMax = range.bounds.max;
+
+    // More bins than triangles would only add empty ones
+    const BvhBinMapping mapping(range.centroids, std::min(context.binCount, std::max(count, 2u)));
+    BvhSplit split;
+    if (count > 1)
+    {
+        split = FindSplit(context, mapping, begin, end);
+    }
+
+    const float area = range.bounds.Area();
+    const float leafCost = area * count;
+    const float splitCost = area * settings.traversalCost + split.cost;
+    if (count == 1 || (count <= settings.maxLeafTriangles && leafCost <= splitCost))
+    {
+        node.first = begin;
+        node.triangleCount = count;
+        return;
+    }
+
+    uint32_t middle;
+    BvhBin children[2];
+    if (split.axis >= 0)
+    {
+        const int axis = split.axis;
+        const auto partitioned = std::partition(
+            context.primitives.begin() + begin, context.primitives.begin() + end,
+            [&](const BvhPrimitive &primitive) {
+                return mapping.GetBin(GetCentroid(primitive.bounds), axis) < split.bin;
+            });
+        middle = static_cast<uint32_t>(partitioned - context.primitives.begin());
+        children[0] = split.children[0];
+        children[1] = split.children[1];
+    }
+    else
+    {
+        // All centroids are in one place, which the bins cannot separate
+        middle = begin + count / 2;
+        children[0] = GetRangeBin(context, begin, middle);
+        children[1] = GetRangeBin(context, middle, end);
+    }
+
+    const uint32_t firstChild = context.nodeCount.fetch_add(2);
+    node.first = firstChild;
+    node.triangleCount = 0;
+    if (count > settings.parallelTriangles)
+    {
+        TaskGroup group;
+        group.Run([&]() { BuildNode(context, firstChild, begin, children[0]); });
+        BuildNode(context, firstChild + 1, middle, children[1]);
+        group.Wait();
+    }
+    else
+    {
+        BuildNode(context, firstChild, begin, children[0]);
+        BuildNode(context, firstChild + 1, middle, children[1]);
+    }
+}
+
+// Stores the children of each node right after the children of the nodes before it in depth
+// first order, returns the depth of the tree
+static uint32_t ReorderNodes(std::vector<BvhNode> &nodes)
+{
+    std::vector<BvhNode> ordered;
+    ordered.reserve(nodes.size());
+    ordered.push_back(nodes[0]);
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 1}};
+    uint32_t maxDepth = 0;
+    while (!stack.empty())
+    {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+        maxDepth = std::max(maxDepth, depth);
+        if (ordered[index].IsLeaf())
+        {
+            continue;
+        }
+        const uint32_t sourceChild = ordered[index].first;
+        const uint32_t firstChild = static_cast<uint32_t>(ordered.size());
+        ordered.push_back(nodes[sourceChild]);
+        ordered.push_back(nodes[sourceChild + 1]);
+        ordered[index].first = firstChild;
+        stack.push_back({firstChild + 1, depth + 1});
+        stack.push_back({firstChild, depth + 1});
+    }
+    nodes = std::move(ordered);
+    return maxDepth;
+}
+
+void BvhBuilder::Build(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings)
+{
+    const uint32_t triangleCount = mesh.indicesCount / 3;
+    bvh.nodes.clear();
+    bvh.depth = 0;
+    bvh.positions.resize(mesh.verticesCount);
+    for (uint32_t i = 0; i < mesh.verticesCount; i++)
+    {
+        bvh.positions[i] = mesh.positions ? mesh.positions[i] : mesh.vertices[i].pos;
+    }
+    bvh.indices.resize(size_t(triangleCount) * 3);
+    bvh.triangleIds.resize(triangleCount);
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    ThreadPool &pool = ThreadPool::Get();
+    const size_t blocks = (triangleCount + BVH_TRIANGLES_PER_TASK - 1) / BVH_TRIANGLES_PER_TASK;
+    std::vector<BvhPrimitive> primitives(triangleCount);
+    pool.ParallelFor(blocks, [&](size_t block) {
+        const size_t first = block * BVH_TRIANGLES_PER_TASK;
+        const size_t last = std::min(first + BVH_TRIANGLES_PER_TASK, size_t(triangleCount));
+        for (size_t triangle = first; triangle < last; triangle++)
+        {
+            BvhPrimitive &primitive = primitives[triangle];
+            primitive.bounds = BvhBounds::Empty();
+            for (size_t corner = 0; corner < 3; corner++)
+            {
+                primitive.bounds.Grow(bvh.positions[mesh.indices[triangle * 3 + corner]]);
+            }
+            primitive.triangle = static_cast<uint32_t>(triangle);
+        }
+    });
+
+    BvhBin root = BvhBin::Empty();
+    root.count = triangleCount;
+    for (const BvhPrimitive &primitive : primitives)
+    {
+        root.bounds.Grow(primitive.bounds);
+        root.centroids.Grow(GetCentroid(primitive.bounds));
+    }
+
+    // Every leaf holds at least one triangle
+    bvh.nodes.resize(size_t(triangleCount) * 2 - 1);
+    BvhBuildContext context{settings,
+                            std::min(std::max(settings.binCount, 2u), uint32_t(BVH_MAX_BINS)),
+                            primitives, bvh.nodes};
+    BuildNode(context, 0, 0, root);
+    bvh.nodes.resize(context.nodeCount);
+    bvh.depth = ReorderNodes(bvh.nodes);
+
+    pool.ParallelFor(blocks, [&](size_t block) {
+        const size_t first = block * BVH_TRIANGLES_PER_TASK;
+        const size_t last = std::min(first + BVH_TRIANGLES_PER_TASK, size_t(triangleCount));
+        for (size_t triangle = first; triangle < last; triangle++)
+        {
+            const uint32_t sourceTriangle = primitives[triangle].triangle;
+            const uint32_t *source = mesh.indices + size_t(sourceTriangle) * 3;
+            std::copy(source, source + 3, bvh.indices.data() + triangle * 3);
+            bvh.triangleIds[triangle] = sourceTriangle;
+        }
+    });
+}
+
+// Returns the SAH cost of the subtree, not divided by the area of the root
+static double RefitNode(Bvh &bvh, const BvhSettings &settings, uint32_t index, uint32_t taskDepth)
+{
+    BvhNode &node = bvh.nodes[index];
+    BvhBounds bounds = BvhBounds::Empty();
+    if (node.IsLeaf())
+    {
+        const uint32_t *indices = bvh.indices.data() + size_t(node.first) * 3;
+        for (size_t corner = 0; corner < size_t(node.triangleCount) * 3; corner++)
+        {
+            bounds.Grow(bvh.positions[indices[corner]]);
+        }
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        return double(bounds.Area()) * node.triangleCount;
+    }
+
+    double childCosts[2];
+    if (taskDepth > 0)
+    {
+        TaskGroup group;
+        group.Run([&]() { childCosts[0] = RefitNode(bvh, settings, node.first, taskDepth - 1); });
+        childCosts[1] = RefitNode(bvh, settings, node.first + 1, taskDepth - 1);
+        group.Wait();
+    }
+    else
+    {
+        childCosts[0] = RefitNode(bvh, settings, node.first, 0);
+        childCosts[1] = RefitNode(bvh, settings, node.first + 1, 0);
+    }
+    for (uint32_t child = node.first; child < node.first + 2; child++)
+    {
+        bounds.Grow(BvhBounds{bvh.nodes[child].boundsMin, bvh.nodes[child].boundsMax});
+    }
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+    return childCosts[0] + childCosts[1] + double(bounds.Area()) * settings.traversalCost;
+}
+
+float BvhBuilder::Refit(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings)
+{
+    assert(mesh.verticesCount == bvh.positions.size());
+    const size_t blocks =
+        (mesh.verticesCount + BVH_TRIANGLES_PER_TASK - 1) / BVH_TRIANGLES_PER_TASK;
+    ThreadPool::Get().ParallelFor(blocks, [&](size_t block) {
+        const size_t first = block * BVH_TRIANGLES_PER_TASK;
+        const size_t last = std::min(first + BVH_TRIANGLES_PER_TASK, size_t(mesh.verticesCount));
+        for (size_t i = first; i < last; i++)
+        {
+            bvh.positions[i] = mesh.positions ? mesh.positions[i] : mesh.vertices[i].pos;
+        }
+    });
+    if (bvh.nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    // Small trees are not worth the tasks
+    const uint32_t taskDepth =
+        bvh.nodes.size() > 2 * BVH_TRIANGLES_PER_TASK ? BVH_REFIT_TASK_DEPTH : 0;
+    const double cost = RefitNode(bvh, settings, 0, taskDepth);
+    const float rootArea = BvhBounds{bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax}.Area();
+    return rootArea > 0.0f ? float(cost / rootArea) : 0.0f;
+}
+
+BvhStats BvhBuilder::GetStats(const Bvh &bvh, const BvhSettings &settings)
+{
+    BvhStats stats;
+    stats.nodes = static_cast<uint32_t>(bvh.nodes.size());
+    stats.nodeBytes = bvh.nodes.size() * sizeof(BvhNode);
+    if (bvh.nodes.empty())
+    {
+        return stats;
+    }
+
+    auto getArea = [](const BvhNode &node) {
+        return BvhBounds{node.boundsMin, node.boundsMax}.Area();
+    };
+    const float rootArea = getArea(bvh.nodes[0]);
+    double cost = 0.0;
+    uint64_t leafTriangles = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 1}};
+    while (!stack.empty())
+    {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+        const BvhNode &node = bvh.nodes[index];
+        stats.depth = std::max(stats.depth, depth);
+        if (node.IsLeaf())
+        {
+            stats.leaves++;
+            leafTriangles += node.triangleCount;
+            cost += double(getArea(node)) * node.triangleCount;
+        }
+        else
+        {
+            cost += double(getArea(node)) * settings.traversalCost;
+            stack.push_back({node.first, depth + 1});
+            stack.push_back({node.first + 1, depth + 1});
+        }
+    }
+    stats.averageLeafTriangles = float(leafTriangles) / stats.leaves;
+    stats.sahCost = rootArea > 0.0f ? float(cost / rootArea) : 0.0f;
+    return stats;
+}
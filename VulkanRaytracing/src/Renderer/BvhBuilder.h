@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ObjModel.h"
+
+struct BvhSettings
+{
+    // Bins per axis the triangle centroids are sorted into when looking for the cheapest split
+    uint32_t binCount = 16;
+    // Leaves with more triangles are split even when the SAH would keep them
+    uint32_t maxLeafTriangles = 8;
+    // Cost of visiting a node relative to testing one triangle
+    float traversalCost = 1.0f;
+    // Nodes with more triangles build one of their children on another task
+    uint32_t parallelTriangles = 4096;
+};
+
+// 32 bytes. The two children of an inner node are stored next to each other.
+struct BvhNode
+{
+    glm::vec3 boundsMin;
+    // First child of inner nodes, first triangle of leaves
+    uint32_t first;
+    glm::vec3 boundsMax;
+    // 0 for inner nodes
+    uint32_t triangleCount;
+
+    bool IsLeaf() const
+    {
+        return triangleCount > 0;
+    }
+};
+
+// Binary bounding volume hierarchy over the triangles of one mesh, the root is nodes[0] and
+// empty meshes have no nodes. Leaves reference ranges of triangles, which are stored in leaf
+// order.
+struct Bvh
+{
+    std::vector<BvhNode> nodes;
+    std::vector<glm::vec3> positions;
+    // Three per triangle
+    std::vector<uint32_t> indices;
+    // Triangle of the source mesh each triangle was taken from
+    std::vector<uint32_t> triangleIds;
+    // Nodes on the longest path from the root to a leaf, bounds the stacks of the traversals
+    uint32_t depth = 0;
+};
+
+struct BvhStats
+{
+    uint32_t nodes = 0;
+    uint32_t leaves = 0;
+    uint32_t depth = 0;
+    float averageLeafTriangles = 0.0f;
+    // Expected node visits and triangle tests of a ray through the root, weighted by the
+    // traversal cost of the settings
+    float sahCost = 0.0f;
+    size_t nodeBytes = 0;
+};
+
+// Builds a BVH top down with the surface area heuristic evaluated on a fixed number of bins per
+// axis. Once a node is split its children are built independently, the large ones on the thread
+// pool. The nodes are stored depth first afterwards, so the layout does not depend on which
+// tasks finished first.
+class BvhBuilder
+{
+  public:
+    static void Build(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings = {});
+
+    // Takes the positions of a mesh with the topology the BVH was built for and fits the bounds
+    // of every node to them, children before their parents and the subtrees near the root on the
+    // thread pool. Works on the BVHs of any builder. Returns the SAH cost GetStats would report.
+    static float Refit(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings = {});
+
+    static BvhStats GetStats(const Bvh &bvh, const BvhSettings &settings = {});
+};
@@ -0,0 +1,193 @@
+#include "vkpch.h"
+
+#include "BvhTraversal.h"
+
+#include "BvhTraversalKernels.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+SimdLevel BvhTraversal::GetSimdLevel()
+{
+    static const SimdLevel level = []() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return SimdLevel::SSE;
+        }
+        // AVX needs the OS to save the YMM registers, which XCR0 tells once OSXSAVE is set
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        {
+            return SimdLevel::SSE;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) ? SimdLevel::AVX2 : SimdLevel::SSE;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE;
+#endif
+    }();
+    return level;
+}
+
+const char *BvhTraversal::GetName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Scalar:
+        return "scalar";
+    case SimdLevel::SSE:
+        return "SSE";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    }
+    return "";
+}
+
+static bool IntersectBounds(const BvhNode &node, const glm::vec3 &origin,
+                            const glm::vec3 &inverseDirection, float tMin, float tMax,
+                            float &tEntry)
+{
+    const glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+    const glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+    const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+    return tEntry <= tExit;
+}
+
+static bool IntersectTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2,
+                              const TraversalRay &ray, float tMax, float &t, float &u, float &v)
+{
+    const glm::vec3 edge1 = p1 - p0;
+    const glm::vec3 edge2 = p2 - p0;
+    const glm::vec3 pvec = glm::cross(ray.direction, edge2);
+    const float det = glm::dot(edge1, pvec);
+    if (det == 0.0f)
+    {
+        return false;
+    }
+    const float inverseDet = 1.0f / det;
+
+    const glm::vec3 tvec = ray.origin - p0;
+    u = glm::dot(tvec, pvec) * inverseDet;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return false;
+    }
+    const glm::vec3 qvec = glm::cross(tvec, edge1);
+    v = glm::dot(ray.direction, qvec) * inverseDet;
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return false;
+    }
+    t = glm::dot(edge2, qvec) * inverseDet;
+    return t > ray.tMin && t < tMax;
+}
+
+bool BvhTraversal::Intersect(const Bvh &bvh, const TraversalRay &ray, TraversalHit &hit)
+{
+    if (bvh.nodes.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    float tMax = ray.tMax;
+    float tEntry;
+    if (!IntersectBounds(bvh.nodes[0], ray.origin, inverseDirection, ray.tMin, tMax, tEntry))
+    {
+        return false;
+    }
+
+    // The nearer child is visited first, the other one waits on the stack with the distance
+    // where the ray enters it
+    TraversalStack<std::pair<uint32_t, float>> stack(bvh.depth);
+    uint32_t nodeIndex = 0;
+    bool found = false;
+    while (true)
+    {
+        const BvhNode &node = bvh.nodes[nodeIndex];
+        if (node.IsLeaf())
+        {
+            for (uint32_t triangle = node.first; triangle < node.first + node.triangleCount;
+                 triangle++)
+            {
+                const uint32_t *indices = bvh.indices.data() + size_t(triangle) * 3;
+                float t, u, v;
+                if (IntersectTriangle(bvh.positions[indices[0]], bvh.positions[indices[1]],
+                                      bvh.positions[indices[2]], ray, tMax, t, u, v))
+                {
+                    tMax = t;
+                    hit = {t, u, v, triangle};
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            float tLeft, tRight;
+            const bool hitLeft = IntersectBounds(bvh.nodes[node.first], ray.origin,
+                                                 inverseDirection, ray.tMin, tMax, tLeft);
+            const bool hitRight = IntersectBounds(bvh.nodes[node.first + 1], ray.origin,
+                                                  inverseDirection, ray.tMin, tMax, tRight);
+            if (hitLeft && hitRight)
+            {
+                const bool leftFirst = tLeft <= tRight;
+                stack.Push(leftFirst ? std::make_pair(node.first + 1, tRight)
+                                     : std::make_pair(node.first, tLeft));
+                nodeIndex = leftFirst ? node.first : node.first + 1;
+                continue;
+            }
+            if (hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? node.first : node.first + 1;
+                continue;
+            }
+        }
+
+        // Nodes the ray enters beyond the closest hit so far are left out
+        do
+        {
+            if (stack.IsEmpty())
+            {
+                return found;
+            }
+            std::tie(nodeIndex, tEntry) = stack.Pop();
+        } while (tEntry > tMax);
+    }
+}
+
+bool BvhTraversal::Intersect(const CompressedBvh &bvh, const TraversalRay &ray,
+                             TraversalHit &hit, SimdLevel level)
+{
+    return level == SimdLevel::AVX2 ? IntersectCompressedAvx2(bvh, ray, hit)
+                                    : IntersectCompressedSse(bvh, ray, hit);
+}
+
+void BvhTraversal::IntersectPacket(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                                   TraversalHit *hits, SimdLevel level)
+{
+    if (level == SimdLevel::AVX2)
+    {
+        IntersectPacketAvx2(bvh, rays, count, hits);
+    }
+    else if (level == SimdLevel::SSE)
+    {
+        IntersectPacketSse(bvh, rays, count, hits);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Intersect(bvh, rays[i], hits[i]);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CompressedBvh.h"
+
+// Rays per IntersectPacket call, a 4x4 tile of primary rays
+#define TRAVERSAL_PACKET_SIZE 16
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE,
+    AVX2
+};
+
+struct TraversalRay
+{
+    glm::vec3 origin;
+    float tMin;
+    glm::vec3 direction;
+    float tMax;
+};
+
+struct TraversalHit
+{
+    float t = 0.0f;
+    // Weights of the second and third vertex
+    float u = 0.0f;
+    float v = 0.0f;
+    // In the leaf order of the binary BVH, UINT32_MAX until something was hit
+    uint32_t triangle = UINT32_MAX;
+};
+
+// Closest hit queries on the BVHs of BvhBuilder, WideBvhBuilder and CompressedBvhBuilder. Every
+// kernel runs the same Möller-Trumbore test without culling in the same order of operations, so
+// they agree on the distance of a hit and only pick different triangles where several are
+// equally close.
+//
+// The SSE and AVX2 kernels test one ray against all children of a 4 or 8 wide node and against
+// a whole block of leaf triangles at once. Packets instead put one ray in each lane and walk the
+// binary BVH together, which pays off for rays as coherent as those of one pixel tile.
+class BvhTraversal
+{
+  public:
+    // SSE is part of x64, AVX2 needs support from both the CPU and the OS
+    static SimdLevel GetSimdLevel();
+    static const char *GetName(SimdLevel level);
+
+    // Each returns whether the ray hit a triangle between tMin and tMax and only then updates hit
+    static bool Intersect(const Bvh &bvh, const TraversalRay &ray, TraversalHit &hit);
+    static bool Intersect(const WideBvh4 &bvh, const TraversalRay &ray, TraversalHit &hit);
+    // Only for SimdLevel::AVX2
+    static bool Intersect(const WideBvh8 &bvh, const TraversalRay &ray, TraversalHit &hit);
+    // 8 children per AVX2 register or 4 per SSE register, SimdLevel::Scalar runs the SSE kernel
+    static bool Intersect(const CompressedBvh &bvh, const TraversalRay &ray, TraversalHit &hit,
+                          SimdLevel level);
+
+    // Up to TRAVERSAL_PACKET_SIZE rays, 4 per SSE register or 8 per AVX2 register. The hits of
+    // rays without one keep their values.
+    static void IntersectPacket(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                                TraversalHit *hits, SimdLevel level);
+
+  private:
+    static bool IntersectCompressedSse(const CompressedBvh &bvh, const TraversalRay &ray,
+                                       TraversalHit &hit);
+    static bool IntersectCompressedAvx2(const CompressedBvh &bvh, const TraversalRay &ray,
+                                        TraversalHit &hit);
+    static void IntersectPacketSse(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                                   TraversalHit *hits);
+    static void IntersectPacketAvx2(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                                    TraversalHit *hits);
+};
@@ -0,0 +1,107 @@
+#include "vkpch.h"
+
+#include "BvhTraversalKernels.h"
+
+#include <immintrin.h>
+
+// The only file built with /arch:AVX2, without the precompiled header whose code generation would
+// not match. Its functions only run once BvhTraversal::GetSimdLevel found support for AVX2.
+
+struct Avx2Float
+{
+    typedef __m256 Float;
+    static const uint32_t Width = 8;
+
+    static Float Set(float value)
+    {
+        return _mm256_set1_ps(value);
+    }
+    static Float Load(const float *values)
+    {
+        return _mm256_loadu_ps(values);
+    }
+    static Float Load4Pair(const float *low, const float *high)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)),
+                                    _mm_loadu_ps(high), 1);
+    }
+    static Float LoadBytes(const uint8_t *values)
+    {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(values));
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    }
+    static void Store(float *values, Float a)
+    {
+        _mm256_storeu_ps(values, a);
+    }
+    static Float Add(Float a, Float b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+    static Float Sub(Float a, Float b)
+    {
+        return _mm256_sub_ps(a, b);
+    }
+    static Float Mul(Float a, Float b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+    static Float Div(Float a, Float b)
+    {
+        return _mm256_div_ps(a, b);
+    }
+    static Float Min(Float a, Float b)
+    {
+        return _mm256_min_ps(a, b);
+    }
+    static Float Max(Float a, Float b)
+    {
+        return _mm256_max_ps(a, b);
+    }
+    static Float Less(Float a, Float b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+    static Float LessEqual(Float a, Float b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+    }
+    static Float Greater(Float a, Float b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+    }
+    static Float GreaterEqual(Float a, Float b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+    }
+    static Float NotEqual(Float a, Float b)
+    {
+        // Ordered, so that NaN determinants fail like in the scalar test
+        return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ);
+    }
+    static Float And(Float a, Float b)
+    {
+        return _mm256_and_ps(a, b);
+    }
+    static int Mask(Float a)
+    {
+        return _mm256_movemask_ps(a);
+    }
+};
+
+bool BvhTraversal::Intersect(const WideBvh8 &bvh, const TraversalRay &ray, TraversalHit &hit)
+{
+    return TraverseWide<Avx2Float>(bvh, ray, hit);
+}
+
+bool BvhTraversal::IntersectCompressedAvx2(const CompressedBvh &bvh, const TraversalRay &ray,
+                                           TraversalHit &hit)
+{
+    return TraverseCompressed<Avx2Float>(bvh, ray, hit);
+}
+
+void BvhTraversal::IntersectPacketAvx2(const Bvh &bvh, const TraversalRay *rays,
+                                       uint32_t count, TraversalHit *hits)
+{
+    TraversePacket<Avx2Float>(bvh, rays, count, hits);
+}
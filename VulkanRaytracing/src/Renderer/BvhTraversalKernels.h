@@ -0,0 +1,552 @@
+#pragma once
+
+#include "BvhTraversal.h"
+
+// Traversal kernels written once for the SSE and AVX2 translation units. Simd wraps the
+// intrinsics of one register width and provides Width, Float, Set, Load, Store, Add, Sub, Mul,
+// Div, Min, Max, the comparisons, And and Mask. Load4Pair fills the low 4 lanes from its first
+// array and, with 8 lanes, the high 4 from its second, LoadBytes converts Width unsigned bytes.
+
+// Entries the traversals keep on the stack before they fall back to heap memory
+#define TRAVERSAL_STACK_SIZE 256
+
+template <typename Entry> class TraversalStack
+{
+  public:
+    explicit TraversalStack(size_t capacity)
+    {
+        if (capacity > TRAVERSAL_STACK_SIZE)
+        {
+            m_Heap.reset(new Entry[capacity]);
+            m_Data = m_Heap.get();
+        }
+    }
+
+    void Push(const Entry &entry)
+    {
+        m_Data[m_Size++] = entry;
+    }
+
+    Entry Pop()
+    {
+        return m_Data[--m_Size];
+    }
+
+    bool IsEmpty() const
+    {
+        return m_Size == 0;
+    }
+
+  private:
+    Entry m_Local[TRAVERSAL_STACK_SIZE];
+    std::unique_ptr<Entry[]> m_Heap;
+    Entry *m_Data = m_Local;
+    size_t m_Size = 0;
+};
+
+// Child of a wide node waiting to be visited, blockCount is 0 for inner nodes. Leaves of a
+// compressed BVH count triangles instead of blocks.
+struct WideStackEntry
+{
+    uint32_t child;
+    uint32_t blockCount;
+    float t;
+};
+
+// Möller-Trumbore on all lanes, with the operations in the order of the glm based scalar test.
+// Returns the lanes that hit.
+template <typename Simd>
+static int IntersectTriangles(const typename Simd::Float origin[3],
+                              const typename Simd::Float direction[3],
+                              const typename Simd::Float vertex[3],
+                              const typename Simd::Float edge1[3],
+                              const typename Simd::Float edge2[3], typename Simd::Float tMin,
+                              typename Simd::Float tMax, typename Simd::Float &t,
+                              typename Simd::Float &u, typename Simd::Float &v)
+{
+    typedef typename Simd::Float Float;
+    const Float zero = Simd::Set(0.0f);
+    const Float one = Simd::Set(1.0f);
+
+    const Float pvec[3] = {
+        Simd::Sub(Simd::Mul(direction[1], edge2[2]), Simd::Mul(edge2[1], direction[2])),
+        Simd::Sub(Simd::Mul(direction[2], edge2[0]), Simd::Mul(edge2[2], direction[0])),
+        Simd::Sub(Simd::Mul(direction[0], edge2[1]), Simd::Mul(edge2[0], direction[1]))};
+    const Float det = Simd::Add(
+        Simd::Add(Simd::Mul(edge1[0], pvec[0]), Simd::Mul(edge1[1], pvec[1])),
+        Simd::Mul(edge1[2], pvec[2]));
+    const Float inverseDet = Simd::Div(one, det);
+
+    const Float tvec[3] = {Simd::Sub(origin[0], vertex[0]), Simd::Sub(origin[1], vertex[1]),
+                           Simd::Sub(origin[2], vertex[2])};
+    u = Simd::Mul(Simd::Add(Simd::Add(Simd::Mul(tvec[0], pvec[0]), Simd::Mul(tvec[1], pvec[1])),
+                            Simd::Mul(tvec[2], pvec[2])),
+                  inverseDet);
+    const Float qvec[3] = {
+        Simd::Sub(Simd::Mul(tvec[1], edge1[2]), Simd::Mul(edge1[1], tvec[2])),
+        Simd::Sub(Simd::Mul(tvec[2], edge1[0]), Simd::Mul(edge1[2], tvec[0])),
+        Simd::Sub(Simd::Mul(tvec[0], edge1[1]), Simd::Mul(edge1[0], tvec[1]))};
+    v = Simd::Mul(
+        Simd::Add(Simd::Add(Simd::Mul(direction[0], qvec[0]), Simd::Mul(direction[1], qvec[1])),
+                  Simd::Mul(direction[2], qvec[2])),
+        inverseDet);
+    t = Simd::Mul(Simd::Add(Simd::Add(Simd::Mul(edge2[0], qvec[0]), Simd::Mul(edge2[1], qvec[1])),
+                            Simd::Mul(edge2[2], qvec[2])),
+                  inverseDet);
+
+    Float hit = Simd::And(Simd::NotEqual(det, zero), Simd::GreaterEqual(u, zero));
+    hit = Simd::And(hit, Simd::LessEqual(u, one));
+    hit = Simd::And(hit, Simd::GreaterEqual(v, zero));
+    hit = Simd::And(hit, Simd::LessEqual(Simd::Add(u, v), one));
+    hit = Simd::And(hit, Simd::Greater(t, tMin));
+    hit = Simd::And(hit, Simd::Less(t, tMax));
+    return Simd::Mask(hit);
+}
+
+// Tests one ray against the given lanes of triangles, keeps the first of equally close hits
+// like the scalar loop does. GetTriangle gives the triangle of a lane.
+template <typename Simd, typename GetTriangle>
+static bool IntersectLanes(const typename Simd::Float vertex[3],
+                           const typename Simd::Float edge1[3],
+                           const typename Simd::Float edge2[3], int lanes,
+                           const GetTriangle &getTriangle, const typename Simd::Float origin[3],
+                           const typename Simd::Float direction[3], typename Simd::Float tMin,
+                           float &tMax, TraversalHit &hit)
+{
+    typedef typename Simd::Float Float;
+    Float t, u, v;
+    const int mask = lanes & IntersectTriangles<Simd>(origin, direction, vertex, edge1, edge2,
+                                                      tMin, Simd::Set(tMax), t, u, v);
+    if (mask == 0)
+    {
+        return false;
+    }
+
+    alignas(32) float ts[Simd::Width];
+    alignas(32) float us[Simd::Width];
+    alignas(32) float vs[Simd::Width];
+    Simd::Store(ts, t);
+    Simd::Store(us, u);
+    Simd::Store(vs, v);
+    bool found = false;
+    for (uint32_t lane = 0; lane < Simd::Width; lane++)
+    {
+        if ((mask & (1 << lane)) && ts[lane] < tMax)
+        {
+            tMax = ts[lane];
+            hit = {ts[lane], us[lane], vs[lane], getTriangle(lane)};
+            found = true;
+        }
+    }
+    return found;
+}
+
+template <typename Simd>
+static bool IntersectBlock(const TriangleBlock<Simd::Width> &block,
+                           const typename Simd::Float origin[3],
+                           const typename Simd::Float direction[3], typename Simd::Float tMin,
+                           float &tMax, TraversalHit &hit)
+{
+    typedef typename Simd::Float Float;
+    const Float vertex[3] = {Simd::Load(block.vertex[0]), Simd::Load(block.vertex[1]),
+                             Simd::Load(block.vertex[2])};
+    const Float edge1[3] = {Simd::Load(block.edge1[0]), Simd::Load(block.edge1[1]),
+                            Simd::Load(block.edge1[2])};
+    const Float edge2[3] = {Simd::Load(block.edge2[0]), Simd::Load(block.edge2[1]),
+                            Simd::Load(block.edge2[2])};
+    return IntersectLanes<Simd>(
+        vertex, edge1, edge2, -1, [&](uint32_t lane) { return block.triangles[lane]; }, origin,
+        direction, tMin, tMax, hit);
+}
+
+// Tests the triangles [first, last) of a compressed BVH. Registers of 8 lanes take two blocks at
+// a time, the lanes outside the range are masked off.
+template <typename Simd>
+static bool IntersectCompressedLeaf(const CompressedBvh &bvh, uint32_t first, uint32_t last,
+                                    const typename Simd::Float origin[3],
+                                    const typename Simd::Float direction[3],
+                                    typename Simd::Float tMin, float &tMax, TraversalHit &hit)
+{
+    typedef typename Simd::Float Float;
+    const uint32_t Width = Simd::Width;
+    bool found = false;
+    for (uint32_t start = first - first % COMPRESSED_BLOCK_WIDTH; start < last; start += Width)
+    {
+        const uint32_t laneBegin = std::max(first, start) - start;
+        const uint32_t laneEnd = std::min(last, start + Width) - start;
+        const int lanes = ((1 << laneEnd) - 1) & ~((1 << laneBegin) - 1);
+        // The second block may lie past the end of the array when the range does not reach it
+        const TriangleBlock<COMPRESSED_BLOCK_WIDTH> &low =
+            bvh.blocks[start / COMPRESSED_BLOCK_WIDTH];
+        const TriangleBlock<COMPRESSED_BLOCK_WIDTH> &high =
+            laneEnd > COMPRESSED_BLOCK_WIDTH ? bvh.blocks[start / COMPRESSED_BLOCK_WIDTH + 1]
+                                             : low;
+        const Float vertex[3] = {Simd::Load4Pair(low.vertex[0], high.vertex[0]),
+                                 Simd::Load4Pair(low.vertex[1], high.vertex[1]),
+                                 Simd::Load4Pair(low.vertex[2], high.vertex[2])};
+        const Float edge1[3] = {Simd::Load4Pair(low.edge1[0], high.edge1[0]),
+                                Simd::Load4Pair(low.edge1[1], high.edge1[1]),
+                                Simd::Load4Pair(low.edge1[2], high.edge1[2])};
+        const Float edge2[3] = {Simd::Load4Pair(low.edge2[0], high.edge2[0]),
+                                Simd::Load4Pair(low.edge2[1], high.edge2[1]),
+                                Simd::Load4Pair(low.edge2[2], high.edge2[2])};
+        found |= IntersectLanes<Simd>(
+            vertex, edge1, edge2, lanes,
+            [&](uint32_t lane) {
+                return lane < COMPRESSED_BLOCK_WIDTH
+                           ? low.triangles[lane]
+                           : high.triangles[lane - COMPRESSED_BLOCK_WIDTH];
+            },
+            origin, direction, tMin, tMax, hit);
+    }
+    return found;
+}
+
+// One ray against all children of each node. The children that were hit go on the stack
+// farthest first, so the nearest one is visited next and the others are skipped once a hit
+// is closer than where the ray enters them.
+template <typename Simd>
+static bool TraverseWide(const WideBvh<Simd::Width> &bvh, const TraversalRay &ray,
+                         TraversalHit &hit)
+{
+    typedef typename Simd::Float Float;
+    const uint32_t Width = Simd::Width;
+    if (bvh.nodes.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    const Float origin[3] = {Simd::Set(ray.origin.x), Simd::Set(ray.origin.y),
+                             Simd::Set(ray.origin.z)};
+    const Float direction[3] = {Simd::Set(ray.direction.x), Simd::Set(ray.direction.y),
+                                Simd::Set(ray.direction.z)};
+    const Float inverse[3] = {Simd::Set(inverseDirection.x), Simd::Set(inverseDirection.y),
+                              Simd::Set(inverseDirection.z)};
+    // The ray enters the bounds through the minimum planes of the axes it goes up along, which
+    // also makes the inverted bounds of empty slots miss. The inverse keeps the sign of -0.
+    bool positive[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        positive[axis] = inverseDirection[axis] >= 0.0f;
+    }
+    const Float tMin = Simd::Set(ray.tMin);
+    float tMax = ray.tMax;
+
+    TraversalStack<WideStackEntry> stack(size_t(Width - 1) * bvh.depth + 1);
+    stack.Push({0, 0, ray.tMin});
+    bool found = false;
+    while (!stack.IsEmpty())
+    {
+        const WideStackEntry entry = stack.Pop();
+        if (entry.t > tMax)
+        {
+            continue;
+        }
+        if (entry.blockCount > 0)
+        {
+            for (uint32_t block = entry.child; block < entry.child + entry.blockCount; block++)
+            {
+                found |=
+                    IntersectBlock<Simd>(bvh.blocks[block], origin, direction, tMin, tMax, hit);
+            }
+            continue;
+        }
+
+        const WideBvhNode<Width> &node = bvh.nodes[entry.child];
+        // NaNs of rays in a bounding plane drop out, the maximum and minimum keep their second
+        // operand then
+        Float tNear = tMin;
+        Float tFar = Simd::Set(tMax);
+        for (int axis = 2; axis >= 0; axis--)
+        {
+            const float *nearPlanes = positive[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+            const float *farPlanes = positive[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+            tNear = Simd::Max(
+                Simd::Mul(Simd::Sub(Simd::Load(nearPlanes), origin[axis]), inverse[axis]), tNear);
+            tFar = Simd::Min(
+                Simd::Mul(Simd::Sub(Simd::Load(farPlanes), origin[axis]), inverse[axis]), tFar);
+        }
+        int mask = Simd::Mask(Simd::LessEqual(tNear, tFar));
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        alignas(32) float entries[Simd::Width];
+        Simd::Store(entries, tNear);
+        WideStackEntry children[Simd::Width];
+        uint32_t count = 0;
+        for (uint32_t slot = 0; slot < Width; slot++)
+        {
+            if (!(mask & (1 << slot)))
+            {
+                continue;
+            }
+            // Insertion sort by decreasing entry distance
+            const WideStackEntry child = {node.children[slot], node.blockCounts[slot],
+                                          entries[slot]};
+            uint32_t position = count++;
+            while (position > 0 && children[position - 1].t < child.t)
+            {
+                children[position] = children[position - 1];
+                position--;
+            }
+            children[position] = child;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            stack.Push(children[i]);
+        }
+    }
+    return found;
+}
+
+// TraverseWide on a compressed BVH. The grid planes of the children come back as exactly the
+// floats the builder checked against the child bounds, so the slab test stays conservative.
+// Registers of 4 lanes take the 8 children in two halves.
+template <typename Simd>
+static bool TraverseCompressed(const CompressedBvh &bvh, const TraversalRay &ray,
+                               TraversalHit &hit)
+{
+    typedef typename Simd::Float Float;
+    const uint32_t Width = Simd::Width;
+    if (bvh.nodes.empty())
+    {
+        return false;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    const Float origin[3] = {Simd::Set(ray.origin.x), Simd::Set(ray.origin.y),
+                             Simd::Set(ray.origin.z)};
+    const Float direction[3] = {Simd::Set(ray.direction.x), Simd::Set(ray.direction.y),
+                                Simd::Set(ray.direction.z)};
+    const Float inverse[3] = {Simd::Set(inverseDirection.x), Simd::Set(inverseDirection.y),
+                              Simd::Set(inverseDirection.z)};
+    bool positive[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        positive[axis] = inverseDirection[axis] >= 0.0f;
+    }
+    const Float tMin = Simd::Set(ray.tMin);
+    float tMax = ray.tMax;
+
+    TraversalStack<WideStackEntry> stack(size_t(7) * bvh.depth + 1);
+    stack.Push({0, 0, ray.tMin});
+    bool found = false;
+    while (!stack.IsEmpty())
+    {
+        const WideStackEntry entry = stack.Pop();
+        if (entry.t > tMax)
+        {
+            continue;
+        }
+        if (entry.blockCount > 0)
+        {
+            found |= IntersectCompressedLeaf<Simd>(bvh, entry.child,
+                                                   entry.child + entry.blockCount, origin,
+                                                   direction, tMin, tMax, hit);
+            continue;
+        }
+
+        const CompressedBvhNode &node = bvh.nodes[entry.child];
+        Float gridOrigin[3];
+        Float step[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            gridOrigin[axis] = Simd::Set(node.origin[axis]);
+            // 2^exponent put together from its float bits
+            const uint32_t bits = uint32_t(node.exponents[axis] + 127) << 23;
+            float scale;
+            memcpy(&scale, &bits, sizeof(scale));
+            step[axis] = Simd::Set(scale);
+        }
+
+        int mask = 0;
+        alignas(32) float entries[8];
+        for (uint32_t first = 0; first < 8; first += Width)
+        {
+            Float tNear = tMin;
+            Float tFar = Simd::Set(tMax);
+            for (int axis = 2; axis >= 0; axis--)
+            {
+                const uint8_t *nearPlanes =
+                    positive[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+                const uint8_t *farPlanes =
+                    positive[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+                const Float nearPlane = Simd::Add(
+                    gridOrigin[axis], Simd::Mul(Simd::LoadBytes(nearPlanes + first), step[axis]));
+                const Float farPlane = Simd::Add(
+                    gridOrigin[axis], Simd::Mul(Simd::LoadBytes(farPlanes + first), step[axis]));
+                tNear = Simd::Max(Simd::Mul(Simd::Sub(nearPlane, origin[axis]), inverse[axis]),
+                                  tNear);
+                tFar = Simd::Min(Simd::Mul(Simd::Sub(farPlane, origin[axis]), inverse[axis]),
+                                 tFar);
+            }
+            mask |= Simd::Mask(Simd::LessEqual(tNear, tFar)) << first;
+            Simd::Store(entries + first, tNear);
+        }
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // Inner children and leaf triangles are found by counting those of the earlier slots
+        WideStackEntry children[8];
+        uint32_t count = 0;
+        uint32_t innerNode = node.firstNode;
+        uint32_t firstTriangle = node.firstTriangle;
+        for (uint32_t slot = 0; slot < 8; slot++)
+        {
+            const bool inner = (node.innerMask & (1 << slot)) != 0;
+            const WideStackEntry child = {inner ? innerNode : firstTriangle,
+                                          node.triangleCounts[slot], entries[slot]};
+            innerNode += inner ? 1 : 0;
+            firstTriangle += node.triangleCounts[slot];
+            // Empty slots can only be told apart from their planes by having neither
+            if (!(mask & (1 << slot)) || (!inner && child.blockCount == 0))
+            {
+                continue;
+            }
+            uint32_t position = count++;
+            while (position > 0 && children[position - 1].t < child.t)
+            {
+                children[position] = children[position - 1];
+                position--;
+            }
+            children[position] = child;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            stack.Push(children[i]);
+        }
+    }
+    return found;
+}
+
+// Width rays per register and TRAVERSAL_PACKET_SIZE / Width registers per packet. A node is
+// visited while any ray of the packet hits its bounds, the children are ordered along the
+// first ray.
+template <typename Simd>
+static void TraversePacket(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                           TraversalHit *hits)
+{
+    typedef typename Simd::Float Float;
+    const uint32_t Width = Simd::Width;
+    count = std::min(count, uint32_t(TRAVERSAL_PACKET_SIZE));
+    if (bvh.nodes.empty() || count == 0)
+    {
+        return;
+    }
+
+    // Lanes past the last ray get an empty interval
+    alignas(32) float origin[3][TRAVERSAL_PACKET_SIZE];
+    alignas(32) float direction[3][TRAVERSAL_PACKET_SIZE];
+    alignas(32) float inverse[3][TRAVERSAL_PACKET_SIZE];
+    alignas(32) float tMin[TRAVERSAL_PACKET_SIZE];
+    alignas(32) float tMax[TRAVERSAL_PACKET_SIZE];
+    for (uint32_t lane = 0; lane < TRAVERSAL_PACKET_SIZE; lane++)
+    {
+        const bool used = lane < count;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            origin[axis][lane] = used ? rays[lane].origin[axis] : 0.0f;
+            direction[axis][lane] = used ? rays[lane].direction[axis] : 1.0f;
+            inverse[axis][lane] = 1.0f / direction[axis][lane];
+        }
+        tMin[lane] = used ? rays[lane].tMin : 1.0f;
+        tMax[lane] = used ? rays[lane].tMax : 0.0f;
+    }
+    const uint32_t groups = (count + Width - 1) / Width;
+    const glm::vec3 &order = rays[0].direction;
+
+    TraversalStack<uint32_t> stack(bvh.depth + 1);
+    stack.Push(0);
+    while (!stack.IsEmpty())
+    {
+        const BvhNode &node = bvh.nodes[stack.Pop()];
+
+        bool visible = false;
+        for (uint32_t group = 0; group < groups && !visible; group++)
+        {
+            const uint32_t first = group * Width;
+            Float tNear = Simd::Load(tMin + first);
+            Float tFar = Simd::Load(tMax + first);
+            for (int axis = 2; axis >= 0; axis--)
+            {
+                const Float o = Simd::Load(origin[axis] + first);
+                const Float inv = Simd::Load(inverse[axis] + first);
+                const Float t0 = Simd::Mul(Simd::Sub(Simd::Set(node.boundsMin[axis]), o), inv);
+                const Float t1 = Simd::Mul(Simd::Sub(Simd::Set(node.boundsMax[axis]), o), inv);
+                tNear = Simd::Max(Simd::Min(t0, t1), tNear);
+                tFar = Simd::Min(Simd::Max(t0, t1), tFar);
+            }
+            visible = Simd::Mask(Simd::LessEqual(tNear, tFar)) != 0;
+        }
+        if (!visible)
+        {
+            continue;
+        }
+
+        if (!node.IsLeaf())
+        {
+            // The child whose center lies first along the first ray is visited first
+            const BvhNode &left = bvh.nodes[node.first];
+            const BvhNode &right = bvh.nodes[node.first + 1];
+            const glm::vec3 separation =
+                (right.boundsMin + right.boundsMax) - (left.boundsMin + left.boundsMax);
+            const bool leftFirst = glm::dot(separation, order) >= 0.0f;
+            stack.Push(leftFirst ? node.first + 1 : node.first);
+            stack.Push(leftFirst ? node.first : node.first + 1);
+            continue;
+        }
+
+        for (uint32_t triangle = node.first; triangle < node.first + node.triangleCount;
+             triangle++)
+        {
+            const uint32_t *indices = bvh.indices.data() + size_t(triangle) * 3;
+            const glm::vec3 &p0 = bvh.positions[indices[0]];
+            const glm::vec3 edge1 = bvh.positions[indices[1]] - p0;
+            const glm::vec3 edge2 = bvh.positions[indices[2]] - p0;
+            const Float vertexLanes[3] = {Simd::Set(p0.x), Simd::Set(p0.y), Simd::Set(p0.z)};
+            const Float edge1Lanes[3] = {Simd::Set(edge1.x), Simd::Set(edge1.y),
+                                         Simd::Set(edge1.z)};
+            const Float edge2Lanes[3] = {Simd::Set(edge2.x), Simd::Set(edge2.y),
+                                         Simd::Set(edge2.z)};
+
+            for (uint32_t group = 0; group < groups; group++)
+            {
+                const uint32_t first = group * Width;
+                const Float originLanes[3] = {Simd::Load(origin[0] + first),
+                                              Simd::Load(origin[1] + first),
+                                              Simd::Load(origin[2] + first)};
+                const Float directionLanes[3] = {Simd::Load(direction[0] + first),
+                                                 Simd::Load(direction[1] + first),
+                                                 Simd::Load(direction[2] + first)};
+                Float t, u, v;
+                const int mask = IntersectTriangles<Simd>(
+                    originLanes, directionLanes, vertexLanes, edge1Lanes, edge2Lanes,
+                    Simd::Load(tMin + first), Simd::Load(tMax + first), t, u, v);
+                if (mask == 0)
+                {
+                    continue;
+                }
+
+                alignas(32) float ts[Simd::Width];
+                alignas(32) float us[Simd::Width];
+                alignas(32) float vs[Simd::Width];
+                Simd::Store(ts, t);
+                Simd::Store(us, u);
+                Simd::Store(vs, v);
+                for (uint32_t lane = 0; lane < Width; lane++)
+                {
+                    if (mask & (1 << lane))
+                    {
+                        tMax[first + lane] = ts[lane];
+                        hits[first + lane] = {ts[lane], us[lane], vs[lane], triangle};
+                    }
+                }
+            }
+        }
+    }
+}
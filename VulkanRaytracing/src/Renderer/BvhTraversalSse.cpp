@@ -0,0 +1,106 @@
+#include "vkpch.h"
+
+#include "BvhTraversalKernels.h"
+
+#include <emmintrin.h>
+
+struct SseFloat
+{
+    typedef __m128 Float;
+    static const uint32_t Width = 4;
+
+    static Float Set(float value)
+    {
+        return _mm_set1_ps(value);
+    }
+    static Float Load(const float *values)
+    {
+        return _mm_loadu_ps(values);
+    }
+    static Float Load4Pair(const float *low, const float *)
+    {
+        return _mm_loadu_ps(low);
+    }
+    static Float LoadBytes(const uint8_t *values)
+    {
+        int32_t packed;
+        memcpy(&packed, values, sizeof(packed));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    }
+    static void Store(float *values, Float a)
+    {
+        _mm_storeu_ps(values, a);
+    }
+    static Float Add(Float a, Float b)
+    {
+        return _mm_add_ps(a, b);
+    }
+    static Float Sub(Float a, Float b)
+    {
+        return _mm_sub_ps(a, b);
+    }
+    static Float Mul(Float a, Float b)
+    {
+        return _mm_mul_ps(a, b);
+    }
+    static Float Div(Float a, Float b)
+    {
+        return _mm_div_ps(a, b);
+    }
+    static Float Min(Float a, Float b)
+    {
+        return _mm_min_ps(a, b);
+    }
+    static Float Max(Float a, Float b)
+    {
+        return _mm_max_ps(a, b);
+    }
+    static Float Less(Float a, Float b)
+    {
+        return _mm_cmplt_ps(a, b);
+    }
+    static Float LessEqual(Float a, Float b)
+    {
+        return _mm_cmple_ps(a, b);
+    }
+    static Float Greater(Float a, Float b)
+    {
+        return _mm_cmpgt_ps(a, b);
+    }
+    static Float GreaterEqual(Float a, Float b)
+    {
+        return _mm_cmpge_ps(a, b);
+    }
+    static Float NotEqual(Float a, Float b)
+    {
+        // Ordered, so that NaN determinants fail like in the scalar test
+        return _mm_andnot_ps(_mm_cmpeq_ps(a, b), _mm_cmpord_ps(a, b));
+    }
+    static Float And(Float a, Float b)
+    {
+        return _mm_and_ps(a, b);
+    }
+    static int Mask(Float a)
+    {
+        return _mm_movemask_ps(a);
+    }
+};
+
+bool BvhTraversal::Intersect(const WideBvh4 &bvh, const TraversalRay &ray, TraversalHit &hit)
+{
+    return TraverseWide<SseFloat>(bvh, ray, hit);
+}
+
+bool BvhTraversal::IntersectCompressedSse(const CompressedBvh &bvh, const TraversalRay &ray,
+                                          TraversalHit &hit)
+{
+    return TraverseCompressed<SseFloat>(bvh, ray, hit);
+}
+
+void BvhTraversal::IntersectPacketSse(const Bvh &bvh, const TraversalRay *rays, uint32_t count,
+                                      TraversalHit *hits)
+{
+    TraversePacket<SseFloat>(bvh, rays, count, hits);
+}
@@ -0,0 +1,51 @@
+#include "vkpch.h"
+
+#include "BvhUpdater.h"
+
+#include "Core/Timer.h"
+#include "LbvhBuilder.h"
+
+void BvhUpdater::Rebuild(const MeshView &mesh, Bvh &bvh, BvhBuildMethod method)
+{
+    Timer timer;
+    if (method == BvhBuildMethod::Lbvh)
+    {
+        LbvhBuilder::Build(mesh, bvh, m_Settings.bvh);
+    }
+    else
+    {
+        BvhBuilder::Build(mesh, bvh, m_Settings.bvh);
+    }
+    m_BuiltSahCost = BvhBuilder::GetStats(bvh, m_Settings.bvh).sahCost;
+    m_Stats.rebuilt = true;
+    m_Stats.buildMillis = timer.ElapsedMillis();
+    m_Stats.sahCost = m_BuiltSahCost;
+    m_Stats.sahGrowth = 1.0f;
+    m_Stats.refitsSinceBuild = 0;
+}
+
+const BvhUpdateStats &BvhUpdater::Build(const MeshView &mesh, Bvh &bvh)
+{
+    m_Stats = {};
+    Rebuild(mesh, bvh, m_Settings.firstBuild);
+    return m_Stats;
+}
+
+const BvhUpdateStats &BvhUpdater::Update(const MeshView &mesh, Bvh &bvh)
+{
+    const uint32_t refitsSinceBuild = m_Stats.refitsSinceBuild;
+    m_Stats = {};
+    Timer timer;
+    m_Stats.refit = true;
+    m_Stats.sahCost = BvhBuilder::Refit(mesh, bvh, m_Settings.bvh);
+    m_Stats.refitMillis = timer.ElapsedMillis();
+    m_Stats.sahGrowth = m_BuiltSahCost > 0.0f ? m_Stats.sahCost / m_BuiltSahCost : 1.0f;
+    m_Stats.refitsSinceBuild = refitsSinceBuild + 1;
+
+    // The refit is what measures the degradation, so the frame that rebuilds pays for both
+    if (m_Stats.sahGrowth > m_Settings.maxSahGrowth)
+    {
+        Rebuild(mesh, bvh, m_Settings.rebuild);
+    }
+    return m_Stats;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "BvhBuilder.h"
+
+enum class BvhBuildMethod
+{
+    // BvhBuilder, slower to build and faster to trace
+    Sah,
+    // LbvhBuilder
+    Lbvh
+};
+
+struct BvhUpdateSettings
+{
+    BvhSettings bvh;
+    BvhBuildMethod firstBuild = BvhBuildMethod::Sah;
+    BvhBuildMethod rebuild = BvhBuildMethod::Lbvh;
+    // Refitting gives way to a rebuild once the SAH cost grew by this factor since the last build
+    float maxSahGrowth = 1.5f;
+};
+
+// What the last Build or Update call did
+struct BvhUpdateStats
+{
+    bool refit = false;
+    bool rebuilt = false;
+    float refitMillis = 0.0f;
+    float buildMillis = 0.0f;
+    float sahCost = 0.0f;
+    // SAH cost over the one right after the last build
+    float sahGrowth = 1.0f;
+    // Updates refit in a row since the last build
+    uint32_t refitsSinceBuild = 0;
+};
+
+// Keeps the BVH of deforming geometry up to date frame after frame. A refit keeps the tree and
+// only moves its bounds, which is cheap but lets the nodes overlap more and more as the triangles
+// move away from where the tree was built. The updater therefore compares the SAH cost after each
+// refit to the cost right after the last build and rebuilds once it grew by more than
+// maxSahGrowth, by default with the LBVH builder.
+class BvhUpdater
+{
+  public:
+    explicit BvhUpdater(const BvhUpdateSettings &settings = {}) : m_Settings(settings)
+    {
+    }
+
+    const BvhUpdateSettings &GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    const BvhUpdateStats &GetStats() const
+    {
+        return m_Stats;
+    }
+
+    // Builds the BVH from scratch with the firstBuild method
+    const BvhUpdateStats &Build(const MeshView &mesh, Bvh &bvh);
+    // The mesh must keep the topology of the last build, only its positions may change
+    const BvhUpdateStats &Update(const MeshView &mesh, Bvh &bvh);
+
+  private:
+    void Rebuild(const MeshView &mesh, Bvh &bvh, BvhBuildMethod method);
+
+  private:
+    BvhUpdateSettings m_Settings;
+    BvhUpdateStats m_Stats;
+    float m_BuiltSahCost = 0.0f;
+};
@@ -0,0 +1,161 @@
+#include "vkpch.h"
+
+#include "CompressedBvh.h"
+
+#include <cmath>
+
+// The traversal gets a plane back as origin + q * 2^exponent in float math. q * 2^exponent is
+// exact, so checking the rounded sum here is enough to know the planes enclose the child.
+static float GetPlane(float origin, float step, int quantized)
+{
+    return origin + float(quantized) * step;
+}
+
+// Smallest step whose last plane still reaches max
+static int GetExponent(float origin, float max)
+{
+    int exponent = -126;
+    const float extent = (max - origin) / 255.0f;
+    if (extent > 0.0f)
+    {
+        std::frexp(extent, &exponent);
+        if (std::ldexp(1.0f, exponent - 1) >= extent)
+        {
+            exponent--;
+        }
+        exponent = std::max(exponent, -126);
+    }
+    while (GetPlane(origin, std::ldexp(1.0f, exponent), 255) < max)
+    {
+        exponent++;
+    }
+    return exponent;
+}
+
+static uint8_t QuantizeMin(float value, float origin, float step)
+{
+    int quantized = static_cast<int>(std::floor((value - origin) / step));
+    quantized = std::min(std::max(quantized, 0), 255);
+    while (quantized > 0 && GetPlane(origin, step, quantized) > value)
+    {
+        quantized--;
+    }
+    return static_cast<uint8_t>(quantized);
+}
+
+static uint8_t QuantizeMax(float value, float origin, float step)
+{
+    int quantized = static_cast<int>(std::ceil((value - origin) / step));
+    quantized = std::min(std::max(quantized, 0), 255);
+    while (quantized < 255 && GetPlane(origin, step, quantized) < value)
+    {
+        quantized++;
+    }
+    return static_cast<uint8_t>(quantized);
+}
+
+static CompressedBvhNode CompressNode(const WideBvh8 &wide, const WideBvhNode<8> &node,
+                                      CompressedBvh &compressed)
+{
+    CompressedBvhNode result = {};
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    uint32_t innerCount = 0;
+    for (uint32_t slot = 0; slot < 8; slot++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], node.boundsMin[axis][slot]);
+            boundsMax[axis] = std::max(boundsMax[axis], node.boundsMax[axis][slot]);
+        }
+        // Inner children were added one after another, so the first one tells where they start
+        if (node.blockCounts[slot] == 0 && node.boundsMin[0][slot] <= node.boundsMax[0][slot])
+        {
+            result.firstNode = innerCount > 0 ? result.firstNode : node.children[slot];
+            assert(node.children[slot] == result.firstNode + innerCount);
+            result.innerMask |= 1 << slot;
+            innerCount++;
+        }
+    }
+
+    glm::vec3 step;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const int exponent = GetExponent(boundsMin[axis], boundsMax[axis]);
+        result.origin[axis] = boundsMin[axis];
+        result.exponents[axis] = static_cast<int8_t>(exponent);
+        step[axis] = std::ldexp(1.0f, exponent);
+    }
+
+    result.firstTriangle =
+        static_cast<uint32_t>(compressed.blocks.size()) * COMPRESSED_BLOCK_WIDTH;
+    uint32_t triangleCount = 0;
+    for (uint32_t slot = 0; slot < 8; slot++)
+    {
+        if (node.boundsMin[0][slot] > node.boundsMax[0][slot])
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                result.boundsMin[axis][slot] = 255;
+                result.boundsMax[axis][slot] = 0;
+            }
+            continue;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            result.boundsMin[axis][slot] =
+                QuantizeMin(node.boundsMin[axis][slot], result.origin[axis], step[axis]);
+            result.boundsMax[axis][slot] =
+                QuantizeMax(node.boundsMax[axis][slot], result.origin[axis], step[axis]);
+        }
+
+        // The triangles of the leaf move over from the blocks of 8 without the unused lanes
+        const uint32_t leafStart = triangleCount;
+        const uint32_t lastBlock = node.children[slot] + node.blockCounts[slot];
+        for (uint32_t blockIndex = node.children[slot]; blockIndex < lastBlock; blockIndex++)
+        {
+            const TriangleBlock<8> &block = wide.blocks[blockIndex];
+            for (uint32_t lane = 0; lane < 8 && block.triangles[lane] != UINT32_MAX; lane++)
+            {
+                const uint32_t target = triangleCount++ % COMPRESSED_BLOCK_WIDTH;
+                if (target == 0)
+                {
+                    compressed.blocks.emplace_back();
+                    TriangleBlock<COMPRESSED_BLOCK_WIDTH> &empty = compressed.blocks.back();
+                    empty = {};
+                    std::fill(std::begin(empty.triangles), std::end(empty.triangles),
+                              UINT32_MAX);
+                }
+                TriangleBlock<COMPRESSED_BLOCK_WIDTH> &packed = compressed.blocks.back();
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    packed.vertex[axis][target] = block.vertex[axis][lane];
+                    packed.edge1[axis][target] = block.edge1[axis][lane];
+                    packed.edge2[axis][target] = block.edge2[axis][lane];
+                }
+                packed.triangles[target] = block.triangles[lane];
+            }
+        }
+        assert(triangleCount - leafStart <= 255);
+        result.triangleCounts[slot] = static_cast<uint8_t>(triangleCount - leafStart);
+    }
+    return result;
+}
+
+void CompressedBvhBuilder::Build(const Bvh &bvh, CompressedBvh &compressed)
+{
+    WideBvh8 wide;
+    WideBvhBuilder::Build(bvh, wide);
+    Build(wide, compressed);
+}
+
+void CompressedBvhBuilder::Build(const WideBvh8 &wide, CompressedBvh &compressed)
+{
+    compressed.nodes.resize(wide.nodes.size());
+    compressed.blocks.clear();
+    compressed.depth = wide.depth;
+    for (size_t i = 0; i < wide.nodes.size(); i++)
+    {
+        compressed.nodes[i] = CompressNode(wide, wide.nodes[i], compressed);
+    }
+}
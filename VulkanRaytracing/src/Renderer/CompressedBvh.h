@@ -0,0 +1,44 @@
+#pragma once
+
+#include "WideBvh.h"
+
+// Triangles per block of a compressed BVH
+#define COMPRESSED_BLOCK_WIDTH 4
+
+// 8 children in 80 bytes. The node spans a grid from origin with a step of 2^exponent on each
+// axis and stores the child bounds as 8 bit grid planes, rounded outwards so that every child
+// stays inside the planes it gets back. Empty slots have inverted planes and no triangles.
+struct CompressedBvhNode
+{
+    glm::vec3 origin;
+    int8_t exponents[3];
+    // Slots of inner children, which follow one another from firstNode in slot order
+    uint8_t innerMask;
+    uint32_t firstNode;
+    // The triangles of the leaf children follow one another in slot order from firstTriangle
+    uint32_t firstTriangle;
+    // Triangles of each leaf child, 0 for inner children
+    uint8_t triangleCounts[8];
+    uint8_t boundsMin[3][8];
+    uint8_t boundsMax[3][8];
+};
+
+// Collapsed 8 wide BVH with quantized child bounds, a quarter of the size of a WideBvh8 node.
+// The triangles of a node are packed into blocks of COMPRESSED_BLOCK_WIDTH without gaps between
+// its leaves, so only the last block of each node has unused lanes.
+struct CompressedBvh
+{
+    std::vector<CompressedBvhNode> nodes;
+    std::vector<TriangleBlock<COMPRESSED_BLOCK_WIDTH>> blocks;
+    // Nodes on the longest path from the root to a leaf
+    uint32_t depth = 0;
+};
+
+class CompressedBvhBuilder
+{
+  public:
+    // Collapses the binary BVH the way WideBvhBuilder does, leaves may hold up to 255 triangles
+    static void Build(const Bvh &bvh, CompressedBvh &compressed);
+    // Saves collapsing the binary BVH again where its WideBvh8 is at hand
+    static void Build(const WideBvh8 &wide, CompressedBvh &compressed);
+};
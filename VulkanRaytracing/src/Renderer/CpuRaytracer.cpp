@@ -0,0 +1,601 @@
+#include "vkpch.h"
+
+#include "CpuRaytracer.h"
+
+#include "Core/Allocator.h"
+#include "Core/ThreadPool.h"
+#include "Core/Timer.h"
+
+#include "glm/gtc/matrix_inverse.hpp"
+
+#include <atomic>
+#include <cmath>
+
+#define CPU_RT_TILE_SIZE 16
+#define CPU_RT_MAX_DEPTH 5
+#define CPU_RT_T_MIN 0.001f
+#define CPU_RT_T_MAX 10000.0f
+#define CPU_RT_PI 3.14159265f
+
+#define CPU_RT_PACKET_WIDTH 4
+#define CPU_RT_PACKET_HEIGHT 4
+
+struct CpuRaytracer::Hit
+{
+    // u and v are the weights of the second and third vertex, like the hit attributes of the
+    // shaders
+    TraversalHit triangle;
+    uint32_t instance = UINT32_MAX;
+};
+
+// hitPayload of raycommon.glsl, with the ray count of the tile
+struct CpuRaytracer::Payload
+{
+    int depth = 0;
+    glm::vec3 hitValue = glm::vec3(0.0f);
+    glm::vec3 attenuation = glm::vec3(1.0f);
+    uint64_t rays = 0;
+};
+
+// Generate a random unsigned int from two unsigned int values, using 16 pairs of rounds of the
+// Tiny Encryption Algorithm, as in random.glsl
+static uint32_t Tea(uint32_t val0, uint32_t val1)
+{
+    uint32_t v0 = val0;
+    uint32_t v1 = val1;
+    uint32_t s0 = 0;
+
+    for (uint32_t n = 0; n < 16; n++)
+    {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+    }
+    return v0;
+}
+
+// Numerical Recipes linear congruential generator, returns [0, 2^24)
+static uint32_t Lcg(uint32_t &prev)
+{
+    const uint32_t LCG_A = 1664525u;
+    const uint32_t LCG_C = 1013904223u;
+    prev = LCG_A * prev + LCG_C;
+    return prev & 0x00FFFFFF;
+}
+
+static float Rnd(uint32_t &prev)
+{
+    return static_cast<float>(Lcg(prev)) / static_cast<float>(0x01000000);
+}
+
+static float FresnelSchlick(float cosTheta, float F0)
+{
+    return F0 + (1.0f - F0) * std::pow(1.0f - cosTheta, 5.0f);
+}
+
+static const float *GetSrgbTable()
+{
+    static const auto table = []() {
+        std::array<float, 256> values;
+        for (int i = 0; i < 256; i++)
+        {
+            const float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+static uint32_t WrapTexel(int coordinate, uint32_t size, bool clamp)
+{
+    const int last = static_cast<int>(size) - 1;
+    if (clamp)
+    {
+        return static_cast<uint32_t>(std::min(std::max(coordinate, 0), last));
+    }
+    const int wrapped = coordinate % static_cast<int>(size);
+    return static_cast<uint32_t>(wrapped < 0 ? wrapped + static_cast<int>(size) : wrapped);
+}
+
+// Linear filtering of the largest level, fetch(x, y) returns one texel in linear RGB. V always
+// repeats, U is clamped to the edge for the skyspheres.
+template <typename Fetch>
+static glm::vec3 SampleBilinear(uint32_t width, uint32_t height, glm::vec2 uv, bool clampU,
+                                Fetch &&fetch)
+{
+    if (!std::isfinite(uv.x) || !std::isfinite(uv.y))
+    {
+        uv = glm::vec2(0.0f);
+    }
+    // Keeps the texel coordinates in the range of int, repeating wraps whole periods anyway
+    uv.y -= std::floor(uv.y);
+    uv.x = clampU ? glm::clamp(uv.x, 0.0f, 1.0f) : uv.x - std::floor(uv.x);
+
+    const float x = uv.x * width - 0.5f;
+    const float y = uv.y * height - 0.5f;
+    const float x0 = std::floor(x);
+    const float y0 = std::floor(y);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const uint32_t left = WrapTexel(static_cast<int>(x0), width, clampU);
+    const uint32_t right = WrapTexel(static_cast<int>(x0) + 1, width, clampU);
+    const uint32_t top = WrapTexel(static_cast<int>(y0), height, false);
+    const uint32_t bottom = WrapTexel(static_cast<int>(y0) + 1, height, false);
+
+    const glm::vec3 upper = glm::mix(fetch(left, top), fetch(right, top), fx);
+    const glm::vec3 lower = glm::mix(fetch(left, bottom), fetch(right, bottom), fx);
+    return glm::mix(upper, lower, fy);
+}
+
+// Samples level 0 of an sRGB texture, the filtering happens after decoding like for the
+// R8G8B8A8Srgb images
+static glm::vec3 SampleSrgb(const MipChain &chain, glm::vec2 uv, bool clampU)
+{
+    const MipLevel &level = chain.levels[0];
+    const uint8_t *pixels = chain.pixels.data() + level.offset;
+    const float *srgb = GetSrgbTable();
+    return SampleBilinear(level.width, level.height, uv, clampU, [&](uint32_t x, uint32_t y) {
+        const uint8_t *texel = pixels + (size_t(y) * level.width + x) * 4;
+        return glm::vec3(srgb[texel[0]], srgb[texel[1]], srgb[texel[2]]);
+    });
+}
+
+static glm::vec3 SampleEnvironment(const EnvironmentMap &map, glm::vec2 uv, bool clampU)
+{
+    const MipLevel &level = map.levels[0];
+    const size_t texelSize = EnvironmentBaker::GetTexelSize(map.format);
+    const uint8_t *texels = map.texels.data() + level.offset * texelSize;
+    return SampleBilinear(level.width, level.height, uv, clampU, [&](uint32_t x, uint32_t y) {
+        glm::vec3 rgb;
+        EnvironmentBaker::DecodeTexel(
+            map.format, texels + (size_t(y) * level.width + x) * texelSize, &rgb.x);
+        return rgb;
+    });
+}
+
+// World bounds of an instance
+static bool IntersectBounds(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                            const glm::vec3 &origin, const glm::vec3 &inverseDirection,
+                            float tMin, float tMax)
+{
+    const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+    const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    const float tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+    const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+    return tEntry <= tExit;
+}
+
+void CpuRaytracer::BuildWideBvh(CpuModel &model) const
+{
+    if (m_SimdLevel == SimdLevel::AVX2)
+    {
+        WideBvhBuilder::Build(model.bvh, model.bvh8);
+    }
+    else if (m_SimdLevel == SimdLevel::SSE)
+    {
+        WideBvhBuilder::Build(model.bvh, model.bvh4);
+    }
+}
+
+uint32_t CpuRaytracer::AddModel(MeshData mesh, const BvhSettings &settings)
+{
+    CpuModel model;
+    model.mesh = std::move(mesh);
+    model.updater = BvhUpdater({settings});
+    model.updater.Build(model.mesh.GetView(), model.bvh);
+    BuildWideBvh(model);
+
+    model.textures.resize(model.mesh.textures.size());
+    ThreadPool::Get().ParallelFor(model.textures.size(), [&](size_t i) {
+        Allocator::LoadTextureMips(model.mesh.textureDirectory + model.mesh.textures[i],
+                                   model.textures[i]);
+    });
+
+    m_Models.push_back(std::move(model));
+    return static_cast<uint32_t>(m_Models.size() - 1);
+}
+
+void CpuRaytracer::LoadModels(const std::vector<std::string> &filenames,
+                              const BvhSettings &settings)
+{
+    for (const auto &filename : filenames)
+    {
+        AddModel(ObjModel::LoadMeshData(filename), settings);
+    }
+}
+
+void CpuRaytracer::SetInstances(const std::vector<ObjInstance> &instances)
+{
+    m_Instances.clear();
+    for (const auto &objInstance : instances)
+    {
+        if (objInstance.objModelIndex >= m_Models.size() ||
+            m_Models[objInstance.objModelIndex].bvh.nodes.empty())
+        {
+            continue;
+        }
+
+        Instance instance;
+        instance.model = objInstance.objModelIndex;
+        instance.modelMatrix = objInstance.modelMatrix;
+        instance.modelMatrixIT = objInstance.modelMatrixIT;
+        instance.worldToObject = glm::inverse(objInstance.modelMatrix);
+        FitInstanceBounds(instance);
+        m_Instances.push_back(instance);
+    }
+}
+
+const BvhUpdateStats &CpuRaytracer::UpdateModel(uint32_t index, std::vector<Vertex> vertices)
+{
+    CpuModel &model = m_Models[index];
+    assert(vertices.size() == model.mesh.vertices.size());
+    model.mesh.vertices = std::move(vertices);
+    model.updater.Update(model.mesh.GetView(), model.bvh);
+    BuildWideBvh(model);
+    for (Instance &instance : m_Instances)
+    {
+        if (instance.model == index)
+        {
+            FitInstanceBounds(instance);
+        }
+    }
+    return model.updater.GetStats();
+}
+
+// World bounds of the eight corners of the root
+void CpuRaytracer::FitInstanceBounds(Instance &instance) const
+{
+    const BvhNode &root = m_Models[instance.model].bvh.nodes[0];
+    instance.boundsMin = glm::vec3(FLT_MAX);
+    instance.boundsMax = glm::vec3(-FLT_MAX);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        const glm::vec3 position((corner & 1) ? root.boundsMax.x : root.boundsMin.x,
+                                 (corner & 2) ? root.boundsMax.y : root.boundsMin.y,
+                                 (corner & 4) ? root.boundsMax.z : root.boundsMin.z);
+        const glm::vec3 world = glm::vec3(instance.modelMatrix * glm::vec4(position, 1.0f));
+        instance.boundsMin = glm::min(instance.boundsMin, world);
+        instance.boundsMax = glm::max(instance.boundsMax, world);
+    }
+}
+
+void CpuRaytracer::LoadSkyspheres(const EnvironmentBakeSettings &settings)
+{
+    EnvironmentBakeSettings equirectSettings = settings;
+    equirectSettings.cubeFaceSize = 0;
+    ObjModel::LoadSkysphereSources(m_Skyspheres, equirectSettings);
+}
+
+TraversalRay CpuRaytracer::GetPrimaryRay(const glm::mat4 &viewInverse,
+                                         const glm::mat4 &projectionInverse, uint32_t x,
+                                         uint32_t y, uint32_t width, uint32_t height,
+                                         uint32_t sample)
+{
+    // Initialize the random number
+    uint32_t seed = Tea(y * width + x, sample);
+    const float r1 = Rnd(seed);
+    const float r2 = Rnd(seed);
+    // Subpixel jitter: send the ray through a different position inside the pixel each time, to
+    // provide antialiasing
+    const glm::vec2 subpixelJitter = sample == 0 ? glm::vec2(0.5f, 0.5f) : glm::vec2(r1, r2);
+
+    const glm::vec2 pixelCenter = glm::vec2(x, y) + subpixelJitter;
+    const glm::vec2 inUV = pixelCenter / glm::vec2(width, height);
+    const glm::vec2 d = inUV * 2.0f - 1.0f;
+    const glm::vec4 origin = viewInverse * glm::vec4(0, 0, 0, 1);
+    const glm::vec4 target = projectionInverse * glm::vec4(d.x, d.y, 1, 1);
+    const glm::vec4 direction = viewInverse * glm::vec4(glm::normalize(glm::vec3(target)), 0);
+    return {glm::vec3(origin), CPU_RT_T_MIN, glm::vec3(direction), CPU_RT_T_MAX};
+}
+
+// The direction is not normalized, so distances along the ray stay those of world space
+static TraversalRay ToObjectSpace(const glm::mat4 &worldToObject, const TraversalRay &ray,
+                                  float tMax)
+{
+    return {glm::vec3(worldToObject * glm::vec4(ray.origin, 1.0f)), ray.tMin,
+            glm::vec3(worldToObject * glm::vec4(ray.direction, 0.0f)), tMax};
+}
+
+bool CpuRaytracer::Intersect(const TraversalRay &ray, Hit &hit) const
+{
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    float tMax = ray.tMax;
+
+    for (uint32_t instanceIndex = 0; instanceIndex < m_Instances.size(); instanceIndex++)
+    {
+        const Instance &instance = m_Instances[instanceIndex];
+        if (!IntersectBounds(instance.boundsMin, instance.boundsMax, ray.origin,
+                             inverseDirection, ray.tMin, tMax))
+        {
+            continue;
+        }
+
+        const TraversalRay objectRay = ToObjectSpace(instance.worldToObject, ray, tMax);
+        const CpuModel &model = m_Models[instance.model];
+        bool found;
+        if (m_SimdLevel == SimdLevel::AVX2)
+        {
+            found = BvhTraversal::Intersect(model.bvh8, objectRay, hit.triangle);
+        }
+        else if (m_SimdLevel == SimdLevel::SSE)
+        {
+            found = BvhTraversal::Intersect(model.bvh4, objectRay, hit.triangle);
+        }
+        else
+        {
+            found = BvhTraversal::Intersect(model.bvh, objectRay, hit.triangle);
+        }
+        if (found)
+        {
+            tMax = hit.triangle.t;
+            hit.instance = instanceIndex;
+        }
+    }
+    return hit.instance != UINT32_MAX;
+}
+
+void CpuRaytracer::IntersectPacket(const TraversalRay *rays, uint32_t count, Hit *hits) const
+{
+    for (uint32_t instanceIndex = 0; instanceIndex < m_Instances.size(); instanceIndex++)
+    {
+        const Instance &instance = m_Instances[instanceIndex];
+        bool visible = false;
+        for (uint32_t i = 0; i < count && !visible; i++)
+        {
+            const float tMax =
+                hits[i].instance != UINT32_MAX ? hits[i].triangle.t : rays[i].tMax;
+            visible = IntersectBounds(instance.boundsMin, instance.boundsMax, rays[i].origin,
+                                      1.0f / rays[i].direction, rays[i].tMin, tMax);
+        }
+        if (!visible)
+        {
+            continue;
+        }
+
+        TraversalRay objectRays[TRAVERSAL_PACKET_SIZE];
+        TraversalHit objectHits[TRAVERSAL_PACKET_SIZE];
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const float tMax =
+                hits[i].instance != UINT32_MAX ? hits[i].triangle.t : rays[i].tMax;
+            objectRays[i] = ToObjectSpace(instance.worldToObject, rays[i], tMax);
+        }
+        BvhTraversal::IntersectPacket(m_Models[instance.model].bvh, objectRays, count,
+                                      objectHits, m_SimdLevel);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (objectHits[i].triangle != UINT32_MAX)
+            {
+                hits[i] = {objectHits[i], instanceIndex};
+            }
+        }
+    }
+}
+
+void CpuRaytracer::Trace(const glm::vec3 &origin, const glm::vec3 &direction,
+                         const CpuRaytraceSettings &settings, Payload &payload) const
+{
+    Hit hit;
+    Intersect({origin, CPU_RT_T_MIN, direction, CPU_RT_T_MAX}, hit);
+    Shade(direction, hit, settings, payload);
+}
+
+void CpuRaytracer::Shade(const glm::vec3 &direction, const Hit &hit,
+                         const CpuRaytraceSettings &settings, Payload &payload) const
+{
+    payload.rays++;
+    if (hit.instance != UINT32_MAX)
+    {
+        ClosestHit(direction, hit, settings, payload);
+    }
+    else
+    {
+        Miss(direction, settings, payload);
+    }
+}
+
+void CpuRaytracer::ClosestHit(const glm::vec3 &direction, const Hit &hit,
+                              const CpuRaytraceSettings &settings, Payload &payload) const
+{
+    const Instance &instance = m_Instances[hit.instance];
+    const CpuModel &model = m_Models[instance.model];
+    const uint32_t *indices = model.bvh.indices.data() + size_t(hit.triangle.triangle) * 3;
+    const Vertex &v0 = model.mesh.vertices[indices[0]];
+    const Vertex &v1 = model.mesh.vertices[indices[1]];
+    const Vertex &v2 = model.mesh.vertices[indices[2]];
+    const float u = hit.triangle.u;
+    const float v = hit.triangle.v;
+    const glm::vec3 barycentrics(1.0f - u - v, u, v);
+
+    // Computing the normal and the coordinates of the hit position
+    glm::vec3 normal =
+        v0.norm * barycentrics.x + v1.norm * barycentrics.y + v2.norm * barycentrics.z;
+    glm::vec3 worldPos =
+        v0.pos * barycentrics.x + v1.pos * barycentrics.y + v2.pos * barycentrics.z;
+    // Transforming them to world space
+    worldPos = glm::vec3(instance.modelMatrix * glm::vec4(worldPos, 1.0f));
+    normal = glm::normalize(glm::vec3(instance.modelMatrixIT * glm::vec4(normal, 0.0f)));
+
+    // Vector toward the light
+    glm::vec3 L;
+    float lightIntensity = settings.lightIntensity;
+    if (settings.lightType == 0)
+    {
+        const glm::vec3 lDir = settings.lightPosition - worldPos;
+        const float lightDistance = glm::length(lDir);
+        lightIntensity = settings.lightIntensity / (lightDistance * lightDistance);
+        L = glm::normalize(lDir);
+    }
+    else
+    {
+        L = glm::normalize(settings.lightPosition);
+    }
+
+    static const Material defaultMaterial;
+    const auto &materials = model.mesh.materials;
+    const Material &mat = v0.matID >= 0 && v0.matID < static_cast<int>(materials.size())
+                              ? materials[v0.matID]
+                              : defaultMaterial;
+
+    // Diffuse
+    glm::vec3 diffuse = mat.ambient + mat.diffuse * std::max(glm::dot(normal, L), 0.0f);
+    if (mat.textureID >= 0 && mat.textureID < static_cast<int>(model.textures.size()))
+    {
+        const glm::vec2 texCoord = v0.texCoord * barycentrics.x + v1.texCoord * barycentrics.y +
+                                   v2.texCoord * barycentrics.z;
+        const glm::vec2 materialTexCoord =
+            glm::vec2(mat.textureTransform.z, mat.textureTransform.w) +
+            texCoord * glm::vec2(mat.textureTransform.x, mat.textureTransform.y);
+        diffuse *= SampleSrgb(model.textures[mat.textureID], materialTexCoord, false);
+    }
+
+    // Specular
+    glm::vec3 specular(0.0f);
+    if (mat.illum >= 2)
+    {
+        const float kShininess = std::max(mat.shininess, 4.0f);
+        const float kEnergyConservation = (2.0f + kShininess) / (2.0f * CPU_RT_PI);
+        const glm::vec3 V = glm::normalize(-direction);
+        const glm::vec3 H = glm::normalize(L + V);
+        specular = mat.specular * kEnergyConservation *
+                   std::pow(std::max(glm::dot(normal, H), 0.0f), kShininess);
+    }
+
+    if (mat.illum == 3 && payload.depth < CPU_RT_MAX_DEPTH)
+    {
+        payload.attenuation *= mat.specular;
+        payload.depth++;
+
+        const glm::vec3 V = -glm::normalize(direction);
+        const float F = FresnelSchlick(std::max(glm::dot(normal, V), 0.0f), settings.F0);
+        const float NdotD = glm::dot(normal, direction);
+
+        // Leaving the surface from inside flips the normal and the ratio of the indices
+        const glm::vec3 refrNormal = NdotD > 0.0f ? -normal : normal;
+        const float refrIndex = NdotD > 0.0f ? settings.ni : 1.0f / settings.ni;
+        Trace(worldPos, glm::refract(direction, refrNormal, refrIndex), settings, payload);
+        const glm::vec3 refrColor = payload.hitValue;
+
+        if (NdotD < 0.0f)
+        {
+            Trace(worldPos, glm::reflect(direction, normal), settings, payload);
+            payload.hitValue = F * payload.hitValue + (1.0f - F) * refrColor;
+        }
+        payload.depth--;
+    }
+    else
+    {
+        payload.hitValue = lightIntensity * (diffuse + specular) * payload.attenuation;
+    }
+}
+
+void CpuRaytracer::Miss(const glm::vec3 &direction, const CpuRaytraceSettings &settings,
+                        Payload &payload) const
+{
+    // asin of a direction a rounding error longer than one would be undefined
+    glm::vec2 texCoord;
+    texCoord.x = 0.5f + std::atan2(direction.z, direction.x) / (2.0f * CPU_RT_PI);
+    texCoord.y = 0.5f - std::asin(glm::clamp(direction.y, -1.0f, 1.0f)) / CPU_RT_PI;
+
+    glm::vec3 envColor(0.0f);
+    if (settings.hdr && !m_Skyspheres.hdrEquirect.levels.empty())
+    {
+        envColor = SampleEnvironment(m_Skyspheres.hdrEquirect, texCoord, true);
+        envColor = glm::pow(envColor, glm::vec3(0.6f));
+    }
+    else if (!settings.hdr && !m_Skyspheres.skysphere.levels.empty())
+    {
+        envColor = SampleSrgb(m_Skyspheres.skysphere, texCoord, true);
+    }
+    payload.hitValue = envColor * payload.attenuation;
+}
+
+void CpuRaytracer::Render(const glm::mat4 &viewInverse, const glm::mat4 &projectionInverse,
+                          uint32_t width, uint32_t height, const CpuRaytraceSettings &settings,
+                          std::vector<float> &image, CpuRaytraceStats *stats) const
+{
+    Timer timer;
+    image.assign(size_t(width) * height * 3, 0.0f);
+
+    const uint32_t tilesX = (width + CPU_RT_TILE_SIZE - 1) / CPU_RT_TILE_SIZE;
+    const uint32_t tilesY = (height + CPU_RT_TILE_SIZE - 1) / CPU_RT_TILE_SIZE;
+    std::atomic<uint64_t> rays{0};
+
+    ThreadPool::Get().ParallelFor(size_t(tilesX) * tilesY, [&](size_t tile) {
+        const uint32_t beginX = static_cast<uint32_t>(tile % tilesX) * CPU_RT_TILE_SIZE;
+        const uint32_t beginY = static_cast<uint32_t>(tile / tilesX) * CPU_RT_TILE_SIZE;
+        const uint32_t endX = std::min(beginX + CPU_RT_TILE_SIZE, width);
+        const uint32_t endY = std::min(beginY + CPU_RT_TILE_SIZE, height);
+        Payload payload;
+
+        // The primary rays of each 4x4 block and sample are traced as one packet, their
+        // secondary rays one by one
+        for (uint32_t packetY = beginY; packetY < endY; packetY += CPU_RT_PACKET_HEIGHT)
+        {
+            for (uint32_t packetX = beginX; packetX < endX; packetX += CPU_RT_PACKET_WIDTH)
+            {
+                uint32_t pixels[TRAVERSAL_PACKET_SIZE];
+                uint32_t count = 0;
+                for (uint32_t y = packetY; y < std::min(packetY + CPU_RT_PACKET_HEIGHT, endY); y++)
+                {
+                    for (uint32_t x = packetX; x < std::min(packetX + CPU_RT_PACKET_WIDTH, endX);
+                         x++)
+                    {
+                        pixels[count++] = y * width + x;
+                    }
+                }
+
+                for (uint32_t smpl = 0; smpl < settings.samples; smpl++)
+                {
+                    TraversalRay primaryRays[TRAVERSAL_PACKET_SIZE];
+                    Hit hits[TRAVERSAL_PACKET_SIZE];
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        primaryRays[i] = GetPrimaryRay(viewInverse, projectionInverse,
+                                                       pixels[i] % width, pixels[i] / width,
+                                                       width, height, smpl);
+                    }
+                    IntersectPacket(primaryRays, count, hits);
+
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        payload.depth = 0;
+                        payload.hitValue = glm::vec3(0.0f);
+                        payload.attenuation = glm::vec3(1.0f);
+                        Shade(primaryRays[i].direction, hits[i], settings, payload);
+
+                        // The running average of the storage image
+                        float *texel = image.data() + size_t(pixels[i]) * 3;
+                        const glm::vec3 color =
+                            smpl == 0 ? payload.hitValue
+                                      : glm::mix(glm::vec3(texel[0], texel[1], texel[2]),
+                                                 payload.hitValue, 1.0f / (smpl + 1));
+                        std::copy(&color.x, &color.x + 3, texel);
+                    }
+                }
+            }
+        }
+        rays += payload.rays;
+    });
+
+    if (stats)
+    {
+        stats->rays = rays;
+        stats->milliseconds = timer.ElapsedMillis();
+    }
+}
+
+void CpuRaytracer::ToDisplay(const std::vector<float> &image, std::vector<uint8_t> &pixels)
+{
+    pixels.resize(image.size());
+    for (size_t i = 0; i < image.size(); i++)
+    {
+        // Also clears NaNs, which the GPU writes as black as well
+        const float linear = image[i] > 0.0f ? image[i] : 0.0f;
+        const float c = std::pow(linear, 1.0f / 2.2f);
+        pixels[i] = static_cast<uint8_t>(std::min(c, 1.0f) * 255.0f + 0.5f);
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "BvhTraversal.h"
+#include "BvhUpdater.h"
+
+// Push constants of the ray tracing shaders, the defaults are those of Sandbox3D
+struct CpuRaytraceSettings
+{
+    glm::vec3 lightPosition = glm::vec3(-20.0f, 20.0f, 9.88f);
+    float lightIntensity = 100.0f;
+    // 0 for a point light, otherwise the light is directional
+    int lightType = 0;
+    uint32_t samples = 1;
+    // Misses sample the HDR environment instead of the skysphere
+    bool hdr = false;
+    float ni = 1.0f;
+    float F0 = 0.1f;
+};
+
+struct CpuRaytraceStats
+{
+    // Every trace call, primary and secondary
+    uint64_t rays = 0;
+    float milliseconds = 0.0f;
+
+    double GetMraysPerSecond() const
+    {
+        return milliseconds > 0.0f ? rays / (milliseconds * 1000.0) : 0.0;
+    }
+};
+
+struct CpuModel
+{
+    MeshData mesh;
+    Bvh bvh;
+    // Built bvh and refits or rebuilds it when UpdateModel moves the vertices
+    BvhUpdater updater;
+    // Collapsed from bvh for the single ray kernel of the SIMD level, the other one stays empty
+    WideBvh4 bvh4;
+    WideBvh8 bvh8;
+    // Indexed like the textures of the mesh, only the largest level is sampled
+    std::vector<MipChain> textures;
+};
+
+// Reference for raytrace_rgen, raytrace_rchit and raytrace_rmiss that runs without the ray
+// tracing extension. The shaders are followed step by step: the tea seeded lcg jitter, the
+// lighting, the Fresnel weighted refraction and reflection of illum 3 materials up to depth 5 and
+// the equirectangular sky, all sharing one payload per sample like traceNV does. Instances are
+// tested one after another against their world bounds and then traced through the BVH of their
+// model in object space. The image is split into tiles the thread pool renders in any order.
+//
+// The primary rays of each 4x4 block of pixels go through the binary BVH as a packet, the rays
+// the hits spawn are traced alone through the 4 or 8 wide BVH of the SIMD level.
+class CpuRaytracer
+{
+  public:
+    explicit CpuRaytracer(SimdLevel simdLevel = BvhTraversal::GetSimdLevel())
+        : m_SimdLevel(simdLevel)
+    {
+    }
+
+    // Builds the BVH of the mesh and loads its textures, returns the index instances refer to
+    uint32_t AddModel(MeshData mesh, const BvhSettings &settings = {});
+    // Models are added in order, so ObjInstance::objModelIndex matches ObjModel::LoadModels
+    void LoadModels(const std::vector<std::string> &filenames, const BvhSettings &settings = {});
+    void SetInstances(const std::vector<ObjInstance> &instances);
+    // Replaces the vertices of a model with as many moved ones and brings its BVHs and the bounds
+    // of its instances up to date. Moving instances only takes SetInstances, no BVH changes then.
+    const BvhUpdateStats &UpdateModel(uint32_t index, std::vector<Vertex> vertices);
+    // Decodes the same skysphere and HDR environment as ObjModel::LoadSkysphereSources, the
+    // cubemap is never baked since misses always use the equirectangular map
+    void LoadSkyspheres(const EnvironmentBakeSettings &settings = {});
+
+    const CpuModel &GetModel(uint32_t index) const
+    {
+        return m_Models[index];
+    }
+
+    // Fills width * height linear RGB texels, top row first like the storage image of
+    // raytrace_rgen
+    void Render(const glm::mat4 &viewInverse, const glm::mat4 &projectionInverse, uint32_t width,
+                uint32_t height, const CpuRaytraceSettings &settings, std::vector<float> &image,
+                CpuRaytraceStats *stats = nullptr) const;
+
+    // The ray raytrace_rgen starts for one sample of a pixel
+    static TraversalRay GetPrimaryRay(const glm::mat4 &viewInverse,
+                                      const glm::mat4 &projectionInverse, uint32_t x, uint32_t y,
+                                      uint32_t width, uint32_t height, uint32_t sample);
+
+    // Applies the gamma of shader_post_frag and rounds to RGB8 the way the UNORM swapchain does
+    static void ToDisplay(const std::vector<float> &image, std::vector<uint8_t> &pixels);
+
+  private:
+    struct Instance
+    {
+        uint32_t model;
+        glm::mat4 modelMatrix;
+        glm::mat4 modelMatrixIT;
+        glm::mat4 worldToObject;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    struct Hit;
+    struct Payload;
+
+    // Collapses the wide BVH the SIMD level traces from the binary one
+    void BuildWideBvh(CpuModel &model) const;
+    void FitInstanceBounds(Instance &instance) const;
+
+    bool Intersect(const TraversalRay &ray, Hit &hit) const;
+    // Rays of a packet that hit nothing keep their hits
+    void IntersectPacket(const TraversalRay *rays, uint32_t count, Hit *hits) const;
+    void Trace(const glm::vec3 &origin, const glm::vec3 &direction,
+               const CpuRaytraceSettings &settings, Payload &payload) const;
+    // Runs the closest hit or the miss shader of a traced ray
+    void Shade(const glm::vec3 &direction, const Hit &hit, const CpuRaytraceSettings &settings,
+               Payload &payload) const;
+    void ClosestHit(const glm::vec3 &direction, const Hit &hit,
+                    const CpuRaytraceSettings &settings, Payload &payload) const;
+    void Miss(const glm::vec3 &direction, const CpuRaytraceSettings &settings,
+              Payload &payload) const;
+
+  private:
+    SimdLevel m_SimdLevel;
+    std::vector<CpuModel> m_Models;
+    std::vector<Instance> m_Instances;
+    SkysphereSources m_Skyspheres;
+};
@@ -0,0 +1,1048 @@
+#include "vkpch.h"
+
+#include "GltfFile.h"
+
+#include "Core/ThreadPool.h"
+#include "Tools/Json.h"
+
+#include "NormalGenerator.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+
+#define GLB_MAGIC 0x46546C67 // "glTF"
+#define GLB_VERSION 2
+#define GLB_HEADER_SIZE 12
+#define GLB_CHUNK_HEADER_SIZE 8
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN 0x004E4942  // "BIN\0"
+
+#define GLTF_MODE_TRIANGLES 4
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_ARRAY_BUFFER 34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+
+#define GLTF_EMBEDDED_IMAGE "#image"
+#define GLTF_VERTICES_PER_TASK (1 << 14)
+
+struct GlbChunks
+{
+    const char *json = nullptr;
+    size_t jsonSize = 0;
+    const uint8_t *binary = nullptr;
+    size_t binarySize = 0;
+};
+
+struct GltfAccessor
+{
+    const uint8_t *data = nullptr;
+    uint32_t count = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+    uint32_t stride = 0;
+    bool normalized = false;
+};
+
+struct GltfPrimitive
+{
+    GltfAccessor positions;
+    GltfAccessor normals;
+    GltfAccessor texCoords;
+    GltfAccessor colors;
+    GltfAccessor indices;
+    bool indexed = false;
+    int material = 0;
+    // Accessor indices of the attributes, equal for primitives sharing their vertices
+    std::array<uint32_t, 4> attributes;
+};
+
+static uint32_t Read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static bool ReadGlb(const uint8_t *data, size_t size, GlbChunks &chunks, std::string &error)
+{
+    if (size < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE || Read32(data) != GLB_MAGIC)
+    {
+        error = "not a binary glTF file";
+        return false;
+    }
+    if (Read32(data + 4) != GLB_VERSION)
+    {
+        error = "unsupported glTF version";
+        return false;
+    }
+    const size_t length = std::min<size_t>(Read32(data + 8), size);
+
+    // The JSON chunk comes first, the binary chunk is optional and unknown chunks are skipped
+    size_t offset = GLB_HEADER_SIZE;
+    while (offset + GLB_CHUNK_HEADER_SIZE <= length)
+    {
+        const size_t chunkSize = Read32(data + offset);
+        const uint32_t chunkType = Read32(data + offset + 4);
+        offset += GLB_CHUNK_HEADER_SIZE;
+        if (chunkSize > length - offset)
+        {
+            error = "truncated chunk";
+            return false;
+        }
+        if (chunkType == GLB_CHUNK_JSON && !chunks.json)
+        {
+            chunks.json = reinterpret_cast<const char *>(data + offset);
+            chunks.jsonSize = chunkSize;
+        }
+        else if (chunkType == GLB_CHUNK_BIN && !chunks.binary)
+        {
+            chunks.binary = data + offset;
+            chunks.binarySize = chunkSize;
+        }
+        offset += (chunkSize + 3) & ~size_t(3);
+    }
+    if (!chunks.json)
+    {
+        error = "missing JSON chunk";
+        return false;
+    }
+    return true;
+}
+
+// Byte range of a buffer view, only the buffer of the binary chunk is supported
+static bool GetBufferView(const JsonValue &document, uint32_t index, const uint8_t *binary,
+                          size_t binarySize, const uint8_t *&data, size_t &size,
+                          uint32_t &stride, std::string &error)
+{
+    const JsonValue &view = document["bufferViews"][index];
+    const uint32_t buffer = view["buffer"].GetIndex();
+    if (view.IsNull() || buffer == UINT32_MAX)
+    {
+        error = "invalid buffer view";
+        return false;
+    }
+    if (buffer != 0 || document["buffers"][buffer].Has("uri") || !binary)
+    {
+        error = "only the buffer of the binary chunk is supported";
+        return false;
+    }
+    const double offset = view["byteOffset"].GetNumber();
+    const double length = view["byteLength"].GetNumber(-1.0);
+    if (offset < 0.0 || length < 0.0 || offset + length > static_cast<double>(binarySize))
+    {
+        error = "buffer view outside of the buffer";
+        return false;
+    }
+    data = binary + static_cast<size_t>(offset);
+    size = static_cast<size_t>(length);
+    stride = view["byteStride"].GetIndex(0);
+    return true;
+}
+
+static uint32_t GetComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE:
+        return 1;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t GetComponentCount(const std::string &type)
+{
+    if (type == "SCALAR")
+    {
+        return 1;
+    }
+    if (type == "VEC2")
+    {
+        return 2;
+    }
+    if (type == "VEC3")
+    {
+        return 3;
+    }
+    return type == "VEC4" ? 4 : 0;
+}
+
+static bool GetAccessor(const JsonValue &document, uint32_t index, const uint8_t *binary,
+                        size_t binarySize, GltfAccessor &accessor, std::string &error)
+{
+    const JsonValue &json = document["accessors"][index];
+    if (json.IsNull())
+    {
+        error = "invalid accessor";
+        return false;
+    }
+    if (json.Has("sparse") || !json.Has("bufferView"))
+    {
+        error = "sparse accessors and accessors without a buffer view are not supported";
+        return false;
+    }
+
+    const uint8_t *viewData;
+    size_t viewSize;
+    uint32_t viewStride;
+    if (!GetBufferView(document, json["bufferView"].GetIndex(), binary, binarySize, viewData,
+                       viewSize, viewStride, error))
+    {
+        return false;
+    }
+
+    accessor.componentType = json["componentType"].GetIndex(0);
+    accessor.components = GetComponentCount(json["type"].GetString());
+    accessor.count = json["count"].GetIndex(0);
+    accessor.normalized = json["normalized"].GetBool();
+    const uint32_t componentSize = GetComponentSize(accessor.componentType);
+    const uint32_t elementSize = componentSize * accessor.components;
+    accessor.stride = viewStride ? viewStride : elementSize;
+    const size_t offset = json["byteOffset"].GetIndex(0);
+    if (elementSize == 0 || offset % componentSize != 0 || accessor.stride % componentSize != 0)
+    {
+        error = "invalid accessor layout";
+        return false;
+    }
+    if (accessor.count > 0 &&
+        (offset > viewSize || viewSize - offset < elementSize ||
+         (viewSize - offset - elementSize) / accessor.stride < accessor.count - 1))
+    {
+        error = "accessor outside of its buffer view";
+        return false;
+    }
+    accessor.data = viewData + offset;
+    return true;
+}
+
+static inline float ReadComponent(const uint8_t *data, uint32_t componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case GLTF_FLOAT: {
+        float value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    case GLTF_UNSIGNED_BYTE:
+        return normalized ? data[0] / 255.0f : data[0];
+    case GLTF_BYTE: {
+        const int8_t value = static_cast<int8_t>(data[0]);
+        return normalized ? std::max(value / 127.0f, -1.0f) : value;
+    }
+    case GLTF_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, data, sizeof(value));
+        return normalized ? value / 65535.0f : value;
+    }
+    case GLTF_SHORT: {
+        int16_t value;
+        memcpy(&value, data, sizeof(value));
+        return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+    }
+    default:
+        return static_cast<float>(Read32(data));
+    }
+}
+
+// Components past the element's own read as 0
+static inline glm::vec4 ReadElement(const GltfAccessor &accessor, size_t index)
+{
+    const uint8_t *element = accessor.data + index * accessor.stride;
+    const uint32_t componentSize = GetComponentSize(accessor.componentType);
+    glm::vec4 value(0.0f);
+    for (uint32_t c = 0; c < accessor.components; c++)
+    {
+        value[c] = ReadComponent(element + c * componentSize, accessor.componentType,
+                                 accessor.normalized);
+    }
+    return value;
+}
+
+static inline uint32_t ReadIndex(const GltfAccessor &accessor, size_t index)
+{
+    const uint8_t *element = accessor.data + index * accessor.stride;
+    switch (accessor.componentType)
+    {
+    case GLTF_UNSIGNED_BYTE:
+        return element[0];
+    case GLTF_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default:
+        return Read32(element);
+    }
+}
+
+static bool IsTightFloat3(const GltfAccessor &accessor)
+{
+    return accessor.componentType == GLTF_FLOAT && accessor.components == 3 &&
+           accessor.stride == sizeof(glm::vec3) &&
+           reinterpret_cast<uintptr_t>(accessor.data) % alignof(glm::vec3) == 0;
+}
+
+static bool ReadPrimitive(const JsonValue &document, const JsonValue &json, const uint8_t *binary,
+                          size_t binarySize, int defaultMaterial, GltfPrimitive &primitive,
+                          std::string &error)
+{
+    const JsonValue &attributes = json["attributes"];
+    const char *names[4] = {"POSITION", "NORMAL", "TEXCOORD_0", "COLOR_0"};
+    GltfAccessor *accessors[4] = {&primitive.positions, &primitive.normals, &primitive.texCoords,
+                                  &primitive.colors};
+    for (int i = 0; i < 4; i++)
+    {
+        primitive.attributes[i] = attributes[names[i]].GetIndex();
+        if (primitive.attributes[i] != UINT32_MAX &&
+            !GetAccessor(document, primitive.attributes[i], binary, binarySize, *accessors[i],
+                         error))
+        {
+            return false;
+        }
+    }
+    if (primitive.attributes[0] == UINT32_MAX || primitive.positions.components != 3 ||
+        primitive.positions.componentType != GLTF_FLOAT)
+    {
+        error = "primitive without float positions";
+        return false;
+    }
+    if (primitive.normals.data &&
+        (primitive.normals.components != 3 || primitive.normals.componentType != GLTF_FLOAT))
+    {
+        error = "invalid normal accessor";
+        return false;
+    }
+    if ((primitive.normals.data && primitive.normals.count < primitive.positions.count) ||
+        (primitive.texCoords.data && primitive.texCoords.count < primitive.positions.count) ||
+        (primitive.colors.data && primitive.colors.count < primitive.positions.count))
+    {
+        error = "attribute accessors of a primitive differ in count";
+        return false;
+    }
+
+    primitive.indexed = json.Has("indices");
+    if (primitive.indexed)
+    {
+        if (!GetAccessor(document, json["indices"].GetIndex(), binary, binarySize,
+                         primitive.indices, error))
+        {
+            return false;
+        }
+        if (primitive.indices.components != 1 ||
+            primitive.indices.componentType == GLTF_BYTE ||
+            primitive.indices.componentType == GLTF_SHORT ||
+            primitive.indices.componentType == GLTF_FLOAT)
+        {
+            error = "invalid index accessor";
+            return false;
+        }
+    }
+
+    const uint32_t material = json["material"].GetIndex();
+    primitive.material = material < static_cast<uint32_t>(defaultMaterial)
+                             ? static_cast<int>(material)
+                             : defaultMaterial;
+    return true;
+}
+
+static uint32_t GetIndexCount(const GltfPrimitive &primitive)
+{
+    const uint32_t count = primitive.indexed ? primitive.indices.count : primitive.positions.count;
+    return count - count % 3;
+}
+
+static bool CheckIndices(const GltfPrimitive &primitive, std::string &error)
+{
+    if (!primitive.indexed)
+    {
+        return true;
+    }
+    const uint32_t indexCount = GetIndexCount(primitive);
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        if (ReadIndex(primitive.indices, i) >= primitive.positions.count)
+        {
+            error = "index out of range";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Missing colors are white like those of OBJ vertices without one
+static void ReadVertices(const GltfPrimitive &primitive, Vertex *vertices)
+{
+    const size_t count = primitive.positions.count;
+    const size_t blocks = (count + GLTF_VERTICES_PER_TASK - 1) / GLTF_VERTICES_PER_TASK;
+    ThreadPool::Get().ParallelFor(blocks, [&](size_t block) {
+        const size_t last = std::min(count, (block + 1) * GLTF_VERTICES_PER_TASK);
+        for (size_t i = block * GLTF_VERTICES_PER_TASK; i < last; i++)
+        {
+            Vertex &vertex = vertices[i];
+            vertex.pos = glm::vec3(ReadElement(primitive.positions, i));
+            vertex.norm = primitive.normals.data ? glm::vec3(ReadElement(primitive.normals, i))
+                                                 : glm::vec3(0.0f);
+            vertex.color = primitive.colors.data ? glm::vec3(ReadElement(primitive.colors, i))
+                                                 : glm::vec3(1.0f);
+            vertex.texCoord = primitive.texCoords.data
+                                  ? glm::vec2(ReadElement(primitive.texCoords, i))
+                                  : glm::vec2(0.0f);
+            vertex.matID = primitive.material;
+        }
+    });
+}
+
+// Generates the normals of a primitive over its welded positions, so that vertices split at
+// texture seams are still smoothed across them, and welds the corners again
+static void AppendWithNormals(const GltfPrimitive &primitive,
+                              const NormalSettings &normalSettings, std::vector<Vertex> &vertices,
+                              std::vector<uint32_t> &indices)
+{
+    std::vector<Vertex> source(primitive.positions.count);
+    ReadVertices(primitive, source.data());
+
+    std::vector<uint32_t> order(source.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    const auto less = [&](uint32_t a, uint32_t b) {
+        const glm::vec3 &p = source[a].pos;
+        const glm::vec3 &q = source[b].pos;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+    std::vector<uint32_t> positionIds(source.size());
+    std::vector<float> positions;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (i == 0 || less(order[i - 1], order[i]))
+        {
+            const glm::vec3 &p = source[order[i]].pos;
+            positions.insert(positions.end(), {p.x, p.y, p.z});
+        }
+        positionIds[order[i]] = static_cast<uint32_t>(positions.size() / 3 - 1);
+    }
+
+    const uint32_t indexCount = GetIndexCount(primitive);
+    std::vector<Vertex> corners(indexCount);
+    std::vector<uint32_t> cornerPositions(indexCount);
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        const uint32_t index = primitive.indexed ? ReadIndex(primitive.indices, i) : i;
+        corners[i] = source[index];
+        cornerPositions[i] = positionIds[index];
+    }
+    NormalGenerator::Generate(positions.data(), positions.size() / 3, cornerPositions.data(),
+                              indexCount / 3, normalSettings, corners.data());
+
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(source.size());
+    for (const auto &vertex : corners)
+    {
+        auto it = uniqueVertices.find(vertex);
+        if (it == uniqueVertices.end())
+        {
+            it = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size())).first;
+            vertices.push_back(vertex);
+        }
+        indices.push_back(it->second);
+    }
+}
+
+std::string GltfFile::GetImagePath(const std::string &filePath, uint32_t image)
+{
+    return filePath + GLTF_EMBEDDED_IMAGE + std::to_string(image);
+}
+
+bool GltfFile::IsEmbeddedImage(const std::string &path)
+{
+    const size_t marker = path.rfind(GLTF_EMBEDDED_IMAGE);
+    const size_t digits = marker + strlen(GLTF_EMBEDDED_IMAGE);
+    if (marker == std::string::npos || marker < 4 || digits == path.size() ||
+        path.find_first_not_of("0123456789", digits) != std::string::npos)
+    {
+        return false;
+    }
+    std::string extension = path.substr(marker - 4, 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](char c) { return static_cast<char>(tolower(c)); });
+    return extension == ".glb";
+}
+
+std::string GltfFile::GetContainerPath(const std::string &path)
+{
+    return IsEmbeddedImage(path) ? path.substr(0, path.rfind(GLTF_EMBEDDED_IMAGE)) : path;
+}
+
+bool GltfFile::OpenImage(const std::string &path, MappedFile &file, const uint8_t *&data,
+                         size_t &size, size_t readSize)
+{
+    if (!file.Open(GetContainerPath(path), IsEmbeddedImage(path) ? SIZE_MAX : readSize))
+    {
+        return false;
+    }
+    if (!IsEmbeddedImage(path))
+    {
+        data = file.GetData();
+        size = file.GetSize();
+        return true;
+    }
+    const uint32_t image = static_cast<uint32_t>(
+        std::stoul(path.substr(path.rfind(GLTF_EMBEDDED_IMAGE) + strlen(GLTF_EMBEDDED_IMAGE))));
+
+    GlbChunks chunks;
+    JsonValue document;
+    std::string error;
+    uint32_t stride;
+    return ReadGlb(file.GetData(), file.GetSize(), chunks, error) &&
+           JsonValue::Parse(chunks.json, chunks.jsonSize, document, error) &&
+           GetBufferView(document, document["images"][image]["bufferView"].GetIndex(),
+                         chunks.binary, chunks.binarySize, data, size, stride, error);
+}
+
+bool GltfFile::Open(const std::string &filePath, std::string &error,
+                    const NormalSettings &normalSettings)
+{
+    *this = GltfFile();
+    if (!m_File.Open(filePath))
+    {
+        error = "cannot open " + filePath;
+        return false;
+    }
+
+    GlbChunks chunks;
+    JsonValue document;
+    if (!ReadGlb(m_File.GetData(), m_File.GetSize(), chunks, error) ||
+        !JsonValue::Parse(chunks.json, chunks.jsonSize, document, error))
+    {
+        return false;
+    }
+    m_Binary = chunks.binary;
+    m_BinarySize = chunks.binarySize;
+    // Required extensions change how the data is stored, so none can be ignored
+    if (document["extensionsRequired"].GetSize() > 0)
+    {
+        error = "required extension " + document["extensionsRequired"][0].GetString() +
+                " is not supported";
+        return false;
+    }
+
+    ReadMaterials(document, filePath);
+
+    // Views are only taken once every mesh is in place
+    const JsonValue &meshes = document["meshes"];
+    m_Meshes.resize(meshes.GetSize());
+    for (size_t i = 0; i < m_Meshes.size(); i++)
+    {
+        if (!ReadMesh(document, meshes[i], normalSettings, m_Meshes[i], error))
+        {
+            return false;
+        }
+    }
+    for (auto &mesh : m_Meshes)
+    {
+        MeshView &view = mesh.view;
+        if (!view.vertices)
+        {
+            view.vertices = mesh.vertices.data();
+            view.verticesCount = static_cast<uint32_t>(mesh.vertices.size());
+        }
+        if (!view.indices)
+        {
+            view.indices = mesh.indices.data();
+            view.indicesCount = static_cast<uint32_t>(mesh.indices.size());
+        }
+        view.materials = m_Materials.data();
+        view.materialsCount = static_cast<uint32_t>(m_Materials.size());
+        view.textures = m_Textures;
+        view.textureDirectory = "";
+        view.normalSettings = normalSettings;
+
+        m_Stats.meshes++;
+        m_Stats.inPlaceIndices += mesh.indices.empty() && view.indicesCount > 0;
+        m_Stats.inPlacePositions += view.positions != nullptr;
+        m_Stats.verticesCount += view.verticesCount;
+        m_Stats.indicesCount += view.indicesCount;
+    }
+
+    ReadInstances(document);
+    return true;
+}
+
+bool GltfFile::ReadMaterials(const JsonValue &document, const std::string &filePath)
+{
+    const std::string baseDir = std::filesystem::path(filePath).parent_path().generic_string();
+    const JsonValue &images = document["images"];
+    const JsonValue &textures = document["textures"];
+    for (size_t i = 0; i < textures.GetSize(); i++)
+    {
+        // Unusable images give the fallback texture
+        const uint32_t source = textures[i]["source"].GetIndex();
+        const JsonValue &image = images[source];
+        std::string path;
+        if (image.Has("bufferView"))
+        {
+            path = GetImagePath(filePath, source);
+        }
+        else if (image.Has("uri") && image["uri"].GetString().compare(0, 5, "data:") != 0)
+        {
+            path = (std::filesystem::path(baseDir) / image["uri"].GetString()).generic_string();
+        }
+        m_Textures.push_back(path);
+    }
+
+    // Blinn-Phong approximation of the metallic-roughness model. The specular color blends from
+    // the dielectric 4% reflectance to the base color with the metalness, and the exponent gives
+    // a lobe about as wide as the GGX lobe of the roughness.
+    const JsonValue &materials = document["materials"];
+    for (size_t i = 0; i < materials.GetSize(); i++)
+    {
+        const JsonValue &json = materials[i];
+        const JsonValue &pbr = json["pbrMetallicRoughness"];
+        glm::vec4 baseColor(1.0f);
+        for (int c = 0; c < 4; c++)
+        {
+            baseColor[c] = static_cast<float>(pbr["baseColorFactor"][c].GetNumber(1.0));
+        }
+        const float metallic = static_cast<float>(pbr["metallicFactor"].GetNumber(1.0));
+        const float roughness = static_cast<float>(pbr["roughnessFactor"].GetNumber(1.0));
+        const float alpha = std::max(roughness * roughness, 1e-3f);
+
+        Material material;
+        material.diffuse = glm::vec3(baseColor) * (1.0f - metallic);
+        material.specular = glm::mix(glm::vec3(0.04f), glm::vec3(baseColor), metallic);
+        material.ambient = 0.1f * glm::vec3(baseColor);
+        for (int c = 0; c < 3; c++)
+        {
+            material.emission[c] = static_cast<float>(json["emissiveFactor"][c].GetNumber());
+        }
+        material.shininess = std::min(2.0f / (alpha * alpha) - 2.0f, 10000.0f);
+        material.ior = static_cast<float>(
+            json["extensions"]["KHR_materials_ior"]["ior"].GetNumber(1.5));
+        material.dissolve = json["alphaMode"].GetString() == "BLEND" ? baseColor.a : 1.0f;
+        // Smooth metals reflect like the mirror illumination model of OBJ
+        material.illum = metallic >= 0.5f && roughness <= 0.2f ? 3 : 2;
+        const uint32_t texture = pbr["baseColorTexture"]["index"].GetIndex();
+        material.textureID = texture < m_Textures.size() ? static_cast<int>(texture) : -1;
+        m_Materials.push_back(material);
+    }
+
+    // Taken by primitives without a material
+    Material fallback;
+    fallback.textureID = -1;
+    m_Materials.push_back(fallback);
+    return true;
+}
+
+bool GltfFile::ReadMesh(const JsonValue &document, const JsonValue &gltfMesh,
+                        const NormalSettings &normalSettings, Mesh &mesh,
+                        std::string &error) const
+{
+    const int defaultMaterial = static_cast<int>(m_Materials.size()) - 1;
+    std::vector<GltfPrimitive> primitives;
+    const JsonValue &jsonPrimitives = gltfMesh["primitives"];
+    for (size_t i = 0; i < jsonPrimitives.GetSize(); i++)
+    {
+        const JsonValue &json = jsonPrimitives[i];
+        if (json["mode"].GetIndex(GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES)
+        {
+            continue;
+        }
+        GltfPrimitive primitive;
+        if (!ReadPrimitive(document, json, m_Binary, m_BinarySize, defaultMaterial, primitive,
+                           error) ||
+            !CheckIndices(primitive, error))
+        {
+            return false;
+        }
+        primitives.push_back(primitive);
+    }
+    if (primitives.empty())
+    {
+        return true;
+    }
+
+    // Primitives that only differ in their indices and material share one vertex array, unless a
+    // vertex is used with two materials
+    bool shared = true;
+    for (const auto &primitive : primitives)
+    {
+        shared = shared && primitive.indexed && primitive.normals.data &&
+                 primitive.attributes == primitives[0].attributes;
+    }
+    if (shared)
+    {
+        const GltfPrimitive &first = primitives[0];
+        const uint32_t verticesCount = first.positions.count;
+        std::vector<int> materials(verticesCount, -1);
+        for (const auto &primitive : primitives)
+        {
+            const uint32_t indexCount = GetIndexCount(primitive);
+            for (uint32_t i = 0; i < indexCount && shared; i++)
+            {
+                int &material = materials[ReadIndex(primitive.indices, i)];
+                shared = material < 0 || material == primitive.material;
+                material = primitive.material;
+            }
+        }
+
+        if (shared)
+        {
+            mesh.vertices.resize(verticesCount);
+            ReadVertices(first, mesh.vertices.data());
+            for (uint32_t i = 0; i < verticesCount; i++)
+            {
+                mesh.vertices[i].matID = materials[i] < 0 ? first.material : materials[i];
+            }
+            if (IsTightFloat3(first.positions))
+            {
+                mesh.view.positions = reinterpret_cast<const glm::vec3 *>(first.positions.data);
+            }
+
+            // 32-bit indices that follow each other are one index buffer already
+            bool inPlace = true;
+            const uint8_t *next = primitives[0].indices.data;
+            for (const auto &primitive : primitives)
+            {
+                inPlace = inPlace && primitive.indices.componentType == GLTF_UNSIGNED_INT &&
+                          primitive.indices.stride == sizeof(uint32_t) &&
+                          primitive.indices.data == next &&
+                          GetIndexCount(primitive) == primitive.indices.count;
+                next = primitive.indices.data + sizeof(uint32_t) * primitive.indices.count;
+            }
+            if (inPlace)
+            {
+                mesh.view.indices = reinterpret_cast<const uint32_t *>(primitives[0].indices.data);
+                mesh.view.indicesCount = static_cast<uint32_t>(
+                    (next - primitives[0].indices.data) / sizeof(uint32_t));
+                return true;
+            }
+            for (const auto &primitive : primitives)
+            {
+                const uint32_t indexCount = GetIndexCount(primitive);
+                for (uint32_t i = 0; i < indexCount; i++)
+                {
+                    mesh.indices.push_back(ReadIndex(primitive.indices, i));
+                }
+            }
+            return true;
+        }
+    }
+
+    for (const auto &primitive : primitives)
+    {
+        if (!primitive.normals.data)
+        {
+            AppendWithNormals(primitive, normalSettings, mesh.vertices, mesh.indices);
+            continue;
+        }
+        const size_t base = mesh.vertices.size();
+        if (base + primitive.positions.count > UINT32_MAX)
+        {
+            error = "mesh too large";
+            return false;
+        }
+        mesh.vertices.resize(base + primitive.positions.count);
+        ReadVertices(primitive, mesh.vertices.data() + base);
+        const uint32_t indexCount = GetIndexCount(primitive);
+        for (uint32_t i = 0; i < indexCount; i++)
+        {
+            const uint32_t index = primitive.indexed ? ReadIndex(primitive.indices, i) : i;
+            mesh.indices.push_back(static_cast<uint32_t>(base + index));
+        }
+    }
+    return true;
+}
+
+static glm::mat4 GetNodeTransform(const JsonValue &node)
+{
+    const JsonValue &matrix = node["matrix"];
+    if (matrix.GetSize() == 16)
+    {
+        glm::mat4 transform;
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                transform[column][row] =
+                    static_cast<float>(matrix[size_t(4 * column + row)].GetNumber());
+            }
+        }
+        return transform;
+    }
+
+    const JsonValue &translation = node["translation"];
+    const JsonValue &rotation = node["rotation"];
+    const JsonValue &scale = node["scale"];
+    const glm::vec3 t(translation[0].GetNumber(), translation[1].GetNumber(),
+                      translation[2].GetNumber());
+    const glm::quat r(static_cast<float>(rotation[3].GetNumber(1.0)),
+                      static_cast<float>(rotation[0].GetNumber()),
+                      static_cast<float>(rotation[1].GetNumber()),
+                      static_cast<float>(rotation[2].GetNumber()));
+    const glm::vec3 s(scale[0].GetNumber(1.0), scale[1].GetNumber(1.0),
+                      scale[2].GetNumber(1.0));
+    return glm::translate(glm::mat4(1.0f), t) * glm::mat4_cast(r) *
+           glm::scale(glm::mat4(1.0f), s);
+}
+
+void GltfFile::ReadInstances(const JsonValue &document)
+{
+    const JsonValue &nodes = document["nodes"];
+    if (nodes.GetSize() == 0)
+    {
+        for (uint32_t i = 0; i < m_Meshes.size(); i++)
+        {
+            m_Instances.push_back({i, glm::mat4(1.0f)});
+        }
+        return;
+    }
+
+    // Without scenes every node that is nobody's child is a root
+    std::vector<uint32_t> roots;
+    const JsonValue &scenes = document["scenes"];
+    if (scenes.GetSize() > 0)
+    {
+        const JsonValue &sceneNodes = scenes[document["scene"].GetIndex(0)]["nodes"];
+        for (size_t i = 0; i < sceneNodes.GetSize(); i++)
+        {
+            roots.push_back(sceneNodes[i].GetIndex());
+        }
+    }
+    else
+    {
+        std::vector<bool> isChild(nodes.GetSize(), false);
+        for (size_t i = 0; i < nodes.GetSize(); i++)
+        {
+            const JsonValue &children = nodes[i]["children"];
+            for (size_t c = 0; c < children.GetSize(); c++)
+            {
+                const uint32_t child = children[c].GetIndex();
+                if (child < isChild.size())
+                {
+                    isChild[child] = true;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < isChild.size(); i++)
+        {
+            if (!isChild[i])
+            {
+                roots.push_back(i);
+            }
+        }
+    }
+
+    // Nodes form a forest, the depth limit only guards against malformed files with cycles
+    struct PendingNode
+    {
+        uint32_t node;
+        glm::mat4 parent;
+        size_t depth;
+    };
+    std::vector<PendingNode> stack;
+    for (auto it = roots.rbegin(); it != roots.rend(); it++)
+    {
+        stack.push_back({*it, glm::mat4(1.0f), 0});
+    }
+    while (!stack.empty())
+    {
+        const PendingNode pending = stack.back();
+        stack.pop_back();
+        const JsonValue &node = nodes[pending.node];
+        if (node.IsNull() || pending.depth > nodes.GetSize())
+        {
+            continue;
+        }
+        const glm::mat4 transform = pending.parent * GetNodeTransform(node);
+        const uint32_t mesh = node["mesh"].GetIndex();
+        if (mesh < m_Meshes.size() && m_Meshes[mesh].view.indicesCount > 0)
+        {
+            m_Instances.push_back({mesh, transform});
+        }
+        const JsonValue &children = node["children"];
+        for (size_t c = children.GetSize(); c-- > 0;)
+        {
+            stack.push_back({children[c].GetIndex(), transform, pending.depth + 1});
+        }
+    }
+}
+
+template <typename T> static void AppendBytes(std::vector<uint8_t> &buffer, const T &value)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+bool GltfFile::Write(const std::string &filePath, const MeshData &mesh, std::string &error)
+{
+    const size_t n = mesh.vertices.size();
+    std::vector<uint8_t> binary;
+    binary.reserve(44 * n + 4 * mesh.indices.size());
+    glm::vec3 minimum(FLT_MAX);
+    glm::vec3 maximum(-FLT_MAX);
+    for (const auto &vertex : mesh.vertices)
+    {
+        AppendBytes(binary, vertex.pos);
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
+    }
+    for (const auto &vertex : mesh.vertices)
+    {
+        AppendBytes(binary, vertex.norm);
+    }
+    for (const auto &vertex : mesh.vertices)
+    {
+        AppendBytes(binary, vertex.texCoord);
+    }
+    for (const auto &vertex : mesh.vertices)
+    {
+        AppendBytes(binary, vertex.color);
+    }
+    const size_t indicesOffset = binary.size();
+    for (uint32_t index : mesh.indices)
+    {
+        AppendBytes(binary, index);
+    }
+
+    // Runs of triangles whose first vertex has the same material
+    struct Run
+    {
+        size_t first;
+        size_t count;
+        int material;
+    };
+    std::vector<Run> runs;
+    const int materialCount = static_cast<int>(mesh.materials.size());
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        int material = mesh.vertices[mesh.indices[i]].matID;
+        material = material >= 0 && material < materialCount ? material : -1;
+        if (runs.empty() || runs.back().material != material)
+        {
+            runs.push_back({i, 0, material});
+        }
+        runs.back().count += 3;
+    }
+
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"VulkanRaytracing\"}";
+    if (!runs.empty())
+    {
+        json << ",\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}]";
+        json << ",\"buffers\":[{\"byteLength\":" << binary.size() << "}]";
+        const size_t viewOffsets[5] = {0, 12 * n, 24 * n, 32 * n, indicesOffset};
+        const size_t viewSizes[5] = {12 * n, 12 * n, 8 * n, 12 * n, 4 * mesh.indices.size()};
+        json << ",\"bufferViews\":[";
+        for (int i = 0; i < 5; i++)
+        {
+            json << (i ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << viewOffsets[i]
+                 << ",\"byteLength\":" << viewSizes[i] << ",\"target\":"
+                 << (i < 4 ? GLTF_ARRAY_BUFFER : GLTF_ELEMENT_ARRAY_BUFFER) << "}";
+        }
+        const char *types[4] = {"VEC3", "VEC3", "VEC2", "VEC3"};
+        json << "],\"accessors\":[";
+        for (int i = 0; i < 4; i++)
+        {
+            json << (i ? "," : "") << "{\"bufferView\":" << i << ",\"componentType\":"
+                 << GLTF_FLOAT << ",\"count\":" << n << ",\"type\":\"" << types[i] << "\"";
+            if (i == 0)
+            {
+                json << ",\"min\":[" << minimum.x << "," << minimum.y << "," << minimum.z
+                     << "],\"max\":[" << maximum.x << "," << maximum.y << "," << maximum.z
+                     << "]";
+            }
+            json << "}";
+        }
+        for (const auto &run : runs)
+        {
+            json << ",{\"bufferView\":4,\"byteOffset\":" << 4 * run.first
+                 << ",\"componentType\":" << GLTF_UNSIGNED_INT << ",\"count\":" << run.count
+                 << ",\"type\":\"SCALAR\"}";
+        }
+        json << "],\"meshes\":[{\"primitives\":[";
+        for (size_t i = 0; i < runs.size(); i++)
+        {
+            json << (i ? "," : "") << "{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,"
+                 << "\"TEXCOORD_0\":2,\"COLOR_0\":3},\"indices\":" << 4 + i;
+            if (runs[i].material >= 0)
+            {
+                json << ",\"material\":" << runs[i].material;
+            }
+            json << "}";
+        }
+        json << "]}]";
+    }
+
+    // Inverse of the mapping in ReadMaterials for a dielectric
+    json << ",\"materials\":[";
+    for (size_t i = 0; i < mesh.materials.size(); i++)
+    {
+        const Material &material = mesh.materials[i];
+        const float alpha = std::sqrt(2.0f / (std::max(material.shininess, 0.0f) + 2.0f));
+        const glm::vec3 emission = glm::clamp(material.emission, 0.0f, 1.0f);
+        json << (i ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":["
+             << material.diffuse.r << "," << material.diffuse.g << "," << material.diffuse.b
+             << "," << material.dissolve << "],\"metallicFactor\":0,\"roughnessFactor\":"
+             << std::sqrt(alpha) << "},\"emissiveFactor\":[" << emission.r << "," << emission.g
+             << "," << emission.b << "]";
+        if (material.dissolve < 1.0f)
+        {
+            json << ",\"alphaMode\":\"BLEND\"";
+        }
+        json << "}";
+    }
+    json << "]}";
+
+    std::string text = json.str();
+    text.resize((text.size() + 3) & ~size_t(3), ' ');
+    binary.resize((binary.size() + 3) & ~size_t(3), 0);
+    const bool hasBinary = !runs.empty();
+    const uint32_t length = static_cast<uint32_t>(
+        GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE + text.size() +
+        (hasBinary ? GLB_CHUNK_HEADER_SIZE + binary.size() : 0));
+
+    std::vector<uint8_t> header;
+    AppendBytes(header, uint32_t(GLB_MAGIC));
+    AppendBytes(header, uint32_t(GLB_VERSION));
+    AppendBytes(header, length);
+    AppendBytes(header, static_cast<uint32_t>(text.size()));
+    AppendBytes(header, uint32_t(GLB_CHUNK_JSON));
+
+    std::ofstream file(filePath, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(text.data(), text.size());
+    if (hasBinary)
+    {
+        header.clear();
+        AppendBytes(header, static_cast<uint32_t>(binary.size()));
+        AppendBytes(header, uint32_t(GLB_CHUNK_BIN));
+        file.write(reinterpret_cast<const char *>(header.data()), header.size());
+        file.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+    }
+    if (!file)
+    {
+        error = "cannot write " + filePath;
+        return false;
+    }
+    return true;
+}
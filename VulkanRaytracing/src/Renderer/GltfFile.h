@@ -0,0 +1,103 @@
+#pragma once
+
+#include "ObjModel.h"
+
+#include "Tools/FileTools.h"
+
+// Bytes at the start of an image file that hold its header for the formats stb_image reads
+#define IMAGE_HEADER_READ_SIZE (64u << 10)
+
+class JsonValue;
+
+// Mesh of the file placed in the scene by a node
+struct GltfInstance
+{
+    uint32_t meshIndex;
+    // Includes the transforms of the parent nodes
+    glm::mat4 transform;
+};
+
+struct GltfStats
+{
+    uint32_t meshes = 0;
+    // Meshes whose index and position data is used where it lies in the mapped file
+    uint32_t inPlaceIndices = 0;
+    uint32_t inPlacePositions = 0;
+    uint64_t verticesCount = 0;
+    uint64_t indicesCount = 0;
+};
+
+// Binary glTF 2.0 file. The file stays mapped while it is open and the mesh views point into it
+// where the layout allows. When the primitives of a mesh share their vertex attributes, the
+// vertices are gathered from the accessors once and uint32 index accessors that follow each other
+// in the buffer are used in place. Tightly packed float positions are also handed out as
+// MeshView::positions, which VertexLayout::Packed uploads as its position stream without a copy.
+// Other layouts are converted into arrays owned by the file.
+//
+// Only triangle primitives and the buffer in the binary chunk are read. PBR factors are mapped
+// onto Material and images stored in the binary chunk are referenced by GetImagePath.
+class GltfFile
+{
+  public:
+    // Normals missing from a primitive are generated with normalSettings
+    bool Open(const std::string &filePath, std::string &error,
+              const NormalSettings &normalSettings = {});
+
+    size_t GetMeshCount() const
+    {
+        return m_Meshes.size();
+    }
+
+    const MeshView &GetView(size_t mesh) const
+    {
+        return m_Meshes[mesh].view;
+    }
+
+    // Nodes of the default scene that reference a mesh
+    const std::vector<GltfInstance> &GetInstances() const
+    {
+        return m_Instances;
+    }
+
+    const GltfStats &GetStats() const
+    {
+        return m_Stats;
+    }
+
+    // Writes the mesh with one primitive per run of triangles that share a material, so that
+    // loading the file gives the same vertices and indices again. Textures are left out.
+    static bool Write(const std::string &filePath, const MeshData &mesh, std::string &error);
+
+    // Texture path of an image stored in the binary chunk of a .glb file
+    static std::string GetImagePath(const std::string &filePath, uint32_t image);
+    static bool IsEmbeddedImage(const std::string &path);
+    // The .glb holding an embedded image, the path itself for everything else
+    static std::string GetContainerPath(const std::string &path);
+    // Maps the file of an image, or the container of an embedded one, and points data at the
+    // encoded image. readSize is passed on to MappedFile::Open for image files.
+    static bool OpenImage(const std::string &path, MappedFile &file, const uint8_t *&data,
+                          size_t &size, size_t readSize = SIZE_MAX);
+
+  private:
+    struct Mesh
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        MeshView view;
+    };
+
+    bool ReadMaterials(const JsonValue &document, const std::string &filePath);
+    bool ReadMesh(const JsonValue &document, const JsonValue &gltfMesh,
+                  const NormalSettings &normalSettings, Mesh &mesh, std::string &error) const;
+    void ReadInstances(const JsonValue &document);
+
+  private:
+    MappedFile m_File;
+    const uint8_t *m_Binary = nullptr;
+    size_t m_BinarySize = 0;
+    std::vector<Material> m_Materials;
+    std::vector<std::string> m_Textures;
+    std::vector<Mesh> m_Meshes;
+    std::vector<GltfInstance> m_Instances;
+    GltfStats m_Stats;
+};
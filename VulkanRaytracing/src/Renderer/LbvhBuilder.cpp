@@ -0,0 +1,437 @@
+#include "vkpch.h"
+
+#include "LbvhBuilder.h"
+
+#include "Core/ThreadPool.h"
+
+#include <atomic>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define LBVH_ITEMS_PER_TASK 4096
+#define LBVH_MORTON_BITS 30
+#define LBVH_RADIX_BITS 8
+#define LBVH_RADIX_BUCKETS (1 << LBVH_RADIX_BITS)
+// Marks children that are triangles of the sorted order instead of inner nodes
+#define LBVH_LEAF_BIT 0x80000000u
+
+// Inner node of the Karras tree, node 0 is the root
+struct LbvhNode
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // Inner nodes, or sorted triangles with LBVH_LEAF_BIT
+    uint32_t children[2];
+    uint32_t parent;
+    // Range of the sorted triangles below the node
+    uint32_t first;
+    uint32_t count;
+    // SAH cost of the subtree, not divided by the area of any node
+    float cost;
+    // Nodes on the longest path to a leaf, counting collapsed subtrees as leaves
+    uint32_t height;
+    // The whole subtree becomes one leaf
+    bool collapsed;
+    // The first child to finish only counts itself, the second one merges the node
+    std::atomic<uint32_t> visits{0};
+};
+
+static size_t GetChunkCount(size_t count)
+{
+    return (count + LBVH_ITEMS_PER_TASK - 1) / LBVH_ITEMS_PER_TASK;
+}
+
+static float GetArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+{
+    const glm::vec3 extent = boundsMax - boundsMin;
+    if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+    {
+        return 0.0f;
+    }
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static int CountLeadingZeros(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanReverse(&index, value) ? 31 - static_cast<int>(index) : 32;
+#else
+    return value != 0 ? __builtin_clz(value) : 32;
+#endif
+}
+
+// Spreads the lower 10 bits apart, two zero bits follow each of them
+static uint32_t ExpandBits(uint32_t value)
+{
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+// Interleaves 10 bits per axis of a point inside the unit cube
+static uint32_t GetMortonCode(const glm::vec3 &point)
+{
+    const glm::vec3 cell = glm::clamp(point * 1024.0f, 0.0f, 1023.0f);
+    return ExpandBits(static_cast<uint32_t>(cell.x)) * 4 +
+           ExpandBits(static_cast<uint32_t>(cell.y)) * 2 +
+           ExpandBits(static_cast<uint32_t>(cell.z));
+}
+
+// Stable least significant digit first radix sort of the codes along with their triangles. Each
+// task counts the digits of its chunk, the chunk is then scattered behind the same digits of the
+// chunks before it.
+static void SortCodes(std::vector<uint32_t> &codes, std::vector<uint32_t> &triangles)
+{
+    ThreadPool &pool = ThreadPool::Get();
+    const size_t count = codes.size();
+    const size_t chunkCount = GetChunkCount(count);
+    std::vector<uint32_t> sortedCodes(count);
+    std::vector<uint32_t> sortedTriangles(count);
+    std::vector<std::array<uint32_t, LBVH_RADIX_BUCKETS>> offsets(chunkCount);
+    for (uint32_t shift = 0; shift < LBVH_MORTON_BITS; shift += LBVH_RADIX_BITS)
+    {
+        pool.ParallelFor(chunkCount, [&](size_t chunk) {
+            std::array<uint32_t, LBVH_RADIX_BUCKETS> &histogram = offsets[chunk];
+            histogram.fill(0);
+            const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, count);
+            for (size_t i = chunk * LBVH_ITEMS_PER_TASK; i < last; i++)
+            {
+                histogram[(codes[i] >> shift) & (LBVH_RADIX_BUCKETS - 1)]++;
+            }
+        });
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < LBVH_RADIX_BUCKETS; digit++)
+        {
+            for (size_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                const uint32_t digitCount = offsets[chunk][digit];
+                offsets[chunk][digit] = offset;
+                offset += digitCount;
+            }
+        }
+
+        pool.ParallelFor(chunkCount, [&](size_t chunk) {
+            std::array<uint32_t, LBVH_RADIX_BUCKETS> &next = offsets[chunk];
+            const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, count);
+            for (size_t i = chunk * LBVH_ITEMS_PER_TASK; i < last; i++)
+            {
+                const uint32_t target = next[(codes[i] >> shift) & (LBVH_RADIX_BUCKETS - 1)]++;
+                sortedCodes[target] = codes[i];
+                sortedTriangles[target] = triangles[i];
+            }
+        });
+        codes.swap(sortedCodes);
+        triangles.swap(sortedTriangles);
+    }
+}
+
+// Length of the prefix two sorted codes share, -1 past either end. Equal codes compare their
+// positions instead, which makes every code distinct.
+static int GetCommonPrefix(const std::vector<uint32_t> &codes, int64_t i, int64_t j)
+{
+    if (j < 0 || j >= static_cast<int64_t>(codes.size()))
+    {
+        return -1;
+    }
+    if (codes[i] == codes[j])
+    {
+        return 32 + CountLeadingZeros(static_cast<uint32_t>(i ^ j));
+    }
+    return CountLeadingZeros(codes[i] ^ codes[j]);
+}
+
+// Finds the range of sorted triangles below inner node i and where it splits. The range starts
+// or ends at i, grows in the direction whose neighbour shares the longer prefix and ends before
+// the first code sharing less than the other neighbour does. The split is the last code that
+// still shares more than the two ends.
+static void EmitNode(const std::vector<uint32_t> &codes, std::vector<LbvhNode> &nodes,
+                     std::vector<uint32_t> &leafParents, int64_t i)
+{
+    const int direction =
+        GetCommonPrefix(codes, i, i + 1) > GetCommonPrefix(codes, i, i - 1) ? 1 : -1;
+    const int minimumPrefix = GetCommonPrefix(codes, i, i - direction);
+    int64_t maxLength = 2;
+    while (GetCommonPrefix(codes, i, i + maxLength * direction) > minimumPrefix)
+    {
+        maxLength *= 2;
+    }
+    int64_t length = 0;
+    for (int64_t step = maxLength / 2; step > 0; step /= 2)
+    {
+        if (GetCommonPrefix(codes, i, i + (length + step) * direction) > minimumPrefix)
+        {
+            length += step;
+        }
+    }
+    const int64_t j = i + length * direction;
+
+    const int nodePrefix = GetCommonPrefix(codes, i, j);
+    int64_t splitLength = 0;
+    for (int64_t divisor = 2;; divisor *= 2)
+    {
+        const int64_t step = (length + divisor - 1) / divisor;
+        if (GetCommonPrefix(codes, i, i + (splitLength + step) * direction) > nodePrefix)
+        {
+            splitLength += step;
+        }
+        if (step <= 1)
+        {
+            break;
+        }
+    }
+    const int64_t split = i + splitLength * direction + std::min(direction, 0);
+
+    LbvhNode &node = nodes[i];
+    node.first = static_cast<uint32_t>(std::min(i, j));
+    node.count = static_cast<uint32_t>(std::abs(j - i) + 1);
+    const uint32_t children[2] = {static_cast<uint32_t>(split), static_cast<uint32_t>(split + 1)};
+    const bool leaves[2] = {std::min(i, j) == split, std::max(i, j) == split + 1};
+    for (int side = 0; side < 2; side++)
+    {
+        if (leaves[side])
+        {
+            node.children[side] = children[side] | LBVH_LEAF_BIT;
+            leafParents[children[side]] = static_cast<uint32_t>(i);
+        }
+        else
+        {
+            node.children[side] = children[side];
+            nodes[children[side]].parent = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+void LbvhBuilder::Build(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings)
+{
+    const uint32_t triangleCount = mesh.indicesCount / 3;
+    bvh.nodes.clear();
+    bvh.depth = 0;
+    bvh.positions.resize(mesh.verticesCount);
+    for (uint32_t i = 0; i < mesh.verticesCount; i++)
+    {
+        bvh.positions[i] = mesh.positions ? mesh.positions[i] : mesh.vertices[i].pos;
+    }
+    bvh.indices.resize(size_t(triangleCount) * 3);
+    bvh.triangleIds.resize(triangleCount);
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangle bounds, and the bounds of the centroids in each chunk
+    ThreadPool &pool = ThreadPool::Get();
+    const size_t triangleChunks = GetChunkCount(triangleCount);
+    std::vector<glm::vec3> boundsMin(triangleCount);
+    std::vector<glm::vec3> boundsMax(triangleCount);
+    std::vector<std::pair<glm::vec3, glm::vec3>> chunkCentroids(triangleChunks);
+    pool.ParallelFor(triangleChunks, [&](size_t chunk) {
+        glm::vec3 centroidMin(FLT_MAX);
+        glm::vec3 centroidMax(-FLT_MAX);
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(triangleCount));
+        for (size_t triangle = chunk * LBVH_ITEMS_PER_TASK; triangle < last; triangle++)
+        {
+            const uint32_t *indices = mesh.indices + triangle * 3;
+            const glm::vec3 &p0 = bvh.positions[indices[0]];
+            const glm::vec3 &p1 = bvh.positions[indices[1]];
+            const glm::vec3 &p2 = bvh.positions[indices[2]];
+            boundsMin[triangle] = glm::min(glm::min(p0, p1), p2);
+            boundsMax[triangle] = glm::max(glm::max(p0, p1), p2);
+            const glm::vec3 centroid = (boundsMin[triangle] + boundsMax[triangle]) * 0.5f;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+        chunkCentroids[chunk] = {centroidMin, centroidMax};
+    });
+
+    glm::vec3 centroidMin(FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX);
+    for (const auto &[chunkMin, chunkMax] : chunkCentroids)
+    {
+        centroidMin = glm::min(centroidMin, chunkMin);
+        centroidMax = glm::max(centroidMax, chunkMax);
+    }
+    // Axes without extent map every centroid to 0
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const float extent = centroidMax[axis] - centroidMin[axis];
+        scale[axis] = extent > 0.0f ? 1.0f / extent : 0.0f;
+    }
+
+    std::vector<uint32_t> codes(triangleCount);
+    std::vector<uint32_t> order(triangleCount);
+    pool.ParallelFor(triangleChunks, [&](size_t chunk) {
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(triangleCount));
+        for (size_t triangle = chunk * LBVH_ITEMS_PER_TASK; triangle < last; triangle++)
+        {
+            const glm::vec3 centroid = (boundsMin[triangle] + boundsMax[triangle]) * 0.5f;
+            codes[triangle] = GetMortonCode((centroid - centroidMin) * scale);
+            order[triangle] = static_cast<uint32_t>(triangle);
+        }
+    });
+    SortCodes(codes, order);
+
+    pool.ParallelFor(triangleChunks, [&](size_t chunk) {
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(triangleCount));
+        for (size_t triangle = chunk * LBVH_ITEMS_PER_TASK; triangle < last; triangle++)
+        {
+            const uint32_t sourceTriangle = order[triangle];
+            const uint32_t *source = mesh.indices + size_t(sourceTriangle) * 3;
+            std::copy(source, source + 3, bvh.indices.data() + triangle * 3);
+            bvh.triangleIds[triangle] = sourceTriangle;
+        }
+    });
+
+    if (triangleCount == 1)
+    {
+        bvh.nodes.push_back({boundsMin[0], 0, boundsMax[0], 1});
+        bvh.depth = 1;
+        return;
+    }
+
+    // Every inner node is emitted on its own
+    const uint32_t innerCount = triangleCount - 1;
+    const size_t innerChunks = GetChunkCount(innerCount);
+    std::vector<LbvhNode> nodes(innerCount);
+    std::vector<uint32_t> leafParents(triangleCount);
+    nodes[0].parent = UINT32_MAX;
+    pool.ParallelFor(innerChunks, [&](size_t chunk) {
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(innerCount));
+        for (size_t i = chunk * LBVH_ITEMS_PER_TASK; i < last; i++)
+        {
+            EmitNode(codes, nodes, leafParents, static_cast<int64_t>(i));
+        }
+    });
+
+    // Climbs from every leaf until reaching a node whose other child is not done yet
+    pool.ParallelFor(triangleChunks, [&](size_t chunk) {
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(triangleCount));
+        for (size_t leaf = chunk * LBVH_ITEMS_PER_TASK; leaf < last; leaf++)
+        {
+            for (uint32_t index = leafParents[leaf]; index != UINT32_MAX;)
+            {
+                LbvhNode &node = nodes[index];
+                if (node.visits.fetch_add(1, std::memory_order_acq_rel) == 0)
+                {
+                    break;
+                }
+
+                node.boundsMin = glm::vec3(FLT_MAX);
+                node.boundsMax = glm::vec3(-FLT_MAX);
+                float childCost = 0.0f;
+                uint32_t childHeight = 0;
+                for (uint32_t child : node.children)
+                {
+                    if (child & LBVH_LEAF_BIT)
+                    {
+                        const uint32_t triangle = order[child & ~LBVH_LEAF_BIT];
+                        node.boundsMin = glm::min(node.boundsMin, boundsMin[triangle]);
+                        node.boundsMax = glm::max(node.boundsMax, boundsMax[triangle]);
+                        childCost += GetArea(boundsMin[triangle], boundsMax[triangle]);
+                        childHeight = std::max(childHeight, 1u);
+                    }
+                    else
+                    {
+                        node.boundsMin = glm::min(node.boundsMin, nodes[child].boundsMin);
+                        node.boundsMax = glm::max(node.boundsMax, nodes[child].boundsMax);
+                        childCost += nodes[child].cost;
+                        childHeight = std::max(childHeight, nodes[child].height);
+                    }
+                }
+
+                // Unlike BvhBuilder the children are priced as the subtrees they became
+                const float area = GetArea(node.boundsMin, node.boundsMax);
+                const float leafCost = area * node.count;
+                const float splitCost = area * settings.traversalCost + childCost;
+                node.collapsed = node.count <= settings.maxLeafTriangles && leafCost <= splitCost;
+                node.cost = node.collapsed ? leafCost : splitCost;
+                node.height = node.collapsed ? 1 : childHeight + 1;
+                index = node.parent;
+            }
+        }
+    });
+
+    // Inner nodes of the BVH are the nodes neither collapsed themselves nor below a collapsed
+    // node, which only nodes of at most maxLeafTriangles can be. They get the pairs of child
+    // slots in the order of their splits.
+    auto isInner = [&](uint32_t index) {
+        for (;;)
+        {
+            const LbvhNode &node = nodes[index];
+            if (node.collapsed)
+            {
+                return false;
+            }
+            if (node.parent == UINT32_MAX || nodes[node.parent].count > settings.maxLeafTriangles)
+            {
+                return true;
+            }
+            index = node.parent;
+        }
+    };
+    std::vector<uint32_t> pairs(innerCount);
+    std::vector<uint32_t> chunkPairs(innerChunks);
+    pool.ParallelFor(innerChunks, [&](size_t chunk) {
+        uint32_t pairCount = 0;
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(innerCount));
+        for (size_t i = chunk * LBVH_ITEMS_PER_TASK; i < last; i++)
+        {
+            pairs[i] = isInner(static_cast<uint32_t>(i)) ? pairCount++ : UINT32_MAX;
+        }
+        chunkPairs[chunk] = pairCount;
+    });
+    uint32_t pairCount = 0;
+    for (uint32_t &chunkPair : chunkPairs)
+    {
+        const uint32_t count = chunkPair;
+        chunkPair = pairCount;
+        pairCount += count;
+    }
+    // Pairs were counted within their chunk
+    auto getFirstChild = [&](uint32_t index) {
+        return 1 + 2 * (chunkPairs[index / LBVH_ITEMS_PER_TASK] + pairs[index]);
+    };
+
+    bvh.nodes.resize(size_t(pairCount) * 2 + 1);
+    bvh.depth = nodes[0].height;
+    const LbvhNode &root = nodes[0];
+    bvh.nodes[0] = {root.boundsMin, root.collapsed ? 0u : 1u, root.boundsMax,
+                    root.collapsed ? triangleCount : 0u};
+    pool.ParallelFor(innerChunks, [&](size_t chunk) {
+        const size_t last = std::min((chunk + 1) * LBVH_ITEMS_PER_TASK, size_t(innerCount));
+        for (size_t i = chunk * LBVH_ITEMS_PER_TASK; i < last; i++)
+        {
+            if (pairs[i] == UINT32_MAX)
+            {
+                continue;
+            }
+            const uint32_t firstChild = getFirstChild(static_cast<uint32_t>(i));
+            for (int side = 0; side < 2; side++)
+            {
+                const uint32_t child = nodes[i].children[side];
+                BvhNode &target = bvh.nodes[firstChild + side];
+                if (child & LBVH_LEAF_BIT)
+                {
+                    const uint32_t triangle = order[child & ~LBVH_LEAF_BIT];
+                    target = {boundsMin[triangle], child & ~LBVH_LEAF_BIT, boundsMax[triangle], 1};
+                    continue;
+                }
+
+                const LbvhNode &inner = nodes[child];
+                if (inner.collapsed)
+                {
+                    target = {inner.boundsMin, inner.first, inner.boundsMax, inner.count};
+                }
+                else
+                {
+                    target = {inner.boundsMin, getFirstChild(child), inner.boundsMax, 0};
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "BvhBuilder.h"
+
+// Builds a linear BVH (Karras 2012) for meshes that change every frame. The triangles are sorted
+// along a 30 bit Morton curve through their centroids with a parallel radix sort, then every
+// inner node finds its range of the sorted triangles and where it splits on its own. Bounds are
+// merged bottom up by whichever thread finishes the second child of a node, subtrees that are
+// cheaper to test as one leaf are collapsed under the SAH and maxLeafTriangles of the settings.
+//
+// The splits follow the curve instead of the surface area, so the tree costs somewhat more to
+// traverse than that of BvhBuilder but builds several times faster. Nodes are stored in the
+// order of their splits rather than depth first, which BVH users must not depend on.
+class LbvhBuilder
+{
+  public:
+    // binCount and parallelTriangles of the settings are not used
+    static void Build(const MeshView &mesh, Bvh &bvh, const BvhSettings &settings = {});
+};
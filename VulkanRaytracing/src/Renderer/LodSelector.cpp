@@ -0,0 +1,49 @@
+#include "vkpch.h"
+
+#include "LodSelector.h"
+
+LodView LodSelector::CreateView(const glm::mat4 &projection, const glm::vec3 &cameraPosition,
+                                uint32_t viewportHeight, float pixelError)
+{
+    // The projection scales y by the cotangent of half the vertical field of view, Vulkan
+    // projections may flip its sign
+    LodView view;
+    view.cameraPosition = cameraPosition;
+    view.pixelsPerUnit = std::abs(projection[1][1]) * 0.5f * viewportHeight;
+    view.pixelError = pixelError;
+    return view;
+}
+
+uint32_t LodSelector::Select(const ObjModel &model, const glm::mat4 &modelMatrix,
+                             const LodView &view, LodStats *stats)
+{
+    uint32_t level = 0;
+    if (model.lods.size() > 1)
+    {
+        const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(model.boundsCenter, 1.0f));
+        const float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                                     std::max(glm::length(glm::vec3(modelMatrix[1])),
+                                              glm::length(glm::vec3(modelMatrix[2]))));
+        const float distance =
+            glm::length(center - view.cameraPosition) - model.boundsRadius * scale;
+        // Inside the bounds everything is drawn in full
+        if (distance > 0.0f)
+        {
+            const float pixelsPerError = scale * view.pixelsPerUnit / distance;
+            while (level + 1 < model.lods.size() &&
+                   model.lods[level + 1].error * pixelsPerError <= view.pixelError)
+            {
+                level++;
+            }
+        }
+    }
+
+    if (stats)
+    {
+        stats->instances++;
+        stats->reducedInstances += level > 0;
+        stats->fullTriangles += model.indicesCount / 3;
+        stats->triangles += (level > 0 ? model.lods[level].indexCount : model.indicesCount) / 3;
+    }
+    return level;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ObjModel.h"
+
+// Largest distance in pixels a coarser level of detail may move the surface on screen
+#define LOD_PIXEL_ERROR 1.0f
+
+struct LodView
+{
+    glm::vec3 cameraPosition;
+    // Pixels one unit covers at a distance of one unit
+    float pixelsPerUnit;
+    float pixelError;
+};
+
+struct LodStats
+{
+    uint64_t instances = 0;
+    // Instances drawn with a coarser level than the full mesh
+    uint64_t reducedInstances = 0;
+    uint64_t fullTriangles = 0;
+    uint64_t triangles = 0;
+
+    float GetSavings() const
+    {
+        return fullTriangles ? 1.0f - float(triangles) / fullTriangles : 0.0f;
+    }
+};
+
+// Picks the level of detail of an instance from the error of each level projected onto the
+// screen at the point of the model bounds nearest to the camera
+class LodSelector
+{
+  public:
+    static LodView CreateView(const glm::mat4 &projection, const glm::vec3 &cameraPosition,
+                              uint32_t viewportHeight, float pixelError = LOD_PIXEL_ERROR);
+
+    // Returns the coarsest level within the pixel error, 0 for models without levels
+    static uint32_t Select(const ObjModel &model, const glm::mat4 &modelMatrix,
+                           const LodView &view, LodStats *stats = nullptr);
+};
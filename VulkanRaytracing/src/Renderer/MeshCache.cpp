@@ -0,0 +1,395 @@
+#include "vkpch.h"
+
+#include "MeshCache.h"
+
+#include <cstring>
+#include <filesystem>
+
+#define MESH_CACHE_MAGIC 0x434d5256 // "VRMC"
+#define MESH_CACHE_VERSION 7
+#define MESH_CACHE_ALIGNMENT 16
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t materialSize;
+    uint64_t sourceSize;
+    int64_t sourceWriteTime;
+    uint64_t sourceHash;
+    uint64_t verticesOffset;
+    uint64_t verticesCount;
+    uint64_t indicesOffset;
+    uint64_t indicesCount;
+    uint64_t materialsOffset;
+    uint64_t materialsCount;
+    uint64_t texturesOffset;
+    uint64_t texturesCount;
+    float normalCreaseAngle;
+    uint32_t normalWeighting;
+    uint32_t sourceNormals;
+    uint64_t meshletsOffset;
+    uint64_t meshletsCount;
+    uint32_t meshletSize;
+    uint32_t meshletMaxVertices;
+    uint32_t meshletMaxTriangles;
+    float meshletConeWeight;
+    uint64_t lodsOffset;
+    uint64_t lodsCount;
+    uint32_t lodSize;
+    uint32_t lodMaxLevels;
+    float lodReduction;
+    float lodMaxError;
+    uint64_t dependenciesOffset;
+    uint64_t dependenciesCount;
+};
+
+// Material library the cached materials were read from, followed by its path. Libraries that
+// were looked for but missing are recorded too, so that adding one later rebuilds the cache.
+struct MeshCacheDependency
+{
+    uint64_t size;
+    int64_t writeTime;
+    uint64_t hash;
+    uint32_t exists;
+    uint32_t pathLength;
+};
+
+static constexpr uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~static_cast<uint64_t>(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static bool HashSource(const std::string &sourcePath, uint64_t &hash)
+{
+    MappedFile source;
+    if (!source.Open(sourcePath))
+    {
+        // Empty files cannot be mapped
+        hash = HashData(nullptr, 0);
+        return std::filesystem::exists(sourcePath) && std::filesystem::is_empty(sourcePath);
+    }
+    hash = HashData(source.GetData(), source.GetSize());
+    return true;
+}
+
+// A changed modification time alone does not invalidate the cache as long as the content hash
+// still matches, so copied or touched assets keep their cache
+static bool IsUnchanged(const std::string &path, const FileStamp &stamp, uint64_t size,
+                        int64_t writeTime, uint64_t hash)
+{
+    uint64_t currentHash;
+    return stamp.size == size &&
+           (stamp.writeTime == writeTime || (HashSource(path, currentHash) && currentHash == hash));
+}
+
+static void RemoveFile(const std::string &path)
+{
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+std::string MeshCache::GetCachePath(const std::string &sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+bool MeshCache::Write(const std::string &sourcePath, const MeshData &mesh)
+{
+    MeshCacheWriter writer;
+    if (!writer.Begin(sourcePath))
+    {
+        return false;
+    }
+    for (const auto &materialFile : mesh.materialFiles)
+    {
+        writer.AddDependency(materialFile);
+    }
+    writer.AppendVertices(mesh.vertices.data(), mesh.vertices.size());
+    writer.AppendIndices(mesh.indices.data(), mesh.indices.size());
+    return writer.Finish(mesh.materials, mesh.textures, mesh.normalSettings, mesh.sourceNormals,
+                         mesh.meshlets, mesh.meshletSettings, mesh.lods, mesh.lodSettings);
+}
+
+MeshCacheWriter::~MeshCacheWriter()
+{
+    if (m_File.is_open())
+    {
+        m_File.close();
+        RemoveFile(m_TempPath);
+    }
+    if (m_Indices.is_open())
+    {
+        m_Indices.close();
+    }
+    if (!m_IndicesPath.empty())
+    {
+        RemoveFile(m_IndicesPath);
+    }
+}
+
+bool MeshCacheWriter::Begin(const std::string &sourcePath)
+{
+    if (!GetFileStamp(sourcePath, m_SourceStamp) || !HashSource(sourcePath, m_SourceHash))
+    {
+        return false;
+    }
+
+    m_SourcePath = sourcePath;
+    m_TempPath = MeshCache::GetCachePath(sourcePath) + ".tmp";
+    m_IndicesPath = MeshCache::GetCachePath(sourcePath) + ".indices.tmp";
+    m_File.open(m_TempPath, std::ios::binary | std::ios::trunc);
+    m_Indices.open(m_IndicesPath, std::ios::binary | std::ios::trunc);
+    if (!m_File.is_open() || !m_Indices.is_open())
+    {
+        return false;
+    }
+
+    // The header is written last, once all counts are known
+    static const char placeholder[AlignOffset(sizeof(MeshCacheHeader))] = {};
+    m_File.write(placeholder, sizeof(placeholder));
+    return m_File.good();
+}
+
+void MeshCacheWriter::AddDependency(const std::string &path)
+{
+    Dependency dependency;
+    dependency.path = path;
+    dependency.exists = GetFileStamp(path, dependency.stamp) && HashSource(path, dependency.hash);
+    m_Dependencies.push_back(dependency);
+}
+
+void MeshCacheWriter::AppendVertices(const Vertex *vertices, size_t count)
+{
+    m_File.write(reinterpret_cast<const char *>(vertices), sizeof(Vertex) * count);
+    m_VerticesCount += count;
+}
+
+void MeshCacheWriter::AppendIndices(const uint32_t *indices, size_t count)
+{
+    m_Indices.write(reinterpret_cast<const char *>(indices), sizeof(uint32_t) * count);
+    m_IndicesCount += count;
+}
+
+bool MeshCacheWriter::Finish(const std::vector<Material> &materials,
+                             const std::vector<std::string> &textures,
+                             const NormalSettings &normalSettings, bool sourceNormals,
+                             const std::vector<Meshlet> &meshlets,
+                             const MeshletSettings &meshletSettings,
+                             const std::vector<MeshLod> &lods, const LodSettings &lodSettings)
+{
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.materialSize = sizeof(Material);
+    header.sourceSize = m_SourceStamp.size;
+    header.sourceWriteTime = m_SourceStamp.writeTime;
+    header.sourceHash = m_SourceHash;
+
+    header.verticesCount = m_VerticesCount;
+    header.indicesCount = m_IndicesCount;
+    header.materialsCount = materials.size();
+    header.texturesCount = textures.size();
+    header.normalCreaseAngle = normalSettings.creaseAngle;
+    header.normalWeighting = static_cast<uint32_t>(normalSettings.weighting);
+    header.sourceNormals = sourceNormals ? 1 : 0;
+    header.meshletsCount = meshlets.size();
+    header.meshletSize = sizeof(Meshlet);
+    header.meshletMaxVertices = meshletSettings.maxVertices;
+    header.meshletMaxTriangles = meshletSettings.maxTriangles;
+    header.meshletConeWeight = meshletSettings.coneWeight;
+    header.lodsCount = lods.size();
+    header.lodSize = sizeof(MeshLod);
+    header.lodMaxLevels = lodSettings.maxLevels;
+    header.lodReduction = lodSettings.reduction;
+    header.lodMaxError = lodSettings.maxError;
+    header.verticesOffset = AlignOffset(sizeof(MeshCacheHeader));
+    header.indicesOffset = AlignOffset(header.verticesOffset + sizeof(Vertex) * m_VerticesCount);
+    header.materialsOffset = AlignOffset(header.indicesOffset + sizeof(uint32_t) * m_IndicesCount);
+    header.meshletsOffset =
+        AlignOffset(header.materialsOffset + sizeof(Material) * materials.size());
+    header.lodsOffset = AlignOffset(header.meshletsOffset + sizeof(Meshlet) * meshlets.size());
+    header.texturesOffset = AlignOffset(header.lodsOffset + sizeof(MeshLod) * lods.size());
+    header.dependenciesCount = m_Dependencies.size();
+
+    auto pad = [this](uint64_t offset) {
+        static const char padding[MESH_CACHE_ALIGNMENT] = {};
+        m_File.write(padding, offset - static_cast<uint64_t>(m_File.tellp()));
+    };
+
+    m_Indices.close();
+    if (!m_Indices.good())
+    {
+        return false;
+    }
+    pad(header.indicesOffset);
+    {
+        // Indices were spilled next to the cache, append them in bounded blocks
+        std::ifstream indices(m_IndicesPath, std::ios::binary);
+        std::vector<char> block(1 << 20);
+        while (indices.read(block.data(), block.size()) || indices.gcount() > 0)
+        {
+            m_File.write(block.data(), indices.gcount());
+        }
+    }
+    RemoveFile(m_IndicesPath);
+    m_IndicesPath.clear();
+
+    pad(header.materialsOffset);
+    m_File.write(reinterpret_cast<const char *>(materials.data()),
+                 sizeof(Material) * materials.size());
+    pad(header.meshletsOffset);
+    m_File.write(reinterpret_cast<const char *>(meshlets.data()),
+                 sizeof(Meshlet) * meshlets.size());
+    pad(header.lodsOffset);
+    m_File.write(reinterpret_cast<const char *>(lods.data()), sizeof(MeshLod) * lods.size());
+    pad(header.texturesOffset);
+    for (const auto &texture : textures)
+    {
+        uint32_t length = static_cast<uint32_t>(texture.size());
+        m_File.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        m_File.write(texture.data(), length);
+    }
+    header.dependenciesOffset = AlignOffset(static_cast<uint64_t>(m_File.tellp()));
+    pad(header.dependenciesOffset);
+    for (const auto &dependency : m_Dependencies)
+    {
+        MeshCacheDependency record = {};
+        record.exists = dependency.exists ? 1 : 0;
+        if (dependency.exists)
+        {
+            record.size = dependency.stamp.size;
+            record.writeTime = dependency.stamp.writeTime;
+            record.hash = dependency.hash;
+        }
+        record.pathLength = static_cast<uint32_t>(dependency.path.size());
+        m_File.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        m_File.write(dependency.path.data(), record.pathLength);
+    }
+
+    m_File.seekp(0);
+    m_File.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_File.close();
+    if (!m_File.good())
+    {
+        RemoveFile(m_TempPath);
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(m_TempPath, MeshCache::GetCachePath(m_SourcePath), error);
+    return !error;
+}
+
+bool MeshCache::Open(const std::string &sourcePath)
+{
+    FileStamp stamp;
+    if (!GetFileStamp(sourcePath, stamp) || !m_File.Open(GetCachePath(sourcePath)))
+    {
+        return false;
+    }
+
+    const uint8_t *data = m_File.GetData();
+    const uint64_t size = m_File.GetSize();
+    MeshCacheHeader header;
+    if (size < sizeof(header))
+    {
+        m_File.Close();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    bool valid = header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION &&
+                 header.vertexSize == sizeof(Vertex) && header.materialSize == sizeof(Material) &&
+                 header.sourceSize == stamp.size &&
+                 header.verticesOffset + sizeof(Vertex) * header.verticesCount <= size &&
+                 header.indicesOffset + sizeof(uint32_t) * header.indicesCount <= size &&
+                 header.materialsOffset + sizeof(Material) * header.materialsCount <= size &&
+                 header.meshletSize == sizeof(Meshlet) &&
+                 header.meshletsOffset + sizeof(Meshlet) * header.meshletsCount <= size &&
+                 header.lodSize == sizeof(MeshLod) &&
+                 header.lodsOffset + sizeof(MeshLod) * header.lodsCount <= size &&
+                 header.texturesOffset <= size && header.dependenciesOffset <= size;
+    valid = valid && IsUnchanged(sourcePath, stamp, header.sourceSize, header.sourceWriteTime,
+                                 header.sourceHash);
+
+    std::vector<std::string> materialFiles;
+    uint64_t dependencyOffset = header.dependenciesOffset;
+    for (uint64_t i = 0; valid && i < header.dependenciesCount; i++)
+    {
+        MeshCacheDependency record;
+        if (dependencyOffset + sizeof(record) > size)
+        {
+            valid = false;
+            break;
+        }
+        memcpy(&record, data + dependencyOffset, sizeof(record));
+        dependencyOffset += sizeof(record);
+        if (dependencyOffset + record.pathLength > size)
+        {
+            valid = false;
+            break;
+        }
+        const std::string path(reinterpret_cast<const char *>(data + dependencyOffset),
+                               record.pathLength);
+        dependencyOffset += record.pathLength;
+        materialFiles.push_back(path);
+
+        FileStamp dependencyStamp;
+        const bool exists = GetFileStamp(path, dependencyStamp);
+        valid = exists == (record.exists != 0) &&
+                (!exists || IsUnchanged(path, dependencyStamp, record.size, record.writeTime,
+                                        record.hash));
+    }
+
+    if (!valid)
+    {
+        m_File.Close();
+        return false;
+    }
+
+    m_View.vertices = reinterpret_cast<const Vertex *>(data + header.verticesOffset);
+    m_View.verticesCount = static_cast<uint32_t>(header.verticesCount);
+    m_View.indices = reinterpret_cast<const uint32_t *>(data + header.indicesOffset);
+    m_View.indicesCount = static_cast<uint32_t>(header.indicesCount);
+    m_View.materials = reinterpret_cast<const Material *>(data + header.materialsOffset);
+    m_View.materialsCount = static_cast<uint32_t>(header.materialsCount);
+    m_View.normalSettings.creaseAngle = header.normalCreaseAngle;
+    m_View.normalSettings.weighting = static_cast<NormalWeighting>(header.normalWeighting);
+    m_View.sourceNormals = header.sourceNormals != 0;
+    m_View.materialFiles = std::move(materialFiles);
+    m_View.meshlets = reinterpret_cast<const Meshlet *>(data + header.meshletsOffset);
+    m_View.meshletsCount = static_cast<uint32_t>(header.meshletsCount);
+    m_View.meshletSettings.maxVertices = header.meshletMaxVertices;
+    m_View.meshletSettings.maxTriangles = header.meshletMaxTriangles;
+    m_View.meshletSettings.coneWeight = header.meshletConeWeight;
+    m_View.lods = reinterpret_cast<const MeshLod *>(data + header.lodsOffset);
+    m_View.lodsCount = static_cast<uint32_t>(header.lodsCount);
+    m_View.lodSettings.maxLevels = header.lodMaxLevels;
+    m_View.lodSettings.reduction = header.lodReduction;
+    m_View.lodSettings.maxError = header.lodMaxError;
+
+    m_View.textures.clear();
+    uint64_t offset = header.texturesOffset;
+    for (uint64_t i = 0; i < header.texturesCount; i++)
+    {
+        uint32_t length;
+        if (offset + sizeof(length) > size)
+        {
+            m_File.Close();
+            return false;
+        }
+        memcpy(&length, data + offset, sizeof(length));
+        offset += sizeof(length);
+        if (offset + length > size)
+        {
+            m_File.Close();
+            return false;
+        }
+        m_View.textures.emplace_back(reinterpret_cast<const char *>(data + offset), length);
+        offset += length;
+    }
+    return true;
+}
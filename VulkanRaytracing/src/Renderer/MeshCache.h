@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ObjModel.h"
+
+#include "Tools/FileTools.h"
+
+// Binary image of the final mesh arrays, meshlets and levels of detail, stored next to the source
+// file. Later loads map the file and hand the arrays straight to the staging upload without any
+// parsing.
+class MeshCache
+{
+  public:
+    static std::string GetCachePath(const std::string &sourcePath);
+    static bool Write(const std::string &sourcePath, const MeshData &mesh);
+
+    bool Open(const std::string &sourcePath);
+
+    const MeshView &GetView() const
+    {
+        return m_View;
+    }
+
+  private:
+    MappedFile m_File;
+    MeshView m_View;
+};
+
+// Writes a cache incrementally. Vertices and indices may be appended in any interleaving, the
+// indices are spilled to a side file until Finish places them after the vertices.
+class MeshCacheWriter
+{
+  public:
+    MeshCacheWriter() = default;
+    ~MeshCacheWriter();
+    MeshCacheWriter(const MeshCacheWriter &other) = delete;
+    MeshCacheWriter &operator=(const MeshCacheWriter &other) = delete;
+
+    bool Begin(const std::string &sourcePath);
+    // Another file the cached data was read from, the cache is rebuilt once it changes, appears
+    // or goes missing
+    void AddDependency(const std::string &path);
+    void AppendVertices(const Vertex *vertices, size_t count);
+    void AppendIndices(const uint32_t *indices, size_t count);
+    bool Finish(const std::vector<Material> &materials, const std::vector<std::string> &textures,
+                const NormalSettings &normalSettings, bool sourceNormals,
+                const std::vector<Meshlet> &meshlets = {},
+                const MeshletSettings &meshletSettings = {},
+                const std::vector<MeshLod> &lods = {}, const LodSettings &lodSettings = {});
+
+  private:
+    struct Dependency
+    {
+        std::string path;
+        bool exists = false;
+        FileStamp stamp;
+        uint64_t hash = 0;
+    };
+
+  private:
+    std::string m_SourcePath;
+    std::string m_TempPath;
+    std::string m_IndicesPath;
+    std::ofstream m_File;
+    std::ofstream m_Indices;
+    FileStamp m_SourceStamp;
+    uint64_t m_SourceHash = 0;
+    uint64_t m_VerticesCount = 0;
+    uint64_t m_IndicesCount = 0;
+    std::vector<Dependency> m_Dependencies;
+};
@@ -0,0 +1,375 @@
+#include "vkpch.h"
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+#define FETCH_CACHE_LINE 64
+#define FETCH_CACHE_SIZE (128 * 1024)
+
+// Simulates a FIFO cache with timestamps: a vertex is still cached while fewer than cacheSize
+// misses happened since it was loaded
+class FifoCache
+{
+  public:
+    FifoCache(size_t vertexCount, uint32_t cacheSize)
+        : m_Time(vertexCount, 0), m_CacheSize(cacheSize), m_Timestamp(cacheSize + 1)
+    {
+    }
+
+    bool Contains(uint32_t vertex) const
+    {
+        return m_Timestamp - m_Time[vertex] <= m_CacheSize;
+    }
+
+    // Returns 1 on a miss
+    uint32_t Access(uint32_t vertex)
+    {
+        if (Contains(vertex))
+        {
+            return 0;
+        }
+        m_Time[vertex] = m_Timestamp++;
+        return 1;
+    }
+
+    uint32_t Age(uint32_t vertex) const
+    {
+        return m_Timestamp - m_Time[vertex];
+    }
+
+    void Clear()
+    {
+        m_Timestamp += m_CacheSize + 1;
+    }
+
+  private:
+    std::vector<uint32_t> m_Time;
+    uint32_t m_CacheSize;
+    uint32_t m_Timestamp;
+};
+
+std::vector<uint32_t> MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t> &indices,
+                                                         size_t vertexCount, uint32_t cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+
+    // Triangles around each vertex
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        offsets[indices[i] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Triangles not yet emitted around each vertex
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> clusters;
+    result.reserve(triangleCount * 3);
+
+    size_t cursor = 0;
+    bool newCluster = true;
+    int64_t fanning = vertexCount > 0 ? 0 : -1;
+    while (fanning >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t j = offsets[fanning]; j < offsets[fanning + 1]; ++j)
+        {
+            const uint32_t triangle = adjacency[j];
+            if (emitted[triangle])
+            {
+                continue;
+            }
+            if (newCluster)
+            {
+                clusters.push_back(static_cast<uint32_t>(result.size() / 3));
+                newCluster = false;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t vertex = indices[3 * triangle + k];
+                result.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                cache.Access(vertex);
+            }
+            emitted[triangle] = true;
+        }
+
+        // The next fanning vertex is the oldest one of the last fan that stays in the cache
+        // while its remaining triangles are emitted
+        fanning = -1;
+        uint32_t bestPriority = 0;
+        for (uint32_t vertex : candidates)
+        {
+            if (live[vertex] == 0)
+            {
+                continue;
+            }
+            uint32_t priority = 0;
+            if (cache.Age(vertex) + 2 * live[vertex] <= cacheSize)
+            {
+                priority = cache.Age(vertex);
+            }
+            if (fanning < 0 || priority > bestPriority)
+            {
+                fanning = vertex;
+                bestPriority = priority;
+            }
+        }
+        if (fanning >= 0)
+        {
+            continue;
+        }
+
+        // Dead end, continue from the most recently used vertex that has triangles left or from
+        // the input order
+        newCluster = true;
+        while (!deadEnd.empty() && fanning < 0)
+        {
+            const uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[vertex] > 0)
+            {
+                fanning = vertex;
+            }
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+            {
+                fanning = static_cast<int64_t>(cursor);
+            }
+            cursor++;
+        }
+    }
+
+    // Indices past the last full triangle are kept as they are
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices = std::move(result);
+    return clusters;
+}
+
+uint32_t MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t> &indices,
+                                         const std::vector<Vertex> &vertices,
+                                         const std::vector<uint32_t> &clusters, float threshold,
+                                         uint32_t cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty())
+    {
+        return 0;
+    }
+
+    // Split each cluster wherever the part before has an ACMR within the threshold of the whole
+    // cluster, so reordering the parts costs little vertex cache efficiency
+    FifoCache cache(vertices.size(), cacheSize);
+    std::vector<uint32_t> parts;
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        const size_t start = clusters[c];
+        const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.Clear();
+        uint32_t clusterMisses = 0;
+        for (size_t i = start * 3; i < end * 3; ++i)
+        {
+            clusterMisses += cache.Access(indices[i]);
+        }
+        const float partThreshold = threshold * clusterMisses / float(end - start);
+
+        cache.Clear();
+        parts.push_back(static_cast<uint32_t>(start));
+        size_t partStart = start;
+        uint32_t misses = 0;
+        for (size_t i = start; i + 1 < end; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                misses += cache.Access(indices[3 * i + k]);
+            }
+            if (misses <= partThreshold * float(i + 1 - partStart))
+            {
+                parts.push_back(static_cast<uint32_t>(i + 1));
+                partStart = i + 1;
+                misses = 0;
+                cache.Clear();
+            }
+        }
+    }
+
+    // Parts facing away from the center of the mesh are more likely to occlude the others
+    glm::vec3 meshCenter(0.0f);
+    for (const Vertex &vertex : vertices)
+    {
+        meshCenter += vertex.pos;
+    }
+    meshCenter /= float(std::max<size_t>(vertices.size(), 1));
+
+    std::vector<float> sortKeys(parts.size());
+    for (size_t p = 0; p < parts.size(); ++p)
+    {
+        const size_t end = p + 1 < parts.size() ? parts[p + 1] : triangleCount;
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t i = parts[p]; i < end; ++i)
+        {
+            const glm::vec3 &p0 = vertices[indices[3 * i + 0]].pos;
+            const glm::vec3 &p1 = vertices[indices[3 * i + 1]].pos;
+            const glm::vec3 &p2 = vertices[indices[3 * i + 2]].pos;
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float a = glm::length(n);
+            center += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        const float length = glm::length(normal);
+        sortKeys[p] = area > 0.0f && length > 0.0f
+                          ? glm::dot(center / area - meshCenter, normal / length)
+                          : 0.0f;
+    }
+
+    std::vector<uint32_t> order(parts.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t p : order)
+    {
+        const size_t end = p + 1 < parts.size() ? parts[p + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + parts[p] * 3, indices.begin() + end * 3);
+    }
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices = std::move(result);
+    return static_cast<uint32_t>(parts.size());
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex> &vertices,
+                                        std::vector<uint32_t> &indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    uint32_t next = 0;
+    for (uint32_t &index : indices)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    std::vector<Vertex> result(next);
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        if (remap[i] != UINT32_MAX)
+        {
+            result[remap[i]] = vertices[i];
+        }
+    }
+    vertices = std::move(result);
+}
+
+void MeshOptimizer::Optimize(MeshData &mesh, MeshOptimizeReport *report)
+{
+    MeshOptimizeReport optimizeReport;
+    const size_t verticesCount = mesh.vertices.size();
+    optimizeReport.cacheBefore =
+        AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), verticesCount);
+    optimizeReport.overfetchBefore = AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(),
+                                                        verticesCount, sizeof(Vertex));
+
+    const std::vector<uint32_t> clusters = OptimizeVertexCache(mesh.indices, verticesCount);
+    optimizeReport.clusters = OptimizeOverdraw(mesh.indices, mesh.vertices, clusters);
+    OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+    optimizeReport.removedVertices = static_cast<uint32_t>(verticesCount - mesh.vertices.size());
+    optimizeReport.cacheAfter =
+        AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+    optimizeReport.overfetchAfter = AnalyzeVertexFetch(
+        mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), sizeof(Vertex));
+    if (report)
+    {
+        *report = optimizeReport;
+    }
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t *indices, size_t indicesCount,
+                                                   size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < indicesCount; ++i)
+    {
+        misses += cache.Access(indices[i]);
+        if (!referenced[indices[i]])
+        {
+            referenced[indices[i]] = true;
+            referencedCount++;
+        }
+    }
+    if (indicesCount >= 3)
+    {
+        stats.acmr = float(misses) / float(indicesCount / 3);
+    }
+    if (referencedCount > 0)
+    {
+        stats.atvr = float(misses) / float(referencedCount);
+    }
+    return stats;
+}
+
+float MeshOptimizer::AnalyzeVertexFetch(const uint32_t *indices, size_t indicesCount,
+                                        size_t vertexCount, size_t vertexSize)
+{
+    // Direct mapped, every index reads its vertex unless the lines are still cached
+    std::vector<size_t> lines(FETCH_CACHE_SIZE / FETCH_CACHE_LINE, SIZE_MAX);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t fetched = 0;
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < indicesCount; ++i)
+    {
+        const uint32_t index = indices[i];
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            referencedCount++;
+        }
+        const size_t first = index * vertexSize / FETCH_CACHE_LINE;
+        const size_t last = ((index + 1) * vertexSize - 1) / FETCH_CACHE_LINE;
+        for (size_t line = first; line <= last; ++line)
+        {
+            size_t &slot = lines[line % lines.size()];
+            if (slot != line)
+            {
+                slot = line;
+                fetched += FETCH_CACHE_LINE;
+            }
+        }
+    }
+    return referencedCount > 0 ? float(fetched) / float(referencedCount * vertexSize) : 0.0f;
+}
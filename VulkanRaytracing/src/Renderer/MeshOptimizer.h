@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ObjModel.h"
+
+// FIFO post-transform cache the triangle order is tuned for and measured with
+#define VERTEX_CACHE_SIZE 16
+// How much worse than its cluster's ACMR a split off cluster may be
+#define OVERDRAW_THRESHOLD 1.05f
+
+struct VertexCacheStats
+{
+    // Transformed vertices per triangle, between 0.5 and 3
+    float acmr = 0.0f;
+    // Transformed vertices per referenced vertex, 1 at best
+    float atvr = 0.0f;
+};
+
+struct MeshOptimizeReport
+{
+    VertexCacheStats cacheBefore;
+    VertexCacheStats cacheAfter;
+    // Bytes read from the vertex buffer in 64 byte lines per byte of referenced vertices
+    float overfetchBefore = 0.0f;
+    float overfetchAfter = 0.0f;
+    uint32_t clusters = 0;
+    uint32_t removedVertices = 0;
+};
+
+// Reorders the triangles of a mesh for the post-transform vertex cache and reduced overdraw, then
+// the vertices in the order the triangles first use them. Triangles are ordered with Tipsify
+// (Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw), whose
+// clusters are split further where the ACMR allows and sorted to draw outward facing clusters
+// first.
+class MeshOptimizer
+{
+  public:
+    // Returns the first triangle of each cluster, a new one starts wherever the order jumps
+    static std::vector<uint32_t> OptimizeVertexCache(std::vector<uint32_t> &indices,
+                                                     size_t vertexCount,
+                                                     uint32_t cacheSize = VERTEX_CACHE_SIZE);
+    static uint32_t OptimizeOverdraw(std::vector<uint32_t> &indices,
+                                     const std::vector<Vertex> &vertices,
+                                     const std::vector<uint32_t> &clusters,
+                                     float threshold = OVERDRAW_THRESHOLD,
+                                     uint32_t cacheSize = VERTEX_CACHE_SIZE);
+    // Vertices no triangle uses are dropped
+    static void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+    // Runs all three passes
+    static void Optimize(MeshData &mesh, MeshOptimizeReport *report = nullptr);
+
+    static VertexCacheStats AnalyzeVertexCache(const uint32_t *indices, size_t indicesCount,
+                                               size_t vertexCount,
+                                               uint32_t cacheSize = VERTEX_CACHE_SIZE);
+    static float AnalyzeVertexFetch(const uint32_t *indices, size_t indicesCount,
+                                    size_t vertexCount, size_t vertexSize);
+};
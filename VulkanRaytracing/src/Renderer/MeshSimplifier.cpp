@@ -0,0 +1,471 @@
+#include "vkpch.h"
+
+#include "MeshSimplifier.h"
+
+#include "MeshOptimizer.h"
+
+#include <numeric>
+#include <queue>
+
+// Symmetric 4x4 matrix of summed squared plane distances, weighted by the area of the planes
+struct Quadric
+{
+    // Upper triangle row by row, xx xy xz xw yy yz yw zz zw ww
+    double m[10] = {};
+    double weight = 0.0;
+
+    void AddPlane(const glm::vec3 &normal, const glm::vec3 &point, double planeWeight)
+    {
+        const double plane[4] = {normal.x, normal.y, normal.z, -glm::dot(normal, point)};
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            for (uint32_t j = i; j < 4; ++j)
+            {
+                m[k++] += plane[i] * plane[j] * planeWeight;
+            }
+        }
+        weight += planeWeight;
+    }
+
+    Quadric &operator+=(const Quadric &other)
+    {
+        for (uint32_t k = 0; k < 10; ++k)
+        {
+            m[k] += other.m[k];
+        }
+        weight += other.weight;
+        return *this;
+    }
+
+    // Root of the weighted mean squared distance from the planes
+    float GetError(const glm::vec3 &point) const
+    {
+        const double p[4] = {point.x, point.y, point.z, 1.0};
+        double error = 0.0;
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            for (uint32_t j = i; j < 4; ++j)
+            {
+                error += (i == j ? 1.0 : 2.0) * m[k++] * p[i] * p[j];
+            }
+        }
+        return weight > 0.0 ? static_cast<float>(std::sqrt(std::max(error, 0.0) / weight)) : 0.0f;
+    }
+};
+
+// Collapse state of a mesh that can be simplified further in steps, one per level of detail
+class EdgeCollapser
+{
+  public:
+    EdgeCollapser(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
+
+    void Collapse(size_t targetIndexCount, float targetError);
+    void GetIndices(std::vector<uint32_t> &result) const;
+
+    size_t GetIndexCount() const
+    {
+        return 3 * m_LiveTriangles;
+    }
+
+    // Largest error of all collapses so far
+    float GetError() const
+    {
+        return m_Error;
+    }
+
+  private:
+    struct Candidate
+    {
+        float error;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Candidate &other) const
+        {
+            return error > other.error;
+        }
+    };
+
+    uint32_t GetPosition(uint32_t triangle, uint32_t corner) const
+    {
+        return m_PositionIds[m_Corners[3 * triangle + corner]];
+    }
+
+    void Push(uint32_t from, uint32_t to);
+    bool CanCollapse(uint32_t from, uint32_t to);
+    void Apply(uint32_t from, uint32_t to);
+    uint32_t MatchVertex(uint32_t vertex, uint32_t position) const;
+
+  private:
+    const std::vector<Vertex> &m_Vertices;
+    std::vector<uint32_t> m_Corners;
+    std::vector<uint8_t> m_LiveTriangle;
+    size_t m_LiveTriangles = 0;
+
+    // Vertices welded by position, m_PositionVertices lists the vertices of each position
+    std::vector<uint32_t> m_PositionIds;
+    std::vector<uint32_t> m_PositionOffsets;
+    std::vector<uint32_t> m_PositionVertices;
+    std::vector<glm::vec3> m_Positions;
+    std::vector<Quadric> m_Quadrics;
+    // Incremented whenever the quadric of a position changes, which outdates its candidates
+    std::vector<uint32_t> m_Versions;
+    std::vector<uint8_t> m_LivePosition;
+    // May still list triangles that were removed
+    std::vector<std::vector<uint32_t>> m_PositionTriangles;
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> m_Candidates;
+    std::vector<uint32_t> m_Stamps;
+    uint32_t m_Stamp = 0;
+    float m_Error = 0.0f;
+};
+
+EdgeCollapser::EdgeCollapser(const std::vector<Vertex> &vertices,
+                             const std::vector<uint32_t> &indices)
+    : m_Vertices(vertices), m_Corners(indices.begin(), indices.begin() + indices.size() / 3 * 3)
+{
+    const size_t vertexCount = vertices.size();
+    std::vector<uint32_t> sorted(vertexCount);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    auto less = [&vertices](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = vertices[a].pos;
+        const glm::vec3 &pb = vertices[b].pos;
+        return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+    };
+    std::sort(sorted.begin(), sorted.end(), less);
+    m_PositionIds.resize(vertexCount);
+    m_PositionVertices = sorted;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (i == 0 || less(sorted[i - 1], sorted[i]))
+        {
+            m_PositionOffsets.push_back(static_cast<uint32_t>(i));
+            m_Positions.push_back(vertices[sorted[i]].pos);
+        }
+        m_PositionIds[sorted[i]] = static_cast<uint32_t>(m_Positions.size() - 1);
+    }
+    m_PositionOffsets.push_back(static_cast<uint32_t>(vertexCount));
+
+    const size_t positionCount = m_Positions.size();
+    const size_t triangleCount = m_Corners.size() / 3;
+    m_Quadrics.resize(positionCount);
+    m_Versions.resize(positionCount, 0);
+    m_LivePosition.resize(positionCount, 1);
+    m_PositionTriangles.resize(positionCount);
+    m_Stamps.resize(positionCount, 0);
+    m_LiveTriangle.resize(triangleCount, 0);
+
+    // Edges used by a single triangle are on the border
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t p[3] = {GetPosition(t, 0), GetPosition(t, 1), GetPosition(t, 2)};
+        if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0])
+        {
+            continue;
+        }
+        m_LiveTriangle[t] = 1;
+        m_LiveTriangles++;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            m_PositionTriangles[p[k]].push_back(t);
+            const uint32_t a = std::min(p[k], p[(k + 1) % 3]);
+            const uint32_t b = std::max(p[k], p[(k + 1) % 3]);
+            edgeUses[uint64_t(a) << 32 | b]++;
+        }
+    }
+
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        if (!m_LiveTriangle[t])
+        {
+            continue;
+        }
+        const uint32_t p[3] = {GetPosition(t, 0), GetPosition(t, 1), GetPosition(t, 2)};
+        const glm::vec3 &p0 = m_Positions[p[0]];
+        const glm::vec3 cross = glm::cross(m_Positions[p[1]] - p0, m_Positions[p[2]] - p0);
+        const float length = glm::length(cross);
+        if (length == 0.0f)
+        {
+            continue;
+        }
+        const glm::vec3 normal = cross / length;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            m_Quadrics[p[k]].AddPlane(normal, p0, 0.5 * length);
+        }
+
+        // A plane through the border edge and perpendicular to the triangle holds the edge in
+        // place
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t a = p[k];
+            const uint32_t b = p[(k + 1) % 3];
+            if (edgeUses[uint64_t(std::min(a, b)) << 32 | std::max(a, b)] != 1)
+            {
+                continue;
+            }
+            const glm::vec3 edge = m_Positions[b] - m_Positions[a];
+            const glm::vec3 borderNormal = glm::cross(edge, normal);
+            const float borderLength = glm::length(borderNormal);
+            if (borderLength > 0.0f)
+            {
+                const double weight = SIMPLIFY_BORDER_WEIGHT * glm::dot(edge, edge);
+                m_Quadrics[a].AddPlane(borderNormal / borderLength, m_Positions[a], weight);
+                m_Quadrics[b].AddPlane(borderNormal / borderLength, m_Positions[a], weight);
+            }
+        }
+    }
+
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        if (m_LiveTriangle[t])
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                Push(GetPosition(t, k), GetPosition(t, (k + 1) % 3));
+                Push(GetPosition(t, (k + 1) % 3), GetPosition(t, k));
+            }
+        }
+    }
+}
+
+void EdgeCollapser::Push(uint32_t from, uint32_t to)
+{
+    Quadric quadric = m_Quadrics[from];
+    quadric += m_Quadrics[to];
+    m_Candidates.push(
+        {quadric.GetError(m_Positions[to]), from, to, m_Versions[from], m_Versions[to]});
+}
+
+bool EdgeCollapser::CanCollapse(uint32_t from, uint32_t to)
+{
+    // Triangles moving with the collapse must not flip
+    uint32_t shared = 0;
+    for (uint32_t t : m_PositionTriangles[from])
+    {
+        if (!m_LiveTriangle[t])
+        {
+            continue;
+        }
+        glm::vec3 before[3];
+        glm::vec3 after[3];
+        bool hasTo = false;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t position = GetPosition(t, k);
+            hasTo = hasTo || position == to;
+            before[k] = m_Positions[position];
+            after[k] = position == from ? m_Positions[to] : before[k];
+        }
+        if (hasTo)
+        {
+            shared++;
+            continue;
+        }
+        const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+        const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (normalBefore != glm::vec3(0.0f) && glm::dot(normalBefore, normalAfter) <= 0.0f)
+        {
+            return false;
+        }
+    }
+    if (shared == 0)
+    {
+        return false;
+    }
+
+    // Positions next to both ends other than the ones across the removed triangles would join
+    // two parts of the surface into a non-manifold edge
+    const uint32_t fromStamp = ++m_Stamp;
+    const uint32_t commonStamp = ++m_Stamp;
+    for (uint32_t t : m_PositionTriangles[from])
+    {
+        for (uint32_t k = 0; k < 3 && m_LiveTriangle[t]; ++k)
+        {
+            m_Stamps[GetPosition(t, k)] = fromStamp;
+        }
+    }
+    uint32_t common = 0;
+    for (uint32_t t : m_PositionTriangles[to])
+    {
+        for (uint32_t k = 0; k < 3 && m_LiveTriangle[t]; ++k)
+        {
+            const uint32_t position = GetPosition(t, k);
+            if (position != from && position != to && m_Stamps[position] == fromStamp)
+            {
+                m_Stamps[position] = commonStamp;
+                common++;
+            }
+        }
+    }
+    return common <= shared;
+}
+
+uint32_t EdgeCollapser::MatchVertex(uint32_t vertex, uint32_t position) const
+{
+    const Vertex &source = m_Vertices[vertex];
+    uint32_t best = m_PositionVertices[m_PositionOffsets[position]];
+    float bestDistance = FLT_MAX;
+    for (uint32_t i = m_PositionOffsets[position]; i < m_PositionOffsets[position + 1]; ++i)
+    {
+        const Vertex &candidate = m_Vertices[m_PositionVertices[i]];
+        const glm::vec3 normal = candidate.norm - source.norm;
+        const glm::vec2 texCoord = candidate.texCoord - source.texCoord;
+        const float distance = (candidate.matID != source.matID ? 1e6f : 0.0f) +
+                               glm::dot(normal, normal) + glm::dot(texCoord, texCoord);
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = m_PositionVertices[i];
+        }
+    }
+    return best;
+}
+
+void EdgeCollapser::Apply(uint32_t from, uint32_t to)
+{
+    m_Quadrics[to] += m_Quadrics[from];
+    m_Versions[to]++;
+    m_LivePosition[from] = 0;
+
+    std::vector<uint32_t> &toTriangles = m_PositionTriangles[to];
+    for (uint32_t t : m_PositionTriangles[from])
+    {
+        if (!m_LiveTriangle[t])
+        {
+            continue;
+        }
+        if (GetPosition(t, 0) == to || GetPosition(t, 1) == to || GetPosition(t, 2) == to)
+        {
+            m_LiveTriangle[t] = 0;
+            m_LiveTriangles--;
+            continue;
+        }
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            if (GetPosition(t, k) == from)
+            {
+                m_Corners[3 * t + k] = MatchVertex(m_Corners[3 * t + k], to);
+            }
+        }
+        toTriangles.push_back(t);
+    }
+    std::vector<uint32_t>().swap(m_PositionTriangles[from]);
+    toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(),
+                                     [this](uint32_t t) { return !m_LiveTriangle[t]; }),
+                      toTriangles.end());
+
+    // The costs of the edges around the merged position changed
+    const uint32_t stamp = ++m_Stamp;
+    m_Stamps[to] = stamp;
+    for (uint32_t t : toTriangles)
+    {
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t position = GetPosition(t, k);
+            if (m_Stamps[position] != stamp)
+            {
+                m_Stamps[position] = stamp;
+                Push(position, to);
+                Push(to, position);
+            }
+        }
+    }
+}
+
+void EdgeCollapser::Collapse(size_t targetIndexCount, float targetError)
+{
+    while (3 * m_LiveTriangles > targetIndexCount && !m_Candidates.empty())
+    {
+        const Candidate candidate = m_Candidates.top();
+        if (!m_LivePosition[candidate.from] || !m_LivePosition[candidate.to] ||
+            candidate.fromVersion != m_Versions[candidate.from] ||
+            candidate.toVersion != m_Versions[candidate.to])
+        {
+            m_Candidates.pop();
+            continue;
+        }
+        // Left in the queue for a later call with a larger error
+        if (candidate.error > targetError)
+        {
+            break;
+        }
+        m_Candidates.pop();
+        if (CanCollapse(candidate.from, candidate.to))
+        {
+            Apply(candidate.from, candidate.to);
+            m_Error = std::max(m_Error, candidate.error);
+        }
+    }
+}
+
+void EdgeCollapser::GetIndices(std::vector<uint32_t> &result) const
+{
+    result.clear();
+    result.reserve(GetIndexCount());
+    for (size_t t = 0; t < m_LiveTriangle.size(); ++t)
+    {
+        if (m_LiveTriangle[t])
+        {
+            result.insert(result.end(), m_Corners.begin() + 3 * t, m_Corners.begin() + 3 * t + 3);
+        }
+    }
+}
+
+float MeshSimplifier::Simplify(const std::vector<Vertex> &vertices,
+                               const std::vector<uint32_t> &indices, size_t targetIndexCount,
+                               float targetError, std::vector<uint32_t> &result)
+{
+    EdgeCollapser collapser(vertices, indices);
+    collapser.Collapse(targetIndexCount, targetError);
+    collapser.GetIndices(result);
+    return collapser.GetError();
+}
+
+void MeshSimplifier::BuildLods(MeshData &mesh, const LodSettings &settings)
+{
+    mesh.lods.clear();
+    mesh.lodSettings = settings;
+    if (mesh.indices.empty())
+    {
+        return;
+    }
+    mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+
+    glm::vec3 minimum(FLT_MAX);
+    glm::vec3 maximum(-FLT_MAX);
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        minimum = glm::min(minimum, vertex.pos);
+        maximum = glm::max(maximum, vertex.pos);
+    }
+    const float radius = glm::length(maximum - minimum) * 0.5f;
+
+    EdgeCollapser collapser(mesh.vertices, mesh.indices);
+    std::vector<uint32_t> level;
+    for (uint32_t i = 0; i < settings.maxLevels; ++i)
+    {
+        const uint32_t previousCount = mesh.lods.back().indexCount;
+        const size_t target = static_cast<size_t>(previousCount / 3 * settings.reduction) * 3;
+        if (target == 0)
+        {
+            break;
+        }
+        collapser.Collapse(target, settings.maxError * radius);
+        if (collapser.GetIndexCount() == 0 ||
+            collapser.GetIndexCount() > previousCount * LOD_MIN_REDUCTION)
+        {
+            break;
+        }
+        collapser.GetIndices(level);
+        MeshOptimizer::OptimizeVertexCache(level, mesh.vertices.size());
+        mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()),
+                             static_cast<uint32_t>(level.size()), collapser.GetError()});
+        mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ObjModel.h"
+
+// Edges along the open border of a mesh weigh this much more than the surface around them, so
+// simplified meshes keep their outline
+#define SIMPLIFY_BORDER_WEIGHT 10.0
+// A level of detail that keeps more of the triangles of the level before is not worth drawing
+#define LOD_MIN_REDUCTION 0.85f
+
+// Simplifies meshes with quadric error metrics (Garland and Heckbert, Surface Simplification
+// Using Quadric Error Metrics). Edges are collapsed onto one of their endpoints, so every level
+// of detail indexes the vertex buffer of the full mesh. Vertices are welded by position while
+// simplifying, and a collapsed corner takes the vertex at the new position whose material,
+// normal and texture coordinates are closest.
+class MeshSimplifier
+{
+  public:
+    // Collapses edges until at most targetIndexCount indices are left or the next collapse would
+    // move the surface further than targetError. Returns the error of the result.
+    static float Simplify(const std::vector<Vertex> &vertices,
+                          const std::vector<uint32_t> &indices, size_t targetIndexCount,
+                          float targetError, std::vector<uint32_t> &result);
+
+    // Appends the coarser levels to the indices, each one simplified further from the one before
+    // and ordered for the vertex cache
+    static void BuildLods(MeshData &mesh, const LodSettings &settings = {});
+};
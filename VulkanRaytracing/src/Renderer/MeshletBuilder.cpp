@@ -0,0 +1,267 @@
+#include "vkpch.h"
+
+#include "MeshletBuilder.h"
+
+#include <numeric>
+
+// Cones wider than this (cosine of the smallest angle to the axis) never cull anything
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+// The normals are those of the triangles in index buffer order
+static void ComputeBounds(const MeshData &mesh, const std::vector<glm::vec3> &normals,
+                          Meshlet &meshlet)
+{
+    const uint32_t firstIndex = meshlet.firstIndex;
+    const uint32_t indexCount = meshlet.indexCount;
+    glm::vec3 minimum(FLT_MAX);
+    glm::vec3 maximum(-FLT_MAX);
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; ++i)
+    {
+        minimum = glm::min(minimum, mesh.vertices[mesh.indices[i]].pos);
+        maximum = glm::max(maximum, mesh.vertices[mesh.indices[i]].pos);
+    }
+    meshlet.center = (minimum + maximum) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (uint32_t i = firstIndex; i < firstIndex + indexCount; ++i)
+    {
+        meshlet.radius = std::max(
+            meshlet.radius, glm::length(mesh.vertices[mesh.indices[i]].pos - meshlet.center));
+    }
+
+    glm::vec3 normalSum(0.0f);
+    for (uint32_t t = firstIndex / 3; t < (firstIndex + indexCount) / 3; ++t)
+    {
+        normalSum += normals[t];
+    }
+    const float length = glm::length(normalSum);
+    meshlet.coneAxis = length > 0.0f ? normalSum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneApex = meshlet.center;
+    meshlet.coneCutoff = 2.0f;
+
+    float minDot = 1.0f;
+    for (uint32_t t = firstIndex / 3; t < (firstIndex + indexCount) / 3; ++t)
+    {
+        if (normals[t] != glm::vec3(0.0f))
+        {
+            minDot = std::min(minDot, glm::dot(normals[t], meshlet.coneAxis));
+        }
+    }
+    if (length == 0.0f || minDot <= MESHLET_MIN_CONE_DOT)
+    {
+        return;
+    }
+
+    // Move the apex back along the axis until every triangle plane is behind it, so that viewers
+    // inside the cone see the back of all of them
+    float maxT = 0.0f;
+    for (uint32_t t = firstIndex / 3; t < (firstIndex + indexCount) / 3; ++t)
+    {
+        if (normals[t] != glm::vec3(0.0f))
+        {
+            const glm::vec3 &p0 = mesh.vertices[mesh.indices[3 * t]].pos;
+            const float d = glm::dot(meshlet.center - p0, normals[t]) /
+                            glm::dot(meshlet.coneAxis, normals[t]);
+            maxT = std::max(maxT, d);
+        }
+    }
+    meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void MeshletBuilder::Build(MeshData &mesh, const MeshletSettings &settings)
+{
+    const size_t triangleCount = mesh.indices.size() / 3;
+    const size_t vertexCount = mesh.vertices.size();
+    const uint32_t maxTriangles = std::max(settings.maxTriangles, 1u);
+    const uint32_t maxVertices = std::max(settings.maxVertices, 3u);
+    mesh.meshlets.clear();
+    mesh.meshletSettings = settings;
+
+    std::vector<glm::vec3> normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const glm::vec3 &p0 = mesh.vertices[mesh.indices[3 * t + 0]].pos;
+        const glm::vec3 &p1 = mesh.vertices[mesh.indices[3 * t + 1]].pos;
+        const glm::vec3 &p2 = mesh.vertices[mesh.indices[3 * t + 2]].pos;
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+    }
+
+    // Neighbours are found through positions rather than vertices, so faces with their own
+    // normals still form meshlets
+    std::vector<uint32_t> sorted(vertexCount);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    auto less = [&mesh](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = mesh.vertices[a].pos;
+        const glm::vec3 &pb = mesh.vertices[b].pos;
+        return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+    };
+    std::sort(sorted.begin(), sorted.end(), less);
+    std::vector<uint32_t> positionIds(vertexCount);
+    uint32_t positionCount = 0;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (i > 0 && less(sorted[i - 1], sorted[i]))
+        {
+            positionCount++;
+        }
+        positionIds[sorted[i]] = positionCount;
+    }
+    positionCount += vertexCount > 0;
+
+    // Triangles around each position
+    std::vector<uint32_t> offsets(positionCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        offsets[positionIds[mesh.indices[i]] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        adjacency[fill[positionIds[mesh.indices[i]]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Stamped with the meshlet number plus one while in the current meshlet
+    std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+    std::vector<uint32_t> positionMeshlet(positionCount, 0);
+    std::vector<uint32_t> candidateMeshlet(triangleCount, 0);
+    std::vector<bool> taken(triangleCount, false);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(mesh.indices.size());
+
+    size_t seed = 0;
+    uint32_t stamp = 0;
+    std::vector<glm::vec3> sortedNormals;
+    sortedNormals.reserve(triangleCount);
+    while (true)
+    {
+        while (seed < triangleCount && taken[seed])
+        {
+            seed++;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        stamp++;
+        candidates.clear();
+        const uint32_t firstIndex = static_cast<uint32_t>(result.size());
+        uint32_t triangles = 0;
+        uint32_t vertices = 0;
+        glm::vec3 normalSum(0.0f);
+
+        auto newVertices = [&](size_t triangle) {
+            uint32_t count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                count += vertexMeshlet[mesh.indices[3 * triangle + k]] != stamp;
+            }
+            return count;
+        };
+        auto add = [&](size_t triangle) {
+            taken[triangle] = true;
+            triangles++;
+            normalSum += normals[triangle];
+            sortedNormals.push_back(normals[triangle]);
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t vertex = mesh.indices[3 * triangle + k];
+                const uint32_t position = positionIds[vertex];
+                result.push_back(vertex);
+                if (vertexMeshlet[vertex] != stamp)
+                {
+                    vertexMeshlet[vertex] = stamp;
+                    vertices++;
+                }
+                if (positionMeshlet[position] == stamp)
+                {
+                    continue;
+                }
+                positionMeshlet[position] = stamp;
+                for (uint32_t j = offsets[position]; j < offsets[position + 1]; ++j)
+                {
+                    const uint32_t neighbour = adjacency[j];
+                    if (!taken[neighbour] && candidateMeshlet[neighbour] != stamp)
+                    {
+                        candidateMeshlet[neighbour] = stamp;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+        };
+
+        add(seed);
+        while (triangles < maxTriangles)
+        {
+            const float length = glm::length(normalSum);
+            const glm::vec3 axis = length > 0.0f ? normalSum / length : glm::vec3(0.0f);
+
+            size_t best = SIZE_MAX;
+            float bestScore = FLT_MAX;
+            size_t kept = 0;
+            for (uint32_t triangle : candidates)
+            {
+                if (taken[triangle])
+                {
+                    continue;
+                }
+                candidates[kept++] = triangle;
+                const uint32_t added = newVertices(triangle);
+                if (vertices + added > maxVertices)
+                {
+                    continue;
+                }
+                const float score =
+                    added + settings.coneWeight * (1.0f - glm::dot(normals[triangle], axis));
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    best = triangle;
+                }
+            }
+            candidates.resize(kept);
+            if (best == SIZE_MAX)
+            {
+                break;
+            }
+            add(best);
+        }
+
+        Meshlet meshlet = {};
+        meshlet.firstIndex = firstIndex;
+        meshlet.indexCount = static_cast<uint32_t>(result.size()) - firstIndex;
+        meshlet.verticesCount = vertices;
+        mesh.meshlets.push_back(meshlet);
+    }
+
+    // Indices past the last full triangle are kept as they are
+    result.insert(result.end(), mesh.indices.begin() + triangleCount * 3, mesh.indices.end());
+    mesh.indices = std::move(result);
+    for (Meshlet &meshlet : mesh.meshlets)
+    {
+        ComputeBounds(mesh, sortedNormals, meshlet);
+    }
+}
+
+MeshletStats MeshletBuilder::GetStats(const std::vector<Meshlet> &meshlets)
+{
+    MeshletStats stats;
+    stats.meshlets = static_cast<uint32_t>(meshlets.size());
+    for (const Meshlet &meshlet : meshlets)
+    {
+        stats.triangles += meshlet.indexCount / 3;
+        stats.vertices += meshlet.verticesCount;
+        stats.cullableMeshlets += meshlet.coneCutoff <= 1.0f;
+    }
+    if (stats.meshlets > 0)
+    {
+        stats.triangles /= stats.meshlets;
+        stats.vertices /= stats.meshlets;
+    }
+    return stats;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ObjModel.h"
+
+struct MeshletStats
+{
+    uint32_t meshlets = 0;
+    // Averages over all meshlets
+    float triangles = 0.0f;
+    float vertices = 0.0f;
+    // Meshlets whose normal cone can cull them from some viewpoint
+    uint32_t cullableMeshlets = 0;
+};
+
+// Splits a mesh into meshlets and reorders its triangles so that each meshlet is one range of the
+// index buffer. A meshlet starts at the first triangle not yet taken, in the order the mesh
+// optimizer left, and grows over neighbouring triangles, preferring those that add few vertices
+// and face like the triangles already in it.
+class MeshletBuilder
+{
+  public:
+    static void Build(MeshData &mesh, const MeshletSettings &settings = {});
+
+    static MeshletStats GetStats(const std::vector<Meshlet> &meshlets);
+};
@@ -0,0 +1,92 @@
+#include "vkpch.h"
+
+#include "MeshletCuller.h"
+
+CullView MeshletCuller::CreateView(const glm::mat4 &viewProjection,
+                                   const glm::vec3 &cameraPosition)
+{
+    auto row = [&viewProjection](int i) {
+        return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+                         viewProjection[3][i]);
+    };
+
+    CullView view;
+    view.planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1),
+                   row(3) - row(1), row(2),          row(3) - row(2)};
+    for (glm::vec4 &plane : view.planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    view.cameraPosition = cameraPosition;
+    return view;
+}
+
+void MeshletCuller::Cull(const std::vector<Meshlet> &meshlets, const glm::mat4 &modelMatrix,
+                         const glm::mat4 &modelMatrixIT, const CullView &view,
+                         std::vector<IndexRange> &ranges, MeshletCullStats *stats)
+{
+    const float scale = std::sqrt(std::max(
+        {glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+         glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1])),
+         glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))}));
+    const glm::mat3 normalMatrix(modelMatrixIT);
+
+    MeshletCullStats cullStats;
+    const size_t firstRange = ranges.size();
+    for (const Meshlet &meshlet : meshlets)
+    {
+        const uint32_t triangles = meshlet.indexCount / 3;
+        cullStats.meshlets++;
+        cullStats.triangles += triangles;
+
+        const glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(meshlet.center, 1.0f));
+        const float radius = meshlet.radius * scale;
+        bool visible = true;
+        for (const glm::vec4 &plane : view.planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            {
+                visible = false;
+                break;
+            }
+        }
+        if (!visible)
+        {
+            cullStats.frustumCulledTriangles += triangles;
+            continue;
+        }
+
+        if (meshlet.coneCutoff <= 1.0f)
+        {
+            const glm::vec3 apex = glm::vec3(modelMatrix * glm::vec4(meshlet.coneApex, 1.0f));
+            const glm::vec3 axis = glm::normalize(normalMatrix * meshlet.coneAxis);
+            const glm::vec3 toApex = apex - view.cameraPosition;
+            const float distance = glm::length(toApex);
+            if (distance > 0.0f && glm::dot(toApex / distance, axis) >= meshlet.coneCutoff)
+            {
+                cullStats.coneCulledTriangles += triangles;
+                continue;
+            }
+        }
+
+        if (ranges.size() > firstRange &&
+            ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex)
+        {
+            ranges.back().indexCount += meshlet.indexCount;
+        }
+        else
+        {
+            ranges.push_back({meshlet.firstIndex, meshlet.indexCount});
+        }
+    }
+    cullStats.ranges = ranges.size() - firstRange;
+
+    if (stats)
+    {
+        stats->meshlets += cullStats.meshlets;
+        stats->triangles += cullStats.triangles;
+        stats->frustumCulledTriangles += cullStats.frustumCulledTriangles;
+        stats->coneCulledTriangles += cullStats.coneCulledTriangles;
+        stats->ranges += cullStats.ranges;
+    }
+}
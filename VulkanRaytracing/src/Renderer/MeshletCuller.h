@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ObjModel.h"
+
+#include <array>
+
+struct CullView
+{
+    // Inward facing planes with unit normals, left, right, bottom, top, near and far
+    std::array<glm::vec4, 6> planes;
+    glm::vec3 cameraPosition;
+};
+
+struct IndexRange
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+struct MeshletCullStats
+{
+    uint64_t meshlets = 0;
+    uint64_t triangles = 0;
+    uint64_t frustumCulledTriangles = 0;
+    uint64_t coneCulledTriangles = 0;
+    uint64_t ranges = 0;
+
+    float GetRejectionRate() const
+    {
+        return triangles ? float(frustumCulledTriangles + coneCulledTriangles) / triangles : 0.0f;
+    }
+};
+
+// Culls the meshlets of an instance against the view frustum and their normal cones on the CPU.
+// Meshlets that pass and follow each other in the index buffer are merged into one range, so each
+// range is a single drawIndexed.
+class MeshletCuller
+{
+  public:
+    // The projection maps depth to [0, 1]
+    static CullView CreateView(const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition);
+
+    // Appends the ranges to draw. Non-uniform scales only widen the bounding spheres, the cones
+    // are kept in the directions modelMatrixIT gives them.
+    static void Cull(const std::vector<Meshlet> &meshlets, const glm::mat4 &modelMatrix,
+                     const glm::mat4 &modelMatrixIT, const CullView &view,
+                     std::vector<IndexRange> &ranges, MeshletCullStats *stats = nullptr);
+};
@@ -0,0 +1,356 @@
+#include "vkpch.h"
+
+#include "NormalGenerator.h"
+
+#include "Core/ThreadPool.h"
+
+#include <atomic>
+#include <emmintrin.h>
+
+#define NORMAL_TRIANGLES_PER_TASK (1 << 12)
+#define NORMAL_POSITIONS_PER_TASK (1 << 12)
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 Dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+// 1 / x where x is positive, 0 elsewhere
+static inline __m128 SafeReciprocal(__m128 x)
+{
+    return _mm_and_ps(_mm_cmpgt_ps(x, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), x));
+}
+
+// Abramowitz and Stegun 4.4.45, within 7e-5 radians of acos
+static inline __m128 Acos(__m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    const __m128 ax = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    __m128 p = _mm_set1_ps(-0.0187293f);
+    p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(0.0742610f));
+    p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(-0.2121144f));
+    p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(1.5707288f));
+    p = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), ax)));
+    const __m128 mirrored = _mm_sub_ps(_mm_set1_ps(3.14159265f), p);
+    return Select(_mm_cmplt_ps(x, _mm_setzero_ps()), mirrored, p);
+}
+
+// Unit face normals and corner weights of four triangles starting at first. Lanes past the last
+// triangle repeat it and are not stored.
+static void ComputeFaces(const float *positions, const uint32_t *cornerPositions, size_t first,
+                         size_t triangleCount, NormalWeighting weighting, glm::vec3 *faceNormals,
+                         float *weights)
+{
+    const size_t count = std::min<size_t>(4, triangleCount - first);
+    __m128 p[3][3];
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        float lanes[3][4];
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            const size_t triangle = first + std::min(lane, count - 1);
+            const float *position = positions + 3 * size_t(cornerPositions[3 * triangle + k]);
+            lanes[0][lane] = position[0];
+            lanes[1][lane] = position[1];
+            lanes[2][lane] = position[2];
+        }
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            p[k][axis] = _mm_loadu_ps(lanes[axis]);
+        }
+    }
+
+    __m128 e01[3], e02[3], e12[3];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        e01[axis] = _mm_sub_ps(p[1][axis], p[0][axis]);
+        e02[axis] = _mm_sub_ps(p[2][axis], p[0][axis]);
+        e12[axis] = _mm_sub_ps(p[2][axis], p[1][axis]);
+    }
+    // Same operation order as glm::cross and glm::normalize
+    __m128 n[3];
+    n[0] = _mm_sub_ps(_mm_mul_ps(e01[1], e02[2]), _mm_mul_ps(e02[1], e01[2]));
+    n[1] = _mm_sub_ps(_mm_mul_ps(e01[2], e02[0]), _mm_mul_ps(e02[2], e01[0]));
+    n[2] = _mm_sub_ps(_mm_mul_ps(e01[0], e02[1]), _mm_mul_ps(e02[0], e01[1]));
+    const __m128 length = _mm_sqrt_ps(Dot(n[0], n[1], n[2], n[0], n[1], n[2]));
+    const __m128 inverseLength = SafeReciprocal(length);
+
+    __m128 w[3];
+    if (weighting == NormalWeighting::Area)
+    {
+        w[0] = w[1] = w[2] = _mm_mul_ps(length, _mm_set1_ps(0.5f));
+    }
+    else
+    {
+        const __m128 l01 = _mm_sqrt_ps(Dot(e01[0], e01[1], e01[2], e01[0], e01[1], e01[2]));
+        const __m128 l02 = _mm_sqrt_ps(Dot(e02[0], e02[1], e02[2], e02[0], e02[1], e02[2]));
+        const __m128 l12 = _mm_sqrt_ps(Dot(e12[0], e12[1], e12[2], e12[0], e12[1], e12[2]));
+        const __m128 d0 = Dot(e01[0], e01[1], e01[2], e02[0], e02[1], e02[2]);
+        const __m128 d1 = Dot(e01[0], e01[1], e01[2], e12[0], e12[1], e12[2]);
+        const __m128 d2 = Dot(e02[0], e02[1], e02[2], e12[0], e12[1], e12[2]);
+        // The edges leave corner 1 as -e01 and e12, and corner 2 as -e02 and -e12
+        w[0] = Acos(_mm_mul_ps(d0, SafeReciprocal(_mm_mul_ps(l01, l02))));
+        const __m128 cos1 = _mm_mul_ps(d1, SafeReciprocal(_mm_mul_ps(l01, l12)));
+        w[1] = Acos(_mm_sub_ps(_mm_setzero_ps(), cos1));
+        w[2] = Acos(_mm_mul_ps(d2, SafeReciprocal(_mm_mul_ps(l02, l12))));
+    }
+
+    float normal[3][4];
+    float weight[3][4];
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        _mm_storeu_ps(normal[k], _mm_mul_ps(n[k], inverseLength));
+        _mm_storeu_ps(weight[k], w[k]);
+    }
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        faceNormals[first + lane] = {normal[0][lane], normal[1][lane], normal[2][lane]};
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            weights[3 * (first + lane) + k] = weight[k][lane];
+        }
+    }
+}
+
+// Normals of the corners around one position. The keys are sorted so that the sums do not
+// depend on the scheduling, faceOf and weightOf give the face normal and weight of a key.
+template <typename FaceOf, typename WeightOf, typename Store>
+static void SmoothPosition(uint32_t *begin, uint32_t *end, float minDot, FaceOf faceOf,
+                           WeightOf weightOf, Store store)
+{
+    std::sort(begin, end);
+
+    glm::vec3 smooth(0.0f);
+    for (const uint32_t *c = begin; c < end; ++c)
+    {
+        smooth += faceOf(*c) * weightOf(*c);
+    }
+    for (const uint32_t *c = begin; c < end; ++c)
+    {
+        // Summed in the same order for every corner, so corners that see the same faces get the
+        // same normal
+        const glm::vec3 &face = faceOf(*c);
+        glm::vec3 sum(0.0f);
+        for (const uint32_t *other = begin; other < end; ++other)
+        {
+            const glm::vec3 &otherFace = faceOf(*other);
+            if (glm::dot(face, otherFace) >= minDot)
+            {
+                sum += otherFace * weightOf(*other);
+            }
+        }
+        // Degenerate faces take the normal of the surface around them
+        sum = sum == glm::vec3(0.0f) ? smooth : sum;
+        const float length = glm::length(sum);
+        store(*c, length > 0.0f ? sum / length : face);
+    }
+}
+
+void NormalGenerator::Generate(const float *positions, size_t positionCount,
+                               const uint32_t *cornerPositions, size_t triangleCount,
+                               const NormalSettings &settings, Vertex *corners)
+{
+    ThreadPool &pool = ThreadPool::Get();
+    const size_t cornerCount = 3 * triangleCount;
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    std::vector<float> weights(cornerCount);
+    const size_t triangleBlocks =
+        (triangleCount + NORMAL_TRIANGLES_PER_TASK - 1) / NORMAL_TRIANGLES_PER_TASK;
+    pool.ParallelFor(triangleBlocks, [&](size_t block) {
+        const size_t first = block * NORMAL_TRIANGLES_PER_TASK;
+        const size_t last = std::min(first + NORMAL_TRIANGLES_PER_TASK, triangleCount);
+        for (size_t t = first; t < last; t += 4)
+        {
+            ComputeFaces(positions, cornerPositions, t, last, settings.weighting,
+                         faceNormals.data(), weights.data());
+        }
+    });
+
+    if (settings.creaseAngle <= 0.0f)
+    {
+        pool.ParallelFor(triangleCount, [&](size_t t) {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                corners[3 * t + k].norm = faceNormals[t];
+            }
+        });
+        return;
+    }
+
+    // Corners around each position
+    const size_t cornerBlocks =
+        (cornerCount + NORMAL_TRIANGLES_PER_TASK - 1) / NORMAL_TRIANGLES_PER_TASK;
+    std::unique_ptr<std::atomic<uint32_t>[]> cursors(
+        new std::atomic<uint32_t>[positionCount + 1]());
+    pool.ParallelFor(cornerBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, cornerCount);
+        for (size_t c = block * NORMAL_TRIANGLES_PER_TASK; c < last; ++c)
+        {
+            cursors[cornerPositions[c] + 1].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint32_t> offsets(positionCount + 1, 0);
+    for (size_t i = 1; i <= positionCount; ++i)
+    {
+        offsets[i] = offsets[i - 1] + cursors[i].load(std::memory_order_relaxed);
+        cursors[i - 1].store(offsets[i - 1], std::memory_order_relaxed);
+    }
+    std::vector<uint32_t> positionCorners(cornerCount);
+    pool.ParallelFor(cornerBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, cornerCount);
+        for (size_t c = block * NORMAL_TRIANGLES_PER_TASK; c < last; ++c)
+        {
+            const uint32_t slot =
+                cursors[cornerPositions[c]].fetch_add(1, std::memory_order_relaxed);
+            positionCorners[slot] = static_cast<uint32_t>(c);
+        }
+    });
+
+    const float minDot = std::cos(glm::radians(settings.creaseAngle));
+    const size_t positionBlocks =
+        (positionCount + NORMAL_POSITIONS_PER_TASK - 1) / NORMAL_POSITIONS_PER_TASK;
+    pool.ParallelFor(positionBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_POSITIONS_PER_TASK, positionCount);
+        for (size_t position = block * NORMAL_POSITIONS_PER_TASK; position < last; ++position)
+        {
+            SmoothPosition(
+                positionCorners.data() + offsets[position],
+                positionCorners.data() + offsets[position + 1], minDot,
+                [&](uint32_t c) -> const glm::vec3 & { return faceNormals[c / 3]; },
+                [&](uint32_t c) { return weights[c]; },
+                [&](uint32_t c, const glm::vec3 &normal) { corners[c].norm = normal; });
+        }
+    });
+}
+
+void NormalGenerator::GenerateRange(const float *positions, const uint32_t *cornerPositions,
+                                    size_t triangleCount, uint32_t firstPosition,
+                                    uint32_t endPosition, const NormalSettings &settings,
+                                    std::vector<glm::vec3> &normals)
+{
+    ThreadPool &pool = ThreadPool::Get();
+    const size_t cornerCount = 3 * triangleCount;
+    const size_t cornerBlocks =
+        (cornerCount + NORMAL_TRIANGLES_PER_TASK - 1) / NORMAL_TRIANGLES_PER_TASK;
+    auto inRange = [&](size_t c) {
+        return cornerPositions[c] >= firstPosition && cornerPositions[c] < endPosition;
+    };
+
+    // Each corner in the range becomes an entry holding a copy of its triangle, in corner order
+    std::vector<size_t> blockOffsets(cornerBlocks + 1, 0);
+    pool.ParallelFor(cornerBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, cornerCount);
+        size_t count = 0;
+        for (size_t c = block * NORMAL_TRIANGLES_PER_TASK; c < last; ++c)
+        {
+            count += inRange(c);
+        }
+        blockOffsets[block + 1] = count;
+    });
+    for (size_t block = 1; block <= cornerBlocks; ++block)
+    {
+        blockOffsets[block] += blockOffsets[block - 1];
+    }
+    const size_t entryCount = blockOffsets[cornerBlocks];
+    std::vector<uint32_t> entryPositions(3 * entryCount);
+    std::vector<uint8_t> entryCorners(entryCount);
+    pool.ParallelFor(cornerBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, cornerCount);
+        size_t entry = blockOffsets[block];
+        for (size_t c = block * NORMAL_TRIANGLES_PER_TASK; c < last; ++c)
+        {
+            if (inRange(c))
+            {
+                const size_t triangle = c / 3;
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    entryPositions[3 * entry + k] = cornerPositions[3 * triangle + k];
+                }
+                entryCorners[entry++] = static_cast<uint8_t>(c % 3);
+            }
+        }
+    });
+
+    std::vector<glm::vec3> faceNormals(entryCount);
+    std::vector<float> weights(3 * entryCount);
+    const size_t entryBlocks =
+        (entryCount + NORMAL_TRIANGLES_PER_TASK - 1) / NORMAL_TRIANGLES_PER_TASK;
+    pool.ParallelFor(entryBlocks, [&](size_t block) {
+        const size_t first = block * NORMAL_TRIANGLES_PER_TASK;
+        const size_t last = std::min(first + NORMAL_TRIANGLES_PER_TASK, entryCount);
+        for (size_t t = first; t < last; t += 4)
+        {
+            ComputeFaces(positions, entryPositions.data(), t, last, settings.weighting,
+                         faceNormals.data(), weights.data());
+        }
+    });
+
+    if (settings.creaseAngle <= 0.0f)
+    {
+        normals.swap(faceNormals);
+        return;
+    }
+
+    // Entries around each position, their order matches the corners so the sums come out the
+    // same as in Generate
+    const size_t positionCount = endPosition - firstPosition;
+    auto entryPosition = [&](size_t entry) {
+        return entryPositions[3 * entry + entryCorners[entry]] - firstPosition;
+    };
+    std::unique_ptr<std::atomic<uint32_t>[]> cursors(
+        new std::atomic<uint32_t>[positionCount + 1]());
+    pool.ParallelFor(entryBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, entryCount);
+        for (size_t entry = block * NORMAL_TRIANGLES_PER_TASK; entry < last; ++entry)
+        {
+            cursors[entryPosition(entry) + 1].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint32_t> offsets(positionCount + 1, 0);
+    for (size_t i = 1; i <= positionCount; ++i)
+    {
+        offsets[i] = offsets[i - 1] + cursors[i].load(std::memory_order_relaxed);
+        cursors[i - 1].store(offsets[i - 1], std::memory_order_relaxed);
+    }
+    std::vector<uint32_t> positionEntries(entryCount);
+    pool.ParallelFor(entryBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_TRIANGLES_PER_TASK, entryCount);
+        for (size_t entry = block * NORMAL_TRIANGLES_PER_TASK; entry < last; ++entry)
+        {
+            const uint32_t slot =
+                cursors[entryPosition(entry)].fetch_add(1, std::memory_order_relaxed);
+            positionEntries[slot] = static_cast<uint32_t>(entry);
+        }
+    });
+
+    normals.resize(entryCount);
+    const float minDot = std::cos(glm::radians(settings.creaseAngle));
+    const size_t positionBlocks =
+        (positionCount + NORMAL_POSITIONS_PER_TASK - 1) / NORMAL_POSITIONS_PER_TASK;
+    pool.ParallelFor(positionBlocks, [&](size_t block) {
+        const size_t last = std::min((block + 1) * NORMAL_POSITIONS_PER_TASK, positionCount);
+        for (size_t position = block * NORMAL_POSITIONS_PER_TASK; position < last; ++position)
+        {
+            SmoothPosition(
+                positionEntries.data() + offsets[position],
+                positionEntries.data() + offsets[position + 1], minDot,
+                [&](uint32_t e) -> const glm::vec3 & { return faceNormals[e]; },
+                [&](uint32_t e) { return weights[3 * e + entryCorners[e]]; },
+                [&](uint32_t e, const glm::vec3 &normal) { normals[e] = normal; });
+        }
+    });
+}
+
+size_t NormalGenerator::GetRangeBytes(size_t cornerCount, size_t positionCount)
+{
+    // Triangle, corner, face normal, weights, sorted entry and result of each corner in the
+    // range, offset and cursor of each position
+    return cornerCount * (3 * sizeof(uint32_t) + sizeof(uint8_t) + sizeof(glm::vec3) +
+                          3 * sizeof(float) + sizeof(uint32_t) + sizeof(glm::vec3)) +
+           (positionCount + 1) * 2 * sizeof(uint32_t);
+}
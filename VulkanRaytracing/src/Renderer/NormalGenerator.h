@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ObjModel.h"
+
+// Generates smooth vertex normals for triangle soups whose corners reference shared positions.
+// Each corner averages the normals of the faces around its position that are within the crease
+// angle of its own face, weighted by area or corner angle. Corners on the same smooth part of
+// the surface get bit identical normals and weld into one vertex again, so vertices are only
+// split along creases.
+//
+// Face normals and weights are computed four triangles at a time with SSE, the corners around
+// each position are gathered with a counting sort, and all passes run on the thread pool.
+class NormalGenerator
+{
+  public:
+    // Sets the normal of the corners, three per triangle. cornerPositions holds the index of
+    // the xyz triple in positions for each corner.
+    static void Generate(const float *positions, size_t positionCount,
+                         const uint32_t *cornerPositions, size_t triangleCount,
+                         const NormalSettings &settings, Vertex *corners);
+
+    // Same normals as Generate for the corners whose position lies in [firstPosition,
+    // endPosition), in corner order. Memory only grows with the corners and positions of the
+    // range, so meshes too large for Generate can be processed range by range out of a mapped
+    // cornerPositions.
+    static void GenerateRange(const float *positions, const uint32_t *cornerPositions,
+                              size_t triangleCount, uint32_t firstPosition, uint32_t endPosition,
+                              const NormalSettings &settings, std::vector<glm::vec3> &normals);
+
+    // Memory held by GenerateRange for a range with that many corners and positions
+    static size_t GetRangeBytes(size_t cornerCount, size_t positionCount);
+};
@@ -3,8 +3,19 @@
 #include "ObjModel.h"
 
 #include "Core/Core.h"
+#include "Core/ThreadPool.h"
+#include "Core/UploadManager.h"
 #include "Tools/FileTools.h"
 
+#include "AssetRegistry.h"
+#include "GltfFile.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "NormalGenerator.h"
+#include "MeshletBuilder.h"
+#include "ObjParser.h"
+#include "VertexPacker.h"
 #include "VulkanRenderer.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -14,6 +25,14 @@ std::vector<TextureImage> ObjModel::s_TextureImages;
 std::vector<TextureImage> ObjModel::s_SkyboxTextureImages;
 TextureImage ObjModel::s_Skysphere;
 TextureImage ObjModel::s_HdrSkysphere;
+TextureImage ObjModel::s_HdrSkybox;
+bool ObjModel::s_HdrSkyboxBaked = false;
+VertexLayout ObjModel::s_VertexLayout = VertexLayout::Full;
+NormalSettings ObjModel::s_NormalSettings;
+bool ObjModel::s_BuildMeshlets = false;
+MeshletSettings ObjModel::s_MeshletSettings;
+bool ObjModel::s_BuildLods = false;
+LodSettings ObjModel::s_LodSettings;
 
 vk::VertexInputBindingDescription Vertex::getBindingDescription()
 {
@@ -29,6 +48,78 @@ std::vector<vk::VertexInputAttributeDescription> Vertex::getAttributeDescription
             {4, 0, vk::Format::eR32Sint, offsetof(Vertex, matID)}};
 }
 
+std::vector<vk::VertexInputBindingDescription> Vertex::getBindingDescriptions(VertexLayout layout)
+{
+    if (layout == VertexLayout::Full)
+    {
+        return {getBindingDescription()};
+    }
+    return {{0, sizeof(glm::vec3)}, {1, sizeof(PackedVertex)}};
+}
+
+std::vector<vk::VertexInputAttributeDescription> Vertex::getAttributeDescriptions(
+    VertexLayout layout)
+{
+    if (layout == VertexLayout::Full)
+    {
+        return getAttributeDescriptions();
+    }
+    // The normal arrives still octahedral encoded and is decoded in the vertex shader
+    return {{0, 0, vk::Format::eR32G32B32Sfloat, 0},
+            {1, 1, vk::Format::eR16G16Snorm, offsetof(PackedVertex, norm)},
+            {2, 1, vk::Format::eR8G8B8A8Unorm, offsetof(PackedVertex, color)},
+            {3, 1, vk::Format::eR16G16Sfloat, offsetof(PackedVertex, texCoord)}};
+}
+
+static inline void HashCombine(size_t &seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static inline size_t HashFloat(float value)
+{
+    // Adding zero folds -0.0f into 0.0f so that equal vertices always hash equally
+    return std::hash<float>()(value + 0.0f);
+}
+
+MeshView MeshData::GetView() const
+{
+    MeshView view;
+    view.vertices = vertices.data();
+    view.verticesCount = static_cast<uint32_t>(vertices.size());
+    view.indices = indices.data();
+    view.indicesCount = static_cast<uint32_t>(indices.size());
+    view.materials = materials.data();
+    view.materialsCount = static_cast<uint32_t>(materials.size());
+    view.textures = textures;
+    view.textureDirectory = textureDirectory;
+    view.normalSettings = normalSettings;
+    view.sourceNormals = sourceNormals;
+    view.materialFiles = materialFiles;
+    view.meshlets = meshlets.data();
+    view.meshletsCount = static_cast<uint32_t>(meshlets.size());
+    view.meshletSettings = meshletSettings;
+    view.lods = lods.data();
+    view.lodsCount = static_cast<uint32_t>(lods.size());
+    view.lodSettings = lodSettings;
+    return view;
+}
+
+size_t std::hash<Vertex>::operator()(const Vertex &vertex) const
+{
+    size_t seed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        HashCombine(seed, HashFloat(vertex.pos[i]));
+        HashCombine(seed, HashFloat(vertex.norm[i]));
+        HashCombine(seed, HashFloat(vertex.color[i]));
+    }
+    HashCombine(seed, HashFloat(vertex.texCoord.x));
+    HashCombine(seed, HashFloat(vertex.texCoord.y));
+    HashCombine(seed, std::hash<int>()(vertex.matID));
+    return seed;
+}
+
 static inline std::string GetPath(const std::string &file)
 {
     std::string dir;
@@ -42,35 +133,33 @@ static inline std::string GetPath(const std::string &file)
     return dir;
 }
 
-void ObjModel::LoadSkysphere()
+void ObjModel::LoadSkysphereSources(SkysphereSources &sources,
+                                    const EnvironmentBakeSettings &settings)
 {
     std::string skysphereTexture = "birchwood.jpg";
-    ImageAllocation imgAllocation =
-        Allocator::CreateTextureImage("textures/" + skysphereTexture);
-    vk::ImageView textureImageView = VulkanRenderer::CreateImageView(
-        imgAllocation.image, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor);
-    vk::SamplerCreateInfo samplerInfo = {
-        {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
-    samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.compareOp = vk::CompareOp::eNever;
+    Allocator::LoadTextureMips("textures/" + skysphereTexture, sources.skysphere);
 
-    samplerInfo.setMaxLod(FLT_MAX);
-    vk::Sampler sampler = VulkanRenderer::CreateSampler(samplerInfo);
-    vk::DescriptorImageInfo desc{sampler, textureImageView,
-                                 vk::ImageLayout::eShaderReadOnlyOptimal};
-    s_Skysphere = {desc, imgAllocation};
+    std::string hdrSkysphereTexture = "birchwood_16k.hdr";
+    const bool loaded = Allocator::LoadEnvironment("textures/" + hdrSkysphereTexture, settings,
+                                                   sources.hdrEquirect, sources.hdrCubemap);
 
-    Allocator::FlushStaging();
+    // The miss shader always declares the cubemap, so a black one stands in when none is baked
+    const float black[3] = {};
+    if (!loaded)
+    {
+        EnvironmentBaker::BakeEquirect(black, 1, 1, settings, sources.hdrEquirect);
+    }
+    sources.hdrCubemapBaked = loaded && settings.cubeFaceSize > 0;
+    if (!sources.hdrCubemapBaked)
+    {
+        EnvironmentBakeSettings placeholder = settings;
+        placeholder.cubeFaceSize = 1;
+        EnvironmentBaker::BakeCubemap(black, 1, 1, placeholder, sources.hdrCubemap);
+    }
 }
 
-void ObjModel::LoadHdrSkysphere()
+void ObjModel::UploadSkyspheres(const SkysphereSources &sources)
 {
-    std::string skysphereTexture = "birchwood_16k.hdr";
-    ImageAllocation imgAllocation =
-        Allocator::CreateHdrTextureImage("textures/" + skysphereTexture);
-    vk::ImageView textureImageView = VulkanRenderer::CreateImageView(
-        imgAllocation.image, vk::Format::eR32G32B32Sfloat, vk::ImageAspectFlagBits::eColor);
     vk::SamplerCreateInfo samplerInfo = {
         {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
     samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
@@ -78,171 +167,491 @@ void ObjModel::LoadHdrSkysphere()
     samplerInfo.compareOp = vk::CompareOp::eNever;
 
     samplerInfo.setMaxLod(FLT_MAX);
-    vk::Sampler sampler = VulkanRenderer::CreateSampler(samplerInfo);
+    vk::Sampler sampler = AssetRegistry::AcquireSampler(samplerInfo);
+
+    ImageAllocation imgAllocation = Allocator::CreateTextureImage(sources.skysphere);
+    vk::ImageView textureImageView =
+        VulkanRenderer::CreateImageView(imgAllocation.image, vk::Format::eR8G8B8A8Srgb,
+                                        vk::ImageAspectFlagBits::eColor, imgAllocation.mipLevels);
     vk::DescriptorImageInfo desc{sampler, textureImageView,
                                  vk::ImageLayout::eShaderReadOnlyOptimal};
+    s_Skysphere = {desc, imgAllocation};
+
+    imgAllocation = Allocator::CreateEnvironmentImage(sources.hdrEquirect);
+    textureImageView = VulkanRenderer::CreateImageView(
+        imgAllocation.image, EnvironmentBaker::GetVulkanFormat(sources.hdrEquirect.format),
+        vk::ImageAspectFlagBits::eColor, imgAllocation.mipLevels);
+    desc = vk::DescriptorImageInfo{sampler, textureImageView,
+                                   vk::ImageLayout::eShaderReadOnlyOptimal};
     s_HdrSkysphere = {desc, imgAllocation};
 
-    Allocator::FlushStaging();
+    imgAllocation = Allocator::CreateEnvironmentImage(sources.hdrCubemap);
+    textureImageView = VulkanRenderer::CreateImageView(
+        imgAllocation.image, EnvironmentBaker::GetVulkanFormat(sources.hdrCubemap.format),
+        vk::ImageAspectFlagBits::eColor, imgAllocation.mipLevels, vk::ImageViewType::eCube, 6);
+    desc = vk::DescriptorImageInfo{sampler, textureImageView,
+                                   vk::ImageLayout::eShaderReadOnlyOptimal};
+    s_HdrSkybox = {desc, imgAllocation};
+    s_HdrSkyboxBaked = sources.hdrCubemapBaked;
+
+    UploadManager::Submit();
 }
 
-ObjModel ObjModel::LoadModel(const std::string &filePath)
+// Normals are generated while parsing, so other settings need the source again
+static bool HasNormals(const MeshView &mesh)
 {
-    std::vector<Material> materials;
-    std::vector<std::string> textures;
+    return mesh.sourceNormals || mesh.normalSettings == ObjModel::s_NormalSettings;
+}
 
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> tinyMaterials;
-    std::string warn, err;
+static bool HasMeshlets(const MeshView &mesh)
+{
+    return (mesh.meshletsCount > 0 || mesh.indicesCount == 0) &&
+           mesh.meshletSettings == ObjModel::s_MeshletSettings;
+}
 
-    result_assert(tinyobj::LoadObj(&attrib, &shapes, &tinyMaterials, &warn, &err, filePath.c_str(),
-                                   GetPath(filePath).c_str()));
+static bool HasLods(const MeshView &mesh)
+{
+    return (mesh.lodsCount > 0 || mesh.indicesCount == 0) &&
+           mesh.lodSettings == ObjModel::s_LodSettings;
+}
 
-    for (const auto &material : tinyMaterials)
-    {
-        Material m = {};
-        m.ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
-        m.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
-        m.specular = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
-        m.emission = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
-        m.transmittance = glm::vec3(material.transmittance[0], material.transmittance[1],
-                                    material.transmittance[2]);
-        m.dissolve = material.dissolve;
-        m.ior = material.ior;
-        m.shininess = material.shininess;
-        m.illum = material.illum;
-        if (!material.diffuse_texname.empty())
-        {
-            textures.push_back(material.diffuse_texname);
-            m.textureID = static_cast<int>(textures.size()) - 1;
-        }
+// Only the full level of detail is copied, without meshlets
+static MeshData CopyMesh(const MeshView &view)
+{
+    const uint32_t indicesCount = view.lodsCount ? view.lods[0].indexCount : view.indicesCount;
+    MeshData mesh;
+    mesh.vertices.assign(view.vertices, view.vertices + view.verticesCount);
+    mesh.indices.assign(view.indices, view.indices + indicesCount);
+    mesh.materials.assign(view.materials, view.materials + view.materialsCount);
+    mesh.textures = view.textures;
+    mesh.textureDirectory = view.textureDirectory;
+    mesh.normalSettings = view.normalSettings;
+    mesh.sourceNormals = view.sourceNormals;
+    // Kept so that the rewritten cache still depends on the material libraries
+    mesh.materialFiles = view.materialFiles;
+    return mesh;
+}
+
+ObjModel ObjModel::LoadModel(const std::string &filePath)
+{
+    return LoadModels({filePath})[0];
+}
 
-        materials.emplace_back(m);
+std::vector<ObjModel> ObjModel::LoadModels(const std::vector<std::string> &filePaths)
+{
+    std::vector<ObjModel> objModels(filePaths.size());
+    std::vector<bool> found(filePaths.size(), false);
+    std::vector<bool> repeated(filePaths.size(), false);
+    std::unordered_set<std::string> missing;
+    for (size_t i = 0; i < filePaths.size(); ++i)
+    {
+        found[i] = AssetRegistry::AcquireModel(filePaths[i], objModels[i]);
+        repeated[i] = !found[i] && !missing.insert(filePaths[i]).second;
     }
 
-    if (materials.empty())
+    // Meshes are optimized before they are cached, so cache hits are ready to upload
+    std::vector<MeshCache> caches(filePaths.size());
+    std::vector<MeshData> meshes(filePaths.size());
+    std::vector<uint8_t> cached(filePaths.size(), 0);
+    TaskGroup group;
+    for (size_t i = 0; i < filePaths.size(); ++i)
     {
-        materials.emplace_back(Material());
+        if (found[i] || repeated[i])
+        {
+            continue;
+        }
+        group.Run([&, i]() {
+            cached[i] = caches[i].Open(filePaths[i]);
+            if (cached[i] && !HasNormals(caches[i].GetView()))
+            {
+                cached[i] = false;
+                caches[i] = MeshCache();
+            }
+            if (cached[i] && ((s_BuildMeshlets && !HasMeshlets(caches[i].GetView())) ||
+                              (s_BuildLods && !HasLods(caches[i].GetView()))))
+            {
+                meshes[i] = CopyMesh(caches[i].GetView());
+                cached[i] = false;
+                caches[i] = MeshCache();
+            }
+            else if (!cached[i])
+            {
+                meshes[i] = LoadMeshData(filePaths[i]);
+                MeshOptimizer::Optimize(meshes[i]);
+            }
+            if (!cached[i])
+            {
+                if (s_BuildMeshlets)
+                {
+                    MeshletBuilder::Build(meshes[i], s_MeshletSettings);
+                }
+                // Appended after the meshlets were built, which only cover the full mesh
+                if (s_BuildLods)
+                {
+                    MeshSimplifier::BuildLods(meshes[i], s_LodSettings);
+                }
+                MeshCache::Write(filePaths[i], meshes[i]);
+            }
+        });
     }
+    group.Wait();
 
-    // Converting from Srgb to linear
-    for (auto &m : materials)
+    for (size_t i = 0; i < filePaths.size(); ++i)
     {
-        m.ambient = glm::pow(m.ambient, glm::vec3(2.2f));
-        m.diffuse = glm::pow(m.diffuse, glm::vec3(2.2f));
-        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
+        if (found[i])
+        {
+            continue;
+        }
+        // Added to the registry by the first use of the path
+        if (repeated[i])
+        {
+            AssetRegistry::AcquireModel(filePaths[i], objModels[i]);
+            continue;
+        }
+        objModels[i] = Upload(cached[i] ? caches[i].GetView() : meshes[i].GetView());
+        AssetRegistry::AddModel(filePaths[i], objModels[i]);
+        meshes[i] = MeshData();
     }
+    return objModels;
+}
 
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+ObjModel ObjModel::LoadModelStreaming(const std::string &filePath, size_t memoryBudget,
+                                      ObjStreamReport *report)
+{
+    ObjModel objModel;
+    if (AssetRegistry::AcquireModel(filePath, objModel))
+    {
+        return objModel;
+    }
 
-    for (const auto &shape : shapes)
+    MeshCache cache;
+    if (!cache.Open(filePath) || !HasNormals(cache.GetView()))
     {
-        uint32_t faceID = 0;
-        int indexCount = 0;
-        for (const auto &index : shape.mesh.indices)
+        cache = MeshCache();
+        ObjStreamReport streamReport;
+        std::string error;
+        result_assert(ObjParser::Stream(filePath, GetPath(filePath), memoryBudget, streamReport,
+                                        error, s_NormalSettings));
+        result_assert(cache.Open(filePath));
+        if (report)
         {
-            Vertex vertex = {};
-            vertex.pos = {attrib.vertices[3L * static_cast<uint64_t>(index.vertex_index) + 0L],
-                          attrib.vertices[3L * static_cast<uint64_t>(index.vertex_index) + 1L],
-                          attrib.vertices[3L * static_cast<uint64_t>(index.vertex_index) + 2L]};
+            *report = streamReport;
+        }
+    }
+    objModel = Upload(cache.GetView(), memoryBudget / 4);
+    AssetRegistry::AddModel(filePath, objModel);
+    return objModel;
+}
 
-            if (!attrib.normals.empty() && index.normal_index >= 0)
+std::vector<ObjModel> ObjModel::LoadGltf(const std::string &filePath,
+                                         std::vector<ObjInstance> &instances,
+                                         uint32_t firstModelIndex)
+{
+    GltfFile file;
+    std::string error;
+    result_assert(file.Open(filePath, error, s_NormalSettings));
+
+    // The file is already binary, so meshes are neither optimized nor cached unless meshlets or
+    // levels of detail have to be built for them
+    std::vector<ObjModel> objModels(file.GetMeshCount());
+    for (size_t i = 0; i < objModels.size(); ++i)
+    {
+        const std::string meshPath = filePath + "#mesh" + std::to_string(i);
+        if (AssetRegistry::AcquireModel(meshPath, objModels[i]))
+        {
+            continue;
+        }
+        if (s_BuildMeshlets || s_BuildLods)
+        {
+            MeshData mesh = CopyMesh(file.GetView(i));
+            if (s_BuildMeshlets)
             {
-                vertex.norm = {attrib.normals[3L * static_cast<uint64_t>(index.normal_index) + 0L],
-                               attrib.normals[3L * static_cast<uint64_t>(index.normal_index) + 1L],
-                               attrib.normals[3L * static_cast<uint64_t>(index.normal_index) + 2L]};
+                MeshletBuilder::Build(mesh, s_MeshletSettings);
             }
-
-            if (!attrib.colors.empty())
+            if (s_BuildLods)
             {
-                vertex.color = {attrib.colors[3L * static_cast<uint64_t>(index.vertex_index) + 0L],
-                                attrib.colors[3L * static_cast<uint64_t>(index.vertex_index) + 1L],
-                                attrib.colors[3L * static_cast<uint64_t>(index.vertex_index) + 2L]};
+                MeshSimplifier::BuildLods(mesh, s_LodSettings);
             }
+            objModels[i] = Upload(mesh.GetView());
+        }
+        else
+        {
+            objModels[i] = Upload(file.GetView(i));
+        }
+        AssetRegistry::AddModel(meshPath, objModels[i]);
+    }
 
-            if (!attrib.texcoords.empty() && index.texcoord_index >= 0)
-            {
-                vertex.texCoord = {
-                    attrib.texcoords[2L * static_cast<uint64_t>(index.texcoord_index) + 0L],
-                    1.0f - attrib.texcoords[2L * static_cast<uint64_t>(index.texcoord_index) + 1L]};
-            }
+    for (const auto &instance : file.GetInstances())
+    {
+        const ObjModel &objModel = objModels[instance.meshIndex];
+        instances.push_back({firstModelIndex + instance.meshIndex, instance.transform,
+                             glm::transpose(glm::inverse(instance.transform)),
+                             objModel.textureOffset});
+    }
+    return objModels;
+}
 
-            vertex.matID = shape.mesh.material_ids[faceID];
-            if (vertex.matID < 0 || vertex.matID >= materials.size())
-            {
-                vertex.matID = 0;
-            }
-            indexCount++;
-            if (indexCount >= 3)
+MeshData ObjModel::LoadMeshData(const std::string &filePath)
+{
+    MeshData mesh;
+    std::string error;
+    result_assert(ObjParser::Load(filePath, GetPath(filePath), mesh, error, s_NormalSettings));
+    return mesh;
+}
+
+MeshData ObjModel::LoadMeshDataTinyObj(const std::string &filePath)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> tinyMaterials;
+    std::string warn, err;
+
+    result_assert(tinyobj::LoadObj(&attrib, &shapes, &tinyMaterials, &warn, &err, filePath.c_str(),
+                                   GetPath(filePath).c_str()));
+
+    MeshData mesh;
+    ObjParser::ConvertMaterials(tinyMaterials, mesh);
+    const auto &materials = mesh.materials;
+
+    size_t cornerCount = 0;
+    for (const auto &shape : shapes)
+    {
+        cornerCount += shape.mesh.indices.size();
+    }
+    std::vector<Vertex> corners;
+    std::vector<uint32_t> cornerPositions;
+    corners.reserve(cornerCount);
+    cornerPositions.reserve(cornerCount);
+
+    for (const auto &shape : shapes)
+    {
+        for (size_t faceID = 0; faceID < shape.mesh.material_ids.size(); faceID++)
+        {
+            for (size_t corner = 0; corner < 3; corner++)
             {
-                ++faceID;
-                indexCount = 0;
+                const auto &index = shape.mesh.indices[3 * faceID + corner];
+                const auto vertexIndex = static_cast<uint64_t>(index.vertex_index);
+                const auto normalIndex = static_cast<uint64_t>(index.normal_index);
+                const auto texcoordIndex = static_cast<uint64_t>(index.texcoord_index);
+
+                Vertex vertex = {};
+                vertex.pos = {attrib.vertices[3L * vertexIndex + 0L],
+                              attrib.vertices[3L * vertexIndex + 1L],
+                              attrib.vertices[3L * vertexIndex + 2L]};
+
+                if (!attrib.normals.empty() && index.normal_index >= 0)
+                {
+                    vertex.norm = {attrib.normals[3L * normalIndex + 0L],
+                                   attrib.normals[3L * normalIndex + 1L],
+                                   attrib.normals[3L * normalIndex + 2L]};
+                }
+
+                if (!attrib.colors.empty())
+                {
+                    vertex.color = {attrib.colors[3L * vertexIndex + 0L],
+                                    attrib.colors[3L * vertexIndex + 1L],
+                                    attrib.colors[3L * vertexIndex + 2L]};
+                }
+
+                if (!attrib.texcoords.empty() && index.texcoord_index >= 0)
+                {
+                    vertex.texCoord = {attrib.texcoords[2L * texcoordIndex + 0L],
+                                       1.0f - attrib.texcoords[2L * texcoordIndex + 1L]};
+                }
+
+                vertex.matID = shape.mesh.material_ids[faceID];
+                if (vertex.matID < 0 || vertex.matID >= materials.size())
+                {
+                    vertex.matID = 0;
+                }
+                corners.push_back(vertex);
+                cornerPositions.push_back(static_cast<uint32_t>(vertexIndex));
             }
+        }
+    }
+
+    // Missing normals have to be assigned before welding, otherwise corners of
+    // differently oriented faces would collapse into one vertex
+    if (attrib.normals.empty())
+    {
+        NormalGenerator::Generate(attrib.vertices.data(), attrib.vertices.size() / 3,
+                                  cornerPositions.data(), corners.size() / 3, s_NormalSettings,
+                                  corners.data());
+    }
+    mesh.normalSettings = s_NormalSettings;
+    mesh.sourceNormals = !attrib.normals.empty();
 
+    // Welds corners that share the full attribute tuple into a single vertex
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    indices.reserve(corners.size());
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(corners.size() / 3);
+    for (const auto &vertex : corners)
+    {
+        auto it = uniqueVertices.find(vertex);
+        if (it == uniqueVertices.end())
+        {
+            it = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size())).first;
             vertices.push_back(vertex);
-            indices.push_back(static_cast<int>(indices.size()));
         }
+        indices.push_back(it->second);
     }
 
-    if (attrib.normals.empty())
+    mesh.vertices = std::move(vertices);
+    mesh.indices = std::move(indices);
+    return mesh;
+}
+
+// The packed buffers are built a staging slice at a time, so that a mesh uploaded within a
+// memory budget never has them in memory at full size
+static void UploadPacked(const MeshView &mesh, const vk::BufferUsageFlags &vertexUsage,
+                         vk::DeviceSize maxStagingSize, ObjModel &objModel)
+{
+    const vk::BufferUsageFlags transferUsage = vk::BufferUsageFlagBits::eTransferDst;
+    const uint32_t trianglesCount = mesh.indicesCount / 3;
+    const vk::DeviceSize vertexSize = std::max(sizeof(glm::vec3), sizeof(PackedVertex));
+    const uint32_t sliceVertices =
+        maxStagingSize ? static_cast<uint32_t>(std::max<vk::DeviceSize>(
+                             maxStagingSize / vertexSize, 1))
+                       : std::max(mesh.verticesCount, 1u);
+    const uint32_t sliceTriangles =
+        maxStagingSize ? static_cast<uint32_t>(std::max<vk::DeviceSize>(
+                             maxStagingSize / sizeof(uint32_t), 1))
+                       : std::max(trianglesCount, 1u);
+
+    if (mesh.positions)
+    {
+        objModel.positionBuffer = Allocator::CreateDeviceLocalBuffer(
+            mesh.positions, sizeof(glm::vec3) * mesh.verticesCount, vertexUsage, maxStagingSize);
+    }
+    else
+    {
+        objModel.positionBuffer =
+            Allocator::CreateBuffer(sizeof(glm::vec3) * mesh.verticesCount,
+                                    transferUsage | vertexUsage, VMA_MEMORY_USAGE_GPU_ONLY);
+    }
+    objModel.vertexBuffer =
+        Allocator::CreateBuffer(sizeof(PackedVertex) * mesh.verticesCount,
+                                transferUsage | vertexUsage, VMA_MEMORY_USAGE_GPU_ONLY);
+    objModel.triangleMaterialBuffer = Allocator::CreateBuffer(
+        sizeof(uint32_t) * trianglesCount,
+        transferUsage | vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+
+    std::vector<glm::vec3> positions;
+    std::vector<PackedVertex> vertices;
+    for (uint32_t first = 0; first < mesh.verticesCount; first += sliceVertices)
     {
-        for (size_t i = 0; i < indices.size(); i += 3)
+        const uint32_t count = std::min(sliceVertices, mesh.verticesCount - first);
+        VertexPacker::PackVertices(mesh, first, count, positions, vertices);
+        if (!mesh.positions)
         {
-            Vertex &v0 = vertices[indices[i + 0]];
-            Vertex &v1 = vertices[indices[i + 1]];
-            Vertex &v2 = vertices[indices[i + 2]];
-
-            glm::vec3 n = glm::normalize(glm::cross((v1.pos - v0.pos), (v2.pos - v0.pos)));
-            v0.norm = n;
-            v1.norm = n;
-            v2.norm = n;
+            UploadManager::UploadBuffer(objModel.positionBuffer.buffer,
+                                        sizeof(glm::vec3) * first, positions.data(),
+                                        sizeof(glm::vec3) * count);
         }
+        UploadManager::UploadBuffer(objModel.vertexBuffer.buffer, sizeof(PackedVertex) * first,
+                                    vertices.data(), sizeof(PackedVertex) * count);
+    }
+
+    std::vector<uint32_t> triangleMaterials;
+    for (uint32_t first = 0; first < trianglesCount; first += sliceTriangles)
+    {
+        const uint32_t count = std::min(sliceTriangles, trianglesCount - first);
+        VertexPacker::PackTriangleMaterials(mesh, first, count, triangleMaterials);
+        UploadManager::UploadBuffer(objModel.triangleMaterialBuffer.buffer,
+                                    sizeof(uint32_t) * first, triangleMaterials.data(),
+                                    sizeof(uint32_t) * count);
     }
+}
 
+ObjModel ObjModel::Upload(const MeshView &mesh, vk::DeviceSize maxStagingSize)
+{
     ObjModel objModel;
-    objModel.verticesCount = (uint32_t)vertices.size();
-    objModel.indicesCount = (uint32_t)indices.size();
-    auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
-    objModel.vertexBuffer = Allocator::CreateDeviceLocalBuffer(
-        cmdBuff, vertices,
-        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+    objModel.verticesCount = mesh.verticesCount;
+    objModel.indicesCount = mesh.lodsCount ? mesh.lods[0].indexCount : mesh.indicesCount;
+    if (s_BuildMeshlets)
+    {
+        objModel.meshlets.assign(mesh.meshlets, mesh.meshlets + mesh.meshletsCount);
+    }
+    if (s_BuildLods && mesh.lodsCount > 0)
+    {
+        objModel.lods.assign(mesh.lods, mesh.lods + mesh.lodsCount);
+        glm::vec3 minimum(FLT_MAX);
+        glm::vec3 maximum(-FLT_MAX);
+        for (uint32_t i = 0; i < mesh.verticesCount; ++i)
+        {
+            minimum = glm::min(minimum, mesh.vertices[i].pos);
+            maximum = glm::max(maximum, mesh.vertices[i].pos);
+        }
+        objModel.boundsCenter = (minimum + maximum) * 0.5f;
+        objModel.boundsRadius = glm::length(maximum - minimum) * 0.5f;
+    }
+    const vk::BufferUsageFlags vertexUsage =
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+    const vk::BufferUsageFlags indexUsage =
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+    if (s_VertexLayout == VertexLayout::Packed)
+    {
+        UploadPacked(mesh, vertexUsage, maxStagingSize, objModel);
+    }
+    else
+    {
+        objModel.vertexBuffer = Allocator::CreateDeviceLocalBuffer(
+            mesh.vertices, sizeof(Vertex) * mesh.verticesCount, vertexUsage, maxStagingSize);
+    }
     objModel.indexBuffer = Allocator::CreateDeviceLocalBuffer(
-        cmdBuff, indices,
-        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
-    objModel.materialBuffer = Allocator::CreateDeviceLocalBuffer(
-        cmdBuff, materials, vk::BufferUsageFlagBits::eStorageBuffer);
-    objModel.textureOffset = static_cast<uint32_t>(s_TextureImages.size());
-    VulkanRenderer::EndSingleTimeCommands(cmdBuff);
-    for (auto &texturePath : textures)
-    {
-        ImageAllocation imgAllocation = Allocator::CreateTextureImage("textures/" + texturePath);
-        vk::ImageView textureImageView = VulkanRenderer::CreateImageView(
-            imgAllocation.image, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor);
-        vk::SamplerCreateInfo samplerInfo = {
-            {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
-        samplerInfo.setMaxLod(FLT_MAX);
-        vk::Sampler sampler = VulkanRenderer::CreateSampler(samplerInfo);
-        vk::DescriptorImageInfo desc{sampler, textureImageView,
-                                     vk::ImageLayout::eShaderReadOnlyOptimal};
-        s_TextureImages.push_back({desc, imgAllocation});
-    }
-
-    if (textures.empty())
-    {
-        ImageAllocation imgAllocation = Allocator::CreateTextureImage("");
-        vk::ImageView textureImageView = VulkanRenderer::CreateImageView(
-            imgAllocation.image, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor);
-        vk::SamplerCreateInfo samplerInfo = {
-            {}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
-        samplerInfo.setMaxLod(FLT_MAX);
-        vk::Sampler sampler = VulkanRenderer::CreateSampler(samplerInfo);
-        vk::DescriptorImageInfo desc{sampler, textureImageView,
-                                     vk::ImageLayout::eShaderReadOnlyOptimal};
-        s_TextureImages.push_back({desc, imgAllocation});
-    }
-
-    Allocator::FlushStaging();
+        mesh.indices, sizeof(uint32_t) * mesh.indicesCount, indexUsage, maxStagingSize);
+    // Textures are shared between models, so materials index ObjModel::s_TextureImages directly
+    // instead of relative to a per model offset
+    objModel.textureOffset = 0;
+    std::vector<std::string> texturePaths;
+    for (auto &texturePath : mesh.textures)
+    {
+        texturePaths.push_back(mesh.textureDirectory + texturePath);
+    }
+    if (texturePaths.empty())
+    {
+        texturePaths.push_back("");
+    }
+    // Only textures whose coordinates stay within [0, 1] can be moved into an atlas, the
+    // sampler would wrap repeated ones onto the neighbouring regions
+    std::vector<bool> atlasable(mesh.textures.size(), mesh.vertices != nullptr);
+    for (uint32_t i = 0; i < mesh.verticesCount && mesh.vertices; i++)
+    {
+        const Vertex &vertex = mesh.vertices[i];
+        if (vertex.matID < 0 || vertex.matID >= static_cast<int>(mesh.materialsCount))
+        {
+            continue;
+        }
+        const int textureID = mesh.materials[vertex.matID].textureID;
+        const float epsilon = 1e-4f;
+        if (textureID >= 0 && textureID < static_cast<int>(atlasable.size()) &&
+            (glm::any(glm::lessThan(vertex.texCoord, glm::vec2(-epsilon))) ||
+             glm::any(glm::greaterThan(vertex.texCoord, glm::vec2(1.0f + epsilon)))))
+        {
+            atlasable[textureID] = false;
+        }
+    }
+    std::vector<AtlasRegion> regions;
+    objModel.textureIndices = AssetRegistry::AcquireTextures(texturePaths, atlasable, &regions);
+    std::vector<Material> materials(mesh.materials, mesh.materials + mesh.materialsCount);
+    for (auto &material : materials)
+    {
+        if (material.textureID >= 0 &&
+            material.textureID < static_cast<int>(objModel.textureIndices.size()))
+        {
+            const AtlasRegion &region = regions[material.textureID];
+            material.textureTransform = glm::vec4(region.scale[0], region.scale[1],
+                                                  region.offset[0], region.offset[1]);
+            material.textureID = static_cast<int>(objModel.textureIndices[material.textureID]);
+        }
+    }
+
+    objModel.materialBuffer =
+        Allocator::CreateDeviceLocalBuffer(materials, vk::BufferUsageFlagBits::eStorageBuffer);
+
+    // The textures and buffers of the model go to the GPU as one batch
+    UploadManager::Submit();
     return objModel;
 }
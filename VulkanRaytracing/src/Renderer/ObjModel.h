@@ -6,6 +6,15 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+enum class VertexLayout
+{
+    // Interleaved Vertex, also the input of the acceleration structures
+    Full,
+    // Positions in a tightly packed vec3 stream that the acceleration structures are built from,
+    // the remaining attributes as PackedVertex and the material per triangle
+    Packed
+};
+
 struct Vertex
 {
     glm::vec3 pos;
@@ -18,12 +27,40 @@ struct Vertex
 
     static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions();
 
+    // The packed layout reads positions from binding 0 and PackedVertex from binding 1, the
+    // material ID location is left out
+    static std::vector<vk::VertexInputBindingDescription> getBindingDescriptions(
+        VertexLayout layout);
+
+    static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions(
+        VertexLayout layout);
+
     bool operator==(const Vertex &other) const
     {
-        return pos == other.pos;
+        return pos == other.pos && norm == other.norm && color == other.color &&
+               texCoord == other.texCoord && matID == other.matID;
     }
 };
 
+// Vertex attributes of VertexLayout::Packed, decoded by the functions in material.glsl
+struct PackedVertex
+{
+    // Octahedral encoded unit normal, two snorm16
+    uint32_t norm;
+    // Two half floats, exact to 1/2048 up to a coordinate of 1
+    uint32_t texCoord;
+    // RGBA8 unorm
+    uint32_t color;
+};
+
+namespace std
+{
+    template <> struct hash<Vertex>
+    {
+        size_t operator()(const Vertex &vertex) const;
+    };
+} // namespace std
+
 struct Material
 {
     glm::vec3 ambient = glm::vec3(0.1f, 0.1f, 0.1f);
@@ -36,6 +73,9 @@ struct Material
     float dissolve = 1.f; // 1 == opaque; 0 == fully transparent
     int illum = 1;
     int textureID = 0;
+    // Scale in xy and offset in zw applied to texture coordinates, places textures packed into an
+    // atlas
+    glm::vec4 textureTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
 };
 
 struct ObjInstance
@@ -52,23 +92,212 @@ struct TextureImage
     ImageAllocation textureAllocation;
 };
 
+// Triangles that follow each other in the index buffer, with the bounds to cull them by
+struct Meshlet
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    glm::vec3 center;
+    float radius;
+    // Every triangle faces away from viewers for which
+    // dot(normalize(coneApex - viewer), coneAxis) >= coneCutoff, which is above 1 when the
+    // triangles face too many ways for that to happen
+    glm::vec3 coneApex;
+    float coneCutoff;
+    glm::vec3 coneAxis;
+    uint32_t verticesCount;
+};
+
+struct MeshletSettings
+{
+    // The defaults fit NV mesh shader output limits
+    uint32_t maxVertices = 64;
+    uint32_t maxTriangles = 124;
+    // How much a triangle facing like the meshlet is preferred over one adding fewer vertices,
+    // higher values give tighter normal cones and more meshlets
+    float coneWeight = 0.5f;
+
+    bool operator==(const MeshletSettings &other) const
+    {
+        return maxVertices == other.maxVertices && maxTriangles == other.maxTriangles &&
+               coneWeight == other.coneWeight;
+    }
+};
+
+enum class NormalWeighting
+{
+    // Faces count with their area, which favours large faces
+    Area,
+    // Faces count with their angle at the corner, which does not depend on the tessellation
+    Angle
+};
+
+// How normals are generated for meshes that come without them
+struct NormalSettings
+{
+    // In degrees, faces meeting at a larger angle keep separate vertices and 0 gives flat normals
+    float creaseAngle = 60.0f;
+    NormalWeighting weighting = NormalWeighting::Angle;
+
+    bool operator==(const NormalSettings &other) const
+    {
+        return creaseAngle == other.creaseAngle && weighting == other.weighting;
+    }
+};
+
+// Triangles of one level of detail, level 0 is the full mesh and the coarser levels follow it in
+// the index buffer
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // Estimated distance of the simplified surface from the full mesh, in model units
+    float error;
+};
+
+struct LodSettings
+{
+    // Levels besides the full mesh, each with at most reduction times the triangles of the one
+    // before
+    uint32_t maxLevels = 4;
+    float reduction = 0.5f;
+    // Largest error of any level relative to the radius of the mesh bounds, the chain ends early
+    // once a level cannot be reduced within it
+    float maxError = 0.05f;
+
+    bool operator==(const LodSettings &other) const
+    {
+        return maxLevels == other.maxLevels && reduction == other.reduction &&
+               maxError == other.maxError;
+    }
+};
+
+struct ObjStreamReport;
+
+struct MeshView
+{
+    const Vertex *vertices = nullptr;
+    uint32_t verticesCount = 0;
+    const uint32_t *indices = nullptr;
+    uint32_t indicesCount = 0;
+    const Material *materials = nullptr;
+    uint32_t materialsCount = 0;
+    std::vector<std::string> textures;
+    // Prefixed to the texture paths when they are loaded
+    std::string textureDirectory = "textures/";
+    NormalSettings normalSettings;
+    // The source had its own normals, so normalSettings were never applied
+    bool sourceNormals = false;
+    // See MeshData::materialFiles
+    std::vector<std::string> materialFiles;
+    // Positions of the vertices as a tightly packed stream, when the source stores them that
+    // way. VertexLayout::Packed then uploads them without gathering them from the vertices.
+    const glm::vec3 *positions = nullptr;
+    const Meshlet *meshlets = nullptr;
+    uint32_t meshletsCount = 0;
+    MeshletSettings meshletSettings;
+    const MeshLod *lods = nullptr;
+    uint32_t lodsCount = 0;
+    LodSettings lodSettings;
+};
+
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Material> materials;
+    std::vector<std::string> textures;
+    std::string textureDirectory = "textures/";
+    // Material libraries the source referenced, whether they were found or not
+    std::vector<std::string> materialFiles;
+    // Normals missing from the source were generated with these
+    NormalSettings normalSettings;
+    bool sourceNormals = false;
+    // Empty unless meshlets were built, the indices are then ordered by meshlet
+    std::vector<Meshlet> meshlets;
+    MeshletSettings meshletSettings;
+    // Empty unless levels of detail were built, the indices of the full mesh then end at
+    // lods[0].indexCount and the meshlets only cover those
+    std::vector<MeshLod> lods;
+    LodSettings lodSettings;
+
+    MeshView GetView() const;
+};
+
+// Skysphere textures decoded and baked on the CPU, waiting for ObjModel::UploadSkyspheres
+struct SkysphereSources
+{
+    MipChain skysphere;
+    EnvironmentMap hdrEquirect;
+    EnvironmentMap hdrCubemap;
+    bool hdrCubemapBaked = false;
+};
+
 struct ObjModel
 {
   public:
+    // Indices of the full mesh, the index buffer also holds the coarser levels of detail
     uint32_t indicesCount{0};
     uint32_t verticesCount{0};
     BufferAllocation vertexBuffer;
     BufferAllocation indexBuffer;
     BufferAllocation materialBuffer;
+    // Only created for VertexLayout::Packed, where vertexBuffer holds PackedVertex
+    BufferAllocation positionBuffer;
+    BufferAllocation triangleMaterialBuffer;
     uint32_t textureOffset;
+    // Entries of s_TextureImages used by the materials, owned through AssetRegistry
+    std::vector<uint32_t> textureIndices;
+    // Only built with s_BuildMeshlets, the rasterizer then draws the meshlets that pass culling
+    std::vector<Meshlet> meshlets;
+    // Only kept with s_BuildLods, the rasterizer then picks a level per instance from the size
+    // the bounds cover on screen
+    std::vector<MeshLod> lods;
+    glm::vec3 boundsCenter{0.0f};
+    float boundsRadius = 0.0f;
 
   public:
     ObjModel() = default;
-    static void LoadSkysphere();
-    static void LoadHdrSkysphere();
+    // Decodes the skysphere and bakes the HDR environment into an equirectangular map and a
+    // cubemap, a cubeFaceSize of 0 leaves a 1x1 placeholder cube. Does not touch the device, so
+    // it may run on a worker thread while the renderer draws.
+    static void LoadSkysphereSources(SkysphereSources &sources,
+                                     const EnvironmentBakeSettings &settings = {});
+    // Creates s_Skysphere, s_HdrSkysphere and s_HdrSkybox on the renderer thread
+    static void UploadSkyspheres(const SkysphereSources &sources);
     static ObjModel LoadModel(const std::string &filename);
+    // Parses and optimizes the models missing from the cache in parallel, then uploads them in
+    // order
+    static std::vector<ObjModel> LoadModels(const std::vector<std::string> &filenames);
+    // Keeps conversion and upload within memoryBudget bytes, for meshes too large to load whole
+    static ObjModel LoadModelStreaming(const std::string &filename, size_t memoryBudget,
+                                       ObjStreamReport *report = nullptr);
+    // Loads every mesh of a binary glTF file as a model and appends the instances of its
+    // default scene, whose objModelIndex counts from firstModelIndex
+    static std::vector<ObjModel> LoadGltf(const std::string &filename,
+                                          std::vector<ObjInstance> &instances,
+                                          uint32_t firstModelIndex = 0);
+    static MeshData LoadMeshData(const std::string &filename);
+    // Single-threaded tinyobj path, kept as the reference ObjParser is checked against
+    static MeshData LoadMeshDataTinyObj(const std::string &filename);
+    // Builds the buffers in s_VertexLayout
+    static ObjModel Upload(const MeshView &mesh, vk::DeviceSize maxStagingSize = 0);
+    // Set before loading models, the renderer builds its pipelines and acceleration structures
+    // for the same layout
+    static VertexLayout s_VertexLayout;
+    // Used by LoadMeshData and LoadModels for meshes without normals, cached meshes generated
+    // with other settings are parsed again
+    static NormalSettings s_NormalSettings;
+    // Applies to models loaded afterwards with LoadModels, cached meshes built with other
+    // settings are built again
+    static bool s_BuildMeshlets;
+    static MeshletSettings s_MeshletSettings;
+    static bool s_BuildLods;
+    static LodSettings s_LodSettings;
     static std::vector<TextureImage> s_TextureImages;
     static std::vector<TextureImage> s_SkyboxTextureImages;
     static TextureImage s_Skysphere;
     static TextureImage s_HdrSkysphere;
+    static TextureImage s_HdrSkybox;
+    static bool s_HdrSkyboxBaked;
 };
\ No newline at end of file
@@ -0,0 +1,1589 @@
+#include "vkpch.h"
+
+#include "ObjParser.h"
+
+#include "MeshCache.h"
+#include "NormalGenerator.h"
+
+#include "Core/ThreadPool.h"
+#include "Tools/FileTools.h"
+
+#include <tiny_obj_loader.h>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <map>
+
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+#define OBJ_MIN_STREAM_BLOCK_SIZE (1 << 16)
+#define OBJ_STREAM_GATHER_RANGE 4096
+// Positions per block when the stream converter splits them into ranges for normal generation
+#define OBJ_STREAM_NORMAL_BLOCK 4096
+#define OBJ_EMPTY_SLOT UINT32_MAX
+
+#define OBJ_IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
+#define OBJ_IS_DIGIT(x) (static_cast<unsigned int>((x) - '0') < static_cast<unsigned int>(10))
+#define OBJ_IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
+
+#define OBJ_RELATIVE_V 1
+#define OBJ_RELATIVE_VT 2
+#define OBJ_RELATIVE_VN 4
+
+struct ObjCorner
+{
+    int v = -1;
+    int vt = -1;
+    int vn = -1;
+};
+
+enum class ObjStatement
+{
+    UseMtl,
+    MtlLib,
+    Group
+};
+
+struct ObjEvent
+{
+    ObjStatement statement;
+    // Faces and positions of the chunk parsed before the statement
+    size_t faceCount;
+    size_t vertexCount;
+    std::string argument;
+};
+
+struct ObjChunk
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<ObjCorner> corners;
+    std::vector<uint32_t> faceSizes;
+    // Corners with negative indices, resolved once the preceding chunks are counted
+    std::vector<std::pair<size_t, uint8_t>> relativeCorners;
+    std::vector<ObjEvent> events;
+    const char *errorLine = nullptr;
+    std::string error;
+
+    size_t positionBase = 0;
+    size_t normalBase = 0;
+    size_t texcoordBase = 0;
+    size_t faceBase = 0;
+
+    std::vector<ObjCorner> triangles;
+    std::vector<int> triangleMaterials;
+    size_t triangleBase = 0;
+};
+
+// Faces tinyobj flushes together, they share the material and the number of positions that
+// were known when the ear clipping ran
+struct ObjSegment
+{
+    size_t faceEnd;
+    int material;
+    size_t vertexLimit;
+};
+
+// Port of tinyobj's tryParseDouble. Every operation is kept as is so that both loaders round
+// each value to exactly the same float.
+static bool TryParseDouble(const char *s, const char *sEnd, double *result)
+{
+    if (s >= sEnd)
+    {
+        return false;
+    }
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char expSign = '+';
+    const char *curr = s;
+    int read = 0;
+    bool endNotReached = false;
+    bool leadingDecimalDots = false;
+
+    if (*curr == '+' || *curr == '-')
+    {
+        sign = *curr;
+        curr++;
+        if ((curr != sEnd) && (*curr == '.'))
+        {
+            leadingDecimalDots = true;
+        }
+    }
+    else if (OBJ_IS_DIGIT(*curr))
+    {
+    }
+    else if (*curr == '.')
+    {
+        leadingDecimalDots = true;
+    }
+    else
+    {
+        return false;
+    }
+
+    endNotReached = (curr != sEnd);
+    if (!leadingDecimalDots)
+    {
+        while (endNotReached && OBJ_IS_DIGIT(*curr))
+        {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*curr - 0x30);
+            curr++;
+            read++;
+            endNotReached = (curr != sEnd);
+        }
+
+        if (read == 0)
+        {
+            return false;
+        }
+    }
+
+    if (!endNotReached)
+    {
+        goto assemble;
+    }
+
+    if (*curr == '.')
+    {
+        curr++;
+        read = 1;
+        endNotReached = (curr != sEnd);
+        while (endNotReached && OBJ_IS_DIGIT(*curr))
+        {
+            static const double powLut[] = {
+                1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+            };
+            const int lutEntries = sizeof powLut / sizeof powLut[0];
+
+            mantissa += static_cast<int>(*curr - 0x30) *
+                        (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+            read++;
+            curr++;
+            endNotReached = (curr != sEnd);
+        }
+    }
+    else if (*curr == 'e' || *curr == 'E')
+    {
+    }
+    else
+    {
+        goto assemble;
+    }
+
+    if (!endNotReached)
+    {
+        goto assemble;
+    }
+
+    if (*curr == 'e' || *curr == 'E')
+    {
+        curr++;
+        endNotReached = (curr != sEnd);
+        if (endNotReached && (*curr == '+' || *curr == '-'))
+        {
+            expSign = *curr;
+            curr++;
+        }
+        else if (OBJ_IS_DIGIT(*curr))
+        {
+        }
+        else
+        {
+            return false;
+        }
+
+        read = 0;
+        endNotReached = (curr != sEnd);
+        while (endNotReached && OBJ_IS_DIGIT(*curr))
+        {
+            exponent *= 10;
+            exponent += static_cast<int>(*curr - 0x30);
+            curr++;
+            read++;
+            endNotReached = (curr != sEnd);
+        }
+        exponent *= (expSign == '+' ? 1 : -1);
+        if (read == 0)
+        {
+            return false;
+        }
+    }
+
+assemble:
+    *result = (sign == '+' ? 1 : -1) *
+              (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
+
+static inline float ParseReal(const char **token, double defaultValue = 0.0)
+{
+    (*token) += strspn((*token), " \t");
+    const char *end = (*token) + strcspn((*token), " \t\r");
+    double value = defaultValue;
+    TryParseDouble((*token), end, &value);
+    (*token) = end;
+    return static_cast<float>(value);
+}
+
+static inline bool ParseReal(const char **token, float *out)
+{
+    (*token) += strspn((*token), " \t");
+    const char *end = (*token) + strcspn((*token), " \t\r");
+    double value;
+    bool parsed = TryParseDouble((*token), end, &value);
+    if (parsed)
+    {
+        (*out) = static_cast<float>(value);
+    }
+    (*token) = end;
+    return parsed;
+}
+
+static inline std::string ParseString(const char **token)
+{
+    (*token) += strspn((*token), " \t");
+    size_t length = strcspn((*token), " \t\r");
+    std::string s((*token), length);
+    (*token) += length;
+    return s;
+}
+
+// Zero based index, negative indices are relative to the elements parsed so far
+static inline bool FixIndex(int idx, int n, int *ret, uint8_t relativeFlag, uint8_t *relative)
+{
+    if (idx > 0)
+    {
+        (*ret) = idx - 1;
+        return true;
+    }
+    if (idx == 0)
+    {
+        return false;
+    }
+    (*ret) = n + idx;
+    (*relative) |= relativeFlag;
+    return true;
+}
+
+// Parses i, i/j/k, i//k and i/j the way tinyobj's parseTriple does
+static bool ParseTriple(const char **token, int vsize, int vnsize, int vtsize, ObjCorner *ret,
+                        uint8_t *relative)
+{
+    ObjCorner corner;
+    if (!FixIndex(atoi((*token)), vsize, &corner.v, OBJ_RELATIVE_V, relative))
+    {
+        return false;
+    }
+
+    (*token) += strcspn((*token), "/ \t\r");
+    if ((*token)[0] != '/')
+    {
+        (*ret) = corner;
+        return true;
+    }
+    (*token)++;
+
+    if ((*token)[0] == '/')
+    {
+        (*token)++;
+        if (!FixIndex(atoi((*token)), vnsize, &corner.vn, OBJ_RELATIVE_VN, relative))
+        {
+            return false;
+        }
+        (*token) += strcspn((*token), "/ \t\r");
+        (*ret) = corner;
+        return true;
+    }
+
+    if (!FixIndex(atoi((*token)), vtsize, &corner.vt, OBJ_RELATIVE_VT, relative))
+    {
+        return false;
+    }
+
+    (*token) += strcspn((*token), "/ \t\r");
+    if ((*token)[0] != '/')
+    {
+        (*ret) = corner;
+        return true;
+    }
+
+    (*token)++;
+    if (!FixIndex(atoi((*token)), vnsize, &corner.vn, OBJ_RELATIVE_VN, relative))
+    {
+        return false;
+    }
+    (*token) += strcspn((*token), "/ \t\r");
+
+    (*ret) = corner;
+    return true;
+}
+
+static bool ParseLine(ObjChunk &chunk, const char *line)
+{
+    const char *token = line + strspn(line, " \t");
+    if (token[0] == '\0' || token[0] == '#')
+    {
+        return true;
+    }
+
+    const int vsize = static_cast<int>(chunk.positions.size() / 3);
+    const int vnsize = static_cast<int>(chunk.normals.size() / 3);
+    const int vtsize = static_cast<int>(chunk.texcoords.size() / 2);
+
+    if (token[0] == 'v' && OBJ_IS_SPACE(token[1]))
+    {
+        token += 2;
+        float x = ParseReal(&token);
+        float y = ParseReal(&token);
+        float z = ParseReal(&token);
+        float r, g, b;
+        if (!(ParseReal(&token, &r) && ParseReal(&token, &g) && ParseReal(&token, &b)))
+        {
+            r = g = b = 1.0f;
+        }
+        chunk.positions.insert(chunk.positions.end(), {x, y, z});
+        chunk.colors.insert(chunk.colors.end(), {r, g, b});
+        return true;
+    }
+
+    if (token[0] == 'v' && token[1] == 'n' && OBJ_IS_SPACE(token[2]))
+    {
+        token += 3;
+        float x = ParseReal(&token);
+        float y = ParseReal(&token);
+        float z = ParseReal(&token);
+        chunk.normals.insert(chunk.normals.end(), {x, y, z});
+        return true;
+    }
+
+    if (token[0] == 'v' && token[1] == 't' && OBJ_IS_SPACE(token[2]))
+    {
+        token += 3;
+        float x = ParseReal(&token);
+        float y = ParseReal(&token);
+        chunk.texcoords.insert(chunk.texcoords.end(), {x, y});
+        return true;
+    }
+
+    // Lines and points are not loaded, but malformed ones fail the whole file in tinyobj
+    if ((token[0] == 'l' || token[0] == 'p') && OBJ_IS_SPACE(token[1]))
+    {
+        const char statement = token[0];
+        token += 2;
+        while (!OBJ_IS_NEW_LINE(token[0]))
+        {
+            ObjCorner corner;
+            uint8_t relative = 0;
+            if (!ParseTriple(&token, vsize, vnsize, vtsize, &corner, &relative))
+            {
+                chunk.error = std::string("Failed parse `") + statement + "' line";
+                return false;
+            }
+            token += strspn(token, " \t\r");
+        }
+        return true;
+    }
+
+    if (token[0] == 'f' && OBJ_IS_SPACE(token[1]))
+    {
+        token += 2;
+        token += strspn(token, " \t");
+
+        size_t firstCorner = chunk.corners.size();
+        while (!OBJ_IS_NEW_LINE(token[0]))
+        {
+            ObjCorner corner;
+            uint8_t relative = 0;
+            if (!ParseTriple(&token, vsize, vnsize, vtsize, &corner, &relative))
+            {
+                chunk.error = "Failed parse `f' line";
+                return false;
+            }
+            if (relative)
+            {
+                chunk.relativeCorners.emplace_back(chunk.corners.size(), relative);
+            }
+            chunk.corners.push_back(corner);
+            token += strspn(token, " \t\r");
+        }
+        chunk.faceSizes.push_back(static_cast<uint32_t>(chunk.corners.size() - firstCorner));
+        return true;
+    }
+
+    const size_t faceCount = chunk.faceSizes.size();
+    const size_t vertexCount = chunk.positions.size() / 3;
+
+    if (0 == strncmp(token, "usemtl", 6))
+    {
+        token += 6;
+        chunk.events.push_back({ObjStatement::UseMtl, faceCount, vertexCount, ParseString(&token)});
+        return true;
+    }
+
+    if (0 == strncmp(token, "mtllib", 6) && OBJ_IS_SPACE(token[6]))
+    {
+        token += 7;
+        chunk.events.push_back({ObjStatement::MtlLib, faceCount, vertexCount, token});
+        return true;
+    }
+
+    if ((token[0] == 'g' || token[0] == 'o') && OBJ_IS_SPACE(token[1]))
+    {
+        chunk.events.push_back({ObjStatement::Group, faceCount, vertexCount, ""});
+        return true;
+    }
+
+    return true;
+}
+
+static void ParseChunk(ObjChunk &chunk)
+{
+    // Lines are copied out so that parsing sees the same null terminated text as tinyobj
+    std::string line;
+    const char *cursor = chunk.begin;
+    while (cursor < chunk.end)
+    {
+        const char *lineEnd = cursor;
+        while (lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r')
+        {
+            lineEnd++;
+        }
+        line.assign(cursor, lineEnd);
+        if (!ParseLine(chunk, line.c_str()))
+        {
+            chunk.errorLine = cursor;
+            return;
+        }
+        cursor = lineEnd + 1;
+    }
+}
+
+static inline void EmitTriangle(ObjChunk &chunk, const ObjCorner &c0, const ObjCorner &c1,
+                                const ObjCorner &c2, int material)
+{
+    chunk.triangles.insert(chunk.triangles.end(), {c0, c1, c2});
+    chunk.triangleMaterials.push_back(material);
+}
+
+// Code from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+static int PointInPolygon(int nvert, const float *vertx, const float *verty, float testx,
+                          float testy)
+{
+    int i, j, c = 0;
+    for (i = 0, j = nvert - 1; i < nvert; j = i++)
+    {
+        if (((verty[i] > testy) != (verty[j] > testy)) &&
+            (testx < (vertx[j] - vertx[i]) * (testy - verty[i]) / (verty[j] - verty[i]) + vertx[i]))
+            c = !c;
+    }
+    return c;
+}
+
+// Ear clipping port of tinyobj's exportGroupsToShape. The positions are limited to the ones
+// tinyobj had parsed when it flushed the face, which only matters for forward references.
+static void TriangulateFace(ObjChunk &chunk, const ObjCorner *face, size_t faceSize,
+                            const float *v, size_t vSize, int material,
+                            std::vector<ObjCorner> &remainingFace)
+{
+    size_t npolys = faceSize;
+    if (npolys < 3)
+    {
+        return;
+    }
+    if (npolys == 3)
+    {
+        EmitTriangle(chunk, face[0], face[1], face[2], material);
+        return;
+    }
+
+    size_t axes[2] = {1, 2};
+    for (size_t k = 0; k < npolys; ++k)
+    {
+        size_t vi0 = size_t(face[(k + 0) % npolys].v);
+        size_t vi1 = size_t(face[(k + 1) % npolys].v);
+        size_t vi2 = size_t(face[(k + 2) % npolys].v);
+
+        if (((3 * vi0 + 2) >= vSize) || ((3 * vi1 + 2) >= vSize) || ((3 * vi2 + 2) >= vSize))
+        {
+            continue;
+        }
+        float v0x = v[vi0 * 3 + 0];
+        float v0y = v[vi0 * 3 + 1];
+        float v0z = v[vi0 * 3 + 2];
+        float v1x = v[vi1 * 3 + 0];
+        float v1y = v[vi1 * 3 + 1];
+        float v1z = v[vi1 * 3 + 2];
+        float v2x = v[vi2 * 3 + 0];
+        float v2y = v[vi2 * 3 + 1];
+        float v2z = v[vi2 * 3 + 2];
+        float e0x = v1x - v0x;
+        float e0y = v1y - v0y;
+        float e0z = v1z - v0z;
+        float e1x = v2x - v1x;
+        float e1y = v2y - v1y;
+        float e1z = v2z - v1z;
+        float cx = std::fabs(e0y * e1z - e0z * e1y);
+        float cy = std::fabs(e0z * e1x - e0x * e1z);
+        float cz = std::fabs(e0x * e1y - e0y * e1x);
+        const float epsilon = std::numeric_limits<float>::epsilon();
+        if (cx > epsilon || cy > epsilon || cz > epsilon)
+        {
+            if (!(cx > cy && cx > cz))
+            {
+                axes[0] = 0;
+                if (cz > cx && cz > cy)
+                    axes[1] = 1;
+            }
+            break;
+        }
+    }
+
+    float area = 0;
+    for (size_t k = 0; k < npolys; ++k)
+    {
+        size_t vi0 = size_t(face[(k + 0) % npolys].v);
+        size_t vi1 = size_t(face[(k + 1) % npolys].v);
+        if (((vi0 * 3 + axes[0]) >= vSize) || ((vi0 * 3 + axes[1]) >= vSize) ||
+            ((vi1 * 3 + axes[0]) >= vSize) || ((vi1 * 3 + axes[1]) >= vSize))
+        {
+            continue;
+        }
+        float v0x = v[vi0 * 3 + axes[0]];
+        float v0y = v[vi0 * 3 + axes[1]];
+        float v1x = v[vi1 * 3 + axes[0]];
+        float v1y = v[vi1 * 3 + axes[1]];
+        area += (v0x * v1y - v0y * v1x) * static_cast<float>(0.5);
+    }
+
+    remainingFace.assign(face, face + faceSize);
+    size_t guessVert = 0;
+    ObjCorner ind[3];
+    float vx[3];
+    float vy[3];
+
+    size_t remainingIterations = faceSize;
+    size_t previousRemainingVertices = remainingFace.size();
+
+    while (remainingFace.size() > 3 && remainingIterations > 0)
+    {
+        npolys = remainingFace.size();
+        if (guessVert >= npolys)
+        {
+            guessVert -= npolys;
+        }
+
+        if (previousRemainingVertices != npolys)
+        {
+            previousRemainingVertices = npolys;
+            remainingIterations = npolys;
+        }
+        else
+        {
+            remainingIterations--;
+        }
+
+        for (size_t k = 0; k < 3; k++)
+        {
+            ind[k] = remainingFace[(guessVert + k) % npolys];
+            size_t vi = size_t(ind[k].v);
+            if (((vi * 3 + axes[0]) >= vSize) || ((vi * 3 + axes[1]) >= vSize))
+            {
+                vx[k] = static_cast<float>(0.0);
+                vy[k] = static_cast<float>(0.0);
+            }
+            else
+            {
+                vx[k] = v[vi * 3 + axes[0]];
+                vy[k] = v[vi * 3 + axes[1]];
+            }
+        }
+        float e0x = vx[1] - vx[0];
+        float e0y = vy[1] - vy[0];
+        float e1x = vx[2] - vx[1];
+        float e1y = vy[2] - vy[1];
+        float cross = e0x * e1y - e0y * e1x;
+        // Skip internal angles
+        if (cross * area < static_cast<float>(0.0))
+        {
+            guessVert += 1;
+            continue;
+        }
+
+        // Skip the triangle if any other vertex lies inside of it
+        bool overlap = false;
+        for (size_t otherVert = 3; otherVert < npolys; ++otherVert)
+        {
+            size_t idx = (guessVert + otherVert) % npolys;
+            size_t ovi = size_t(remainingFace[idx].v);
+            if (((ovi * 3 + axes[0]) >= vSize) || ((ovi * 3 + axes[1]) >= vSize))
+            {
+                continue;
+            }
+            float tx = v[ovi * 3 + axes[0]];
+            float ty = v[ovi * 3 + axes[1]];
+            if (PointInPolygon(3, vx, vy, tx, ty))
+            {
+                overlap = true;
+                break;
+            }
+        }
+
+        if (overlap)
+        {
+            guessVert += 1;
+            continue;
+        }
+
+        EmitTriangle(chunk, ind[0], ind[1], ind[2], material);
+
+        size_t removedVertIndex = (guessVert + 1) % npolys;
+        while (removedVertIndex + 1 < npolys)
+        {
+            remainingFace[removedVertIndex] = remainingFace[removedVertIndex + 1];
+            removedVertIndex += 1;
+        }
+        remainingFace.pop_back();
+    }
+
+    if (remainingFace.size() == 3)
+    {
+        EmitTriangle(chunk, remainingFace[0], remainingFace[1], remainingFace[2], material);
+    }
+}
+
+static void SplitString(const std::string &s, char delim, std::vector<std::string> &elems)
+{
+    std::stringstream ss;
+    ss.str(s);
+    std::string item;
+    while (std::getline(ss, item, delim))
+    {
+        elems.push_back(item);
+    }
+}
+
+static std::string GetMaterialBaseDir(const std::string &mtlBaseDir)
+{
+    std::string baseDir = mtlBaseDir;
+    if (!baseDir.empty())
+    {
+#ifndef _WIN32
+        const char dirsep = '/';
+#else
+        const char dirsep = '\\';
+#endif
+        if (baseDir[baseDir.length() - 1] != dirsep)
+            baseDir += dirsep;
+    }
+    return baseDir;
+}
+
+// Material statements depend on everything before them, so they are replayed in file order
+// once the chunks are parsed
+struct ObjStatementReplay
+{
+    explicit ObjStatementReplay(const std::string &mtlBaseDir)
+        : materialBaseDir(GetMaterialBaseDir(mtlBaseDir)), materialReader(materialBaseDir)
+    {
+    }
+
+    // Material files are mapped first so that they are found in the mounted asset archives,
+    // tinyobj reads the rest such as empty files and lists of search paths
+    bool LoadMaterials(const std::string &filename)
+    {
+        std::string warn, err;
+        MappedFile file;
+        if (file.Open(materialBaseDir + filename))
+        {
+            std::istringstream stream(
+                std::string(reinterpret_cast<const char *>(file.GetData()), file.GetSize()));
+            tinyobj::LoadMtl(&materialMap, &objMaterials, &stream, &warn, &err);
+            return true;
+        }
+        return materialReader(filename.c_str(), &objMaterials, &materialMap, &warn, &err);
+    }
+
+    void Apply(const ObjChunk &chunk)
+    {
+        for (const auto &event : chunk.events)
+        {
+            const size_t face = chunk.faceBase + event.faceCount;
+            const size_t vertexCount = chunk.positionBase + event.vertexCount;
+            if (event.statement == ObjStatement::UseMtl)
+            {
+                auto it = materialMap.find(event.argument);
+                int newMaterial = it != materialMap.end() ? it->second : -1;
+                if (newMaterial != material)
+                {
+                    segments.push_back({face, material, vertexCount});
+                    material = newMaterial;
+                }
+            }
+            else if (event.statement == ObjStatement::MtlLib)
+            {
+                std::vector<std::string> filenames;
+                SplitString(event.argument, ' ', filenames);
+                for (const auto &filename : filenames)
+                {
+                    if (filename.empty())
+                    {
+                        continue;
+                    }
+                    materialFiles.push_back(materialBaseDir + filename);
+                    if (LoadMaterials(filename))
+                    {
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                segments.push_back({face, material, vertexCount});
+            }
+        }
+    }
+
+    void Finish(size_t faceCount, size_t positionCount)
+    {
+        segments.push_back({faceCount, material, positionCount});
+    }
+
+    std::string materialBaseDir;
+    tinyobj::MaterialFileReader materialReader;
+    std::vector<tinyobj::material_t> objMaterials;
+    std::map<std::string, int> materialMap;
+    // Every library looked for up to the first one found of each mtllib statement
+    std::vector<std::string> materialFiles;
+    std::vector<ObjSegment> segments;
+    int material = -1;
+};
+
+// Adds the element counts of the preceding chunks to negative indices
+static void ResolveRelativeCorners(ObjChunk &chunk)
+{
+    for (const auto &relative : chunk.relativeCorners)
+    {
+        ObjCorner &corner = chunk.corners[relative.first];
+        if (relative.second & OBJ_RELATIVE_V)
+            corner.v += static_cast<int>(chunk.positionBase);
+        if (relative.second & OBJ_RELATIVE_VT)
+            corner.vt += static_cast<int>(chunk.texcoordBase);
+        if (relative.second & OBJ_RELATIVE_VN)
+            corner.vn += static_cast<int>(chunk.normalBase);
+    }
+}
+
+struct ObjAttributes
+{
+    const float *positions = nullptr;
+    const float *colors = nullptr;
+    const float *normals = nullptr;
+    const float *texcoords = nullptr;
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+};
+
+// Builds the three vertices of a triangle the same way the tinyobj path in ObjModel does
+static bool GatherTriangle(const ObjCorner *triangle, int material, int materialCount,
+                           const ObjAttributes &attributes, Vertex *faceVertices)
+{
+    for (size_t c = 0; c < 3; c++)
+    {
+        const ObjCorner &index = triangle[c];
+        const auto vertexIndex = static_cast<uint64_t>(index.v);
+        const auto normalIndex = static_cast<uint64_t>(index.vn);
+        const auto texcoordIndex = static_cast<uint64_t>(index.vt);
+
+        if (vertexIndex >= attributes.positionCount ||
+            (attributes.normalCount && index.vn >= 0 && normalIndex >= attributes.normalCount) ||
+            (attributes.texcoordCount && index.vt >= 0 &&
+             texcoordIndex >= attributes.texcoordCount))
+        {
+            return false;
+        }
+
+        Vertex &vertex = faceVertices[c];
+        vertex = {};
+        vertex.pos = {attributes.positions[3 * vertexIndex + 0],
+                      attributes.positions[3 * vertexIndex + 1],
+                      attributes.positions[3 * vertexIndex + 2]};
+
+        if (attributes.normalCount && index.vn >= 0)
+        {
+            vertex.norm = {attributes.normals[3 * normalIndex + 0],
+                           attributes.normals[3 * normalIndex + 1],
+                           attributes.normals[3 * normalIndex + 2]};
+        }
+
+        vertex.color = {attributes.colors[3 * vertexIndex + 0],
+                        attributes.colors[3 * vertexIndex + 1],
+                        attributes.colors[3 * vertexIndex + 2]};
+
+        if (attributes.texcoordCount && index.vt >= 0)
+        {
+            vertex.texCoord = {attributes.texcoords[2 * texcoordIndex + 0],
+                               1.0f - attributes.texcoords[2 * texcoordIndex + 1]};
+        }
+
+        vertex.matID = material;
+        if (vertex.matID < 0 || vertex.matID >= materialCount)
+        {
+            vertex.matID = 0;
+        }
+    }
+    return true;
+}
+
+void ObjParser::ConvertMaterials(const std::vector<tinyobj::material_t> &objMaterials,
+                                 MeshData &mesh)
+{
+    for (const auto &material : objMaterials)
+    {
+        Material m = {};
+        m.ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
+        m.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+        m.specular = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+        m.emission = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
+        m.transmittance = glm::vec3(material.transmittance[0], material.transmittance[1],
+                                    material.transmittance[2]);
+        m.dissolve = material.dissolve;
+        m.ior = material.ior;
+        m.shininess = material.shininess;
+        m.illum = material.illum;
+        if (!material.diffuse_texname.empty())
+        {
+            mesh.textures.push_back(material.diffuse_texname);
+            m.textureID = static_cast<int>(mesh.textures.size()) - 1;
+        }
+
+        mesh.materials.emplace_back(m);
+    }
+
+    if (mesh.materials.empty())
+    {
+        mesh.materials.emplace_back(Material());
+    }
+
+    // Converting from Srgb to linear
+    for (auto &m : mesh.materials)
+    {
+        m.ambient = glm::pow(m.ambient, glm::vec3(2.2f));
+        m.diffuse = glm::pow(m.diffuse, glm::vec3(2.2f));
+        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
+    }
+}
+
+// Splits [begin, end) into chunks that end right after a line break, so that no line is
+// split between two of them
+static void SplitChunks(const char *begin, const char *end, size_t chunkSize,
+                        std::vector<ObjChunk> &chunks)
+{
+    chunks.clear();
+    for (const char *cursor = begin; cursor < end;)
+    {
+        const char *chunkEnd = cursor + std::min(chunkSize, static_cast<size_t>(end - cursor));
+        while (chunkEnd < end && chunkEnd[-1] != '\n' && chunkEnd[-1] != '\r')
+        {
+            chunkEnd++;
+        }
+        chunks.emplace_back();
+        chunks.back().begin = cursor;
+        chunks.back().end = chunkEnd;
+        cursor = chunkEnd;
+    }
+}
+
+bool ObjParser::Load(const std::string &filePath, const std::string &mtlBaseDir, MeshData &mesh,
+                     std::string &error, const NormalSettings &normalSettings)
+{
+    MappedFile file;
+    if (!file.Open(filePath))
+    {
+        // Mapping also fails for empty files, which load as an empty mesh
+        std::ifstream stream(filePath);
+        if (!stream)
+        {
+            error = "Cannot open file [" + filePath + "]";
+            return false;
+        }
+    }
+    const char *data = reinterpret_cast<const char *>(file.GetData());
+
+    ThreadPool &pool = ThreadPool::Get();
+
+    std::vector<ObjChunk> chunks;
+    SplitChunks(data, data + file.GetSize(),
+                std::max<size_t>(OBJ_MIN_CHUNK_SIZE,
+                                 file.GetSize() / (pool.GetConcurrency() * 4) + 1),
+                chunks);
+
+    pool.ParallelFor(chunks.size(), [&chunks](size_t i) { ParseChunk(chunks[i]); });
+
+    ObjStatementReplay replay(mtlBaseDir);
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+    size_t faceCount = 0;
+    for (auto &chunk : chunks)
+    {
+        if (chunk.errorLine)
+        {
+            size_t line = std::count(data, chunk.errorLine, '\n') + 1;
+            error = chunk.error + " (line " + std::to_string(line) + ")";
+            return false;
+        }
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        chunk.texcoordBase = texcoordCount;
+        chunk.faceBase = faceCount;
+        positionCount += chunk.positions.size() / 3;
+        normalCount += chunk.normals.size() / 3;
+        texcoordCount += chunk.texcoords.size() / 2;
+        faceCount += chunk.faceSizes.size();
+        replay.Apply(chunk);
+    }
+    replay.Finish(faceCount, positionCount);
+
+    ConvertMaterials(replay.objMaterials, mesh);
+    mesh.materialFiles = replay.materialFiles;
+    const int materialCount = static_cast<int>(mesh.materials.size());
+
+    std::vector<float> positions(3 * positionCount);
+    std::vector<float> colors(3 * positionCount);
+    std::vector<float> normals(3 * normalCount);
+    std::vector<float> texcoords(2 * texcoordCount);
+    pool.ParallelFor(chunks.size(), [&](size_t i) {
+        ObjChunk &chunk = chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(),
+                  positions.begin() + 3 * chunk.positionBase);
+        std::copy(chunk.colors.begin(), chunk.colors.end(),
+                  colors.begin() + 3 * chunk.positionBase);
+        std::copy(chunk.normals.begin(), chunk.normals.end(),
+                  normals.begin() + 3 * chunk.normalBase);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                  texcoords.begin() + 2 * chunk.texcoordBase);
+        std::vector<float>().swap(chunk.positions);
+        std::vector<float>().swap(chunk.colors);
+        std::vector<float>().swap(chunk.normals);
+        std::vector<float>().swap(chunk.texcoords);
+        ResolveRelativeCorners(chunk);
+    });
+
+    const auto &segments = replay.segments;
+    pool.ParallelFor(chunks.size(), [&](size_t i) {
+        ObjChunk &chunk = chunks[i];
+        std::vector<ObjCorner> remainingFace;
+        chunk.triangles.reserve(chunk.corners.size());
+        chunk.triangleMaterials.reserve(chunk.faceSizes.size());
+
+        auto segment = std::upper_bound(
+            segments.begin(), segments.end(), chunk.faceBase,
+            [](size_t face, const ObjSegment &segment) { return face < segment.faceEnd; });
+        size_t corner = 0;
+        for (size_t face = 0; face < chunk.faceSizes.size(); face++)
+        {
+            while (segment->faceEnd <= chunk.faceBase + face)
+            {
+                segment++;
+            }
+            TriangulateFace(chunk, &chunk.corners[corner], chunk.faceSizes[face],
+                            positions.data(), 3 * segment->vertexLimit, segment->material,
+                            remainingFace);
+            corner += chunk.faceSizes[face];
+        }
+        std::vector<ObjCorner>().swap(chunk.corners);
+        std::vector<uint32_t>().swap(chunk.faceSizes);
+    });
+
+    size_t triangleCount = 0;
+    for (auto &chunk : chunks)
+    {
+        chunk.triangleBase = triangleCount;
+        triangleCount += chunk.triangleMaterials.size();
+    }
+
+    ObjAttributes attributes;
+    attributes.positions = positions.data();
+    attributes.colors = colors.data();
+    attributes.normals = normals.data();
+    attributes.texcoords = texcoords.data();
+    attributes.positionCount = positionCount;
+    attributes.normalCount = normalCount;
+    attributes.texcoordCount = texcoordCount;
+
+    // Files without normals get them generated over the shared positions
+    const bool generateNormals = normalCount == 0;
+    std::vector<Vertex> corners(3 * triangleCount);
+    std::vector<uint32_t> cornerPositions(generateNormals ? 3 * triangleCount : 0);
+    pool.ParallelFor(chunks.size(), [&](size_t i) {
+        ObjChunk &chunk = chunks[i];
+        for (size_t triangle = 0; triangle < chunk.triangleMaterials.size(); triangle++)
+        {
+            const size_t first = 3 * (chunk.triangleBase + triangle);
+            if (!GatherTriangle(&chunk.triangles[3 * triangle], chunk.triangleMaterials[triangle],
+                                materialCount, attributes, &corners[first]))
+            {
+                chunk.error = "Face index out of bounds";
+                return;
+            }
+            for (size_t c = 0; generateNormals && c < 3; c++)
+            {
+                cornerPositions[first + c] = chunk.triangles[3 * triangle + c].v;
+            }
+        }
+    });
+
+    for (const auto &chunk : chunks)
+    {
+        if (!chunk.error.empty())
+        {
+            error = chunk.error;
+            return false;
+        }
+    }
+
+    if (generateNormals)
+    {
+        NormalGenerator::Generate(positions.data(), positionCount, cornerPositions.data(),
+                                  triangleCount, normalSettings, corners.data());
+        std::vector<uint32_t>().swap(cornerPositions);
+    }
+    mesh.normalSettings = normalSettings;
+    mesh.sourceNormals = !generateNormals;
+
+    std::vector<size_t> hashes(3 * triangleCount);
+    pool.ParallelFor(chunks.size(), [&](size_t i) {
+        const size_t first = 3 * chunks[i].triangleBase;
+        const size_t last = first + 3 * chunks[i].triangleMaterials.size();
+        for (size_t c = first; c < last; c++)
+        {
+            hashes[c] = std::hash<Vertex>()(corners[c]);
+        }
+    });
+
+    // Welding stays serial so that vertices keep the order of their first use. The hashes are
+    // already known, which leaves only the probing here.
+    const size_t cornerCount = corners.size();
+    size_t capacity = 16;
+    while (capacity < 2 * cornerCount)
+    {
+        capacity <<= 1;
+    }
+    const size_t mask = capacity - 1;
+    std::vector<uint32_t> table(capacity, OBJ_EMPTY_SLOT);
+
+    mesh.vertices.clear();
+    mesh.indices.resize(cornerCount);
+    for (size_t i = 0; i < cornerCount; i++)
+    {
+        size_t slot = hashes[i] & mask;
+        while (table[slot] != OBJ_EMPTY_SLOT && !(mesh.vertices[table[slot]] == corners[i]))
+        {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot] == OBJ_EMPTY_SLOT)
+        {
+            table[slot] = static_cast<uint32_t>(mesh.vertices.size());
+            mesh.vertices.push_back(corners[i]);
+        }
+        mesh.indices[i] = table[slot];
+    }
+    return true;
+}
+
+// Append-only binary file holding data that does not fit into the memory budget. Once written
+// it is mapped, which leaves paging it in and out to the OS.
+struct ObjSpillFile
+{
+    ~ObjSpillFile()
+    {
+        mapping.Close();
+        stream.close();
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    bool Open(const std::string &filePath)
+    {
+        path = filePath;
+        stream.open(path, std::ios::binary | std::ios::trunc);
+        return stream.is_open();
+    }
+
+    template <typename T> void Append(const std::vector<T> &data)
+    {
+        stream.write(reinterpret_cast<const char *>(data.data()), sizeof(T) * data.size());
+    }
+
+    // Empty files cannot be mapped and leave the data pointer null
+    bool Map()
+    {
+        stream.close();
+        if (!stream.good())
+        {
+            return false;
+        }
+        mapping.Open(path);
+        return true;
+    }
+
+    template <typename T> const T *GetData() const
+    {
+        return reinterpret_cast<const T *>(mapping.GetData());
+    }
+
+    std::string path;
+    std::ofstream stream;
+    MappedFile mapping;
+};
+
+struct ObjWeldEntry
+{
+    Vertex vertex;
+    uint32_t index;
+};
+
+template <typename T> static inline size_t GetCapacityBytes(const std::vector<T> &data)
+{
+    return sizeof(T) * data.capacity();
+}
+
+static size_t GetChunkBytes(const ObjChunk &chunk)
+{
+    return GetCapacityBytes(chunk.positions) + GetCapacityBytes(chunk.colors) +
+           GetCapacityBytes(chunk.normals) + GetCapacityBytes(chunk.texcoords) +
+           GetCapacityBytes(chunk.corners) + GetCapacityBytes(chunk.faceSizes) +
+           GetCapacityBytes(chunk.relativeCorners) + GetCapacityBytes(chunk.events) +
+           GetCapacityBytes(chunk.triangles) + GetCapacityBytes(chunk.triangleMaterials);
+}
+
+bool ObjParser::Stream(const std::string &filePath, const std::string &mtlBaseDir,
+                       size_t memoryBudget, ObjStreamReport &report, std::string &error,
+                       const NormalSettings &normalSettings)
+{
+    report = {};
+    report.memoryBudget = memoryBudget;
+    auto track = [&report](size_t bytes) {
+        report.peakMemory = std::max(report.peakMemory, bytes);
+    };
+
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file)
+    {
+        error = "Cannot open file [" + filePath + "]";
+        return false;
+    }
+
+    ObjSpillFile positionsSpill, colorsSpill, normalsSpill, texcoordsSpill, cornersSpill,
+        faceSizesSpill;
+    if (!positionsSpill.Open(filePath + ".positions.tmp") ||
+        !colorsSpill.Open(filePath + ".colors.tmp") ||
+        !normalsSpill.Open(filePath + ".normals.tmp") ||
+        !texcoordsSpill.Open(filePath + ".texcoords.tmp") ||
+        !cornersSpill.Open(filePath + ".corners.tmp") ||
+        !faceSizesSpill.Open(filePath + ".faces.tmp"))
+    {
+        error = "Cannot create spill files next to [" + filePath + "]";
+        return false;
+    }
+
+    ThreadPool &pool = ThreadPool::Get();
+
+    // First pass: text is read in line aligned blocks of an eighth of the budget, their parsed
+    // form takes about two more, and everything is appended to the spill files
+    std::vector<char> block(std::max<size_t>(memoryBudget / 8, OBJ_MIN_STREAM_BLOCK_SIZE));
+    std::vector<ObjChunk> chunks;
+    ObjStatementReplay replay(mtlBaseDir);
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+    size_t faceCount = 0;
+    size_t lineCount = 0;
+    size_t carry = 0;
+    bool endOfFile = false;
+    while (!endOfFile)
+    {
+        file.read(block.data() + carry, block.size() - carry);
+        const size_t valid = carry + static_cast<size_t>(file.gcount());
+        endOfFile = file.eof();
+
+        size_t parsed = valid;
+        if (!endOfFile)
+        {
+            while (parsed > 0 && block[parsed - 1] != '\n' && block[parsed - 1] != '\r')
+            {
+                parsed--;
+            }
+            if (parsed == 0)
+            {
+                // A single line does not fit, grow the block until it does
+                carry = valid;
+                block.resize(2 * block.size());
+                continue;
+            }
+        }
+
+        SplitChunks(block.data(), block.data() + parsed,
+                    std::max<size_t>(OBJ_MIN_STREAM_BLOCK_SIZE, parsed / pool.GetConcurrency() + 1),
+                    chunks);
+        pool.ParallelFor(chunks.size(), [&chunks](size_t i) { ParseChunk(chunks[i]); });
+
+        size_t blockBytes = GetCapacityBytes(block);
+        for (const auto &chunk : chunks)
+        {
+            blockBytes += GetChunkBytes(chunk);
+        }
+        track(blockBytes);
+
+        for (auto &chunk : chunks)
+        {
+            if (chunk.errorLine)
+            {
+                const char *blockData = block.data();
+                size_t line = lineCount + std::count(blockData, chunk.errorLine, '\n') + 1;
+                error = chunk.error + " (line " + std::to_string(line) + ")";
+                return false;
+            }
+            chunk.positionBase = positionCount;
+            chunk.normalBase = normalCount;
+            chunk.texcoordBase = texcoordCount;
+            chunk.faceBase = faceCount;
+            positionCount += chunk.positions.size() / 3;
+            normalCount += chunk.normals.size() / 3;
+            texcoordCount += chunk.texcoords.size() / 2;
+            faceCount += chunk.faceSizes.size();
+            ResolveRelativeCorners(chunk);
+            replay.Apply(chunk);
+
+            positionsSpill.Append(chunk.positions);
+            colorsSpill.Append(chunk.colors);
+            normalsSpill.Append(chunk.normals);
+            texcoordsSpill.Append(chunk.texcoords);
+            cornersSpill.Append(chunk.corners);
+            faceSizesSpill.Append(chunk.faceSizes);
+        }
+
+        lineCount += std::count(block.data(), block.data() + parsed, '\n');
+        memmove(block.data(), block.data() + parsed, valid - parsed);
+        carry = valid - parsed;
+    }
+    replay.Finish(faceCount, positionCount);
+    std::vector<ObjChunk>().swap(chunks);
+    std::vector<char>().swap(block);
+
+    if (!positionsSpill.Map() || !colorsSpill.Map() || !normalsSpill.Map() ||
+        !texcoordsSpill.Map() || !cornersSpill.Map() || !faceSizesSpill.Map())
+    {
+        error = "Failed to write spill files next to [" + filePath + "]";
+        return false;
+    }
+
+    MeshData materials;
+    ConvertMaterials(replay.objMaterials, materials);
+    const int materialCount = static_cast<int>(materials.materials.size());
+
+    ObjAttributes attributes;
+    attributes.positions = positionsSpill.GetData<float>();
+    attributes.colors = colorsSpill.GetData<float>();
+    attributes.normals = normalsSpill.GetData<float>();
+    attributes.texcoords = texcoordsSpill.GetData<float>();
+    attributes.positionCount = positionCount;
+    attributes.normalCount = normalCount;
+    attributes.texcoordCount = texcoordCount;
+    const ObjCorner *faceCorners = cornersSpill.GetData<ObjCorner>();
+    const uint32_t *faceSizes = faceSizesSpill.GetData<uint32_t>();
+
+    MeshCacheWriter writer;
+    if (!writer.Begin(filePath))
+    {
+        error = "Cannot write mesh cache for [" + filePath + "]";
+        return false;
+    }
+    for (const auto &materialFile : replay.materialFiles)
+    {
+        writer.AddDependency(materialFile);
+    }
+
+    // A quarter of the budget goes to triangle batches, with room for their generated normals
+    const bool generateNormals = normalCount == 0;
+    const size_t triangleBytes = 3 * (sizeof(ObjCorner) + sizeof(Vertex) + sizeof(size_t)) +
+                                 sizeof(int) + (generateNormals ? 3 * sizeof(glm::vec3) : 0);
+    const size_t batchTriangles = std::max<size_t>(memoryBudget / 4 / triangleBytes, 1024);
+
+    ObjChunk batch;
+    batch.triangles.reserve(3 * batchTriangles);
+    batch.triangleMaterials.reserve(batchTriangles);
+    std::vector<ObjCorner> remainingFace;
+    size_t face = 0;
+    size_t corner = 0;
+    auto segment = replay.segments.cbegin();
+    auto triangulateBatch = [&]() {
+        batch.triangles.clear();
+        batch.triangleMaterials.clear();
+        while (face < faceCount && batch.triangleMaterials.size() < batchTriangles)
+        {
+            while (segment->faceEnd <= face)
+            {
+                segment++;
+            }
+            TriangulateFace(batch, faceCorners + corner, faceSizes[face], attributes.positions,
+                            3 * segment->vertexLimit, segment->material, remainingFace);
+            corner += faceSizes[face];
+            face++;
+        }
+    };
+
+    // Smoothing needs every corner around a position, which the weld pass does not have. The
+    // triangles are spilled once, then normals are generated for one position range at a time
+    // and spilled in corner order, so the weld pass only has to keep a cursor per range.
+    ObjSpillFile trianglesSpill, generatedNormalsSpill;
+    std::vector<uint32_t> blockRanges;
+    std::vector<size_t> rangeCursors;
+    if (generateNormals)
+    {
+        if (!trianglesSpill.Open(filePath + ".triangles.tmp") ||
+            !generatedNormalsSpill.Open(filePath + ".smooth.tmp"))
+        {
+            error = "Cannot create spill files next to [" + filePath + "]";
+            return false;
+        }
+
+        std::vector<size_t> blockCorners(positionCount / OBJ_STREAM_NORMAL_BLOCK + 1, 0);
+        std::vector<uint32_t> trianglePositions;
+        size_t triangleCount = 0;
+        while (face < faceCount)
+        {
+            triangulateBatch();
+            trianglePositions.resize(batch.triangles.size());
+            for (size_t i = 0; i < batch.triangles.size(); i++)
+            {
+                const auto vertexIndex = static_cast<uint64_t>(batch.triangles[i].v);
+                if (vertexIndex >= positionCount)
+                {
+                    error = "Face index out of bounds";
+                    return false;
+                }
+                trianglePositions[i] = static_cast<uint32_t>(vertexIndex);
+                blockCorners[vertexIndex / OBJ_STREAM_NORMAL_BLOCK]++;
+            }
+            trianglesSpill.Append(trianglePositions);
+            triangleCount += batch.triangleMaterials.size();
+            track(GetChunkBytes(batch) + GetCapacityBytes(trianglePositions) +
+                  GetCapacityBytes(blockCorners) + GetCapacityBytes(remainingFace));
+        }
+        std::vector<uint32_t>().swap(trianglePositions);
+        if (!trianglesSpill.Map())
+        {
+            error = "Failed to write spill files next to [" + filePath + "]";
+            return false;
+        }
+
+        // Ranges are made of whole position blocks and sized to half of the budget, a single
+        // block over it still makes a range of its own
+        blockRanges.resize(blockCorners.size());
+        std::vector<uint32_t> rangeEnds;
+        std::vector<size_t> rangeCorners(1, 0);
+        size_t rangePositions = 0;
+        for (size_t block = 0; block < blockCorners.size(); block++)
+        {
+            const size_t blockPositions = std::min<size_t>(
+                OBJ_STREAM_NORMAL_BLOCK, positionCount - block * OBJ_STREAM_NORMAL_BLOCK);
+            if (rangePositions > 0 &&
+                NormalGenerator::GetRangeBytes(rangeCorners.back() + blockCorners[block],
+                                               rangePositions + blockPositions) > memoryBudget / 2)
+            {
+                rangeEnds.push_back(static_cast<uint32_t>(block * OBJ_STREAM_NORMAL_BLOCK));
+                rangeCorners.push_back(0);
+                rangePositions = 0;
+            }
+            blockRanges[block] = static_cast<uint32_t>(rangeEnds.size());
+            rangeCorners.back() += blockCorners[block];
+            rangePositions += blockPositions;
+        }
+        rangeEnds.push_back(static_cast<uint32_t>(positionCount));
+
+        std::vector<glm::vec3> rangeNormals;
+        size_t generatedCount = 0;
+        for (size_t range = 0; range < rangeEnds.size(); range++)
+        {
+            const uint32_t rangeBegin = range > 0 ? rangeEnds[range - 1] : 0;
+            track(GetChunkBytes(batch) + GetCapacityBytes(blockCorners) +
+                  GetCapacityBytes(blockRanges) + GetCapacityBytes(rangeEnds) +
+                  GetCapacityBytes(rangeCorners) +
+                  NormalGenerator::GetRangeBytes(rangeCorners[range],
+                                                 rangeEnds[range] - rangeBegin));
+
+            NormalGenerator::GenerateRange(
+                attributes.positions, trianglesSpill.GetData<uint32_t>(), triangleCount,
+                rangeBegin, rangeEnds[range], normalSettings, rangeNormals);
+            generatedNormalsSpill.Append(rangeNormals);
+            rangeCursors.push_back(generatedCount);
+            generatedCount += rangeNormals.size();
+            std::vector<glm::vec3>().swap(rangeNormals);
+        }
+        report.normalRanges = rangeEnds.size();
+        if (!generatedNormalsSpill.Map())
+        {
+            error = "Failed to write spill files next to [" + filePath + "]";
+            return false;
+        }
+
+        face = 0;
+        corner = 0;
+        segment = replay.segments.cbegin();
+    }
+    const glm::vec3 *generatedNormals = generatedNormalsSpill.GetData<glm::vec3>();
+
+    // Second pass: half of the budget goes to the weld table. Once it is half full it starts
+    // over, so vertices seen before that point may be emitted again.
+    size_t tableCapacity = 1024;
+    while (2 * tableCapacity * sizeof(ObjWeldEntry) <= memoryBudget / 2)
+    {
+        tableCapacity <<= 1;
+    }
+    const size_t tableMask = tableCapacity - 1;
+    const size_t tableLimit = tableCapacity / 2;
+    std::vector<ObjWeldEntry> table(tableCapacity);
+    for (auto &entry : table)
+    {
+        entry.index = OBJ_EMPTY_SLOT;
+    }
+    size_t tableCount = 0;
+
+    // The rest goes to the output buffers
+    const size_t outputCount = std::max<size_t>(memoryBudget / 16 / sizeof(Vertex), 1024);
+    std::vector<Vertex> batchVertices;
+    std::vector<size_t> batchHashes;
+    std::vector<glm::vec3> batchNormals;
+    std::vector<Vertex> outputVertices;
+    std::vector<uint32_t> outputIndices;
+    outputVertices.reserve(outputCount);
+    outputIndices.reserve(outputCount);
+
+    uint64_t vertexCount = 0;
+    while (face < faceCount)
+    {
+        triangulateBatch();
+
+        // Corners are visited in the order their normals were generated, so the next normal of
+        // the range holding their position is theirs. They have to be set before welding,
+        // otherwise corners of differently oriented faces would collapse into one vertex.
+        if (generateNormals)
+        {
+            batchNormals.resize(batch.triangles.size());
+            for (size_t i = 0; i < batch.triangles.size(); i++)
+            {
+                const uint32_t range = blockRanges[batch.triangles[i].v / OBJ_STREAM_NORMAL_BLOCK];
+                batchNormals[i] = generatedNormals[rangeCursors[range]++];
+            }
+        }
+
+        const size_t triangleCount = batch.triangleMaterials.size();
+        batchVertices.resize(3 * triangleCount);
+        batchHashes.resize(3 * triangleCount);
+        std::atomic<bool> valid{true};
+        pool.ParallelFor(
+            (triangleCount + OBJ_STREAM_GATHER_RANGE - 1) / OBJ_STREAM_GATHER_RANGE,
+            [&](size_t range) {
+                const size_t end =
+                    std::min(triangleCount, (range + 1) * OBJ_STREAM_GATHER_RANGE);
+                for (size_t triangle = range * OBJ_STREAM_GATHER_RANGE; triangle < end;
+                     triangle++)
+                {
+                    if (!GatherTriangle(&batch.triangles[3 * triangle],
+                                        batch.triangleMaterials[triangle], materialCount,
+                                        attributes, &batchVertices[3 * triangle]))
+                    {
+                        valid = false;
+                        return;
+                    }
+                    for (size_t c = 0; c < 3; c++)
+                    {
+                        if (generateNormals)
+                        {
+                            batchVertices[3 * triangle + c].norm = batchNormals[3 * triangle + c];
+                        }
+                        batchHashes[3 * triangle + c] =
+                            std::hash<Vertex>()(batchVertices[3 * triangle + c]);
+                    }
+                }
+            });
+        if (!valid)
+        {
+            error = "Face index out of bounds";
+            return false;
+        }
+
+        track(GetCapacityBytes(table) + GetChunkBytes(batch) + GetCapacityBytes(batchVertices) +
+              GetCapacityBytes(batchHashes) + GetCapacityBytes(batchNormals) +
+              GetCapacityBytes(blockRanges) + GetCapacityBytes(rangeCursors) +
+              GetCapacityBytes(outputVertices) + GetCapacityBytes(outputIndices) +
+              GetCapacityBytes(remainingFace));
+
+        for (size_t i = 0; i < batchVertices.size(); i++)
+        {
+            const Vertex &vertex = batchVertices[i];
+            size_t slot = batchHashes[i] & tableMask;
+            while (table[slot].index != OBJ_EMPTY_SLOT && !(table[slot].vertex == vertex))
+            {
+                slot = (slot + 1) & tableMask;
+            }
+
+            if (table[slot].index == OBJ_EMPTY_SLOT)
+            {
+                if (vertexCount == OBJ_EMPTY_SLOT)
+                {
+                    error = "Mesh has more vertices than 32 bit indices can address";
+                    return false;
+                }
+                if (tableCount == tableLimit)
+                {
+                    for (auto &entry : table)
+                    {
+                        entry.index = OBJ_EMPTY_SLOT;
+                    }
+                    tableCount = 0;
+                    report.weldTableResets++;
+                    slot = batchHashes[i] & tableMask;
+                }
+                table[slot] = {vertex, static_cast<uint32_t>(vertexCount++)};
+                tableCount++;
+                outputVertices.push_back(vertex);
+                if (outputVertices.size() == outputCount)
+                {
+                    writer.AppendVertices(outputVertices.data(), outputVertices.size());
+                    outputVertices.clear();
+                }
+            }
+
+            outputIndices.push_back(table[slot].index);
+            if (outputIndices.size() == outputCount)
+            {
+                writer.AppendIndices(outputIndices.data(), outputIndices.size());
+                report.indicesCount += outputIndices.size();
+                outputIndices.clear();
+            }
+        }
+    }
+    writer.AppendVertices(outputVertices.data(), outputVertices.size());
+    writer.AppendIndices(outputIndices.data(), outputIndices.size());
+    report.indicesCount += outputIndices.size();
+    report.verticesCount = vertexCount;
+
+    if (!writer.Finish(materials.materials, materials.textures, normalSettings, normalCount > 0))
+    {
+        error = "Cannot write mesh cache for [" + filePath + "]";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ObjModel.h"
+
+namespace tinyobj
+{
+    struct material_t;
+}
+
+struct ObjStreamReport
+{
+    size_t memoryBudget = 0;
+    // Largest amount of memory held by the converter itself, the mapped spill files are paged
+    // by the OS and not included
+    size_t peakMemory = 0;
+    size_t weldTableResets = 0;
+    // Position ranges the generated normals were split into, 0 when the file has normals
+    size_t normalRanges = 0;
+    size_t verticesCount = 0;
+    size_t indicesCount = 0;
+};
+
+// Multi-threaded OBJ loader producing the same MeshData as tinyobj::LoadObj followed by the
+// gather in ObjModel. The file is split into line aligned chunks that are tokenized in parallel,
+// only the order dependent statements (mtllib, usemtl, g, o) are replayed serially.
+class ObjParser
+{
+  public:
+    // Normals missing from the file are generated with normalSettings
+    static bool Load(const std::string &filePath, const std::string &mtlBaseDir, MeshData &mesh,
+                     std::string &error, const NormalSettings &normalSettings = {});
+
+    // Converts the file into its mesh cache without holding the whole mesh in memory. Parsed
+    // attributes and faces are spilled to disk, vertices are welded in a table bounded by the
+    // budget and the result is written to the cache in slices. Missing normals are generated
+    // with normalSettings one position range at a time and match the ones of Load.
+    static bool Stream(const std::string &filePath, const std::string &mtlBaseDir,
+                       size_t memoryBudget, ObjStreamReport &report, std::string &error,
+                       const NormalSettings &normalSettings = {});
+
+    static void ConvertMaterials(const std::vector<tinyobj::material_t> &objMaterials,
+                                 MeshData &mesh);
+};
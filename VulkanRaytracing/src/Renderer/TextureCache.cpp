@@ -0,0 +1,495 @@
+#include "vkpch.h"
+
+#include "TextureCache.h"
+
+#include "GltfFile.h"
+
+#include "Tools/FileTools.h"
+
+#include <cstring>
+#include <filesystem>
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+#define KTX2_SOURCE_KEY "VulkanRaytracing.source"
+
+// Data format descriptor values of the Khronos basic descriptor block
+#define KHR_DF_VERSION 2
+#define KHR_DF_MODEL_RGBSDA 1
+#define KHR_DF_PRIMARIES_BT709 1
+#define KHR_DF_TRANSFER_LINEAR 1
+#define KHR_DF_TRANSFER_SRGB 2
+#define KHR_DF_CHANNEL_ALPHA 15
+#define KHR_DF_SAMPLE_LINEAR 0x10
+#define KHR_DF_SAMPLE_EXPONENT 0x20
+#define KHR_DF_SAMPLE_SIGNED 0x40
+#define KHR_DF_SAMPLE_FLOAT 0x80
+
+static const uint8_t s_Ktx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                             0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct SourceRecord
+{
+    uint64_t size;
+    int64_t writeTime;
+    uint64_t hash;
+};
+
+struct DescriptorSample
+{
+    uint32_t bitOffset;
+    uint32_t bitLength;
+    uint32_t channel;
+    uint32_t lower;
+    uint32_t upper;
+};
+
+// Everything of a KTX2 file but the level data
+struct Ktx2Layout
+{
+    uint32_t vkFormat = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t faceCount = 1;
+    // Level data alignment, the texel block size rounded up to a multiple of 4
+    uint64_t alignment = 4;
+    std::vector<uint8_t> descriptor;
+    // Bytes of every level including all faces, largest first
+    std::vector<uint64_t> levelSizes;
+};
+
+// Images embedded in a .glb file are checked against the whole file
+static bool GetSourceStamp(const std::string &sourcePath, FileStamp &stamp)
+{
+    return GetFileStamp(GltfFile::GetContainerPath(sourcePath), stamp);
+}
+
+static bool HashSource(const std::string &sourcePath, uint64_t &hash)
+{
+    MappedFile source;
+    if (!source.Open(GltfFile::GetContainerPath(sourcePath)))
+    {
+        return false;
+    }
+    hash = HashData(source.GetData(), source.GetSize());
+    return true;
+}
+
+static void RemoveFile(const std::string &path)
+{
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+static void Append32(std::vector<uint8_t> &data, uint32_t value)
+{
+    data.insert(data.end(), reinterpret_cast<uint8_t *>(&value),
+                reinterpret_cast<uint8_t *>(&value) + sizeof(value));
+}
+
+static void Append64(std::vector<uint8_t> &data, uint64_t value)
+{
+    data.insert(data.end(), reinterpret_cast<uint8_t *>(&value),
+                reinterpret_cast<uint8_t *>(&value) + sizeof(value));
+}
+
+static void AppendKeyValue(std::vector<uint8_t> &data, const char *key, const void *value,
+                           uint32_t valueSize)
+{
+    const uint32_t keySize = static_cast<uint32_t>(strlen(key)) + 1;
+    Append32(data, keySize + valueSize);
+    data.insert(data.end(), key, key + keySize);
+    data.insert(data.end(), static_cast<const uint8_t *>(value),
+                static_cast<const uint8_t *>(value) + valueSize);
+    data.resize((data.size() + 3) & ~size_t(3));
+}
+
+static uint32_t Read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t Read64(const uint8_t *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Basic descriptor block, blockSize is the texel block edge length
+static void BuildDescriptor(uint32_t colorModel, uint32_t transfer, uint32_t blockSize,
+                            uint32_t bytesPerBlock, const std::vector<DescriptorSample> &samples,
+                            std::vector<uint8_t> &descriptor)
+{
+    const uint32_t blockBytes = 24 + 16 * static_cast<uint32_t>(samples.size());
+    Append32(descriptor, 4 + blockBytes);
+    Append32(descriptor, 0);
+    Append32(descriptor, KHR_DF_VERSION | (blockBytes << 16));
+    Append32(descriptor, colorModel | (KHR_DF_PRIMARIES_BT709 << 8) | (transfer << 16));
+    Append32(descriptor, (blockSize - 1) | ((blockSize - 1) << 8));
+    Append32(descriptor, bytesPerBlock);
+    Append32(descriptor, 0);
+    for (const auto &sample : samples)
+    {
+        Append32(descriptor, sample.bitOffset | ((sample.bitLength - 1) << 16) |
+                                 (sample.channel << 24));
+        Append32(descriptor, 0);
+        Append32(descriptor, sample.lower);
+        Append32(descriptor, sample.upper);
+    }
+}
+
+static void BuildDescriptor(BlockFormat format, std::vector<uint8_t> &descriptor)
+{
+    const uint32_t blockSize = static_cast<uint32_t>(BlockCompressor::GetBlockSize(format));
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        // Color with punch through alpha
+        BuildDescriptor(128, KHR_DF_TRANSFER_SRGB, 4, blockSize, {{0, 64, 1, 0, 0xFFFFFFFF}},
+                        descriptor);
+        break;
+    case BlockFormat::BC3:
+        BuildDescriptor(130, KHR_DF_TRANSFER_SRGB, 4, blockSize,
+                        {{0, 64, KHR_DF_CHANNEL_ALPHA | KHR_DF_SAMPLE_LINEAR, 0, 0xFFFFFFFF},
+                         {64, 64, 0, 0, 0xFFFFFFFF}},
+                        descriptor);
+        break;
+    default:
+        BuildDescriptor(134, KHR_DF_TRANSFER_SRGB, 4, blockSize, {{0, 128, 0, 0, 0xFFFFFFFF}},
+                        descriptor);
+        break;
+    }
+}
+
+static void BuildDescriptor(EnvironmentFormat format, std::vector<uint8_t> &descriptor)
+{
+    std::vector<DescriptorSample> samples;
+    if (format == EnvironmentFormat::Half)
+    {
+        // Floats are bounded by -1 and 1
+        const uint32_t channels[4] = {0, 1, 2, KHR_DF_CHANNEL_ALPHA};
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            samples.push_back({16 * c, 16, channels[c] | KHR_DF_SAMPLE_SIGNED | KHR_DF_SAMPLE_FLOAT,
+                               0xBF800000, 0x3F800000});
+        }
+    }
+    else
+    {
+        // Each mantissa is followed by the shared exponent with its bias as the lower bound
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            samples.push_back({9 * c, 9, c, 0, 8448});
+            samples.push_back({27, 5, c | KHR_DF_SAMPLE_EXPONENT, 15, 31});
+        }
+    }
+    BuildDescriptor(KHR_DF_MODEL_RGBSDA, KHR_DF_TRANSFER_LINEAR, 1,
+                    static_cast<uint32_t>(EnvironmentBaker::GetTexelSize(format)), samples,
+                    descriptor);
+}
+
+static size_t GetLevelSize(const MipLevel &level, BlockFormat format)
+{
+    return BlockCompressor::GetBlockSize(format) * ((level.width + 3) / 4) *
+           ((level.height + 3) / 4);
+}
+
+static size_t GetLevelSize(const MipLevel &level, const EnvironmentMap &map)
+{
+    return EnvironmentBaker::GetTexelSize(map.format) * level.width * level.height *
+           map.faceCount;
+}
+
+static bool WriteKtx2(const std::string &sourcePath, const std::string &cachePath,
+                      const Ktx2Layout &layout, const uint8_t *data,
+                      const std::vector<MipLevel> &levels)
+{
+    FileStamp stamp;
+    SourceRecord source;
+    if (!GetSourceStamp(sourcePath, stamp) || !HashSource(sourcePath, source.hash))
+    {
+        return false;
+    }
+    source.size = stamp.size;
+    source.writeTime = stamp.writeTime;
+
+    // Keys are sorted by their bytes
+    std::vector<uint8_t> keyValues;
+    static const char writer[] = "VulkanRaytracing";
+    AppendKeyValue(keyValues, "KTXwriter", writer, sizeof(writer));
+    AppendKeyValue(keyValues, KTX2_SOURCE_KEY, &source, sizeof(source));
+
+    const uint32_t levelCount = static_cast<uint32_t>(layout.levelSizes.size());
+    const uint64_t descriptorOffset = KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_ENTRY_SIZE * levelCount;
+    const uint64_t keyValuesOffset = descriptorOffset + layout.descriptor.size();
+
+    // Level data is stored smallest first
+    std::vector<uint64_t> levelOffsets(levelCount);
+    uint64_t offset = keyValuesOffset + keyValues.size();
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+        offset = (offset + layout.alignment - 1) / layout.alignment * layout.alignment;
+        levelOffsets[i] = offset;
+        offset += layout.levelSizes[i];
+    }
+
+    std::vector<uint8_t> header(s_Ktx2Identifier, s_Ktx2Identifier + sizeof(s_Ktx2Identifier));
+    Append32(header, layout.vkFormat);
+    Append32(header, 1);
+    Append32(header, layout.width);
+    Append32(header, layout.height);
+    Append32(header, 0);
+    Append32(header, 0);
+    Append32(header, layout.faceCount);
+    Append32(header, levelCount);
+    Append32(header, 0);
+    Append32(header, static_cast<uint32_t>(descriptorOffset));
+    Append32(header, static_cast<uint32_t>(layout.descriptor.size()));
+    Append32(header, static_cast<uint32_t>(keyValuesOffset));
+    Append32(header, static_cast<uint32_t>(keyValues.size()));
+    Append64(header, 0);
+    Append64(header, 0);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        Append64(header, levelOffsets[i]);
+        Append64(header, layout.levelSizes[i]);
+        Append64(header, layout.levelSizes[i]);
+    }
+
+    const std::string tempPath = cachePath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(reinterpret_cast<const char *>(layout.descriptor.data()),
+               layout.descriptor.size());
+    file.write(reinterpret_cast<const char *>(keyValues.data()), keyValues.size());
+    static const char padding[16] = {};
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+        file.write(padding, levelOffsets[i] - static_cast<uint64_t>(file.tellp()));
+        file.write(reinterpret_cast<const char *>(data + levels[i].offset), layout.levelSizes[i]);
+    }
+    file.close();
+    if (!file.good())
+    {
+        RemoveFile(tempPath);
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, cachePath, error);
+    return !error;
+}
+
+// Maps the cache and checks it against the source. Fills in the format, size, face count and
+// level sizes of the layout and the file offset of every level.
+static bool OpenKtx2(const std::string &sourcePath, const std::string &cachePath,
+                     MappedFile &file, Ktx2Layout &layout, std::vector<uint64_t> &levelOffsets)
+{
+    FileStamp stamp;
+    if (!GetSourceStamp(sourcePath, stamp) || !file.Open(cachePath))
+    {
+        return false;
+    }
+
+    const uint8_t *data = file.GetData();
+    const uint64_t size = file.GetSize();
+    if (size < KTX2_HEADER_SIZE || memcmp(data, s_Ktx2Identifier, sizeof(s_Ktx2Identifier)) != 0)
+    {
+        return false;
+    }
+
+    layout.vkFormat = Read32(data + 12);
+    layout.width = Read32(data + 20);
+    layout.height = Read32(data + 24);
+    layout.faceCount = Read32(data + 36);
+    const uint32_t levelCount = Read32(data + 40);
+    if (layout.width == 0 || layout.height == 0 || Read32(data + 28) != 0 ||
+        Read32(data + 32) > 1 || (layout.faceCount != 1 && layout.faceCount != 6) ||
+        levelCount == 0 || levelCount > MipGenerator::GetLevelCount(layout.width, layout.height) ||
+        Read32(data + 44) != 0 ||
+        KTX2_HEADER_SIZE + uint64_t(KTX2_LEVEL_INDEX_ENTRY_SIZE) * levelCount > size)
+    {
+        return false;
+    }
+
+    // The source record has to match the image the cache was built from
+    const uint64_t keyValuesOffset = Read32(data + 56);
+    const uint64_t keyValuesEnd = keyValuesOffset + Read32(data + 60);
+    if (keyValuesEnd > size)
+    {
+        return false;
+    }
+    bool sourceFound = false;
+    SourceRecord source = {};
+    for (uint64_t offset = keyValuesOffset; offset + 4 <= keyValuesEnd;)
+    {
+        const uint32_t length = Read32(data + offset);
+        const uint64_t entry = offset + 4;
+        if (entry + length > keyValuesEnd)
+        {
+            return false;
+        }
+        if (length == sizeof(KTX2_SOURCE_KEY) + sizeof(source) &&
+            memcmp(data + entry, KTX2_SOURCE_KEY, sizeof(KTX2_SOURCE_KEY)) == 0)
+        {
+            memcpy(&source, data + entry + sizeof(KTX2_SOURCE_KEY), sizeof(source));
+            sourceFound = true;
+        }
+        offset = (entry + length + 3) & ~uint64_t(3);
+    }
+    if (!sourceFound || source.size != stamp.size)
+    {
+        return false;
+    }
+    uint64_t sourceHash;
+    if (source.writeTime != stamp.writeTime &&
+        (!HashSource(sourcePath, sourceHash) || sourceHash != source.hash))
+    {
+        return false;
+    }
+
+    layout.levelSizes.resize(levelCount);
+    levelOffsets.resize(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        const uint8_t *entry = data + KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_ENTRY_SIZE * i;
+        levelOffsets[i] = Read64(entry);
+        layout.levelSizes[i] = Read64(entry + 8);
+        if (levelOffsets[i] + layout.levelSizes[i] > size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lays out the levels of the opened cache tightly and copies their data, getLevelSize gives
+// the size the level is expected to have
+template <typename GetLevelSize>
+static bool CopyLevels(const MappedFile &file, const Ktx2Layout &layout,
+                       const std::vector<uint64_t> &levelOffsets,
+                       const GetLevelSize &getLevelSize, std::vector<MipLevel> &levels,
+                       std::vector<uint8_t> &data)
+{
+    levels.resize(layout.levelSizes.size());
+    size_t size = 0;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        MipLevel &level = levels[i];
+        level.offset = size;
+        level.width = std::max(layout.width >> i, 1u);
+        level.height = std::max(layout.height >> i, 1u);
+        if (layout.levelSizes[i] != getLevelSize(level))
+        {
+            return false;
+        }
+        size += layout.levelSizes[i];
+    }
+
+    data.resize(size);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        memcpy(data.data() + levels[i].offset, file.GetData() + levelOffsets[i],
+               layout.levelSizes[i]);
+    }
+    return true;
+}
+
+std::string TextureCache::GetCachePath(const std::string &sourcePath, const std::string &variant)
+{
+    return sourcePath + variant + ".ktx2";
+}
+
+bool TextureCache::Write(const std::string &sourcePath, const CompressedChain &chain)
+{
+    Ktx2Layout layout;
+    layout.vkFormat = static_cast<uint32_t>(BlockCompressor::GetVulkanFormat(chain.format));
+    layout.width = chain.levels[0].width;
+    layout.height = chain.levels[0].height;
+    layout.alignment = BlockCompressor::GetBlockSize(chain.format);
+    BuildDescriptor(chain.format, layout.descriptor);
+    for (const auto &level : chain.levels)
+    {
+        layout.levelSizes.push_back(GetLevelSize(level, chain.format));
+    }
+    return WriteKtx2(sourcePath, GetCachePath(sourcePath), layout, chain.blocks.data(),
+                     chain.levels);
+}
+
+bool TextureCache::Load(const std::string &sourcePath, CompressedChain &chain)
+{
+    MappedFile file;
+    Ktx2Layout layout;
+    std::vector<uint64_t> levelOffsets;
+    if (!OpenKtx2(sourcePath, GetCachePath(sourcePath), file, layout, levelOffsets) ||
+        layout.faceCount != 1)
+    {
+        return false;
+    }
+
+    bool known = false;
+    for (BlockFormat format : {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC7})
+    {
+        if (static_cast<uint32_t>(BlockCompressor::GetVulkanFormat(format)) == layout.vkFormat)
+        {
+            chain.format = format;
+            known = true;
+        }
+    }
+    return known && CopyLevels(
+                        file, layout, levelOffsets,
+                        [&](const MipLevel &level) { return GetLevelSize(level, chain.format); },
+                        chain.levels, chain.blocks);
+}
+
+bool TextureCache::Write(const std::string &sourcePath, const std::string &variant,
+                         const EnvironmentMap &map)
+{
+    Ktx2Layout layout;
+    layout.vkFormat = static_cast<uint32_t>(EnvironmentBaker::GetVulkanFormat(map.format));
+    layout.width = map.levels[0].width;
+    layout.height = map.levels[0].height;
+    layout.faceCount = map.faceCount;
+    layout.alignment = EnvironmentBaker::GetTexelSize(map.format);
+    BuildDescriptor(map.format, layout.descriptor);
+    for (const auto &level : map.levels)
+    {
+        layout.levelSizes.push_back(GetLevelSize(level, map));
+    }
+    return WriteKtx2(sourcePath, GetCachePath(sourcePath, variant), layout, map.texels.data(),
+                     map.levels);
+}
+
+bool TextureCache::Load(const std::string &sourcePath, const std::string &variant,
+                        EnvironmentMap &map)
+{
+    MappedFile file;
+    Ktx2Layout layout;
+    std::vector<uint64_t> levelOffsets;
+    if (!OpenKtx2(sourcePath, GetCachePath(sourcePath, variant), file, layout, levelOffsets))
+    {
+        return false;
+    }
+
+    bool known = false;
+    for (EnvironmentFormat format : {EnvironmentFormat::Half, EnvironmentFormat::SharedExponent})
+    {
+        if (static_cast<uint32_t>(EnvironmentBaker::GetVulkanFormat(format)) == layout.vkFormat)
+        {
+            map.format = format;
+            known = true;
+        }
+    }
+    map.faceCount = layout.faceCount;
+    return known && CopyLevels(
+                        file, layout, levelOffsets,
+                        [&](const MipLevel &level) { return GetLevelSize(level, map); },
+                        map.levels, map.texels);
+}
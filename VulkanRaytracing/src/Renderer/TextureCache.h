@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Tools/BlockCompressor.h"
+#include "Tools/EnvironmentBaker.h"
+
+#include <string>
+
+// Block compressed mip chains and baked environments stored next to the source image as KTX2
+// files, so other tools can open them too. The source size, modification time and content hash
+// are kept in a key/value entry and checked the same way the mesh cache checks them.
+class TextureCache
+{
+  public:
+    // variant tells apart several caches built from one source
+    static std::string GetCachePath(const std::string &sourcePath,
+                                    const std::string &variant = "");
+
+    static bool Write(const std::string &sourcePath, const CompressedChain &chain);
+    static bool Load(const std::string &sourcePath, CompressedChain &chain);
+
+    static bool Write(const std::string &sourcePath, const std::string &variant,
+                      const EnvironmentMap &map);
+    static bool Load(const std::string &sourcePath, const std::string &variant,
+                     EnvironmentMap &map);
+};
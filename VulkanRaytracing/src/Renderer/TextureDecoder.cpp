@@ -0,0 +1,145 @@
+#include "vkpch.h"
+
+#include "TextureDecoder.h"
+
+#include "GltfFile.h"
+
+#include "stb_image.h"
+
+bool TextureDecoder::GetImageSize(const std::string &path, uint32_t &width, uint32_t &height)
+{
+    int imageWidth, imageHeight, channels;
+    MappedFile file;
+    const uint8_t *data;
+    size_t size;
+    if (!GltfFile::OpenImage(path, file, data, size, IMAGE_HEADER_READ_SIZE) || size > INT_MAX ||
+        !stbi_info_from_memory(data, static_cast<int>(size), &imageWidth, &imageHeight,
+                               &channels))
+    {
+        return false;
+    }
+    width = static_cast<uint32_t>(imageWidth);
+    height = static_cast<uint32_t>(imageHeight);
+    return true;
+}
+
+TextureDecoder::TextureDecoder(std::vector<std::string> paths,
+                               const TextureDecodeSettings &settings, ThreadPool &pool)
+    : m_Paths(std::move(paths)), m_Settings(settings),
+      m_MaxWorkers(std::min(settings.maxThreads, pool.GetConcurrency() - 1)), m_Group(pool)
+{
+    // RGBA8 with a full mip chain, BC chains from the cache come out smaller. Paths that do not
+    // load fall back to a 1x1 texture.
+    m_Estimates.resize(m_Paths.size());
+    pool.ParallelFor(m_Paths.size(), [this](size_t i) {
+        uint32_t width, height;
+        if (!m_Paths[i].empty() && GetImageSize(m_Paths[i], width, height))
+        {
+            m_Estimates[i] = size_t(width) * height * 16 / 3;
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    StartWorkers();
+}
+
+TextureDecoder::~TextureDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_Group.Wait();
+}
+
+bool TextureDecoder::Pop(DecodedTexture &texture)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true)
+    {
+        if (!m_Decoded.empty())
+        {
+            texture = std::move(m_Decoded.front());
+            m_Decoded.pop_front();
+            m_HeldBytes -= texture.bytes;
+            m_Taken++;
+            StartWorkers();
+            return true;
+        }
+        if (m_Taken == m_Paths.size())
+        {
+            return false;
+        }
+
+        // Nothing is ready, so rather than wait the consumer decodes the next texture itself.
+        // It is handed over right away and not counted against the budget.
+        if (m_Next < m_Paths.size() && !m_Stopping)
+        {
+            const size_t index = m_Next++;
+            m_Taken++;
+            lock.unlock();
+            texture = DecodedTexture();
+            Decode(index, texture);
+            return true;
+        }
+        m_Ready.wait(lock);
+    }
+}
+
+bool TextureDecoder::CanClaim() const
+{
+    if (m_Stopping || m_Next == m_Paths.size())
+    {
+        return false;
+    }
+    // Something is always allowed to be in flight, so textures over the budget still progress
+    return !m_Settings.memoryBudget || m_HeldBytes == 0 ||
+           m_HeldBytes + m_Estimates[m_Next] <= m_Settings.memoryBudget;
+}
+
+void TextureDecoder::StartWorkers()
+{
+    while (m_ActiveWorkers < m_MaxWorkers && CanClaim())
+    {
+        m_ActiveWorkers++;
+        m_Group.Run([this]() { WorkerLoop(); });
+    }
+}
+
+void TextureDecoder::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (CanClaim())
+    {
+        // The estimate holds the budget until the real size is known
+        const size_t index = m_Next++;
+        const size_t estimate = m_Estimates[index];
+        m_HeldBytes += estimate;
+        m_PeakBytes = std::max(m_PeakBytes, m_HeldBytes);
+        lock.unlock();
+
+        DecodedTexture texture;
+        Decode(index, texture);
+
+        lock.lock();
+        m_HeldBytes = m_HeldBytes - estimate + texture.bytes;
+        m_PeakBytes = std::max(m_PeakBytes, m_HeldBytes);
+        m_Decoded.push_back(std::move(texture));
+        m_Ready.notify_all();
+    }
+    m_ActiveWorkers--;
+}
+
+void TextureDecoder::Decode(size_t index, DecodedTexture &texture) const
+{
+    const std::string &path = m_Paths[index];
+    texture.index = index;
+    texture.compressed = m_Settings.compress && !path.empty() &&
+                         Allocator::LoadCompressedTexture(path, m_Settings.preferBC7,
+                                                          texture.blocks);
+    if (!texture.compressed)
+    {
+        Allocator::LoadTextureMips(path, texture.chain);
+    }
+    texture.bytes = texture.compressed ? texture.blocks.blocks.size() : texture.chain.pixels.size();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Core/Allocator.h"
+#include "Core/ThreadPool.h"
+
+#include <deque>
+#include <string>
+
+struct TextureDecodeSettings
+{
+    // Loads the BC chain from the texture cache or compresses it, see
+    // Allocator::LoadCompressedTexture
+    bool compress = false;
+    bool preferBC7 = false;
+    // Bytes of decoded textures waiting for the consumer, including those being decoded, 0 is
+    // unbounded. A single texture larger than the budget is still decoded.
+    size_t memoryBudget = 256ull << 20;
+    // Decoding threads besides the consuming one, limited by the size of the pool
+    uint32_t maxThreads = UINT32_MAX;
+};
+
+struct DecodedTexture
+{
+    // Position of the path in the list the decoder was given
+    size_t index = 0;
+    bool compressed = false;
+    MipChain chain;
+    CompressedChain blocks;
+    size_t bytes = 0;
+};
+
+// Decodes, mipmaps and optionally block compresses a list of textures on the thread pool while
+// the consumer takes them out in the order they finish. Workers stop claiming textures once the
+// decoded data would exceed the memory budget and are started again as the consumer catches up.
+// When nothing is ready the consumer decodes the next texture itself, so pools without worker
+// threads work too.
+class TextureDecoder
+{
+  public:
+    TextureDecoder(std::vector<std::string> paths, const TextureDecodeSettings &settings,
+                   ThreadPool &pool = ThreadPool::Get());
+    // Waits for the textures being decoded, the ones not yet claimed are skipped
+    ~TextureDecoder();
+    TextureDecoder(const TextureDecoder &other) = delete;
+    TextureDecoder &operator=(const TextureDecoder &other) = delete;
+
+    // Blocks until a texture is decoded, returns false once all of them were taken
+    bool Pop(DecodedTexture &texture);
+
+    // Most bytes held for the consumer at once
+    size_t GetPeakBytes() const
+    {
+        return m_PeakBytes;
+    }
+
+    // Reads only the image header
+    static bool GetImageSize(const std::string &path, uint32_t &width, uint32_t &height);
+
+  private:
+    bool CanClaim() const;
+    void StartWorkers();
+    void WorkerLoop();
+    void Decode(size_t index, DecodedTexture &texture) const;
+
+  private:
+    std::vector<std::string> m_Paths;
+    // Decoded size expected from the image header
+    std::vector<size_t> m_Estimates;
+    TextureDecodeSettings m_Settings;
+    uint32_t m_MaxWorkers;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Ready;
+    std::deque<DecodedTexture> m_Decoded;
+    size_t m_Next = 0;
+    size_t m_Taken = 0;
+    size_t m_HeldBytes = 0;
+    size_t m_PeakBytes = 0;
+    uint32_t m_ActiveWorkers = 0;
+    bool m_Stopping = false;
+
+    TaskGroup m_Group;
+};
@@ -0,0 +1,157 @@
+#include "vkpch.h"
+
+#include "VertexPacker.h"
+
+#include "Core/ThreadPool.h"
+
+#include <glm/gtc/packing.hpp>
+
+static inline glm::vec2 SignNotZero(const glm::vec2 &v)
+{
+    return {v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f};
+}
+
+static inline glm::vec2 ToOctahedral(const glm::vec3 &normal)
+{
+    const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (length == 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 e = glm::vec2(normal) / length;
+    if (normal.z < 0.0f)
+    {
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * SignNotZero(e);
+    }
+    return e;
+}
+
+uint32_t VertexPacker::EncodeNormal(const glm::vec3 &normal)
+{
+    const glm::vec2 e = ToOctahedral(normal);
+    const glm::vec3 n = glm::normalize(normal);
+    if (!std::isfinite(n.x))
+    {
+        return glm::packSnorm2x16(e);
+    }
+
+    // Rounding each coordinate on its own is not the closest direction, so the four pairs
+    // around the exact value are all decoded and compared
+    const glm::vec2 scaled = glm::clamp(e, -1.0f, 1.0f) * 32767.0f;
+    uint32_t best = 0;
+    float bestDot = -2.0f;
+    for (int i = 0; i < 4; ++i)
+    {
+        const glm::vec2 q = glm::vec2(i & 1 ? std::ceil(scaled.x) : std::floor(scaled.x),
+                                      i & 2 ? std::ceil(scaled.y) : std::floor(scaled.y)) /
+                            32767.0f;
+        const uint32_t packed = glm::packSnorm2x16(q);
+        const float d = glm::dot(DecodeNormal(packed), n);
+        if (d > bestDot)
+        {
+            bestDot = d;
+            best = packed;
+        }
+    }
+    return best;
+}
+
+glm::vec3 VertexPacker::DecodeNormal(uint32_t normal)
+{
+    // Matches decodeOctahedral in material.glsl
+    const glm::vec2 e = glm::unpackSnorm2x16(normal);
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if (n.z < 0.0f)
+    {
+        const glm::vec2 xy = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * SignNotZero(e);
+        n.x = xy.x;
+        n.y = xy.y;
+    }
+    return glm::normalize(n);
+}
+
+PackedVertex VertexPacker::Encode(const Vertex &vertex)
+{
+    PackedVertex packed;
+    packed.norm = EncodeNormal(vertex.norm);
+    packed.texCoord = glm::packHalf2x16(vertex.texCoord);
+    packed.color = glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f));
+    return packed;
+}
+
+void VertexPacker::Pack(const MeshView &mesh, PackedMesh &packed)
+{
+    PackVertices(mesh, 0, mesh.verticesCount, packed.positions, packed.vertices);
+    PackTriangleMaterials(mesh, 0, mesh.indicesCount / 3, packed.triangleMaterials);
+}
+
+void VertexPacker::PackVertices(const MeshView &mesh, uint32_t first, uint32_t count,
+                                std::vector<glm::vec3> &positions,
+                                std::vector<PackedVertex> &vertices)
+{
+    // Positions the mesh already has as a stream are used from there
+    positions.resize(mesh.positions ? 0 : count);
+    vertices.resize(count);
+    ThreadPool::Get().ParallelFor(count, [&](size_t i) {
+        const Vertex &vertex = mesh.vertices[first + i];
+        if (!mesh.positions)
+        {
+            positions[i] = vertex.pos;
+        }
+        vertices[i] = Encode(vertex);
+    });
+}
+
+void VertexPacker::PackTriangleMaterials(const MeshView &mesh, uint32_t firstTriangle,
+                                         uint32_t count, std::vector<uint32_t> &triangleMaterials)
+{
+    triangleMaterials.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int matID = mesh.vertices[mesh.indices[3 * (firstTriangle + i)]].matID;
+        triangleMaterials[i] = static_cast<uint32_t>(std::max(matID, 0));
+    }
+}
+
+VertexPackingError VertexPacker::MeasureError(const MeshView &mesh, const PackedMesh &packed)
+{
+    VertexPackingError error;
+    // Distances between the unit normals, converting them to angles with acos near 1 would lose
+    // all precision
+    float maxNormalDistance = 0.0f;
+    for (uint32_t i = 0; i < mesh.verticesCount; ++i)
+    {
+        const Vertex &vertex = mesh.vertices[i];
+        const PackedVertex &packedVertex = packed.vertices[i];
+
+        const glm::vec3 n = glm::normalize(vertex.norm);
+        if (std::isfinite(n.x))
+        {
+            maxNormalDistance =
+                std::max(maxNormalDistance, glm::length(n - DecodeNormal(packedVertex.norm)));
+        }
+        const glm::vec2 texCoord = glm::unpackHalf2x16(packedVertex.texCoord);
+        const glm::vec3 color = glm::vec3(glm::unpackUnorm4x8(packedVertex.color));
+        const glm::vec3 clamped = glm::clamp(vertex.color, 0.0f, 1.0f);
+        for (int c = 0; c < 2; ++c)
+        {
+            error.texCoord = std::max(error.texCoord, std::abs(texCoord[c] - vertex.texCoord[c]));
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            error.color = std::max(error.color, std::abs(color[c] - clamped[c]));
+        }
+    }
+    error.normal = glm::degrees(2.0f * std::asin(std::min(maxNormalDistance / 2.0f, 1.0f)));
+
+    for (uint32_t i = 0; i + 2 < mesh.indicesCount; i += 3)
+    {
+        const int matID = mesh.vertices[mesh.indices[i]].matID;
+        if (mesh.vertices[mesh.indices[i + 1]].matID != matID ||
+            mesh.vertices[mesh.indices[i + 2]].matID != matID)
+        {
+            error.mixedMaterialTriangles++;
+        }
+    }
+    return error;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ObjModel.h"
+
+// Buffers of a mesh in VertexLayout::Packed, indexed like the MeshView it was packed from
+struct PackedMesh
+{
+    // Left empty when the view has MeshView::positions
+    std::vector<glm::vec3> positions;
+    std::vector<PackedVertex> vertices;
+    // Material of each triangle, taken from its first vertex like the shaders did before
+    std::vector<uint32_t> triangleMaterials;
+};
+
+// Largest differences between the attributes of a mesh and their packed versions
+struct VertexPackingError
+{
+    // In degrees
+    float normal = 0.0f;
+    float texCoord = 0.0f;
+    float color = 0.0f;
+    // Triangles whose vertices disagree on the material
+    uint32_t mixedMaterialTriangles = 0;
+};
+
+// Converts meshes to VertexLayout::Packed. Vertices and indices are kept as they are, so only
+// the attributes lose precision. Normals are encoded by picking the closest of the four
+// neighbouring snorm16 pairs, which keeps the error below a hundredth of a degree.
+class VertexPacker
+{
+  public:
+    static uint32_t EncodeNormal(const glm::vec3 &normal);
+    static glm::vec3 DecodeNormal(uint32_t normal);
+
+    static PackedVertex Encode(const Vertex &vertex);
+
+    // The vertices are spread over the thread pool
+    static void Pack(const MeshView &mesh, PackedMesh &packed);
+    // Pack in slices, so that large meshes can be uploaded without their packed buffers at full
+    // size. The outputs are resized to count and positions is left empty like in Pack.
+    static void PackVertices(const MeshView &mesh, uint32_t first, uint32_t count,
+                             std::vector<glm::vec3> &positions,
+                             std::vector<PackedVertex> &vertices);
+    static void PackTriangleMaterials(const MeshView &mesh, uint32_t firstTriangle,
+                                      uint32_t count, std::vector<uint32_t> &triangleMaterials);
+
+    static VertexPackingError MeasureError(const MeshView &mesh, const PackedMesh &packed);
+};
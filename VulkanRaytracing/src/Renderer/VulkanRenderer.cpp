@@ -3,6 +3,7 @@
 #include "VulkanRenderer.h"
 
 #include "Core/Allocator.h"
+#include "Core/UploadManager.h"
 
 #include "Core/Core.h"
 #include "Tools/FileTools.h"
@@ -37,6 +38,8 @@ struct PushConstant
     uint32_t instanceID;
     glm::vec3 lightPosition;
     glm::vec3 lightColor;
+    // gl_PrimitiveID of the first triangle of the draw within its mesh
+    uint32_t firstTriangle;
 };
 
 struct RtPushConstant
@@ -49,10 +52,28 @@ struct RtPushConstant
     int hdr;
     float ni;
     float F0;
+    int hdrCubemap;
 };
 
 auto msaaSamples = vk::SampleCountFlagBits::e8;
 
+// Compiled with -DPACKED_VERTICES, see compile.bat
+static const char *packedShaders[] = {"src/Shaders/vert_packed.spv", "src/Shaders/frag_packed.spv",
+                                      "src/Shaders/raytrace_rchit_packed.spv"};
+
+static bool HasPackedShaders()
+{
+    for (const char *shader : packedShaders)
+    {
+        FileStamp stamp;
+        if (!GetFileStamp(shader, stamp))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 float lightIntensity = 100.0f;
 uint32_t lightType = 0;
 
@@ -74,33 +95,79 @@ void VulkanRenderer::Init(WindowsWindow *window)
 
 void VulkanRenderer::Shutdown()
 {
+    if (s_Instance.m_RtPipelineTasks)
+    {
+        s_Instance.m_RtPipelineTasks->Wait();
+    }
     s_Instance.m_Device.get().waitIdle();
+    UploadManager::Shutdown();
 }
 
 void VulkanRenderer::Flush(const std::vector<ObjInstance> &instances_)
 {
     instances = instances_;
+    s_Instance.CreateSceneResources(true);
+}
+
+void VulkanRenderer::CreateSceneResources(bool sceneChanged)
+{
+    // A pipeline still compiling reads the offscreen descriptor set layout recreated below
+    if (m_RtPipelineTasks)
+    {
+        m_RtPipelineTasks->Wait();
+    }
+    // Uploads still being batched have to be submitted before the scene is built from them
+    UploadManager::Submit();
     auto cmdBuf = BeginSingleTimeCommands();
     instanceBufferAlloc = Allocator::CreateDeviceLocalBuffer(
         cmdBuf, instances, vk::BufferUsageFlagBits::eStorageBuffer);
     EndSingleTimeCommands(cmdBuf);
-    s_Instance.m_Device.get().waitIdle();
-    s_Instance.CreateOffscreenDescriptorResources();
-    s_Instance.CreateOffscreenGraphicsPipeline();
-    s_Instance.CreateUniformBuffers(s_Instance.m_CameraBufferAllocations, sizeof(CameraMatrices));
-    s_Instance.UpdateOffscreenDescriptorSets();
-    s_Instance.IntegrateImGui();
-
-    s_Instance.CreatePostDescriptorResources();
-    s_Instance.CreatePostGraphicsPipeline();
-    s_Instance.UpdatePostDescriptorSets();
-
-    s_Instance.CreateBottomLevelAS();
-    s_Instance.CreateTopLevelAS(instances);
-    s_Instance.CreateRtDescriptorResources();
-    s_Instance.UpdateRtDescriptorSets();
-    s_Instance.CreateRtPipeline();
-    s_Instance.CreateRtShaderBindingTable();
+    m_Device.get().waitIdle();
+    CreateOffscreenDescriptorResources();
+    CreateOffscreenGraphicsPipeline();
+    CreateUniformBuffers(m_CameraBufferAllocations, sizeof(CameraMatrices));
+    UpdateOffscreenDescriptorSets();
+    IntegrateImGui();
+
+    CreatePostDescriptorResources();
+    CreatePostGraphicsPipeline();
+    UpdatePostDescriptorSets();
+
+    // The pipeline layout includes the offscreen set layout, whose arrays are sized by the
+    // model count, so a pipeline built for another count no longer matches the bound sets
+    const bool rtLayoutChanged = m_RtPipeline && m_RtPipelineModelCount != models.size();
+    if (m_RtReady)
+    {
+        // Once ray tracing is built a new scene needs its acceleration structures rebuilt, models
+        // pushed since then also their bottom level ones
+        if (sceneChanged)
+        {
+            if (m_Blas.size() != models.size())
+            {
+                CreateBottomLevelAS();
+            }
+            CreateTopLevelAS(instances);
+        }
+        if (rtLayoutChanged)
+        {
+            CreateRtPipeline();
+            CreateRtShaderBindingTable();
+        }
+        // The ray generation shader writes to the offscreen image recreated with the swap chain
+        UpdateRtDescriptorSets();
+    }
+    else if (!m_RtPipelineTasks || rtLayoutChanged)
+    {
+        // BuildRayTracing compiles the pipeline itself when there are no workers
+        m_RtPipelineTasks.reset();
+        if (ThreadPool::Get().GetConcurrency() > 1)
+        {
+            // The pipeline only depends on the model count of the scene, so it compiles while
+            // the raster path renders
+            m_RtPipelineTasks = std::make_unique<TaskGroup>();
+            m_RtPipelineTasks->Run([]() { s_Instance.CompileRtPipeline(); });
+        }
+    }
 }
 
 void VulkanRenderer::WaitIdle()
@@ -173,11 +240,22 @@ void VulkanRenderer::End()
     }
 
     // s_CurrentFrame = (s_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+    if (s_Instance.m_StartupStats.firstFrameMillis == 0.0f)
+    {
+        s_Instance.m_StartupStats.firstFrameMillis = s_Instance.m_StartupTimer.ElapsedMillis();
+        std::cout << "Time to first frame: " << s_Instance.m_StartupStats.firstFrameMillis
+                  << " ms" << std::endl;
+    }
 }
 
 void VulkanRenderer::BeginScene(const PerspectiveCamera &camera)
 {
     s_Instance.UpdateCameraMatrices(camera);
+    s_Instance.m_CullView = MeshletCuller::CreateView(
+        camera.GetProjectionMatrix() * camera.GetViewMatrix(), camera.GetPosition());
+    s_Instance.m_LodView = LodSelector::CreateView(
+        camera.GetProjectionMatrix(), camera.GetPosition(), s_Instance.m_Extent.height);
 }
 
 void VulkanRenderer::EndScene()
@@ -228,22 +306,66 @@ void VulkanRenderer::Rasterize(const glm::vec4 &clearColor, const glm::vec3 &lig
         vk::PipelineBindPoint::eGraphics, s_Instance.m_OffscreenGraphicsPipeline.GetLayout(), 0, 1,
         &s_Instance.m_OffscreenDescriptorSets.Get()[s_ImageIndex], 0, nullptr);
 
+    s_Instance.m_CullStats = MeshletCullStats();
+    s_Instance.m_LodStats = LodStats();
     uint32_t instanceId = 0;
     for (auto &instance : instances)
     {
-        PushConstant pushConstant{instanceId++, lightPosition, {1, 0, 1}};
+        PushConstant pushConstant{instanceId++, lightPosition, {1, 0, 1}, 0};
         s_Instance.m_CommandBuffers[s_ImageIndex].get().pushConstants(
             s_Instance.m_OffscreenGraphicsPipeline.GetLayout(),
             vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0,
             sizeof(PushConstant), &pushConstant);
 
-        s_Instance.m_CommandBuffers[s_ImageIndex].get().bindVertexBuffers(
-            0, {models[instance.objModelIndex].vertexBuffer.buffer}, {0});
+        const ObjModel &model = models[instance.objModelIndex];
+        if (ObjModel::s_VertexLayout == VertexLayout::Packed)
+        {
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().bindVertexBuffers(
+                0, {model.positionBuffer.buffer, model.vertexBuffer.buffer}, {0, 0});
+        }
+        else
+        {
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().bindVertexBuffers(
+                0, {model.vertexBuffer.buffer}, {0});
+        }
         s_Instance.m_CommandBuffers[s_ImageIndex].get().bindIndexBuffer(
-            models[instance.objModelIndex].indexBuffer.buffer, 0, vk::IndexType::eUint32);
+            model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+
+        const uint32_t level = LodSelector::Select(model, instance.modelMatrix,
+                                                   s_Instance.m_LodView, &s_Instance.m_LodStats);
+        if (level > 0)
+        {
+            const MeshLod &lod = model.lods[level];
+            const uint32_t firstTriangle = lod.firstIndex / 3;
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().pushConstants(
+                s_Instance.m_OffscreenGraphicsPipeline.GetLayout(),
+                vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+                offsetof(PushConstant, firstTriangle), sizeof(firstTriangle), &firstTriangle);
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().drawIndexed(lod.indexCount, 1,
+                                                                        lod.firstIndex, 0, 0);
+            continue;
+        }
+        if (model.meshlets.empty())
+        {
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().drawIndexed(
+                static_cast<uint32_t>(model.indicesCount), 1, 0, 0, 0);
+            continue;
+        }
 
-        s_Instance.m_CommandBuffers[s_ImageIndex].get().drawIndexed(
-            static_cast<uint32_t>(models[instance.objModelIndex].indicesCount), 1, 0, 0, 0);
+        std::vector<IndexRange> &ranges = s_Instance.m_DrawRanges;
+        ranges.clear();
+        MeshletCuller::Cull(model.meshlets, instance.modelMatrix, instance.modelMatrixIT,
+                            s_Instance.m_CullView, ranges, &s_Instance.m_CullStats);
+        for (const IndexRange &range : ranges)
+        {
+            const uint32_t firstTriangle = range.firstIndex / 3;
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().pushConstants(
+                s_Instance.m_OffscreenGraphicsPipeline.GetLayout(),
+                vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+                offsetof(PushConstant, firstTriangle), sizeof(firstTriangle), &firstTriangle);
+            s_Instance.m_CommandBuffers[s_ImageIndex].get().drawIndexed(range.indexCount, 1,
+                                                                        range.firstIndex, 0, 0);
+        }
     }
 
     s_Instance.m_CommandBuffers[s_ImageIndex].get().endRenderPass();
@@ -288,18 +410,19 @@ void VulkanRenderer::EndSingleTimeCommands(vk::CommandBuffer commandBuffer)
 }
 
 vk::ImageView VulkanRenderer::CreateImageView(vk::Image image, vk::Format format,
-                                              vk::ImageAspectFlags aspectFlags)
+                                              vk::ImageAspectFlags aspectFlags, uint32_t mipLevels,
+                                              vk::ImageViewType viewType, uint32_t layerCount)
 {
-    vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, 1, 0, 1);
-    vk::ImageViewCreateInfo imageViewCreateInfo{{},     image, vk::ImageViewType::e2D,
-                                                format, {},    subResourceRange};
+    vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, mipLevels, 0, layerCount);
+    vk::ImageViewCreateInfo imageViewCreateInfo{{}, image, viewType, format, {}, subResourceRange};
     return s_Instance.m_Device.get().createImageView(imageViewCreateInfo);
 }
 
 vk::UniqueImageView VulkanRenderer::CreateImageViewUnique(vk::Image image, vk::Format format,
-                                                          vk::ImageAspectFlags aspectFlags)
+                                                          vk::ImageAspectFlags aspectFlags,
+                                                          uint32_t mipLevels)
 {
-    vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, 1, 0, 1);
+    vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, mipLevels, 0, 1);
     vk::ImageViewCreateInfo imageViewCreateInfo{{},     image, vk::ImageViewType::e2D,
                                                 format, {},    subResourceRange};
     return s_Instance.m_Device.get().createImageViewUnique(imageViewCreateInfo);
@@ -310,8 +433,19 @@ vk::Sampler VulkanRenderer::CreateSampler(const vk::SamplerCreateInfo createInfo
     return s_Instance.m_Device.get().createSampler(createInfo);
 }
 
+void VulkanRenderer::DestroyImageView(vk::ImageView imageView)
+{
+    s_Instance.m_Device.get().destroyImageView(imageView);
+}
+
+void VulkanRenderer::DestroySampler(vk::Sampler sampler)
+{
+    s_Instance.m_Device.get().destroySampler(sampler);
+}
+
 void VulkanRenderer::InitRenderer(WindowsWindow *window)
 {
+    m_StartupTimer.Reset();
     m_Window = window;
     CreateInstance();
     CreateSurface();
@@ -389,6 +523,10 @@ void VulkanRenderer::CreateDevice()
 
     std::set<uint32_t> queueFamilyIndices = {m_QueueFamilyIndices.graphicsFamily.value(),
                                              m_QueueFamilyIndices.presentFamily.value()};
+    if (m_QueueFamilyIndices.transferFamily)
+    {
+        queueFamilyIndices.insert(m_QueueFamilyIndices.transferFamily.value());
+    }
     float queuePriority = 1.0f;
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
     for (uint32_t queueFamilyIndex : queueFamilyIndices)
@@ -402,6 +540,23 @@ void VulkanRenderer::CreateDevice()
     descriptorFeatures.pNext = &scalarLayoutFeatures;
     vk::PhysicalDeviceFeatures deviceFeatures;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    m_BlockCompression = m_PhysicalDevice.getFeatures().textureCompressionBC;
+    deviceFeatures.textureCompressionBC = m_BlockCompression;
+    // The fragment shader of the packed vertex layout finds the material with gl_PrimitiveID
+    deviceFeatures.geometryShader = m_PhysicalDevice.getFeatures().geometryShader;
+    if (ObjModel::s_VertexLayout == VertexLayout::Packed && !deviceFeatures.geometryShader)
+    {
+        std::cout << "The packed vertex layout needs the geometryShader feature for "
+                     "gl_PrimitiveID, using the full layout"
+                  << std::endl;
+        ObjModel::s_VertexLayout = VertexLayout::Full;
+    }
+    if (ObjModel::s_VertexLayout == VertexLayout::Packed && !HasPackedShaders())
+    {
+        std::cout << "The packed shaders are not compiled, using the full vertex layout"
+                  << std::endl;
+        ObjModel::s_VertexLayout = VertexLayout::Full;
+    }
     vk::PhysicalDeviceFeatures2 enabled;
     enabled.pNext = &descriptorFeatures;
     enabled.features = deviceFeatures;
@@ -442,6 +597,8 @@ void VulkanRenderer::CreateDevice()
 void VulkanRenderer::InitAllocator()
 {
     Allocator::Init(m_PhysicalDevice, m_Device.get());
+    UploadManager::Init(m_Device.get(), m_QueueFamilyIndices.graphicsFamily.value(),
+                        m_QueueFamilyIndices.transferFamily);
 }
 
 void VulkanRenderer::CreateSwapChain()
@@ -531,7 +688,8 @@ void VulkanRenderer::RecreateSwapChain()
     CreatePostRenderer();
     CreateImGuiRenderer();
     CreateCommandBuffers();
-    Flush(instances);
+    // Only the swap chain changed, the acceleration structures still match the scene
+    CreateSceneResources(false);
 }
 
 void VulkanRenderer::IntegrateImGui()
@@ -722,6 +880,12 @@ void VulkanRenderer::CreateOffscreenDescriptorResources()
                         vk::ShaderStageFlagBits::eClosestHitNV});
     bindings.push_back({5, vk::DescriptorType::eStorageBuffer, static_cast<uint32_t>(models.size()),
                         vk::ShaderStageFlagBits::eClosestHitNV});
+    if (ObjModel::s_VertexLayout == VertexLayout::Packed)
+    {
+        bindings.push_back(
+            {6, vk::DescriptorType::eStorageBuffer, static_cast<uint32_t>(models.size()),
+             vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eClosestHitNV});
+    }
 
     m_OffscreenDescriptorSets.Init(m_Device.get());
     m_OffscreenDescriptorSets.CreateDescriptorSetLayout(bindings);
@@ -753,11 +917,14 @@ void VulkanRenderer::UpdateOffscreenDescriptorSets()
     std::vector<vk::DescriptorBufferInfo> materialBufferInfo;
     std::vector<vk::DescriptorBufferInfo> vertexBufferInfo;
     std::vector<vk::DescriptorBufferInfo> indexBufferInfo;
+    std::vector<vk::DescriptorBufferInfo> triangleMaterialBufferInfo;
     for (size_t i = 0; i < models.size(); ++i)
     {
         materialBufferInfo.push_back({models[i].materialBuffer.buffer, 0, VK_WHOLE_SIZE});
         vertexBufferInfo.push_back({models[i].vertexBuffer.buffer, 0, VK_WHOLE_SIZE});
         indexBufferInfo.push_back({models[i].indexBuffer.buffer, 0, VK_WHOLE_SIZE});
+        triangleMaterialBufferInfo.push_back(
+            {models[i].triangleMaterialBuffer.buffer, 0, VK_WHOLE_SIZE});
     }
 
     std::vector<vk::DescriptorImageInfo> texturesBufferInfo;
@@ -773,6 +940,11 @@ void VulkanRenderer::UpdateOffscreenDescriptorSets()
         m_OffscreenDescriptorSets.CreateWrite(3, &instanceBufferInfo, 0),
         m_OffscreenDescriptorSets.CreateWrite(4, vertexBufferInfo.data(), 0),
         m_OffscreenDescriptorSets.CreateWrite(5, indexBufferInfo.data(), 0)};
+    if (ObjModel::s_VertexLayout == VertexLayout::Packed)
+    {
+        descriptorWrites.push_back(
+            m_OffscreenDescriptorSets.CreateWrite(6, triangleMaterialBufferInfo.data(), 0));
+    }
 
     m_OffscreenDescriptorSets.Update(descriptorWrites);
 }
@@ -787,8 +959,17 @@ void VulkanRenderer::UpdatePostDescriptorSets()
 void VulkanRenderer::CreateOffscreenGraphicsPipeline()
 {
     m_OffscreenGraphicsPipeline.Init(m_Device.get());
-    m_OffscreenGraphicsPipeline.LoadVertexShader("src/Shaders/vert.spv");
-    m_OffscreenGraphicsPipeline.LoadFragmentShader("src/Shaders/frag.spv");
+    const VertexLayout layout = ObjModel::s_VertexLayout;
+    if (layout == VertexLayout::Packed)
+    {
+        m_OffscreenGraphicsPipeline.LoadVertexShader(packedShaders[0]);
+        m_OffscreenGraphicsPipeline.LoadFragmentShader(packedShaders[1]);
+    }
+    else
+    {
+        m_OffscreenGraphicsPipeline.LoadVertexShader("src/Shaders/vert.spv");
+        m_OffscreenGraphicsPipeline.LoadFragmentShader("src/Shaders/frag.spv");
+    }
 
     vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
                                                    vk::ShaderStageFlagBits::eFragment,
@@ -796,8 +977,8 @@ void VulkanRenderer::CreateOffscreenGraphicsPipeline()
     m_OffscreenGraphicsPipeline.CreatePipelineLayout({m_OffscreenDescriptorSets.GetLayout()},
                                                      {pushConstantRange});
     m_OffscreenGraphicsPipeline.CreatePipeline(
-        m_OffscreenRenderPass.get(), msaaSamples, m_Extent, {Vertex::getBindingDescription()},
-        {Vertex::getAttributeDescriptions()}, vk::CullModeFlagBits::eBack);
+        m_OffscreenRenderPass.get(), msaaSamples, m_Extent, Vertex::getBindingDescriptions(layout),
+        Vertex::getAttributeDescriptions(layout), vk::CullModeFlagBits::eBack);
 }
 
 void VulkanRenderer::CreatePostGraphicsPipeline()
@@ -867,6 +1048,8 @@ void VulkanRenderer::UpdateCameraMatrices(const PerspectiveCamera &camera)
 void VulkanRenderer::Raytrace(const glm::vec4 &clearColor, const glm::vec3 &lightPosition,
                               uint32_t nSamples)
 {
+    BuildRayTracing();
+
     RtPushConstant rtPushConstant;
     rtPushConstant.clearColor = clearColor;
     rtPushConstant.lightPosition = lightPosition;
@@ -876,6 +1059,7 @@ void VulkanRenderer::Raytrace(const glm::vec4 &clearColor, const glm::vec3 &ligh
     rtPushConstant.hdr = hdr;
     rtPushConstant.ni = ni;
     rtPushConstant.F0 = F0;
+    rtPushConstant.hdrCubemap = ObjModel::s_HdrSkyboxBaked;
 
     auto &cmdBuf = s_Instance.m_CommandBuffers[s_ImageIndex].get();
 
@@ -903,6 +1087,32 @@ void VulkanRenderer::Raytrace(const glm::vec4 &clearColor, const glm::vec3 &ligh
                        s_Instance.m_Extent.height, 1);
 }
 
+void VulkanRenderer::BuildRayTracing()
+{
+    if (s_Instance.m_RtReady)
+    {
+        return;
+    }
+    if (s_Instance.m_RtPipelineTasks)
+    {
+        s_Instance.m_RtPipelineTasks->Wait();
+    }
+    else
+    {
+        s_Instance.CompileRtPipeline();
+    }
+
+    s_Instance.CreateBottomLevelAS();
+    s_Instance.CreateTopLevelAS(instances);
+    s_Instance.UpdateRtDescriptorSets();
+    s_Instance.CreateRtShaderBindingTable();
+    s_Instance.m_RtReady = true;
+
+    s_Instance.m_StartupStats.rayTracingReadyMillis = s_Instance.m_StartupTimer.ElapsedMillis();
+    std::cout << "Time to ray tracing ready: " << s_Instance.m_StartupStats.rayTracingReadyMillis
+              << " ms" << std::endl;
+}
+
 void VulkanRenderer::InitRayTracing()
 {
     auto properties = m_PhysicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
@@ -1026,6 +1236,8 @@ void VulkanRenderer::CreateRtDescriptorResources()
         vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1,
                                        vk::ShaderStageFlagBits::eMissNV),
         vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1,
+                                       vk::ShaderStageFlagBits::eMissNV),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eCombinedImageSampler, 1,
                                        vk::ShaderStageFlagBits::eMissNV)};
 
     m_RtDescriptorSet.Init(m_Device.get());
@@ -1048,18 +1260,24 @@ void VulkanRenderer::UpdateRtDescriptorSets()
         m_RtDescriptorSet.CreateWrite(0, &descASInfo, 0),
         m_RtDescriptorSet.CreateWrite(1, &imageInfo, 0),
         m_RtDescriptorSet.CreateWrite(2, &ObjModel::s_Skysphere.descriptor, 0),
-        m_RtDescriptorSet.CreateWrite(3, &ObjModel::s_HdrSkysphere.descriptor, 0)};
+        m_RtDescriptorSet.CreateWrite(3, &ObjModel::s_HdrSkysphere.descriptor, 0),
+        m_RtDescriptorSet.CreateWrite(4, &ObjModel::s_HdrSkybox.descriptor, 0)};
     m_RtDescriptorSet.Update(descriptorWrites);
 }
 
 void VulkanRenderer::CreateRtPipeline()
 {
+    m_RtShaderGroups.clear();
+    m_RtPipelineModelCount = models.size();
     VulkanShader rayGen(m_Device.get());
     rayGen.LoadFromFile("src/Shaders/raytrace_rgen.spv", vk::ShaderStageFlagBits::eRaygenNV);
     VulkanShader rayMiss(m_Device.get());
     rayMiss.LoadFromFile("src/Shaders/raytrace_rmiss.spv", vk::ShaderStageFlagBits::eMissNV);
     VulkanShader rayHit(m_Device.get());
-    rayHit.LoadFromFile("src/Shaders/raytrace_rchit.spv", vk::ShaderStageFlagBits::eClosestHitNV);
+    rayHit.LoadFromFile(ObjModel::s_VertexLayout == VertexLayout::Packed
+                            ? packedShaders[2]
+                            : "src/Shaders/raytrace_rchit.spv",
+                        vk::ShaderStageFlagBits::eClosestHitNV);
     VulkanShader rayShadowMiss(m_Device.get());
     rayShadowMiss.LoadFromFile("src/Shaders/raytrace_shadow_rmiss.spv",
                                vk::ShaderStageFlagBits::eMissNV);
@@ -1126,6 +1344,12 @@ void VulkanRenderer::CreateRtPipeline()
     assert(m_RtPipeline);
 }
 
+void VulkanRenderer::CompileRtPipeline()
+{
+    CreateRtDescriptorResources();
+    CreateRtPipeline();
+}
+
 void VulkanRenderer::CreateRtShaderBindingTable()
 {
     auto groupCount = static_cast<uint32_t>(m_RtShaderGroups.size());
@@ -1148,10 +1372,20 @@ void VulkanRenderer::CreateRtShaderBindingTable()
 vk::GeometryNV VulkanRenderer::objectToVkGeometryNV(const ObjModel &model)
 {
     vk::GeometryTrianglesNV triangles;
-    triangles.setVertexData(model.vertexBuffer.buffer);
+    // The packed layout builds from the position stream alone instead of striding over every
+    // attribute
+    if (ObjModel::s_VertexLayout == VertexLayout::Packed)
+    {
+        triangles.setVertexData(model.positionBuffer.buffer);
+        triangles.setVertexStride(sizeof(glm::vec3));
+    }
+    else
+    {
+        triangles.setVertexData(model.vertexBuffer.buffer);
+        triangles.setVertexStride(sizeof(Vertex));
+    }
     triangles.setVertexOffset(0);
     triangles.setVertexCount(model.verticesCount);
-    triangles.setVertexStride(sizeof(Vertex));
     triangles.setVertexFormat(vk::Format::eR32G32B32Sfloat);
     triangles.setIndexData(model.indexBuffer.buffer);
     triangles.setIndexOffset(0);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "LodSelector.h"
+#include "MeshletCuller.h"
 #include "ObjModel.h"
 #include "PerspectiveCamera.h"
 #include "VulkanShader.h"
@@ -10,6 +12,8 @@
 #define GLFW_INCLUDE_VULKAN
 #include "Window/WindowsWindow.h"
 
+#include "Core/ThreadPool.h"
+#include "Core/Timer.h"
 #include "Tools/VulkanTools.h"
 
 struct Blas
@@ -51,6 +55,13 @@ struct VkGeometryInstanceNV
     uint64_t accelerationStructureHandle;
 };
 
+// Milliseconds from VulkanRenderer::Init, 0 until the milestone is reached
+struct StartupStats
+{
+    float firstFrameMillis = 0.0f;
+    float rayTracingReadyMillis = 0.0f;
+};
+
 class VulkanRenderer
 {
   public:
@@ -58,6 +69,9 @@ class VulkanRenderer
     VulkanRenderer &operator=(const VulkanRenderer &) = delete;
     static void Init(WindowsWindow *window);
     static void Shutdown();
+    // Builds what the raster path needs and starts compiling the ray tracing pipeline on the
+    // thread pool, BuildRayTracing adds the rest of the ray tracing resources. Once they exist,
+    // their acceleration structures are rebuilt for the new instances.
     static void Flush(const std::vector<ObjInstance> &instances_);
     static void WaitIdle();
     static void Begin();
@@ -70,10 +84,37 @@ class VulkanRenderer
     static vk::CommandBuffer BeginSingleTimeCommands();
     static void EndSingleTimeCommands(vk::CommandBuffer commandBuffer);
     static vk::ImageView CreateImageView(vk::Image image, vk::Format format,
-                                         vk::ImageAspectFlags aspectFlags);
+                                         vk::ImageAspectFlags aspectFlags, uint32_t mipLevels = 1,
+                                         vk::ImageViewType viewType = vk::ImageViewType::e2D,
+                                         uint32_t layerCount = 1);
     static vk::UniqueImageView CreateImageViewUnique(vk::Image image, vk::Format format,
-                                                     vk::ImageAspectFlags aspectFlags);
+                                                     vk::ImageAspectFlags aspectFlags,
+                                                     uint32_t mipLevels = 1);
     static vk::Sampler CreateSampler(const vk::SamplerCreateInfo createInfo);
+    static void DestroyImageView(vk::ImageView imageView);
+    static void DestroySampler(vk::Sampler sampler);
+
+    static bool SupportsBlockCompression()
+    {
+        return s_Instance.m_BlockCompression;
+    }
+
+    // Meshlets and triangles of the last Rasterize call and how many of them were culled
+    static const MeshletCullStats &GetCullStats()
+    {
+        return s_Instance.m_CullStats;
+    }
+
+    // Triangles the levels of detail of the last Rasterize call drew instead of the full meshes
+    static const LodStats &GetLodStats()
+    {
+        return s_Instance.m_LodStats;
+    }
+
+    static const StartupStats &GetStartupStats()
+    {
+        return s_Instance.m_StartupStats;
+    }
 
   private:
     VulkanRenderer() = default;
@@ -85,6 +126,10 @@ class VulkanRenderer
     void InitAllocator();
     void CreateSwapChain();
     void RecreateSwapChain();
+    // Recreates the resources that depend on the swap chain or the instances. The acceleration
+    // structures are only rebuilt for a changed scene and the ray tracing pipeline for a changed
+    // model count.
+    void CreateSceneResources(bool sceneChanged);
     void IntegrateImGui();
     void CreateSwapChainImageViews();
     void CreateOffscreenRenderer();
@@ -116,6 +161,7 @@ class VulkanRenderer
     vk::UniqueSurfaceKHR m_Surface;
     vk::PhysicalDevice m_PhysicalDevice;
     vk::UniqueDevice m_Device;
+    bool m_BlockCompression = false;
 
     vk::UniqueSwapchainKHR m_SwapChain;
     std::vector<vk::Image> m_SwapChainImages;
@@ -154,6 +200,11 @@ class VulkanRenderer
     std::vector<vk::UniqueDeviceMemory> m_IndexBufferMemory;
 
     std::vector<BufferAllocation> m_CameraBufferAllocations;
+    CullView m_CullView;
+    MeshletCullStats m_CullStats;
+    std::vector<IndexRange> m_DrawRanges;
+    LodView m_LodView;
+    LodStats m_LodStats;
 
     vk::UniqueDescriptorPool m_OffscreenDescriptorPool;
     DescriptorSetType m_OffscreenDescriptorSets;
@@ -171,9 +222,26 @@ class VulkanRenderer
     std::vector<vk::UniqueFence> m_InFlightFences;
     std::vector<vk::Fence> m_ImagesInFlight;
 
+    Timer m_StartupTimer;
+    StartupStats m_StartupStats;
+
   public:
+    // Builds the ray tracing resources first when BuildRayTracing was not called yet
     static void Raytrace(const glm::vec4 &clearColor, const glm::vec3 &lightPosition,
                          uint32_t nSamples);
+    // Builds the acceleration structures, descriptors and shader binding table once, waiting for
+    // the pipeline or compiling it when the pool has no workers. The skyspheres have to be
+    // uploaded before.
+    static void BuildRayTracing();
+    static bool IsRayTracingReady()
+    {
+        return s_Instance.m_RtReady;
+    }
+    // True once the pipeline compiled on the thread pool, BuildRayTracing then does not wait
+    static bool IsRayTracingPipelineCompiled()
+    {
+        return s_Instance.m_RtPipelineTasks && s_Instance.m_RtPipelineTasks->IsDone();
+    }
 
   private:
     // Ray tracing
@@ -183,6 +251,7 @@ class VulkanRenderer
     void CreateRtDescriptorResources();
     void UpdateRtDescriptorSets();
     void CreateRtPipeline();
+    void CompileRtPipeline();
     void CreateRtShaderBindingTable();
     vk::GeometryNV objectToVkGeometryNV(const ObjModel &model);
     VkGeometryInstanceNV InstanceToVkGeometryInstanceNV(const BlasInstance &instance);
@@ -194,9 +263,15 @@ class VulkanRenderer
     BufferAllocation m_TlasAlloc;
     vk::UniquePipelineLayout m_RtPipelineLayout;
     vk::UniquePipeline m_RtPipeline;
+    // Models in the scene the pipeline layout was created for
+    size_t m_RtPipelineModelCount = 0;
     std::vector<vk::RayTracingShaderGroupCreateInfoNV> m_RtShaderGroups;
     BufferAllocation m_RtSBTBufferAllocation;
 
     vk::UniqueDescriptorPool m_RtDescriptorPool;
     DescriptorSetType m_RtDescriptorSet;
+
+    // Only created once there are workers to compile the pipeline on
+    std::unique_ptr<TaskGroup> m_RtPipelineTasks;
+    bool m_RtReady = false;
 };
@@ -0,0 +1,145 @@
+#include "vkpch.h"
+
+#include "WideBvh.h"
+
+static float GetArea(const BvhNode &node)
+{
+    const glm::vec3 size = node.boundsMax - node.boundsMin;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+template <uint32_t Width>
+static void AddLeaf(const Bvh &bvh, const BvhNode &leaf, WideBvh<Width> &wide)
+{
+    for (uint32_t first = 0; first < leaf.triangleCount; first += Width)
+    {
+        TriangleBlock<Width> block = {};
+        for (uint32_t lane = 0; lane < Width; lane++)
+        {
+            block.triangles[lane] = UINT32_MAX;
+            if (first + lane >= leaf.triangleCount)
+            {
+                continue;
+            }
+            const uint32_t triangle = leaf.first + first + lane;
+            const uint32_t *indices = bvh.indices.data() + size_t(triangle) * 3;
+            const glm::vec3 &p0 = bvh.positions[indices[0]];
+            const glm::vec3 edge1 = bvh.positions[indices[1]] - p0;
+            const glm::vec3 edge2 = bvh.positions[indices[2]] - p0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                block.vertex[axis][lane] = p0[axis];
+                block.edge1[axis][lane] = edge1[axis];
+                block.edge2[axis][lane] = edge2[axis];
+            }
+            block.triangles[lane] = triangle;
+        }
+        wide.blocks.push_back(block);
+    }
+}
+
+template <uint32_t Width> static void BuildWide(const Bvh &bvh, WideBvh<Width> &wide)
+{
+    wide.nodes.clear();
+    wide.blocks.clear();
+    wide.depth = 0;
+    if (bvh.nodes.empty())
+    {
+        return;
+    }
+
+    // Wide nodes waiting for their children, with the binary node they stand for
+    struct PendingNode
+    {
+        uint32_t wideNode;
+        uint32_t binaryNode;
+        uint32_t depth;
+    };
+    std::vector<PendingNode> stack = {{0, 0, 1}};
+    wide.nodes.emplace_back();
+    while (!stack.empty())
+    {
+        const PendingNode pending = stack.back();
+        stack.pop_back();
+        wide.depth = std::max(wide.depth, pending.depth);
+
+        // A leaf root becomes the only child of the wide root
+        const BvhNode &binary = bvh.nodes[pending.binaryNode];
+        std::vector<uint32_t> children;
+        if (binary.IsLeaf())
+        {
+            children.push_back(pending.binaryNode);
+        }
+        else
+        {
+            children = {binary.first, binary.first + 1};
+        }
+        while (children.size() < Width)
+        {
+            int largest = -1;
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                const BvhNode &child = bvh.nodes[children[i]];
+                if (!child.IsLeaf() &&
+                    (largest < 0 || GetArea(child) > GetArea(bvh.nodes[children[largest]])))
+                {
+                    largest = static_cast<int>(i);
+                }
+            }
+            if (largest < 0)
+            {
+                break;
+            }
+            const uint32_t first = bvh.nodes[children[largest]].first;
+            children[largest] = first;
+            children.insert(children.begin() + largest + 1, first + 1);
+        }
+
+        WideBvhNode<Width> node;
+        for (uint32_t slot = 0; slot < Width; slot++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                node.boundsMin[axis][slot] = FLT_MAX;
+                node.boundsMax[axis][slot] = -FLT_MAX;
+            }
+            node.children[slot] = 0;
+            node.blockCounts[slot] = 0;
+            if (slot >= children.size())
+            {
+                continue;
+            }
+
+            const BvhNode &child = bvh.nodes[children[slot]];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                node.boundsMin[axis][slot] = child.boundsMin[axis];
+                node.boundsMax[axis][slot] = child.boundsMax[axis];
+            }
+            if (child.IsLeaf())
+            {
+                node.children[slot] = static_cast<uint32_t>(wide.blocks.size());
+                AddLeaf(bvh, child, wide);
+                node.blockCounts[slot] =
+                    static_cast<uint32_t>(wide.blocks.size()) - node.children[slot];
+            }
+            else
+            {
+                node.children[slot] = static_cast<uint32_t>(wide.nodes.size());
+                wide.nodes.emplace_back();
+                stack.push_back({node.children[slot], children[slot], pending.depth + 1});
+            }
+        }
+        wide.nodes[pending.wideNode] = node;
+    }
+}
+
+void WideBvhBuilder::Build(const Bvh &bvh, WideBvh4 &wide)
+{
+    BuildWide(bvh, wide);
+}
+
+void WideBvhBuilder::Build(const Bvh &bvh, WideBvh8 &wide)
+{
+    BuildWide(bvh, wide);
+}
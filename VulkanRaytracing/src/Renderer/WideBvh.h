@@ -0,0 +1,47 @@
+#pragma once
+
+#include "BvhBuilder.h"
+
+// Children of a wide node as structure of arrays, so that one ray is tested against all of them
+// at once. Empty slots have inverted bounds and a block count of 0.
+template <uint32_t Width> struct alignas(Width * sizeof(float)) WideBvhNode
+{
+    float boundsMin[3][Width];
+    float boundsMax[3][Width];
+    // Node of inner children, first triangle block of leaves
+    uint32_t children[Width];
+    // Triangle blocks of leaves, 0 for inner children
+    uint32_t blockCounts[Width];
+};
+
+// First vertex and edges of up to Width triangles. Lanes past the end of a leaf have zero edges
+// and never report a hit.
+template <uint32_t Width> struct alignas(Width * sizeof(float)) TriangleBlock
+{
+    float vertex[3][Width];
+    float edge1[3][Width];
+    float edge2[3][Width];
+    // Triangle in the leaf order of the binary BVH
+    uint32_t triangles[Width];
+};
+
+template <uint32_t Width> struct WideBvh
+{
+    std::vector<WideBvhNode<Width>> nodes;
+    std::vector<TriangleBlock<Width>> blocks;
+    // Nodes on the longest path from the root to a leaf
+    uint32_t depth = 0;
+};
+
+typedef WideBvh<4> WideBvh4;
+typedef WideBvh<8> WideBvh8;
+
+// Collapses a binary BVH into one with 4 or 8 children per node. Each node opens the inner child
+// with the largest surface area until it is full, binary leaves become leaf children whose
+// triangles are split into blocks of Width.
+class WideBvhBuilder
+{
+  public:
+    static void Build(const Bvh &bvh, WideBvh4 &wide);
+    static void Build(const Bvh &bvh, WideBvh8 &wide);
+};
@@ -2,6 +2,7 @@
 
 #include "Sandbox3D.h"
 
+#include "Renderer/AssetRegistry.h"
 #include "Renderer/VulkanRenderer.h"
 
 #include "glm/gtc/matrix_inverse.hpp"
@@ -22,12 +23,16 @@ float F0 = 0.1f;
 
 Sandbox3D::Sandbox3D() : Layer("Sandbox3D"), m_CameraController((float)WIDTH / HEIGHT)
 {
-    ObjModel::LoadSkysphere();
-    ObjModel::LoadHdrSkysphere();
+    // Only ray tracing samples the skyspheres, so they are decoded and baked on the thread pool
+    // while the models load and the raster path renders. Without workers that would hold up the
+    // first frame, they are then loaded when ray tracing is first needed.
+    if (ThreadPool::Get().GetConcurrency() > 1)
+    {
+        m_SkysphereLoading = true;
+        m_SkysphereTasks.Run([this]() { ObjModel::LoadSkysphereSources(m_SkysphereSources); });
+    }
 
-    m_Models.push_back(ObjModel::LoadModel("models/Sphere.obj"));
-    m_Models.push_back(ObjModel::LoadModel("models/plane.obj"));
-    m_Models.push_back(ObjModel::LoadModel("models/wuson.obj"));
+    m_Models = ObjModel::LoadModels({"models/Sphere.obj", "models/plane.obj", "models/wuson.obj"});
 
     VulkanRenderer::PushModel(m_Models[0]);
     VulkanRenderer::PushModel(m_Models[1]);
@@ -45,6 +50,20 @@ Sandbox3D::Sandbox3D() : Layer("Sandbox3D"), m_CameraController((float)WIDTH / H
     VulkanRenderer::Flush(m_Instances);
 }
 
+void Sandbox3D::PrepareRayTracing()
+{
+    if (!m_SkysphereLoading)
+    {
+        ObjModel::LoadSkysphereSources(m_SkysphereSources);
+    }
+    m_SkysphereTasks.Wait();
+    ObjModel::UploadSkyspheres(m_SkysphereSources);
+    m_SkysphereSources = {};
+    m_SkysphereLoading = false;
+
+    VulkanRenderer::BuildRayTracing();
+}
+
 void Sandbox3D::OnAttach()
 {
 }
@@ -55,6 +74,15 @@ void Sandbox3D::OnDetach()
 
 void Sandbox3D::OnUpdate(float ts)
 {
+    // The ray tracing resources are built as soon as their background work finished, or right
+    // away when RTX is switched on before that
+    if (!VulkanRenderer::IsRayTracingReady() &&
+        (raytrace || (m_SkysphereLoading && m_SkysphereTasks.IsDone() &&
+                      VulkanRenderer::IsRayTracingPipelineCompiled())))
+    {
+        PrepareRayTracing();
+    }
+
     m_CameraController.OnUpdate(ts);
     VulkanRenderer::BeginScene(m_CameraController.GetCamera());
     if (raytrace)
@@ -87,6 +115,21 @@ void Sandbox3D::OnImGuiRender()
     ImGui::Checkbox("HDR", &hdr);
     ImGui::SliderFloat("Ni", &ni, 1.f, 2.f);
     ImGui::SliderFloat("F0", &F0, 0.0f, 1.f);
+
+    const AssetRegistryStats &assets = AssetRegistry::GetStats();
+    ImGui::Text("Meshes: %u hits, %u misses", assets.meshHits, assets.meshMisses);
+    ImGui::Text("Textures: %u hits, %u misses", assets.textureHits, assets.textureMisses);
+    ImGui::Text("Samplers: %u hits, %u misses", assets.samplerHits, assets.samplerMisses);
+    ImGui::Text("Atlases: %u holding %u textures", assets.atlases, assets.atlasTextures);
+    ImGui::Text("Saved: %.2f MB", assets.bytesSaved / (1024.0 * 1024.0));
+
+    const StartupStats &startup = VulkanRenderer::GetStartupStats();
+    ImGui::Text("First frame: %.0f ms, ray tracing ready: %.0f ms", startup.firstFrameMillis,
+                startup.rayTracingReadyMillis);
+
+    const LodStats &lods = VulkanRenderer::GetLodStats();
+    ImGui::Text("Triangles: %llu of %llu, %llu instances reduced", lods.triangles,
+                lods.fullTriangles, lods.reducedInstances);
 }
 
 void Sandbox3D::OnEvent(Event &e)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Core/Layer.h"
+#include "Core/ThreadPool.h"
 
 #include "Renderer/ObjModel.h"
 
@@ -19,11 +20,18 @@ class Sandbox3D : public Layer
     void OnImGuiRender() override;
     void OnEvent(Event &e) override;
 
+  private:
+    void PrepareRayTracing();
+
   private:
     PerspectiveCameraController m_CameraController;
     std::vector<ObjInstance> m_Instances;
     std::vector<ObjModel> m_Models;
 
+    SkysphereSources m_SkysphereSources;
+    TaskGroup m_SkysphereTasks;
+    bool m_SkysphereLoading = false;
+
     std::queue<float> m_Times;
     float m_TimePassed = 0.0f;
     int m_FrameCount = 0;
@@ -1,8 +1,11 @@
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" shader_vert.vert -o vert.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" shader_frag.frag -o frag.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" -DPACKED_VERTICES shader_vert.vert -o vert_packed.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" -DPACKED_VERTICES shader_frag.frag -o frag_packed.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" shader_post_vert.vert -o vert_post.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" shader_post_frag.frag -o frag_post.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" raytrace_rchit.rchit -o raytrace_rchit.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" -DPACKED_VERTICES raytrace_rchit.rchit -o raytrace_rchit_packed.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" raytrace_rgen.rgen -o raytrace_rgen.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" raytrace_rmiss.rmiss -o raytrace_rmiss.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" raytrace_shadow_rmiss.rmiss -o raytrace_shadow_rmiss.spv
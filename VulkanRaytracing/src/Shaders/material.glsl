@@ -10,8 +10,14 @@ struct Material
     float dissolve;  // 1 == opaque; 0 == fully transparent
     int illum;
     int textureId;
+    vec4 textureTransform; // xy scale, zw offset of the texture in its atlas
 };
 
+vec2 materialTexCoord(Material mat, vec2 texCoord)
+{
+    return mat.textureTransform.zw + texCoord * mat.textureTransform.xy;
+}
+
 struct Vertex{
     vec3 pos;
     vec3 norm;
@@ -20,6 +26,38 @@ struct Vertex{
     int matID;
 };
 
+// Attributes of the packed vertex layout, see PackedVertex in ObjModel.h. The positions are a
+// separate vec3 stream and the materials are stored per triangle.
+struct PackedVertex
+{
+    uint norm;
+    uint texCoord;
+    uint color;
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+vec3 unpackNormal(uint norm)
+{
+    return decodeOctahedral(unpackSnorm2x16(norm));
+}
+
+vec2 unpackTexCoord(uint texCoord)
+{
+    return unpackHalf2x16(texCoord);
+}
+
+vec3 unpackColor(uint color)
+{
+    return unpackUnorm4x8(color).rgb;
+}
+
 struct Instance
 {
     int objId;
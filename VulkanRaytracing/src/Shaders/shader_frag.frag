@@ -11,7 +11,9 @@ layout(location = 1) in vec3 fragNorm;
 layout(location = 2) in vec3 fragPos;
 layout(location = 3) in vec3 fragCameraPos;
 layout(location = 4) in vec2 fragTexCoord;
+#ifndef PACKED_VERTICES
 layout(location = 5) flat in int fragMatID;
+#endif
 layout(location = 6) in vec3 worldPos;
 layout(location = 7) in vec3 viewDir;
 
@@ -20,19 +22,29 @@ layout(location = 0) out vec4 outColor;
 layout(binding = 1, scalar) readonly buffer MaterialBufferObject { Material m[]; } materials[];
 layout(binding = 2) uniform sampler2D textureSamplers[];
 layout(binding = 3, scalar) readonly buffer InstanceBufferObject { Instance i[]; } instances;
+#ifdef PACKED_VERTICES
+layout(binding = 6) readonly buffer TriangleMaterials { uint m[]; } triangleMaterials[];
+#endif
 
 layout(push_constant, scalar) uniform PushConstant
 {
     int instanceID;
     vec3 lightPosition;
     vec3 lightColor;
+    int firstTriangle;
 }
 pushC;
 
 void main() 
 {
     int objId = instances.i[pushC.instanceID].objId;
+#ifdef PACKED_VERTICES
+    // Draws of culled meshlets start inside the mesh, which gl_PrimitiveID does not include
+    uint triangle = pushC.firstTriangle + gl_PrimitiveID;
+    Material mat = materials[objId].m[triangleMaterials[objId].m[triangle]];
+#else
     Material mat = materials[objId].m[fragMatID];
+#endif
 
     vec3 N = normalize(fragNorm);
 
@@ -50,7 +62,7 @@ void main()
     {
         int  txtOffset  = instances.i[pushC.instanceID].texOffset;
         uint txtId      = txtOffset + mat.textureId;
-        vec3 diffuseTxt = texture(textureSamplers[txtId], fragTexCoord).xyz;
+        vec3 diffuseTxt = texture(textureSamplers[txtId], materialTexCoord(mat, fragTexCoord)).xyz;
         diffuse *= diffuseTxt;
     }
 
@@ -79,5 +91,5 @@ void main()
     // outColor = vec4(1.0f, 0.0f, 0.0f, 0.0f);
         //outColor = vec4(materials[pushC.instanceID].m[0].shininess, materials[pushC.instanceID].m[0].ior, materials[pushC.instanceID].m[0].dissolve, 1.0f);
         //outColor = vec4(result, 1.0f);
-    outColor = texture(textureSamplers[mat.textureId + instances.i[pushC.instanceID].texOffset], fragTexCoord).rgba;
+    outColor = texture(textureSamplers[mat.textureId + instances.i[pushC.instanceID].texOffset], materialTexCoord(mat, fragTexCoord)).rgba;
 }
\ No newline at end of file
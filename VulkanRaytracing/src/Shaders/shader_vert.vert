@@ -6,17 +6,25 @@
 #include "material.glsl"
 
 layout(location = 0) in vec3 pos;
+#ifdef PACKED_VERTICES
+layout(location = 1) in vec2 octNorm;
+#else
 layout(location = 1) in vec3 norm;
+#endif
 layout(location = 2) in vec3 color;
 layout(location = 3) in vec2 texCoord;
+#ifndef PACKED_VERTICES
 layout(location = 4) in int matID;
+#endif
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec3 fragPos;
 layout(location = 3) out vec3 fragCameraPos;
 layout(location = 4) out vec2 fragTexCoord;
+#ifndef PACKED_VERTICES
 layout(location = 5) flat out int fragMatID;
+#endif
 layout(location = 6) out vec3 worldPos;
 layout(location = 7) out vec3 viewDir;
 
@@ -36,6 +44,7 @@ layout(push_constant, scalar) uniform PushConstant
     int instanceID;
     vec3 lightPosition;
     vec3 lightColor;
+    int firstTriangle;
 }
 pushC;
 
@@ -44,11 +53,17 @@ void main()
     mat4 modelMatrix = instances.i[pushC.instanceID].modelMatrix;
     gl_Position = cameraMatrices.projection * cameraMatrices.view * modelMatrix * vec4(pos, 1.0);
     fragColor = color;
+#ifdef PACKED_VERTICES
+    fragNorm = decodeOctahedral(octNorm);
+#else
     fragNorm = norm;
+#endif
     fragPos = pos;
     fragCameraPos = cameraMatrices.cameraPos;
     fragTexCoord = texCoord;
+#ifndef PACKED_VERTICES
     fragMatID = matID;
+#endif
     worldPos = vec3(modelMatrix * vec4(pos, 1.0));
     vec3 origin = vec3(cameraMatrices.view * vec4(0, 0, 0, 1));
     viewDir      = vec3(worldPos - origin);
@@ -0,0 +1,557 @@
+#include "vkpch.h"
+
+#include "AssetArchive.h"
+
+#include "Core/ThreadPool.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+#define ASSET_ARCHIVE_MAGIC 0x4B505256 // "VRPK"
+#define ASSET_ARCHIVE_VERSION 1
+
+// Matches are found through a hash of their first bytes and point at most 64 KiB back
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+// The search steps one byte further for every 64 bytes without a match, which keeps
+// incompressible data such as PNG files from costing much more than a copy
+#define LZ_SKIP_TRIGGER 6
+// Literal runs and matches up to this size are decoded with one fixed size copy
+#define LZ_FAST_COPY 16
+
+struct ArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t blockCount;
+    uint64_t tocOffset;
+    uint64_t tocSize;
+    uint64_t tocHash;
+};
+
+static inline uint32_t Read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline void WriteLength(uint8_t *&out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *out++ = 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+}
+
+// Token with the literal count in the high and the match length in the low nibble, the counts
+// that do not fit continue in bytes of 255. The last sequence of a block has no match.
+static bool WriteSequence(uint8_t *&out, const uint8_t *outEnd, const uint8_t *literals,
+                          size_t literalCount, size_t offset, size_t matchLength)
+{
+    // Worst case of the token, both lengths, the literals and the offset
+    const size_t bound = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+    if (static_cast<size_t>(outEnd - out) < bound)
+    {
+        return false;
+    }
+    const size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    *out++ = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) |
+                                  std::min<size_t>(matchCode, 15));
+    if (literalCount >= 15)
+    {
+        WriteLength(out, literalCount - 15);
+    }
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+    if (matchLength)
+    {
+        *out++ = static_cast<uint8_t>(offset);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+        if (matchCode >= 15)
+        {
+            WriteLength(out, matchCode - 15);
+        }
+    }
+    return true;
+}
+
+// Size of the compressed block, 0 when it does not fit into capacity
+static size_t CompressBlock(const uint8_t *source, size_t size, uint8_t *destination,
+                            size_t capacity)
+{
+    std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, UINT32_MAX);
+    uint8_t *out = destination;
+    const uint8_t *outEnd = destination + capacity;
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= size)
+    {
+        const uint32_t sequence = Read32(source + i);
+        uint32_t &slot = table[HashSequence(sequence)];
+        const uint32_t candidate = slot;
+        slot = static_cast<uint32_t>(i);
+        if (candidate == UINT32_MAX || i - candidate > LZ_MAX_OFFSET ||
+            Read32(source + candidate) != sequence)
+        {
+            i += 1 + ((i - anchor) >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+
+        size_t length = LZ_MIN_MATCH;
+        while (i + length < size && source[candidate + length] == source[i + length])
+        {
+            length++;
+        }
+        if (!WriteSequence(out, outEnd, source + anchor, i - anchor, i - candidate, length))
+        {
+            return 0;
+        }
+        i += length;
+        anchor = i;
+    }
+    if (!WriteSequence(out, outEnd, source + anchor, size - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return static_cast<size_t>(out - destination);
+}
+
+static inline bool ReadLength(const uint8_t *&in, const uint8_t *inEnd, size_t &length)
+{
+    uint8_t byte;
+    do
+    {
+        if (in == inEnd || length > ASSET_ARCHIVE_BLOCK_SIZE)
+        {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Checks every length and offset, so that damaged archives fail instead of writing out of bounds
+static bool DecompressBlock(const uint8_t *source, size_t size, uint8_t *destination,
+                            size_t destinationSize)
+{
+    const uint8_t *in = source;
+    const uint8_t *inEnd = source + size;
+    uint8_t *out = destination;
+    uint8_t *outEnd = destination + destinationSize;
+    while (in < inEnd)
+    {
+        const uint8_t token = *in++;
+        size_t literalCount = token >> 4;
+        if ((literalCount == 15 && !ReadLength(in, inEnd, literalCount)) ||
+            literalCount > static_cast<size_t>(inEnd - in) ||
+            literalCount > static_cast<size_t>(outEnd - out))
+        {
+            return false;
+        }
+        // Short runs are copied as one fixed size piece where both buffers have room for it
+        if (literalCount <= LZ_FAST_COPY && inEnd - in >= LZ_FAST_COPY &&
+            outEnd - out >= LZ_FAST_COPY)
+        {
+            memcpy(out, in, LZ_FAST_COPY);
+        }
+        else
+        {
+            memcpy(out, in, literalCount);
+        }
+        in += literalCount;
+        out += literalCount;
+        if (in == inEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+        const size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+        in += 2;
+        size_t length = (token & 15) + LZ_MIN_MATCH;
+        if (((token & 15) == 15 && !ReadLength(in, inEnd, length)) || offset == 0 ||
+            offset > static_cast<size_t>(out - destination) ||
+            length > static_cast<size_t>(outEnd - out))
+        {
+            return false;
+        }
+        const uint8_t *match = out - offset;
+        if (length <= LZ_FAST_COPY && offset >= LZ_FAST_COPY && outEnd - out >= LZ_FAST_COPY)
+        {
+            memcpy(out, match, LZ_FAST_COPY);
+            out += length;
+            continue;
+        }
+        // Overlapping matches repeat the last offset bytes, copying from the match start keeps
+        // the distance a multiple of the offset while it doubles with every copy
+        for (size_t remaining = length; remaining > 0;)
+        {
+            const size_t count = std::min(remaining, static_cast<size_t>(out - match));
+            memcpy(out, match, count);
+            out += count;
+            remaining -= count;
+        }
+    }
+    return out == outEnd;
+}
+
+static inline uint64_t GetBlockCount(uint64_t size)
+{
+    return size / ASSET_ARCHIVE_BLOCK_SIZE + (size % ASSET_ARCHIVE_BLOCK_SIZE != 0);
+}
+
+static inline size_t GetBlockSize(const AssetArchiveEntry &entry, uint32_t block)
+{
+    return static_cast<size_t>(std::min<uint64_t>(
+        ASSET_ARCHIVE_BLOCK_SIZE, entry.size - uint64_t(block) * ASSET_ARCHIVE_BLOCK_SIZE));
+}
+
+// Bounds checked reads of the table of contents
+struct TocReader
+{
+    template <typename T> bool Read(T &value)
+    {
+        if (static_cast<size_t>(end - cursor) < sizeof(T))
+        {
+            return false;
+        }
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    bool ReadString(std::string &value)
+    {
+        uint32_t length;
+        if (!Read(length) || static_cast<size_t>(end - cursor) < length)
+        {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char *>(cursor), length);
+        cursor += length;
+        return true;
+    }
+
+    const uint8_t *cursor;
+    const uint8_t *end;
+};
+
+template <typename T> static void AppendToc(std::vector<uint8_t> &toc, const T &value)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    toc.insert(toc.end(), bytes, bytes + sizeof(T));
+}
+
+bool AssetArchive::Open(const std::string &archivePath, std::string &error)
+{
+    *this = AssetArchive();
+    if (!m_File.Open(archivePath))
+    {
+        error = "cannot open " + archivePath;
+        return false;
+    }
+
+    ArchiveHeader header;
+    const uint8_t *data = m_File.GetData();
+    const size_t fileSize = m_File.GetSize();
+    if (fileSize < sizeof(header))
+    {
+        error = archivePath + " is not an asset archive";
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != ASSET_ARCHIVE_MAGIC || header.version != ASSET_ARCHIVE_VERSION)
+    {
+        error = archivePath + " is not an asset archive of version " +
+                std::to_string(ASSET_ARCHIVE_VERSION);
+        return false;
+    }
+    if (header.tocOffset < sizeof(header) || header.tocOffset > fileSize ||
+        header.tocSize != fileSize - header.tocOffset ||
+        HashData(data + header.tocOffset, static_cast<size_t>(header.tocSize)) != header.tocHash)
+    {
+        error = archivePath + " has a damaged table of contents";
+        return false;
+    }
+
+    TocReader reader{data + header.tocOffset, data + fileSize};
+    m_Entries.resize(header.entryCount);
+    for (auto &entry : m_Entries)
+    {
+        if (!reader.ReadString(entry.name) || !reader.Read(entry.size) ||
+            !reader.Read(entry.stamp.size) || !reader.Read(entry.stamp.writeTime) ||
+            !reader.Read(entry.firstBlock) || !reader.Read(entry.blockCount) ||
+            entry.blockCount != GetBlockCount(entry.size) ||
+            entry.firstBlock > header.blockCount ||
+            entry.blockCount > header.blockCount - entry.firstBlock)
+        {
+            error = archivePath + " has a damaged table of contents";
+            return false;
+        }
+    }
+    m_Blocks.resize(header.blockCount);
+    for (auto &block : m_Blocks)
+    {
+        if (!reader.Read(block.offset) || !reader.Read(block.storedSize) ||
+            block.storedSize > ASSET_ARCHIVE_BLOCK_SIZE || block.offset < sizeof(header) ||
+            block.offset > header.tocOffset || block.storedSize > header.tocOffset - block.offset)
+        {
+            error = archivePath + " has a damaged table of contents";
+            return false;
+        }
+    }
+
+    m_Lookup.reserve(m_Entries.size());
+    for (size_t i = 0; i < m_Entries.size(); i++)
+    {
+        m_Lookup[m_Entries[i].name] = i;
+    }
+    return true;
+}
+
+const AssetArchiveEntry *AssetArchive::Find(const std::string &path) const
+{
+    auto it = m_Lookup.find(GetEntryName(path));
+    return it != m_Lookup.end() ? &m_Entries[it->second] : nullptr;
+}
+
+size_t AssetArchive::Read(const AssetArchiveEntry &entry, uint8_t *destination,
+                         size_t readSize) const
+{
+    const size_t size = static_cast<size_t>(std::min<uint64_t>(entry.size, readSize));
+    const size_t blockCount = static_cast<size_t>(GetBlockCount(size));
+    std::atomic<bool> failed{false};
+    ThreadPool::Get().ParallelFor(blockCount, [&](size_t i) {
+        const uint32_t index = static_cast<uint32_t>(i);
+        const Block &block = m_Blocks[entry.firstBlock + index];
+        const uint8_t *source = m_File.GetData() + block.offset;
+        uint8_t *target = destination + size_t(index) * ASSET_ARCHIVE_BLOCK_SIZE;
+        const size_t blockSize = GetBlockSize(entry, index);
+        // Blocks that did not get smaller are stored as they are
+        if (block.storedSize == blockSize)
+        {
+            memcpy(target, source, blockSize);
+        }
+        else if (!DecompressBlock(source, block.storedSize, target, blockSize))
+        {
+            failed.store(true, std::memory_order_relaxed);
+        }
+    });
+    if (failed.load() || blockCount == 0)
+    {
+        return 0;
+    }
+    return static_cast<size_t>((blockCount - 1) * ASSET_ARCHIVE_BLOCK_SIZE) +
+           GetBlockSize(entry, static_cast<uint32_t>(blockCount - 1));
+}
+
+uint64_t AssetArchive::GetStoredSize(const AssetArchiveEntry &entry) const
+{
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < entry.blockCount; i++)
+    {
+        size += m_Blocks[entry.firstBlock + i].storedSize;
+    }
+    return size;
+}
+
+bool AssetArchive::Write(const std::string &archivePath, const std::vector<std::string> &files,
+                         std::string &error)
+{
+    std::ofstream stream(archivePath, std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        error = "cannot create " + archivePath;
+        return false;
+    }
+    ArchiveHeader header{};
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<AssetArchiveEntry> entries;
+    std::vector<Block> blocks;
+    std::unordered_set<std::string> names;
+    uint64_t offset = sizeof(header);
+    for (const auto &file : files)
+    {
+        AssetArchiveEntry entry;
+        entry.name = GetEntryName(file);
+        if (!names.insert(entry.name).second)
+        {
+            continue;
+        }
+        MappedFile source;
+        if (!GetFileStamp(file, entry.stamp) || (entry.stamp.size > 0 && !source.Open(file)))
+        {
+            error = "cannot read " + file;
+            return false;
+        }
+        entry.size = source.GetSize();
+        entry.firstBlock = static_cast<uint32_t>(blocks.size());
+        entry.blockCount = static_cast<uint32_t>(GetBlockCount(entry.size));
+
+        // Compressed in parallel, written in order
+        std::vector<std::vector<uint8_t>> compressed(entry.blockCount);
+        ThreadPool::Get().ParallelFor(entry.blockCount, [&](size_t i) {
+            const uint32_t index = static_cast<uint32_t>(i);
+            const uint8_t *data = source.GetData() + size_t(index) * ASSET_ARCHIVE_BLOCK_SIZE;
+            const size_t size = GetBlockSize(entry, index);
+            compressed[i].resize(size);
+            const size_t storedSize = CompressBlock(data, size, compressed[i].data(), size - 1);
+            if (storedSize == 0)
+            {
+                memcpy(compressed[i].data(), data, size);
+            }
+            else
+            {
+                compressed[i].resize(storedSize);
+            }
+        });
+        for (const auto &block : compressed)
+        {
+            stream.write(reinterpret_cast<const char *>(block.data()), block.size());
+            blocks.push_back({offset, static_cast<uint32_t>(block.size())});
+            offset += block.size();
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    std::vector<uint8_t> toc;
+    for (const auto &entry : entries)
+    {
+        AppendToc(toc, static_cast<uint32_t>(entry.name.size()));
+        toc.insert(toc.end(), entry.name.begin(), entry.name.end());
+        AppendToc(toc, entry.size);
+        AppendToc(toc, entry.stamp.size);
+        AppendToc(toc, entry.stamp.writeTime);
+        AppendToc(toc, entry.firstBlock);
+        AppendToc(toc, entry.blockCount);
+    }
+    for (const auto &block : blocks)
+    {
+        AppendToc(toc, block.offset);
+        AppendToc(toc, block.storedSize);
+    }
+    stream.write(reinterpret_cast<const char *>(toc.data()), toc.size());
+
+    header.magic = ASSET_ARCHIVE_MAGIC;
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.blockCount = static_cast<uint32_t>(blocks.size());
+    header.tocOffset = offset;
+    header.tocSize = toc.size();
+    header.tocHash = HashData(toc.data(), toc.size());
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    stream.close();
+    if (!stream)
+    {
+        error = "cannot write " + archivePath;
+        return false;
+    }
+    return true;
+}
+
+std::string AssetArchive::GetEntryName(const std::string &path)
+{
+    std::string generic = path;
+    std::replace(generic.begin(), generic.end(), '\\', '/');
+    std::filesystem::path name(generic);
+    if (name.is_absolute())
+    {
+        std::error_code error;
+        const std::filesystem::path relative =
+            name.lexically_relative(std::filesystem::current_path(error));
+        if (!error && !relative.empty())
+        {
+            name = relative;
+        }
+    }
+    return name.lexically_normal().generic_string();
+}
+
+static std::mutex s_MountMutex;
+static std::vector<std::unique_ptr<AssetArchive>> s_Mounted;
+static std::atomic<bool> s_AnyMounted{false};
+
+bool AssetArchive::Mount(const std::string &archivePath, std::string &error)
+{
+    // Opened outside of the lock, the archive file itself is looked up like any other
+    auto archive = std::make_unique<AssetArchive>();
+    if (!archive->Open(archivePath, error))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_MountMutex);
+    s_Mounted.push_back(std::move(archive));
+    s_AnyMounted.store(true);
+    return true;
+}
+
+const AssetArchive *AssetArchive::FindMounted(const std::string &path,
+                                              const AssetArchiveEntry *&entry)
+{
+    if (!s_AnyMounted.load())
+    {
+        return nullptr;
+    }
+    const std::string name = GetEntryName(path);
+    std::lock_guard<std::mutex> lock(s_MountMutex);
+    for (auto it = s_Mounted.rbegin(); it != s_Mounted.rend(); ++it)
+    {
+        auto found = (*it)->m_Lookup.find(name);
+        if (found != (*it)->m_Lookup.end())
+        {
+            entry = &(*it)->m_Entries[found->second];
+            return it->get();
+        }
+    }
+    return nullptr;
+}
+
+bool AssetArchive::ReadMounted(const std::string &path, std::unique_ptr<uint8_t[]> &data,
+                               size_t &size, size_t readSize)
+{
+    const AssetArchiveEntry *entry;
+    const AssetArchive *archive = FindMounted(path, entry);
+    if (!archive || entry->size == 0 || readSize == 0)
+    {
+        return false;
+    }
+    // Whole blocks are read, so the buffer is rounded up to them
+    const uint64_t blocks = GetBlockCount(std::min<uint64_t>(entry->size, readSize));
+    data.reset(new uint8_t[static_cast<size_t>(
+        std::min<uint64_t>(entry->size, blocks * ASSET_ARCHIVE_BLOCK_SIZE))]);
+    size = archive->Read(*entry, data.get(), readSize);
+    if (size == 0)
+    {
+        data.reset();
+        return false;
+    }
+    return true;
+}
+
+bool AssetArchive::GetMountedStamp(const std::string &path, FileStamp &stamp)
+{
+    const AssetArchiveEntry *entry;
+    if (!FindMounted(path, entry))
+    {
+        return false;
+    }
+    stamp = entry->stamp;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "FileTools.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Archive the application mounts at startup when it is present in the working directory
+#define ASSET_ARCHIVE_PATH "assets.pack"
+// Uncompressed bytes of every block but the last one of an entry
+#define ASSET_ARCHIVE_BLOCK_SIZE (256u << 10)
+
+struct AssetArchiveEntry
+{
+    // Relative path with forward slashes, as given by GetEntryName
+    std::string name;
+    uint64_t size = 0;
+    // Stamp of the packed file, so that caches keyed on it stay valid inside the archive
+    FileStamp stamp;
+    uint32_t firstBlock = 0;
+    uint32_t blockCount = 0;
+};
+
+// Single file holding many assets: the compressed blocks of all entries followed by a table of
+// contents. Entries are split into fixed size blocks compressed independently with a byte
+// oriented LZ77 coder, so that the blocks of one entry are decompressed in parallel on the
+// thread pool. The archive stays mapped while it is open.
+//
+// Mounted archives are searched by MappedFile and GetFileStamp for files that are not on disk,
+// which lets every loader that maps its input read from them unchanged.
+class AssetArchive
+{
+  public:
+    bool Open(const std::string &archivePath, std::string &error);
+
+    // Null when the archive has no entry for the path
+    const AssetArchiveEntry *Find(const std::string &path) const;
+    // Decompresses the blocks holding the first readSize bytes of the entry into destination and
+    // returns how many bytes that gave, the whole entry by default and 0 for damaged blocks
+    size_t Read(const AssetArchiveEntry &entry, uint8_t *destination,
+                size_t readSize = SIZE_MAX) const;
+    // Compressed bytes of the entry in the archive
+    uint64_t GetStoredSize(const AssetArchiveEntry &entry) const;
+
+    const std::vector<AssetArchiveEntry> &GetEntries() const
+    {
+        return m_Entries;
+    }
+
+    // Packs the files under their entry names. Files named twice are packed once.
+    static bool Write(const std::string &archivePath, const std::vector<std::string> &files,
+                      std::string &error);
+    // Lexically normal path relative to the working directory with forward slashes
+    static std::string GetEntryName(const std::string &path);
+
+    // Later archives take precedence. Mounted archives stay open until the program exits.
+    static bool Mount(const std::string &archivePath, std::string &error);
+    // Reads the entry for path from the mounted archives into a buffer of its own, as far as
+    // Read does. Empty entries are not read, the same way MappedFile does not map empty files.
+    static bool ReadMounted(const std::string &path, std::unique_ptr<uint8_t[]> &data,
+                            size_t &size, size_t readSize = SIZE_MAX);
+    static bool GetMountedStamp(const std::string &path, FileStamp &stamp);
+
+  private:
+    struct Block
+    {
+        uint64_t offset;
+        uint32_t storedSize;
+    };
+
+    static const AssetArchive *FindMounted(const std::string &path,
+                                           const AssetArchiveEntry *&entry);
+
+  private:
+    MappedFile m_File;
+    std::vector<AssetArchiveEntry> m_Entries;
+    std::vector<Block> m_Blocks;
+    std::unordered_map<std::string, size_t> m_Lookup;
+};
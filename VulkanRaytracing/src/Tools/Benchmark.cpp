@@ -0,0 +1,1700 @@
+#include "vkpch.h"
+
+#include "Benchmark.h"
+
+#include "Core/ThreadPool.h"
+#include "Core/Timer.h"
+#include "Renderer/BvhBuilder.h"
+#include "Renderer/BvhTraversal.h"
+#include "Renderer/BvhUpdater.h"
+#include "Renderer/CpuRaytracer.h"
+#include "Renderer/GltfFile.h"
+#include "Renderer/LbvhBuilder.h"
+#include "Renderer/LodSelector.h"
+#include "Renderer/MeshCache.h"
+#include "Renderer/MeshOptimizer.h"
+#include "Renderer/MeshSimplifier.h"
+#include "Renderer/MeshletBuilder.h"
+#include "Renderer/MeshletCuller.h"
+#include "Renderer/ObjParser.h"
+#include "Renderer/PerspectiveCamera.h"
+#include "Renderer/TextureCache.h"
+#include "Renderer/TextureDecoder.h"
+#include "Renderer/VertexPacker.h"
+#include "Tools/AssetArchive.h"
+#include "Tools/BlockCompressor.h"
+#include "Tools/HdrDecoder.h"
+#include "Tools/ImageWriter.h"
+#include "Tools/TextureAtlas.h"
+
+#include "stb_image.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+struct BenchmarkEntry
+{
+    const char *name;
+    const char *usage;
+    int (*run)(const std::vector<std::string> &args);
+};
+
+// Compares a full OBJ parse against mapping the cache and copying its arrays into a
+// staging sized buffer, which is all ObjModel::LoadModel does on a cache hit
+static int BenchMeshCache(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "mesh-cache: no input files" << std::endl;
+        return 1;
+    }
+
+    for (const auto &path : args)
+    {
+        std::filesystem::remove(MeshCache::GetCachePath(path));
+
+        Timer timer;
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        float parseTime = timer.ElapsedMillis();
+
+        timer.Reset();
+        if (!MeshCache::Write(path, mesh))
+        {
+            std::cout << path << ": failed to write mesh cache" << std::endl;
+            return 1;
+        }
+        float writeTime = timer.ElapsedMillis();
+
+        timer.Reset();
+        MeshCache cache;
+        if (!cache.Open(path))
+        {
+            std::cout << path << ": failed to open mesh cache" << std::endl;
+            return 1;
+        }
+        const MeshView &view = cache.GetView();
+        std::vector<uint8_t> staging(sizeof(Vertex) * view.verticesCount +
+                                     sizeof(uint32_t) * view.indicesCount +
+                                     sizeof(Material) * view.materialsCount);
+        uint8_t *dst = staging.data();
+        memcpy(dst, view.vertices, sizeof(Vertex) * view.verticesCount);
+        dst += sizeof(Vertex) * view.verticesCount;
+        memcpy(dst, view.indices, sizeof(uint32_t) * view.indicesCount);
+        dst += sizeof(uint32_t) * view.indicesCount;
+        memcpy(dst, view.materials, sizeof(Material) * view.materialsCount);
+        float loadTime = timer.ElapsedMillis();
+
+        std::cout << path << ": " << view.verticesCount << " vertices, "
+                  << view.indicesCount / 3 << " triangles" << std::endl;
+        std::cout << "  obj parse:   " << parseTime << " ms" << std::endl;
+        std::cout << "  cache write: " << writeTime << " ms" << std::endl;
+        std::cout << "  cache load:  " << loadTime << " ms (" << parseTime / loadTime << "x)"
+                  << std::endl;
+    }
+    return 0;
+}
+
+// Compares the parallel OBJ parser against the tinyobj path and checks both produce the same
+// mesh
+static int BenchObjParser(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "obj-parser: no input files" << std::endl;
+        return 1;
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << std::endl;
+    int result = 0;
+    for (const auto &path : args)
+    {
+        Timer timer;
+        MeshData reference = ObjModel::LoadMeshDataTinyObj(path);
+        float referenceTime = timer.ElapsedMillis();
+
+        timer.Reset();
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        float parseTime = timer.ElapsedMillis();
+
+        bool identical =
+            mesh.vertices.size() == reference.vertices.size() &&
+            mesh.indices == reference.indices && mesh.textures == reference.textures &&
+            mesh.materials.size() == reference.materials.size() &&
+            memcmp(mesh.vertices.data(), reference.vertices.data(),
+                   sizeof(Vertex) * mesh.vertices.size()) == 0 &&
+            memcmp(mesh.materials.data(), reference.materials.data(),
+                   sizeof(Material) * mesh.materials.size()) == 0;
+        if (!identical)
+        {
+            result = 1;
+        }
+
+        std::cout << path << ": " << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles"
+                  << (identical ? "" : ", OUTPUT DIFFERS FROM TINYOBJ") << std::endl;
+        std::cout << "  tinyobj:    " << referenceTime << " ms" << std::endl;
+        std::cout << "  obj parser: " << parseTime << " ms (" << referenceTime / parseTime << "x)"
+                  << std::endl;
+    }
+    return result;
+}
+
+// Writes each OBJ file as a .glb next to it and compares parsing the OBJ against opening the
+// .glb, which gathers the vertices from their accessors and maps everything else in place
+static int BenchGltf(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "gltf: no input files" << std::endl;
+        return 1;
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << std::endl;
+    int result = 0;
+    for (const auto &path : args)
+    {
+        Timer timer;
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        float objTime = timer.ElapsedMillis();
+
+        const std::string glbPath = std::filesystem::path(path).replace_extension(".glb").string();
+        std::string error;
+        if (!GltfFile::Write(glbPath, mesh, error))
+        {
+            std::cout << path << ": " << error << std::endl;
+            return 1;
+        }
+
+        timer.Reset();
+        GltfFile file;
+        if (!file.Open(glbPath, error))
+        {
+            std::cout << glbPath << ": " << error << std::endl;
+            return 1;
+        }
+        float glbTime = timer.ElapsedMillis();
+
+        const MeshView view = file.GetMeshCount() ? file.GetView(0) : MeshView();
+        bool identical = view.verticesCount == mesh.vertices.size() &&
+                         view.indicesCount == mesh.indices.size() &&
+                         memcmp(view.indices, mesh.indices.data(),
+                                sizeof(uint32_t) * mesh.indices.size()) == 0;
+        for (uint32_t i = 0; identical && i < view.verticesCount; i++)
+        {
+            identical = view.vertices[i] == mesh.vertices[i];
+        }
+        if (!identical)
+        {
+            result = 1;
+        }
+
+        const GltfStats &stats = file.GetStats();
+        std::cout << path << ": " << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles"
+                  << (identical ? "" : ", GLB MESH DIFFERS FROM OBJ") << std::endl;
+        std::cout << "  obj parser: " << objTime << " ms" << std::endl;
+        std::cout << "  glb:        " << glbTime << " ms (" << objTime / glbTime << "x), "
+                  << stats.inPlaceIndices << " of " << stats.meshes << " meshes with indices and "
+                  << stats.inPlacePositions << " with positions in place" << std::endl;
+    }
+    return result;
+}
+
+// Parses each file with its normals generated at several crease angles and reports how many
+// vertices remain after welding. Only files without normals are affected.
+static int BenchNormals(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "normals: no input files" << std::endl;
+        return 1;
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << std::endl;
+    for (const auto &path : args)
+    {
+        const std::string baseDir = std::filesystem::path(path).parent_path().string();
+        std::cout << path << ":" << std::endl;
+        for (float creaseAngle : {0.0f, 30.0f, 60.0f, 180.0f})
+        {
+            for (NormalWeighting weighting : {NormalWeighting::Area, NormalWeighting::Angle})
+            {
+                NormalSettings settings;
+                settings.creaseAngle = creaseAngle;
+                settings.weighting = weighting;
+
+                Timer timer;
+                MeshData mesh;
+                std::string error;
+                if (!ObjParser::Load(path, baseDir, mesh, error, settings))
+                {
+                    std::cout << "  " << error << std::endl;
+                    return 1;
+                }
+                float parseTime = timer.ElapsedMillis();
+
+                std::cout << "  crease " << creaseAngle << " deg, "
+                          << (weighting == NormalWeighting::Area ? "area" : "angle")
+                          << " weighted: " << mesh.vertices.size() << " vertices, "
+                          << mesh.indices.size() / 3 << " triangles, " << parseTime << " ms"
+                          << std::endl;
+            }
+        }
+    }
+    return 0;
+}
+
+// Converts each file into its mesh cache within the given memory budget and compares the time
+// against the in-memory parser
+static int BenchObjStream(const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "obj-stream: expected a budget and input files" << std::endl;
+        return 1;
+    }
+
+    const size_t memoryBudget = std::stoull(args[0]) << 20;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        const std::string &path = args[i];
+
+        Timer timer;
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        float parseTime = timer.ElapsedMillis();
+
+        std::filesystem::remove(MeshCache::GetCachePath(path));
+        timer.Reset();
+        ObjStreamReport report;
+        std::string error;
+        const std::string baseDir = std::filesystem::path(path).parent_path().string();
+        if (!ObjParser::Stream(path, baseDir, memoryBudget, report, error,
+                               ObjModel::s_NormalSettings))
+        {
+            std::cout << path << ": " << error << std::endl;
+            return 1;
+        }
+        float streamTime = timer.ElapsedMillis();
+
+        std::cout << path << ": " << report.verticesCount << " vertices ("
+                  << mesh.vertices.size() << " unbounded), " << report.indicesCount / 3
+                  << " triangles" << std::endl;
+        std::cout << "  obj parse:   " << parseTime << " ms" << std::endl;
+        std::cout << "  stream:      " << streamTime << " ms" << std::endl;
+        std::cout << "  peak memory: " << (report.peakMemory >> 20) << " MB of "
+                  << (report.memoryBudget >> 20) << " MB" << std::endl;
+        std::cout << "  weld resets: " << report.weldTableResets << std::endl;
+        std::cout << "  normal ranges: " << report.normalRanges << std::endl;
+    }
+    return 0;
+}
+
+struct BenchImage
+{
+    std::vector<uint8_t> pixels;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Builds mip chains for a set of textures with both filters, textures run in parallel as they
+// do when a model is loaded. Without arguments eight 2048x2048 noise images are used.
+static bool LoadBenchImages(const std::vector<std::string> &args, std::vector<BenchImage> &images)
+{
+    for (const auto &path : args)
+    {
+        int width, height, channels;
+        stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels)
+        {
+            std::cout << path << ": failed to load image" << std::endl;
+            return false;
+        }
+        BenchImage image;
+        image.width = static_cast<uint32_t>(width);
+        image.height = static_cast<uint32_t>(height);
+        image.pixels.assign(pixels, pixels + 4 * size_t(width) * height);
+        images.push_back(std::move(image));
+        stbi_image_free(pixels);
+    }
+    return true;
+}
+
+static int BenchMips(const std::vector<std::string> &args)
+{
+    std::vector<BenchImage> images;
+    if (!LoadBenchImages(args, images))
+    {
+        return 1;
+    }
+    if (images.empty())
+    {
+        uint32_t seed = 1;
+        for (int i = 0; i < 8; i++)
+        {
+            BenchImage image;
+            image.width = image.height = 2048;
+            image.pixels.resize(4 * size_t(image.width) * image.height);
+            for (auto &value : image.pixels)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                value = static_cast<uint8_t>(seed >> 24);
+            }
+            images.push_back(std::move(image));
+        }
+    }
+
+    size_t levels = 0;
+    double pixels = 0.0;
+    for (const auto &image : images)
+    {
+        levels += MipGenerator::GetLevelCount(image.width, image.height) - 1;
+        pixels += double(image.width) * image.height / 3.0;
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << ", textures: "
+              << images.size() << ", generated levels: " << levels << std::endl;
+    const std::pair<const char *, MipFilter> filters[] = {{"box", MipFilter::Box},
+                                                          {"kaiser", MipFilter::Kaiser}};
+    for (const auto &filter : filters)
+    {
+        std::vector<MipChain> chains(images.size());
+        Timer timer;
+        {
+            TaskGroup group;
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                group.Run([&, i]() {
+                    MipGenerator::Generate(images[i].pixels.data(), images[i].width,
+                                           images[i].height, true, filter.second, chains[i]);
+                });
+            }
+        }
+        float time = timer.ElapsedMillis();
+        std::cout << "  " << filter.first << ": " << time << " ms, " << levels * 1000.0 / time
+                  << " mips/s, " << pixels / (time * 1000.0) << " Mpix/s" << std::endl;
+    }
+    return 0;
+}
+
+// Block compresses the mip chains of a set of textures in every format and reports the size
+// ratio to RGBA8, the PSNR of the decoded chain and the encode rate. For image files the KTX2
+// cache is written and read back as well. Without arguments four 1024x1024 images of gradients,
+// edges and noise with a varying alpha channel are used.
+static int BenchBlockCompression(const std::vector<std::string> &args)
+{
+    std::vector<BenchImage> images;
+    if (!LoadBenchImages(args, images))
+    {
+        return 1;
+    }
+    if (images.empty())
+    {
+        uint32_t seed = 1;
+        for (int i = 0; i < 4; i++)
+        {
+            BenchImage image;
+            image.width = image.height = 1024;
+            image.pixels.resize(4 * size_t(image.width) * image.height);
+            for (uint32_t y = 0; y < image.height; y++)
+            {
+                for (uint32_t x = 0; x < image.width; x++)
+                {
+                    seed = seed * 1664525u + 1013904223u;
+                    uint8_t *pixel = &image.pixels[4 * (size_t(y) * image.width + x)];
+                    pixel[0] = static_cast<uint8_t>(x / 4 + (seed >> 29));
+                    pixel[1] = static_cast<uint8_t>(((x / (16 << i)) ^ (y / (16 << i))) & 1
+                                                        ? 200
+                                                        : 40 + y / 8);
+                    pixel[2] = static_cast<uint8_t>(128 + 127 * std::sin(0.02f * (x + y)));
+                    pixel[3] = static_cast<uint8_t>(255 - y / 8);
+                }
+            }
+            images.push_back(std::move(image));
+        }
+    }
+
+    std::vector<MipChain> chains(images.size());
+    double pixels = 0.0;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        MipGenerator::Generate(images[i].pixels.data(), images[i].width, images[i].height, true,
+                               MipFilter::Box, chains[i]);
+        pixels += chains[i].pixels.size() / 4.0;
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << ", textures: "
+              << images.size() << ", texels with mips: " << pixels << std::endl;
+    const std::pair<const char *, BlockFormat> formats[] = {
+        {"bc1", BlockFormat::BC1}, {"bc3", BlockFormat::BC3}, {"bc7", BlockFormat::BC7}};
+    for (const auto &format : formats)
+    {
+        std::vector<CompressedChain> compressed(chains.size());
+        Timer timer;
+        for (size_t i = 0; i < chains.size(); i++)
+        {
+            BlockCompressor::Compress(chains[i], format.second, compressed[i]);
+        }
+        float time = timer.ElapsedMillis();
+
+        double rawBytes = 0.0;
+        double compressedBytes = 0.0;
+        double psnr = 0.0;
+        for (size_t i = 0; i < chains.size(); i++)
+        {
+            MipChain decoded;
+            BlockCompressor::Decompress(compressed[i], decoded);
+            rawBytes += chains[i].pixels.size();
+            compressedBytes += compressed[i].blocks.size();
+            psnr += BlockCompressor::ComputePsnr(chains[i], decoded) / chains.size();
+        }
+        std::cout << "  " << format.first << ": " << time << " ms, " << pixels / (time * 1000.0)
+                  << " Mpix/s, ratio " << rawBytes / compressedBytes << ":1, PSNR " << psnr
+                  << " dB" << std::endl;
+
+        if (!args.empty())
+        {
+            timer.Reset();
+            for (size_t i = 0; i < args.size(); i++)
+            {
+                TextureCache::Write(args[i], compressed[i]);
+            }
+            float writeTime = timer.ElapsedMillis();
+            timer.Reset();
+            for (size_t i = 0; i < args.size(); i++)
+            {
+                if (!TextureCache::Load(args[i], compressed[i]))
+                {
+                    std::cout << args[i] << ": failed to read the texture cache" << std::endl;
+                    return 1;
+                }
+            }
+            std::cout << "    cache write: " << writeTime << " ms, read: " << timer.ElapsedMillis()
+                      << " ms" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Packs a set of textures into atlases with a range of paddings and compares the descriptors
+// and memory, RGBA8 and block compressed, with uploading every texture on its own. Without
+// arguments 256 noise images from 16x16 to 256x256 are used.
+static int BenchAtlas(const std::vector<std::string> &args)
+{
+    std::vector<BenchImage> images;
+    if (!LoadBenchImages(args, images))
+    {
+        return 1;
+    }
+    if (images.empty())
+    {
+        uint32_t seed = 1;
+        for (int i = 0; i < 256; i++)
+        {
+            BenchImage image;
+            seed = seed * 1664525u + 1013904223u;
+            image.width = 16u << (seed >> 30);
+            image.height = 16u << ((seed >> 28) & 3);
+            image.pixels.resize(4 * size_t(image.width) * image.height);
+            for (auto &value : image.pixels)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                value = static_cast<uint8_t>(seed >> 24);
+            }
+            images.push_back(std::move(image));
+        }
+    }
+
+    std::vector<MipChain> chains(images.size());
+    std::vector<const MipChain *> textures;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        MipGenerator::Generate(images[i].pixels.data(), images[i].width, images[i].height, true,
+                               MipFilter::Box, chains[i]);
+        textures.push_back(&chains[i]);
+    }
+
+    // BC1 or BC3 as TextureCompression::Default picks them
+    auto getSizes = [](const MipChain &chain, double &rawBytes, double &compressedBytes) {
+        CompressedChain compressed;
+        BlockCompressor::Compress(chain, BlockCompressor::ChooseFormat(chain, false), compressed);
+        rawBytes += chain.pixels.size();
+        compressedBytes += compressed.blocks.size();
+    };
+    double rawBytes = 0.0, compressedBytes = 0.0;
+    for (const auto &chain : chains)
+    {
+        getSizes(chain, rawBytes, compressedBytes);
+    }
+
+    const double mb = 1024.0 * 1024.0;
+    std::cout << "textures: " << images.size() << ", rgba8: " << rawBytes / mb
+              << " MB, bc: " << compressedBytes / mb << " MB" << std::endl;
+    for (uint32_t padding = 2; padding <= 8; padding *= 2)
+    {
+        TextureAtlasSettings settings;
+        settings.maxTextureSize = 512;
+        settings.padding = padding;
+        std::vector<MipChain> atlases;
+        std::vector<AtlasRegion> regions;
+        Timer timer;
+        TextureAtlas::Build(textures, settings, atlases, regions);
+        const float time = timer.ElapsedMillis();
+
+        double atlasRawBytes = 0.0, atlasCompressedBytes = 0.0;
+        size_t descriptors = atlases.size();
+        for (size_t i = 0; i < chains.size(); i++)
+        {
+            if (regions[i].atlas == UINT32_MAX)
+            {
+                getSizes(chains[i], atlasRawBytes, atlasCompressedBytes);
+                descriptors++;
+            }
+        }
+        for (const auto &atlas : atlases)
+        {
+            getSizes(atlas, atlasRawBytes, atlasCompressedBytes);
+        }
+        std::cout << "  padding " << padding << ": " << time << " ms, " << atlases.size()
+                  << " atlases, descriptors " << images.size() << " -> " << descriptors
+                  << ", rgba8 " << atlasRawBytes / mb << " MB, bc " << atlasCompressedBytes / mb
+                  << " MB, " << (atlases.empty() ? 0 : atlases[0].levels.size()) << " levels"
+                  << std::endl;
+    }
+    return 0;
+}
+
+// Bakes an HDR environment in both formats, equirectangular and as a cubemap, and compares the
+// size with the RGB32F linear tiled image the renderer used to upload. The cache of the default
+// settings is written and read back. Without an image a 4096x2048 gradient is baked instead.
+static int BenchEnvironment(const std::vector<std::string> &args)
+{
+    const std::string path = args.empty() ? "" : args[0];
+    EnvironmentBakeSettings settings;
+    if (args.size() > 1)
+    {
+        settings.cubeFaceSize = static_cast<uint32_t>(std::stoul(args[1]));
+    }
+
+    int width = 4096, height = 2048, components;
+    std::vector<float> source;
+    Timer timer;
+    if (!path.empty())
+    {
+        float *pixels = stbi_loadf(path.c_str(), &width, &height, &components, STBI_rgb);
+        if (!pixels)
+        {
+            std::cout << path << ": failed to load image" << std::endl;
+            return 1;
+        }
+        source.assign(pixels, pixels + 3 * size_t(width) * height);
+        stbi_image_free(pixels);
+    }
+    else
+    {
+        source.resize(3 * size_t(width) * height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                float *texel = &source[3 * (size_t(y) * width + x)];
+                texel[0] = 8.0f * x / width;
+                texel[1] = 100.0f * std::pow(1.0f - float(y) / height, 8.0f);
+                texel[2] = 0.5f;
+            }
+        }
+    }
+    const double sourceBytes = 12.0 * width * height;
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << ", source: " << width << "x"
+              << height << ", decode: " << timer.ElapsedMillis() << " ms, RGB32F "
+              << sourceBytes / (1 << 20) << " MB" << std::endl;
+
+    const std::pair<const char *, EnvironmentFormat> formats[] = {
+        {"rgba16f", EnvironmentFormat::Half}, {"e5b9g9r9", EnvironmentFormat::SharedExponent}};
+    for (const auto &format : formats)
+    {
+        settings.format = format.second;
+        const uint32_t w = static_cast<uint32_t>(width);
+        const uint32_t h = static_cast<uint32_t>(height);
+        EnvironmentMap equirect;
+        EnvironmentMap cubemap;
+        timer.Reset();
+        EnvironmentBaker::BakeEquirect(source.data(), w, h, settings, equirect);
+        float equirectTime = timer.ElapsedMillis();
+        timer.Reset();
+        if (settings.cubeFaceSize > 0)
+        {
+            EnvironmentBaker::BakeCubemap(source.data(), w, h, settings, cubemap);
+        }
+        float cubemapTime = timer.ElapsedMillis();
+
+        std::cout << "  " << format.first << ": equirect " << equirect.levels[0].width << "x"
+                  << equirect.levels[0].height << " with " << equirect.levels.size()
+                  << " levels " << equirect.texels.size() / double(1 << 20) << " MB ("
+                  << sourceBytes / equirect.texels.size() << "x smaller) in " << equirectTime
+                  << " ms, cubemap " << cubemap.texels.size() / double(1 << 20) << " MB in "
+                  << cubemapTime << " ms" << std::endl;
+
+        if (!path.empty() && format.second == EnvironmentBakeSettings().format)
+        {
+            timer.Reset();
+            TextureCache::Write(path, ".equirect", equirect);
+            TextureCache::Write(path, ".cube", cubemap);
+            float writeTime = timer.ElapsedMillis();
+            timer.Reset();
+            if (!TextureCache::Load(path, ".equirect", equirect) ||
+                !TextureCache::Load(path, ".cube", cubemap))
+            {
+                std::cout << path << ": failed to read the environment cache" << std::endl;
+                return 1;
+            }
+            std::cout << "    cache write: " << writeTime << " ms, read: " << timer.ElapsedMillis()
+                      << " ms" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Decodes Radiance images from memory with stb_image and with HdrDecoder to floats and halves,
+// and counts the floats that differ from stb_image
+static int BenchHdr(const std::vector<std::string> &args)
+{
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << std::endl;
+    for (const auto &path : args)
+    {
+        MappedFile file;
+        if (!file.Open(path) || file.GetSize() > INT_MAX)
+        {
+            std::cout << path << ": failed to read file" << std::endl;
+            return 1;
+        }
+
+        Timer timer;
+        int width, height, components;
+        float *reference = stbi_loadf_from_memory(
+            file.GetData(), static_cast<int>(file.GetSize()), &width, &height, &components, 3);
+        const float stbTime = timer.ElapsedMillis();
+        if (!reference)
+        {
+            std::cout << path << ": failed to load image" << std::endl;
+            return 1;
+        }
+
+        const double pixels = double(width) * height;
+        std::cout << path << ": " << width << "x" << height << std::endl;
+        std::cout << "  stb_image: " << stbTime << " ms, " << pixels / (stbTime * 1000.0)
+                  << " Mpix/s" << std::endl;
+        const std::pair<const char *, HdrFormat> formats[] = {{"float", HdrFormat::Float},
+                                                              {"half", HdrFormat::Half}};
+        for (const auto &format : formats)
+        {
+            HdrImage image;
+            timer.Reset();
+            if (!HdrDecoder::Decode(file.GetData(), file.GetSize(), format.second, image))
+            {
+                std::cout << path << ": failed to decode image" << std::endl;
+                stbi_image_free(reference);
+                return 1;
+            }
+            const float time = timer.ElapsedMillis();
+            std::cout << "  " << format.first << ": " << time << " ms, "
+                      << pixels / (time * 1000.0) << " Mpix/s, " << stbTime / time << "x";
+            if (format.second == HdrFormat::Float)
+            {
+                const float *floats = reinterpret_cast<const float *>(image.texels.data());
+                size_t differences = 0;
+                for (size_t i = 0; i < size_t(pixels) * 3; i++)
+                {
+                    differences += floats[i] != reference[i];
+                }
+                std::cout << ", " << differences << " floats differ";
+            }
+            std::cout << std::endl;
+        }
+        stbi_image_free(reference);
+    }
+    return 0;
+}
+
+// Runs the texture decode stage the asset registry uses with 1, 2, 4... threads up to the
+// hardware concurrency and reports the rate source files are read at, the rate RGBA8 mip chains
+// come out at and the most decoded data held at once
+static int BenchDecode(const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "decode: expected a budget and input images" << std::endl;
+        return 1;
+    }
+
+    TextureDecodeSettings settings;
+    settings.memoryBudget = std::stoull(args[0]) << 20;
+    const std::vector<std::string> paths(args.begin() + 1, args.end());
+    double sourceBytes = 0.0;
+    for (const auto &path : paths)
+    {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        sourceBytes += error ? 0.0 : double(size);
+    }
+
+    const uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::cout << "textures: " << paths.size() << ", source: " << sourceBytes / (1 << 20)
+              << " MB, budget: " << (settings.memoryBudget >> 20) << " MB" << std::endl;
+    for (uint32_t threads = 1;; threads = std::min(threads * 2, maxThreads))
+    {
+        ThreadPool pool(threads - 1);
+        double decodedBytes = 0.0;
+        size_t peakBytes;
+        Timer timer;
+        {
+            TextureDecoder decoder(paths, settings, pool);
+            DecodedTexture texture;
+            while (decoder.Pop(texture))
+            {
+                decodedBytes += double(texture.bytes);
+            }
+            peakBytes = decoder.GetPeakBytes();
+        }
+        float time = timer.ElapsedMillis();
+        std::cout << "  " << threads << " threads: " << time << " ms, "
+                  << sourceBytes / (1 << 20) * 1000.0 / time << " MB/s read, "
+                  << decodedBytes / (1 << 20) * 1000.0 / time << " MB/s decoded, peak "
+                  << (peakBytes >> 20) << " MB" << std::endl;
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Hashes every file either mapped from disk or decompressed from the archive, the files in
+// parallel as the asset registry loads them and the blocks of each archived file in parallel
+static float ReadBenchFiles(const std::vector<std::string> &paths, const AssetArchive *archive,
+                            std::vector<uint64_t> &hashes)
+{
+    hashes.assign(paths.size(), 0);
+    Timer timer;
+    ThreadPool::Get().ParallelFor(paths.size(), [&](size_t i) {
+        if (archive)
+        {
+            const AssetArchiveEntry *entry = archive->Find(paths[i]);
+            std::vector<uint8_t> data(entry ? static_cast<size_t>(entry->size) : 0);
+            if (entry && archive->Read(*entry, data.data()) == data.size())
+            {
+                hashes[i] = HashData(data.data(), data.size());
+            }
+        }
+        else
+        {
+            MappedFile file;
+            hashes[i] = file.Open(paths[i]) ? HashData(file.GetData(), file.GetSize())
+                                            : HashData(nullptr, 0);
+        }
+    });
+    return timer.ElapsedMillis();
+}
+
+// Packs the files, and the files under the directories, into the archive and compares reading
+// them loose against reading them from the archive. The first pass of each is cold as far as
+// the OS file cache does not hold the files yet, the warm time is the best of the passes after
+// it. Without inputs the existing archive is compared against the loose files of its entries.
+static int BenchArchive(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "archive: expected an archive path" << std::endl;
+        return 1;
+    }
+
+    const std::string archivePath = args[0];
+    std::vector<std::string> paths;
+    std::unordered_set<std::string> names;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        std::vector<std::string> inputs;
+        if (std::filesystem::is_directory(args[i]))
+        {
+            for (const auto &file : std::filesystem::recursive_directory_iterator(args[i]))
+            {
+                if (file.is_regular_file())
+                {
+                    inputs.push_back(file.path().generic_string());
+                }
+            }
+            std::sort(inputs.begin(), inputs.end());
+        }
+        else
+        {
+            inputs.push_back(args[i]);
+        }
+        for (const auto &input : inputs)
+        {
+            if (names.insert(AssetArchive::GetEntryName(input)).second)
+            {
+                paths.push_back(input);
+            }
+        }
+    }
+
+    AssetArchive archive;
+    std::string error;
+    if (paths.empty())
+    {
+        if (!archive.Open(archivePath, error))
+        {
+            std::cout << error << std::endl;
+            return 1;
+        }
+        for (const auto &entry : archive.GetEntries())
+        {
+            paths.push_back(entry.name);
+        }
+    }
+
+    std::cout << "threads: " << ThreadPool::Get().GetConcurrency() << std::endl;
+    // Packing reads every file, so the loose files are read first to see them cold
+    std::vector<uint64_t> looseHashes, archiveHashes;
+    const float looseFirst = ReadBenchFiles(paths, nullptr, looseHashes);
+    if (!names.empty())
+    {
+        Timer timer;
+        if (!AssetArchive::Write(archivePath, paths, error) || !archive.Open(archivePath, error))
+        {
+            std::cout << error << std::endl;
+            return 1;
+        }
+        std::cout << "packed in " << timer.ElapsedMillis() << " ms" << std::endl;
+    }
+    const float archiveFirst = ReadBenchFiles(paths, &archive, archiveHashes);
+    const bool identical = archiveHashes == looseHashes;
+
+    float looseWarm = FLT_MAX;
+    float archiveWarm = FLT_MAX;
+    std::vector<uint64_t> hashes;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        looseWarm = std::min(looseWarm, ReadBenchFiles(paths, nullptr, hashes));
+        archiveWarm = std::min(archiveWarm, ReadBenchFiles(paths, &archive, hashes));
+    }
+
+    double looseBytes = 0.0;
+    double storedBytes = 0.0;
+    for (const auto &entry : archive.GetEntries())
+    {
+        looseBytes += double(entry.size);
+        storedBytes += double(archive.GetStoredSize(entry));
+    }
+    const double megabytes = looseBytes / (1 << 20);
+    std::cout << "files: " << paths.size() << ", " << megabytes << " MB loose, "
+              << storedBytes / (1 << 20) << " MB in the archive ("
+              << looseBytes / std::max(storedBytes, 1.0) << "x)"
+              << (identical ? "" : ", ARCHIVE DIFFERS FROM LOOSE FILES") << std::endl;
+    std::cout << "  loose:   cold " << looseFirst << " ms, warm " << looseWarm << " ms ("
+              << megabytes * 1000.0 / looseWarm << " MB/s)" << std::endl;
+    std::cout << "  archive: cold " << archiveFirst << " ms, warm " << archiveWarm << " ms ("
+              << megabytes * 1000.0 / archiveWarm << " MB/s)" << std::endl;
+    return identical ? 0 : 1;
+}
+
+// Reports the vertex cache and vertex fetch efficiency of each mesh as parsed and after
+// MeshOptimizer, measured with the cache size it optimizes for and with twice that
+static int BenchMeshOptimizer(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "mesh-opt: no input files" << std::endl;
+        return 1;
+    }
+
+    for (const auto &path : args)
+    {
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        const VertexCacheStats largeBefore = MeshOptimizer::AnalyzeVertexCache(
+            mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), 2 * VERTEX_CACHE_SIZE);
+
+        Timer timer;
+        MeshOptimizeReport report;
+        MeshOptimizer::Optimize(mesh, &report);
+        float optimizeTime = timer.ElapsedMillis();
+        const VertexCacheStats largeAfter = MeshOptimizer::AnalyzeVertexCache(
+            mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), 2 * VERTEX_CACHE_SIZE);
+
+        std::cout << path << ": " << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles, " << report.clusters
+                  << " clusters, optimized in " << optimizeTime << " ms" << std::endl;
+        std::cout << "  cache " << VERTEX_CACHE_SIZE << ": ACMR " << report.cacheBefore.acmr
+                  << " -> " << report.cacheAfter.acmr << ", ATVR " << report.cacheBefore.atvr
+                  << " -> " << report.cacheAfter.atvr << std::endl;
+        std::cout << "  cache " << 2 * VERTEX_CACHE_SIZE << ": ACMR " << largeBefore.acmr
+                  << " -> " << largeAfter.acmr << ", ATVR " << largeBefore.atvr << " -> "
+                  << largeAfter.atvr << std::endl;
+        std::cout << "  overfetch: " << report.overfetchBefore << " -> " << report.overfetchAfter
+                  << ", unused vertices removed: " << report.removedVertices << std::endl;
+    }
+    return 0;
+}
+
+// Builds the meshlets of each mesh and culls them from cameras spread over a sphere around it,
+// once from far enough to see the whole mesh and once from close up, and reports the share of
+// triangles each test rejects
+static int BenchMeshlets(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "meshlets: no input files" << std::endl;
+        return 1;
+    }
+
+    const uint32_t viewCount = 64;
+    for (const auto &path : args)
+    {
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        MeshOptimizer::Optimize(mesh);
+        Timer timer;
+        MeshletBuilder::Build(mesh);
+        float buildTime = timer.ElapsedMillis();
+        const MeshletStats meshletStats = MeshletBuilder::GetStats(mesh.meshlets);
+
+        glm::vec3 minimum(FLT_MAX);
+        glm::vec3 maximum(-FLT_MAX);
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            minimum = glm::min(minimum, vertex.pos);
+            maximum = glm::max(maximum, vertex.pos);
+        }
+        const glm::vec3 center = (minimum + maximum) * 0.5f;
+        const float radius = std::max(glm::length(maximum - center), 1e-6f);
+
+        std::cout << path << ": " << mesh.indices.size() / 3 << " triangles, "
+                  << meshletStats.meshlets << " meshlets built in " << buildTime << " ms"
+                  << std::endl;
+        std::cout << "  per meshlet: " << meshletStats.triangles << " triangles, "
+                  << meshletStats.vertices << " vertices, "
+                  << 100.0f * meshletStats.cullableMeshlets / std::max(meshletStats.meshlets, 1u)
+                  << "% with a usable cone" << std::endl;
+
+        for (float distance : {3.0f, 1.2f})
+        {
+            MeshletCullStats stats;
+            std::vector<IndexRange> ranges;
+            timer.Reset();
+            for (uint32_t i = 0; i < viewCount; ++i)
+            {
+                // Fibonacci sphere
+                const float y = 1.0f - 2.0f * (i + 0.5f) / viewCount;
+                const float phi = i * 2.39996323f;
+                const float r = std::sqrt(1.0f - y * y);
+                const glm::vec3 eye =
+                    center + glm::vec3(r * std::cos(phi), y, r * std::sin(phi)) * radius * distance;
+                const glm::vec3 up = std::abs(y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+                const glm::mat4 projection =
+                    glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f * radius,
+                                     10.0f * radius);
+                const CullView view =
+                    MeshletCuller::CreateView(projection * glm::lookAt(eye, center, up), eye);
+                ranges.clear();
+                MeshletCuller::Cull(mesh.meshlets, glm::mat4(1.0f), glm::mat4(1.0f), view, ranges,
+                                    &stats);
+            }
+            float cullTime = timer.ElapsedMillis() / viewCount;
+            const double triangles = double(std::max<uint64_t>(stats.triangles, 1));
+            std::cout << "  camera at " << distance << "x radius: "
+                      << 100.0 * stats.GetRejectionRate() << "% rejected (frustum "
+                      << 100.0 * stats.frustumCulledTriangles / triangles << "%, cone "
+                      << 100.0 * stats.coneCulledTriangles / triangles << "%), "
+                      << double(stats.ranges) / viewCount << " draws, " << cullTime
+                      << " ms per view" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Builds the levels of detail of each mesh, then flies a camera with the view of Sandbox3D over a
+// 5x5 grid of instances, from inside the grid out to 6000 units at 1080p, and reports how many
+// triangles the selected levels draw instead of the full meshes
+static int BenchLods(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "lods: no input files" << std::endl;
+        return 1;
+    }
+
+    const uint32_t frameCount = 600;
+    const uint32_t gridSize = 5;
+    for (const auto &path : args)
+    {
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        MeshOptimizer::Optimize(mesh);
+        Timer timer;
+        MeshSimplifier::BuildLods(mesh);
+        float buildTime = timer.ElapsedMillis();
+
+        ObjModel model;
+        model.indicesCount = mesh.lods.empty() ? 0 : mesh.lods[0].indexCount;
+        model.lods = mesh.lods;
+        glm::vec3 minimum(FLT_MAX);
+        glm::vec3 maximum(-FLT_MAX);
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            minimum = glm::min(minimum, vertex.pos);
+            maximum = glm::max(maximum, vertex.pos);
+        }
+        model.boundsCenter = (minimum + maximum) * 0.5f;
+        model.boundsRadius = std::max(glm::length(maximum - minimum) * 0.5f, 1e-6f);
+
+        std::cout << path << ": " << model.indicesCount / 3 << " triangles, "
+                  << mesh.lods.size() << " levels built in " << buildTime << " ms" << std::endl;
+        for (size_t i = 1; i < mesh.lods.size(); ++i)
+        {
+            std::cout << "  level " << i << ": " << mesh.lods[i].indexCount / 3
+                      << " triangles, error " << mesh.lods[i].error << " ("
+                      << 100.0f * mesh.lods[i].error / model.boundsRadius << "% of the radius)"
+                      << std::endl;
+        }
+
+        // Instances spaced four radii apart, scaled to the size of the Sphere.obj in the sandbox
+        const float scale = 1.0f / model.boundsRadius;
+        std::vector<glm::mat4> instances;
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            for (uint32_t z = 0; z < gridSize; ++z)
+            {
+                const glm::vec3 offset = glm::vec3(x, 0.0f, z) * 4.0f - model.boundsCenter * scale;
+                instances.push_back(glm::scale(glm::translate(glm::mat4(1.0f), offset),
+                                               glm::vec3(scale)));
+            }
+        }
+
+        const glm::mat4 projection =
+            glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 6000.0f);
+        const glm::vec3 target = glm::vec3(gridSize - 1) * glm::vec3(2.0f, 0.0f, 2.0f);
+        LodStats total;
+        LodStats far;
+        timer.Reset();
+        for (uint32_t frame = 0; frame < frameCount; ++frame)
+        {
+            // Distance grows geometrically, so each decade of it gets the same number of frames
+            const float distance = 2.0f * std::pow(3000.0f, float(frame) / (frameCount - 1));
+            const glm::vec3 eye = target + glm::normalize(glm::vec3(-1.0f, 0.5f, -1.0f)) * distance;
+            const LodView view = LodSelector::CreateView(projection, eye, 1080);
+            for (const glm::mat4 &instance : instances)
+            {
+                LodSelector::Select(model, instance, view, distance > 100.0f ? &far : &total);
+            }
+        }
+        float selectTime = timer.ElapsedMillis() / frameCount;
+        const LodStats near = total;
+        total.instances += far.instances;
+        total.reducedInstances += far.reducedInstances;
+        total.fullTriangles += far.fullTriangles;
+        total.triangles += far.triangles;
+        std::cout << "  fly-through: " << 100.0f * total.GetSavings() << "% fewer triangles ("
+                  << 100.0f * near.GetSavings() << "% within 100 units, "
+                  << 100.0f * far.GetSavings() << "% beyond), "
+                  << 100.0 * total.reducedInstances / std::max<uint64_t>(total.instances, 1)
+                  << "% of instances reduced, " << selectTime << " ms per frame" << std::endl;
+    }
+    return 0;
+}
+
+// Compares the memory of both vertex layouts, the bytes the acceleration structure build strides
+// over, the bytes fetched per closest hit and per rasterized vertex, and the precision the
+// packed attributes lose
+static int BenchVertexLayout(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "vertex-layout: no input files" << std::endl;
+        return 1;
+    }
+
+    for (const auto &path : args)
+    {
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        const MeshView view = mesh.GetView();
+
+        Timer timer;
+        PackedMesh packed;
+        VertexPacker::Pack(view, packed);
+        float packTime = timer.ElapsedMillis();
+        const VertexPackingError error = VertexPacker::MeasureError(view, packed);
+
+        const double vertices = view.verticesCount;
+        const double triangles = view.indicesCount / 3;
+        const double fullBytes = sizeof(Vertex) * vertices;
+        const double packedBytes = sizeof(glm::vec3) * vertices + sizeof(PackedVertex) * vertices +
+                                   sizeof(uint32_t) * triangles;
+        const double indexBytes = sizeof(uint32_t) * view.indicesCount;
+        // The full closest hit reads all three vertices, the packed one their attributes and
+        // the material of the triangle but takes the position from the ray
+        const size_t fullHitBytes = 3 * sizeof(Vertex);
+        const size_t packedHitBytes = 3 * sizeof(PackedVertex) + sizeof(uint32_t);
+
+        std::cout << path << ": " << view.verticesCount << " vertices, " << triangles
+                  << " triangles, packed in " << packTime << " ms" << std::endl;
+        std::cout << "  vertex data: full " << fullBytes / (1 << 20) << " MB, packed "
+                  << packedBytes / (1 << 20) << " MB (" << 100.0 * packedBytes / fullBytes
+                  << "%), indices " << indexBytes / (1 << 20) << " MB" << std::endl;
+        std::cout << "  acceleration structure input: stride " << sizeof(Vertex) << " -> "
+                  << sizeof(glm::vec3) << " bytes, " << fullBytes / (1 << 20) << " -> "
+                  << sizeof(glm::vec3) * vertices / (1 << 20) << " MB" << std::endl;
+        std::cout << "  closest hit fetch: " << fullHitBytes << " -> " << packedHitBytes
+                  << " bytes, vertex fetch: " << sizeof(Vertex) << " -> "
+                  << sizeof(glm::vec3) + sizeof(PackedVertex) << " bytes" << std::endl;
+        std::cout << "  max error: normal " << error.normal << " deg, texCoord " << error.texCoord
+                  << ", color " << error.color << ", mixed material triangles "
+                  << error.mixedMaterialTriangles << std::endl;
+    }
+    return 0;
+}
+
+// Builds the BVH of each mesh with several bin counts, the tree is the same whichever tasks
+// finish first
+static int BenchBvh(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "bvh: no input files" << std::endl;
+        return 1;
+    }
+
+    for (const auto &path : args)
+    {
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        const MeshView view = mesh.GetView();
+        const uint32_t triangles = view.indicesCount / 3;
+        std::cout << path << ": " << triangles << " triangles, "
+                  << ThreadPool::Get().GetConcurrency() << " threads" << std::endl;
+
+        for (uint32_t binCount : {8u, 16u, 32u})
+        {
+            BvhSettings settings;
+            settings.binCount = binCount;
+            Bvh bvh;
+            Timer timer;
+            BvhBuilder::Build(view, bvh, settings);
+            float buildTime = timer.ElapsedMillis();
+            const BvhStats stats = BvhBuilder::GetStats(bvh, settings);
+
+            std::cout << "  " << binCount << " bins: " << buildTime << " ms, "
+                      << triangles / (buildTime * 1000.0f) << " Mtris/s, SAH cost "
+                      << stats.sahCost << std::endl;
+            std::cout << "    " << stats.nodes << " nodes, " << stats.leaves << " leaves of "
+                      << stats.averageLeafTriangles << " triangles, depth " << stats.depth
+                      << ", nodes " << stats.nodeBytes / double(1 << 20) << " MB ("
+                      << double(stats.nodeBytes) / std::max(triangles, 1u)
+                      << " bytes per triangle)" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Twists a mesh further around its vertical axis every frame
+static void TwistMesh(const MeshData &mesh, float turns, MeshData &twisted)
+{
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (const Vertex &vertex : mesh.vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+    const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    const float height = std::max(boundsMax.y - boundsMin.y, 1e-6f);
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const glm::vec3 &position = mesh.vertices[i].pos;
+        const float angle = turns * 6.2831853f * (position.y - center.y) / height;
+        const float x = position.x - center.x;
+        const float z = position.z - center.z;
+        twisted.vertices[i].pos = glm::vec3(center.x + x * std::cos(angle) - z * std::sin(angle),
+                                            position.y,
+                                            center.z + x * std::sin(angle) + z * std::cos(angle));
+    }
+}
+
+// Compares the SAH and LBVH builders, then twists each mesh a bit more every frame and keeps its
+// BVH up to date by rebuilding it, by refitting until the SAH cost grew by half and by only
+// refitting. The frames of the default BvhUpdater policy are printed one by one.
+static int BenchBvhUpdate(const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "bvh-update: expected a frame count and input files" << std::endl;
+        return 1;
+    }
+
+    const uint32_t frames = std::max(static_cast<uint32_t>(std::stoul(args[0])), 1u);
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        const std::string &path = args[i];
+        MeshData mesh = ObjModel::LoadMeshData(path);
+        const MeshView view = mesh.GetView();
+        const uint32_t triangles = view.indicesCount / 3;
+        std::cout << path << ": " << triangles << " triangles, "
+                  << ThreadPool::Get().GetConcurrency() << " threads" << std::endl;
+
+        for (BvhBuildMethod method : {BvhBuildMethod::Sah, BvhBuildMethod::Lbvh})
+        {
+            Bvh bvh;
+            Timer timer;
+            if (method == BvhBuildMethod::Sah)
+            {
+                BvhBuilder::Build(view, bvh);
+            }
+            else
+            {
+                LbvhBuilder::Build(view, bvh);
+            }
+            const float buildTime = timer.ElapsedMillis();
+            const BvhStats stats = BvhBuilder::GetStats(bvh);
+            timer.Reset();
+            const float refitCost = BvhBuilder::Refit(view, bvh);
+            const float refitTime = timer.ElapsedMillis();
+            std::cout << "  " << (method == BvhBuildMethod::Sah ? "SAH" : "LBVH") << ": "
+                      << buildTime << " ms, " << triangles / (buildTime * 1000.0f)
+                      << " Mtris/s, SAH cost " << stats.sahCost << ", " << stats.nodes
+                      << " nodes, depth " << stats.depth << ", refit " << refitTime
+                      << " ms (SAH cost " << refitCost << ")" << std::endl;
+        }
+
+        // Rebuilding every frame skips the refit the updater measures the tree with
+        {
+            MeshData twisted = mesh;
+            Bvh bvh;
+            float totalTime = 0.0f;
+            double totalSahCost = 0.0;
+            for (uint32_t frame = 1; frame <= frames; frame++)
+            {
+                TwistMesh(mesh, 0.5f * frame / frames, twisted);
+                Timer timer;
+                LbvhBuilder::Build(twisted.GetView(), bvh);
+                totalTime += timer.ElapsedMillis();
+                totalSahCost += BvhBuilder::GetStats(bvh).sahCost;
+            }
+            std::cout << "  LBVH every frame: " << totalTime / frames << " ms per frame, "
+                      << "average SAH cost " << totalSahCost / frames << std::endl;
+        }
+
+        for (float maxSahGrowth : {1.5f, FLT_MAX})
+        {
+            BvhUpdateSettings settings;
+            settings.maxSahGrowth = maxSahGrowth;
+            BvhUpdater updater(settings);
+            MeshData twisted = mesh;
+            Bvh bvh;
+            updater.Build(twisted.GetView(), bvh);
+
+            const bool printFrames = maxSahGrowth != FLT_MAX;
+            float totalTime = 0.0f;
+            double totalSahCost = 0.0;
+            uint32_t rebuilds = 0;
+            for (uint32_t frame = 1; frame <= frames; frame++)
+            {
+                TwistMesh(mesh, 0.5f * frame / frames, twisted);
+                const BvhUpdateStats &stats = updater.Update(twisted.GetView(), bvh);
+                totalTime += stats.refitMillis + stats.buildMillis;
+                totalSahCost += stats.sahCost;
+                rebuilds += stats.rebuilt ? 1 : 0;
+                if (printFrames)
+                {
+                    std::cout << "    frame " << frame << ": refit " << stats.refitMillis
+                              << " ms, ";
+                    if (stats.rebuilt)
+                    {
+                        std::cout << "rebuilt " << stats.buildMillis << " ms, ";
+                    }
+                    std::cout << "SAH cost " << stats.sahCost << " (" << stats.sahGrowth
+                              << "x)" << std::endl;
+                }
+            }
+            if (printFrames)
+            {
+                std::cout << "  refit until " << maxSahGrowth << "x: ";
+            }
+            else
+            {
+                std::cout << "  refit only: ";
+            }
+            std::cout << totalTime / frames << " ms per frame, " << rebuilds
+                      << " rebuilds, average SAH cost " << totalSahCost / frames << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Sphere of rings * rings * 2 triangles whose radius ripples along both angles, so that the
+// triangles do not all line up with the axes
+static void BuildStressMesh(uint32_t rings, MeshData &mesh)
+{
+    const float pi = 3.14159265f;
+    const uint32_t columns = rings + 1;
+    mesh.vertices.resize(size_t(rings + 1) * columns);
+    for (uint32_t row = 0; row <= rings; row++)
+    {
+        const float theta = pi * row / rings;
+        for (uint32_t column = 0; column < columns; column++)
+        {
+            const float phi = 2.0f * pi * column / rings;
+            const float radius = 1.0f + 0.05f * std::sin(13.0f * theta) * std::sin(17.0f * phi);
+            Vertex &vertex = mesh.vertices[size_t(row) * columns + column];
+            vertex = {};
+            vertex.pos = radius * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                                            std::sin(theta) * std::sin(phi));
+        }
+    }
+    mesh.indices.clear();
+    mesh.indices.reserve(size_t(rings) * rings * 6);
+    for (uint32_t row = 0; row < rings; row++)
+    {
+        for (uint32_t column = 0; column < rings; column++)
+        {
+            const uint32_t corner = row * columns + column;
+            for (uint32_t index : {corner, corner + columns, corner + 1, corner + 1,
+                                   corner + columns, corner + columns + 1})
+            {
+                mesh.indices.push_back(index);
+            }
+        }
+    }
+}
+
+static void PrintBvhMemory(const char *name, size_t nodeBytes, size_t triangleBytes,
+                           size_t triangles)
+{
+    std::cout << "    " << name << ": nodes " << nodeBytes / double(1 << 20) << " MB, triangles "
+              << triangleBytes / double(1 << 20) << " MB, "
+              << double(nodeBytes + triangleBytes) / std::max<size_t>(triangles, 1)
+              << " bytes per triangle" << std::endl;
+}
+
+// Traces a 640x360 view of each mesh with every traversal kernel the CPU supports, then the
+// reflection and refraction rays spawned where the view hit it. Primary rays come in the 4x4
+// pixel tiles CpuRaytracer::Render packs, secondary rays keep the order of their pixels.
+// "stress" instead of a file traces a rippled sphere of 10.6M triangles.
+static int BenchTraversal(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "traversal: no input files" << std::endl;
+        return 1;
+    }
+
+    const SimdLevel simdLevel = BvhTraversal::GetSimdLevel();
+    std::cout << "SIMD level " << BvhTraversal::GetName(simdLevel) << ", "
+              << ThreadPool::Get().GetConcurrency() << " threads" << std::endl;
+
+    const uint32_t width = 640;
+    const uint32_t height = 360;
+    for (const auto &path : args)
+    {
+        MeshData mesh;
+        if (path == "stress")
+        {
+            BuildStressMesh(2304, mesh);
+        }
+        else
+        {
+            mesh = ObjModel::LoadMeshData(path);
+        }
+        Bvh bvh;
+        BvhBuilder::Build(mesh.GetView(), bvh);
+        if (bvh.nodes.empty())
+        {
+            std::cout << path << ": no triangles" << std::endl;
+            continue;
+        }
+
+        Timer timer;
+        WideBvh4 bvh4;
+        WideBvhBuilder::Build(bvh, bvh4);
+        const float build4Time = timer.ElapsedMillis();
+        timer.Reset();
+        WideBvh8 bvh8;
+        WideBvhBuilder::Build(bvh, bvh8);
+        const float build8Time = timer.ElapsedMillis();
+        timer.Reset();
+        CompressedBvh compressed;
+        CompressedBvhBuilder::Build(bvh8, compressed);
+        const float compressTime = timer.ElapsedMillis();
+        const size_t triangles = bvh.indices.size() / 3;
+        std::cout << path << ": " << triangles << " triangles, binary depth " << bvh.depth
+                  << std::endl;
+        std::cout << "  4 wide: " << bvh4.nodes.size() << " nodes, " << bvh4.blocks.size()
+                  << " triangle blocks, depth " << bvh4.depth << ", " << build4Time << " ms"
+                  << std::endl;
+        std::cout << "  8 wide: " << bvh8.nodes.size() << " nodes, " << bvh8.blocks.size()
+                  << " triangle blocks, depth " << bvh8.depth << ", " << build8Time << " ms"
+                  << std::endl;
+        std::cout << "  compressed 8 wide: " << compressed.nodes.size() << " nodes, "
+                  << compressed.blocks.size() << " triangle blocks, " << compressTime
+                  << " ms from the 8 wide BVH" << std::endl;
+
+        // What each traversal reads, the binary BVH reads triangles through its indices
+        std::cout << "  memory" << std::endl;
+        PrintBvhMemory("binary", bvh.nodes.size() * sizeof(BvhNode),
+                       bvh.positions.size() * sizeof(glm::vec3) +
+                           bvh.indices.size() * sizeof(uint32_t),
+                       triangles);
+        PrintBvhMemory("4 wide", bvh4.nodes.size() * sizeof(WideBvhNode<4>),
+                       bvh4.blocks.size() * sizeof(TriangleBlock<4>), triangles);
+        PrintBvhMemory("8 wide", bvh8.nodes.size() * sizeof(WideBvhNode<8>),
+                       bvh8.blocks.size() * sizeof(TriangleBlock<8>), triangles);
+        PrintBvhMemory("compressed 8 wide", compressed.nodes.size() * sizeof(CompressedBvhNode),
+                       compressed.blocks.size() * sizeof(TriangleBlock<COMPRESSED_BLOCK_WIDTH>),
+                       triangles);
+
+        // Looks at the mesh from the front and a little above, it fills most of the view
+        const BvhNode &root = bvh.nodes[0];
+        const glm::vec3 center = (root.boundsMin + root.boundsMax) * 0.5f;
+        const float radius = std::max(glm::length(root.boundsMax - root.boundsMin) * 0.5f, 1e-3f);
+        PerspectiveCamera camera(glm::radians(45.0f), float(width) / height, 0.1f, 6000.0f);
+        camera.SetPosition(center + glm::vec3(0.0f, 0.5f, -2.5f) * radius, center);
+        const glm::mat4 viewInverse = glm::inverse(camera.GetViewMatrix());
+        const glm::mat4 projectionInverse = glm::inverse(camera.GetProjectionMatrix());
+
+        std::vector<TraversalRay> primary;
+        primary.reserve(size_t(width) * height);
+        for (uint32_t tileY = 0; tileY < height; tileY += 4)
+        {
+            for (uint32_t tileX = 0; tileX < width; tileX += 4)
+            {
+                for (uint32_t y = tileY; y < tileY + 4; y++)
+                {
+                    for (uint32_t x = tileX; x < tileX + 4; x++)
+                    {
+                        primary.push_back(CpuRaytracer::GetPrimaryRay(
+                            viewInverse, projectionInverse, x, y, width, height, 0));
+                    }
+                }
+            }
+        }
+
+        // Secondary rays leave the hits about the geometric normal facing the ray, refraction
+        // enters glass like the illum 3 materials of raytrace_rchit
+        std::vector<TraversalHit> primaryHits(primary.size());
+        ThreadPool::Get().ParallelFor(primary.size(), [&](size_t i) {
+            BvhTraversal::Intersect(bvh, primary[i], primaryHits[i]);
+        });
+        const float epsilon = radius * 1e-5f;
+        std::vector<TraversalRay> reflected;
+        std::vector<TraversalRay> refracted;
+        for (size_t i = 0; i < primary.size(); i++)
+        {
+            const TraversalHit &hit = primaryHits[i];
+            if (hit.triangle == UINT32_MAX)
+            {
+                continue;
+            }
+            const uint32_t *indices = bvh.indices.data() + size_t(hit.triangle) * 3;
+            const glm::vec3 &p0 = bvh.positions[indices[0]];
+            glm::vec3 normal = glm::normalize(
+                glm::cross(bvh.positions[indices[1]] - p0, bvh.positions[indices[2]] - p0));
+            const glm::vec3 &direction = primary[i].direction;
+            if (glm::dot(normal, direction) > 0.0f)
+            {
+                normal = -normal;
+            }
+            const glm::vec3 position = primary[i].origin + direction * hit.t;
+            reflected.push_back({position, epsilon, glm::reflect(direction, normal), FLT_MAX});
+            refracted.push_back(
+                {position, epsilon, glm::refract(direction, normal, 1.0f / 1.3f), FLT_MAX});
+        }
+
+        typedef std::function<void(const TraversalRay *, uint32_t, TraversalHit *)> Kernel;
+        std::vector<std::pair<const char *, Kernel>> kernels = {
+            {"scalar binary",
+             [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                 for (uint32_t i = 0; i < count; i++)
+                 {
+                     BvhTraversal::Intersect(bvh, rays[i], hits[i]);
+                 }
+             }},
+            {"SSE 4 wide",
+             [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                 for (uint32_t i = 0; i < count; i++)
+                 {
+                     BvhTraversal::Intersect(bvh4, rays[i], hits[i]);
+                 }
+             }},
+            {"SSE packet",
+             [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                 BvhTraversal::IntersectPacket(bvh, rays, count, hits, SimdLevel::SSE);
+             }},
+            {"SSE compressed",
+             [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                 for (uint32_t i = 0; i < count; i++)
+                 {
+                     BvhTraversal::Intersect(compressed, rays[i], hits[i], SimdLevel::SSE);
+                 }
+             }}};
+        if (simdLevel == SimdLevel::AVX2)
+        {
+            kernels.push_back({"AVX2 8 wide",
+                               [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                                   for (uint32_t i = 0; i < count; i++)
+                                   {
+                                       BvhTraversal::Intersect(bvh8, rays[i], hits[i]);
+                                   }
+                               }});
+            kernels.push_back({"AVX2 packet",
+                               [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                                   BvhTraversal::IntersectPacket(bvh, rays, count, hits,
+                                                                 SimdLevel::AVX2);
+                               }});
+            kernels.push_back({"AVX2 compressed",
+                               [&](const TraversalRay *rays, uint32_t count, TraversalHit *hits) {
+                                   for (uint32_t i = 0; i < count; i++)
+                                   {
+                                       BvhTraversal::Intersect(compressed, rays[i], hits[i],
+                                                               SimdLevel::AVX2);
+                                   }
+                               }});
+        }
+
+        const std::pair<const char *, const std::vector<TraversalRay> *> raySets[] = {
+            {"primary", &primary}, {"reflection", &reflected}, {"refraction", &refracted}};
+        for (const auto &[setName, rays] : raySets)
+        {
+            std::cout << "  " << setName << ", " << rays->size() << " rays" << std::endl;
+            const size_t packetCount =
+                (rays->size() + TRAVERSAL_PACKET_SIZE - 1) / TRAVERSAL_PACKET_SIZE;
+            for (const auto &[kernelName, kernel] : kernels)
+            {
+                std::vector<TraversalHit> hits(rays->size());
+                timer.Reset();
+                ThreadPool::Get().ParallelFor(packetCount, [&](size_t packet) {
+                    const size_t first = packet * TRAVERSAL_PACKET_SIZE;
+                    const size_t count =
+                        std::min<size_t>(TRAVERSAL_PACKET_SIZE, rays->size() - first);
+                    kernel(rays->data() + first, static_cast<uint32_t>(count),
+                           hits.data() + first);
+                });
+                const float traceTime = timer.ElapsedMillis();
+
+                const size_t hitCount =
+                    std::count_if(hits.begin(), hits.end(), [](const TraversalHit &hit) {
+                        return hit.triangle != UINT32_MAX;
+                    });
+                std::cout << "    " << kernelName << ": " << traceTime << " ms, "
+                          << rays->size() / (std::max(traceTime, 1e-3f) * 1000.0f)
+                          << " Mrays/s, " << hitCount << " hits" << std::endl;
+            }
+        }
+    }
+    return 0;
+}
+
+// Renders the scene Sandbox3D starts with from its first camera position on the CPU, then writes
+// the storage image as <output>.pfm and what the post pass presents as <output>.png
+static int BenchCpuRaytrace(const std::vector<std::string> &args)
+{
+    if (args.empty())
+    {
+        std::cout << "raytrace: no output file" << std::endl;
+        return 1;
+    }
+
+    const std::string &output = args[0];
+    const uint32_t width = args.size() > 1 ? static_cast<uint32_t>(std::stoul(args[1])) : 1920;
+    const uint32_t height = args.size() > 2 ? static_cast<uint32_t>(std::stoul(args[2])) : 1080;
+    CpuRaytraceSettings settings;
+    settings.samples = args.size() > 3 ? static_cast<uint32_t>(std::stoul(args[3])) : 1;
+    settings.hdr = args.size() > 4 && args[4] == "hdr";
+
+    Timer timer;
+    CpuRaytracer raytracer;
+    raytracer.LoadModels({"models/Sphere.obj", "models/plane.obj", "models/wuson.obj"});
+    raytracer.LoadSkyspheres();
+
+    std::vector<ObjInstance> instances;
+    for (const auto &[model, translation] :
+         {std::pair<uint32_t, glm::vec3>{0, {-5.0f, 0.0f, 0.0f}},
+          std::pair<uint32_t, glm::vec3>{2, {-2.0f, -1.0f, 0.0f}},
+          std::pair<uint32_t, glm::vec3>{1, {0.0f, -1.1f, 0.0f}}})
+    {
+        const glm::mat4 matrix = glm::translate(glm::mat4(1.0f), translation);
+        instances.push_back({model, matrix, glm::inverseTranspose(matrix), 0});
+    }
+    raytracer.SetInstances(instances);
+    std::cout << "scene loaded in " << timer.ElapsedMillis() << " ms, "
+              << ThreadPool::Get().GetConcurrency() << " threads" << std::endl;
+
+    PerspectiveCamera camera(glm::radians(45.0f), float(width) / height, 0.1f, 6000.0f);
+    camera.SetPosition({-6, 0, -5}, {-5, 0, 0});
+
+    std::vector<float> image;
+    CpuRaytraceStats stats;
+    raytracer.Render(glm::inverse(camera.GetViewMatrix()),
+                     glm::inverse(camera.GetProjectionMatrix()), width, height, settings, image,
+                     &stats);
+    std::cout << width << "x" << height << ", " << settings.samples << " samples: "
+              << stats.milliseconds << " ms, " << stats.rays << " rays, "
+              << stats.GetMraysPerSecond() << " Mrays/s" << std::endl;
+
+    std::vector<uint8_t> pixels;
+    CpuRaytracer::ToDisplay(image, pixels);
+    if (!ImageWriter::WritePfm(output + ".pfm", width, height, image.data()) ||
+        !ImageWriter::WritePng(output + ".png", width, height, pixels.data()))
+    {
+        std::cout << output << ": failed to write the images" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+bool Benchmark::IsRequested(int argc, char **argv)
+{
+    return argc > 1 && std::string(argv[1]) == "--bench";
+}
+
+int Benchmark::Run(int argc, char **argv)
+{
+    static const BenchmarkEntry benchmarks[] = {
+        {"mesh-cache", "<file.obj>...", &BenchMeshCache},
+        {"obj-parser", "<file.obj>...", &BenchObjParser},
+        {"obj-stream", "<budgetMB> <file.obj>...", &BenchObjStream},
+        {"normals", "<file.obj>...", &BenchNormals},
+        {"gltf", "<file.obj>...", &BenchGltf},
+        {"mesh-opt", "<file.obj>...", &BenchMeshOptimizer},
+        {"meshlets", "<file.obj>...", &BenchMeshlets},
+        {"lods", "<file.obj>...", &BenchLods},
+        {"mips", "[image]...", &BenchMips},
+        {"bc", "[image]...", &BenchBlockCompression},
+        {"atlas", "[image]...", &BenchAtlas},
+        {"env", "[image.hdr] [cubeFaceSize]", &BenchEnvironment},
+        {"hdr", "<image.hdr>...", &BenchHdr},
+        {"decode", "<budgetMB> <image>...", &BenchDecode},
+        {"archive", "<archive> [file or directory]...", &BenchArchive},
+        {"vertex-layout", "<file.obj>...", &BenchVertexLayout},
+        {"bvh", "<file.obj>...", &BenchBvh},
+        {"bvh-update", "<frames> <file.obj>...", &BenchBvhUpdate},
+        {"traversal", "<file.obj or stress>...", &BenchTraversal},
+        {"raytrace", "<output> [width] [height] [samples] [hdr]", &BenchCpuRaytrace},
+    };
+
+    if (argc > 2)
+    {
+        std::vector<std::string> args(argv + 3, argv + argc);
+        for (const auto &benchmark : benchmarks)
+        {
+            if (argv[2] == std::string(benchmark.name))
+            {
+                return benchmark.run(args);
+            }
+        }
+    }
+
+    std::cout << "Usage: " << argv[0] << " --bench <name> [args...]" << std::endl;
+    for (const auto &benchmark : benchmarks)
+    {
+        std::cout << "  " << benchmark.name << " " << benchmark.usage << std::endl;
+    }
+    return 1;
+}
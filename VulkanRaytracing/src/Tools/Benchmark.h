@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Command line benchmarks for the asset pipeline, run with
+// VulkanRaytracing --bench <name> [args...]
+class Benchmark
+{
+  public:
+    static bool IsRequested(int argc, char **argv);
+    static int Run(int argc, char **argv);
+};
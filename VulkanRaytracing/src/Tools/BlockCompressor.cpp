@@ -0,0 +1,773 @@
+#include "vkpch.h"
+
+#include "BlockCompressor.h"
+
+#include "Core/ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+
+#define BLOCK_REFINE_ITERATIONS 2
+
+static const int s_Bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct BlockTexels
+{
+    int rgba[16][4];
+};
+
+static inline int Clamp(int value, int low, int high)
+{
+    return std::min(std::max(value, low), high);
+}
+
+static void FetchBlock(const uint8_t *pixels, const MipLevel &level, uint32_t blockX,
+                       uint32_t blockY, BlockTexels &block)
+{
+    // Texels past the edge of partial blocks repeat the last row and column
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        const uint32_t sy = std::min(4 * blockY + y, level.height - 1);
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            const uint32_t sx = std::min(4 * blockX + x, level.width - 1);
+            const uint8_t *texel = pixels + level.offset + 4 * (size_t(sy) * level.width + sx);
+            for (int c = 0; c < 4; c++)
+            {
+                block.rgba[4 * y + x][c] = texel[c];
+            }
+        }
+    }
+}
+
+static void StoreBlock(const BlockTexels &block, const MipLevel &level, uint32_t blockX,
+                       uint32_t blockY, uint8_t *pixels)
+{
+    for (uint32_t y = 0; y < 4 && 4 * blockY + y < level.height; y++)
+    {
+        for (uint32_t x = 0; x < 4 && 4 * blockX + x < level.width; x++)
+        {
+            uint8_t *texel =
+                pixels + level.offset + 4 * (size_t(4 * blockY + y) * level.width + 4 * blockX + x);
+            for (int c = 0; c < 4; c++)
+            {
+                texel[c] = static_cast<uint8_t>(block.rgba[4 * y + x][c]);
+            }
+        }
+    }
+}
+
+// Mean and dominant direction of the block in the first channelCount channels. The axis is zero
+// for blocks of a single color.
+static void FindPrincipalAxis(const BlockTexels &block, int channelCount, float mean[4],
+                              float axis[4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < channelCount; c++)
+        {
+            mean[c] += block.rgba[i][c];
+        }
+    }
+    for (int c = 0; c < channelCount; c++)
+    {
+        mean[c] /= 16.0f;
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        float d[4];
+        for (int c = 0; c < channelCount; c++)
+        {
+            d[c] = block.rgba[i][c] - mean[c];
+        }
+        for (int a = 0; a < channelCount; a++)
+        {
+            for (int b = 0; b < channelCount; b++)
+            {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+
+    float v[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        float largest = 0.0f;
+        for (int a = 0; a < channelCount; a++)
+        {
+            for (int b = 0; b < channelCount; b++)
+            {
+                next[a] += covariance[a][b] * v[b];
+            }
+            largest = std::max(largest, std::abs(next[a]));
+        }
+        if (largest < 1e-6f)
+        {
+            return;
+        }
+        for (int c = 0; c < channelCount; c++)
+        {
+            v[c] = next[c] / largest;
+        }
+    }
+
+    float length = 0.0f;
+    for (int c = 0; c < channelCount; c++)
+    {
+        length += v[c] * v[c];
+    }
+    length = std::sqrt(length);
+    for (int c = 0; c < channelCount; c++)
+    {
+        axis[c] = v[c] / length;
+    }
+}
+
+// Ends of the block's extent along the axis, low end first
+static void FindAxisEndpoints(const BlockTexels &block, int channelCount, const float mean[4],
+                              const float axis[4], float low[4], float high[4])
+{
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channelCount; c++)
+        {
+            t += (block.rgba[i][c] - mean[c]) * axis[c];
+        }
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    for (int c = 0; c < channelCount; c++)
+    {
+        low[c] = mean[c] + axis[c] * minT;
+        high[c] = mean[c] + axis[c] * maxT;
+    }
+}
+
+// Least squares endpoints for fixed indices, weights[i] is how much texel i takes from the
+// second endpoint. Returns false when the indices do not constrain both endpoints.
+static bool FitEndpoints(const BlockTexels &block, int channelCount, const float weights[16],
+                         float first[4], float second[4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        const float b = weights[i];
+        const float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channelCount; c++)
+        {
+            ax[c] += a * block.rgba[i][c];
+            bx[c] += b * block.rgba[i][c];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+    {
+        return false;
+    }
+    for (int c = 0; c < channelCount; c++)
+    {
+        first[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+        second[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+    }
+    return true;
+}
+
+static uint16_t PackColor565(const float color[3])
+{
+    const int r = Clamp(static_cast<int>(std::lround(color[0] * 31.0f / 255.0f)), 0, 31);
+    const int g = Clamp(static_cast<int>(std::lround(color[1] * 63.0f / 255.0f)), 0, 63);
+    const int b = Clamp(static_cast<int>(std::lround(color[2] * 31.0f / 255.0f)), 0, 31);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackColor565(uint16_t packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void GetColorPalette(uint16_t color0, uint16_t color1, bool fourColor, int palette[4][4])
+{
+    UnpackColor565(color0, palette[0]);
+    UnpackColor565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = fourColor ? 255 : 0;
+    for (int c = 0; c < 3; c++)
+    {
+        if (fourColor)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+struct ColorBlock
+{
+    uint16_t color0 = 0;
+    uint16_t color1 = 0;
+    uint32_t indices = 0;
+    int error = INT32_MAX;
+};
+
+// Always four color mode, which BC3 requires and BC1 selects with color0 > color1
+static ColorBlock EvaluateColorBlock(const BlockTexels &block, uint16_t color0, uint16_t color1)
+{
+    ColorBlock result;
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+    result.color0 = color0;
+    result.color1 = color1;
+    result.error = 0;
+
+    int palette[4][4];
+    GetColorPalette(color0, color1, true, palette);
+    const int paletteSize = color0 == color1 ? 1 : 4;
+    for (int i = 0; i < 16; i++)
+    {
+        int bestIndex = 0;
+        int bestError = INT32_MAX;
+        for (int p = 0; p < paletteSize; p++)
+        {
+            int error = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                const int d = block.rgba[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestIndex = p;
+            }
+        }
+        result.indices |= static_cast<uint32_t>(bestIndex) << (2 * i);
+        result.error += bestError;
+    }
+    return result;
+}
+
+static void EncodeColorBlock(const BlockTexels &block, uint8_t *out)
+{
+    float mean[4], axis[4], low[4], high[4];
+    FindPrincipalAxis(block, 3, mean, axis);
+    FindAxisEndpoints(block, 3, mean, axis, low, high);
+    ColorBlock best = EvaluateColorBlock(block, PackColor565(high), PackColor565(low));
+
+    for (int iteration = 0; iteration < BLOCK_REFINE_ITERATIONS && best.error > 0; iteration++)
+    {
+        // Palette entries 0..3 sit at 0, 1, 1/3 and 2/3 of the way to color1
+        static const float paletteWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+        {
+            weights[i] = paletteWeights[(best.indices >> (2 * i)) & 3];
+        }
+        float first[4], second[4];
+        if (!FitEndpoints(block, 3, weights, first, second))
+        {
+            break;
+        }
+        ColorBlock refined = EvaluateColorBlock(block, PackColor565(first), PackColor565(second));
+        if (refined.error >= best.error)
+        {
+            break;
+        }
+        best = refined;
+    }
+
+    memcpy(out, &best.color0, 2);
+    memcpy(out + 2, &best.color1, 2);
+    memcpy(out + 4, &best.indices, 4);
+}
+
+static void EncodeAlphaBlock(const BlockTexels &block, uint8_t *out)
+{
+    int alphaMin = 255;
+    int alphaMax = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        alphaMin = std::min(alphaMin, block.rgba[i][3]);
+        alphaMax = std::max(alphaMax, block.rgba[i][3]);
+    }
+
+    // alpha0 > alpha1 selects eight interpolated values
+    uint64_t packed = static_cast<uint64_t>(alphaMax) | (static_cast<uint64_t>(alphaMin) << 8);
+    if (alphaMax > alphaMin)
+    {
+        int palette[8] = {alphaMax, alphaMin};
+        for (int p = 1; p < 7; p++)
+        {
+            palette[p + 1] = ((7 - p) * alphaMax + p * alphaMin) / 7;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int bestIndex = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 8; p++)
+            {
+                const int error = std::abs(block.rgba[i][3] - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            packed |= static_cast<uint64_t>(bestIndex) << (16 + 3 * i);
+        }
+    }
+    memcpy(out, &packed, 8);
+}
+
+struct Bc7Block
+{
+    int endpoints[2][4] = {};
+    int pbits[2] = {};
+    int indices[16] = {};
+    int error = INT32_MAX;
+};
+
+static void EvaluateBc7Block(const BlockTexels &block, const float first[4], const float second[4],
+                             Bc7Block &best)
+{
+    for (int pbit0 = 0; pbit0 < 2; pbit0++)
+    {
+        for (int pbit1 = 0; pbit1 < 2; pbit1++)
+        {
+            Bc7Block candidate;
+            candidate.pbits[0] = pbit0;
+            candidate.pbits[1] = pbit1;
+            int values[2][4];
+            for (int c = 0; c < 4; c++)
+            {
+                candidate.endpoints[0][c] =
+                    Clamp(static_cast<int>(std::lround((first[c] - pbit0) / 2.0f)), 0, 127);
+                candidate.endpoints[1][c] =
+                    Clamp(static_cast<int>(std::lround((second[c] - pbit1) / 2.0f)), 0, 127);
+                values[0][c] = (candidate.endpoints[0][c] << 1) | pbit0;
+                values[1][c] = (candidate.endpoints[1][c] << 1) | pbit1;
+            }
+
+            int palette[16][4];
+            for (int p = 0; p < 16; p++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    palette[p][c] =
+                        ((64 - s_Bc7Weights[p]) * values[0][c] + s_Bc7Weights[p] * values[1][c] +
+                         32) >>
+                        6;
+                }
+            }
+
+            // Texels are projected on the endpoint line and only the indices next to the
+            // projection are compared
+            float direction[4];
+            float lengthSquared = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                direction[c] = static_cast<float>(values[1][c] - values[0][c]);
+                lengthSquared += direction[c] * direction[c];
+            }
+            const float scale = lengthSquared > 0.0f ? 15.0f / lengthSquared : 0.0f;
+
+            candidate.error = 0;
+            for (int i = 0; i < 16 && candidate.error < best.error; i++)
+            {
+                float t = 0.0f;
+                for (int c = 0; c < 4; c++)
+                {
+                    t += (block.rgba[i][c] - values[0][c]) * direction[c];
+                }
+                const int nearest = Clamp(static_cast<int>(std::lround(t * scale)), 0, 15);
+
+                int bestError = INT32_MAX;
+                for (int p = std::max(nearest - 1, 0); p <= std::min(nearest + 1, 15); p++)
+                {
+                    int error = 0;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        const int d = block.rgba[i][c] - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        candidate.indices[i] = p;
+                    }
+                }
+                candidate.error += bestError;
+            }
+
+            if (candidate.error < best.error)
+            {
+                best = candidate;
+            }
+        }
+    }
+}
+
+class Bc7BitWriter
+{
+  public:
+    explicit Bc7BitWriter(uint8_t *out) : m_Out(out)
+    {
+        memset(m_Out, 0, 16);
+    }
+
+    void Write(uint32_t value, int bitCount)
+    {
+        for (int i = 0; i < bitCount; i++, m_Position++)
+        {
+            m_Out[m_Position >> 3] |= ((value >> i) & 1) << (m_Position & 7);
+        }
+    }
+
+  private:
+    uint8_t *m_Out;
+    int m_Position = 0;
+};
+
+class Bc7BitReader
+{
+  public:
+    explicit Bc7BitReader(const uint8_t *in) : m_In(in)
+    {
+    }
+
+    uint32_t Read(int bitCount)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < bitCount; i++, m_Position++)
+        {
+            value |= ((m_In[m_Position >> 3] >> (m_Position & 7)) & 1u) << i;
+        }
+        return value;
+    }
+
+  private:
+    const uint8_t *m_In;
+    int m_Position = 0;
+};
+
+static void EncodeBc7Block(const BlockTexels &block, uint8_t *out)
+{
+    float mean[4], axis[4], low[4], high[4];
+    FindPrincipalAxis(block, 4, mean, axis);
+    FindAxisEndpoints(block, 4, mean, axis, low, high);
+    Bc7Block best;
+    EvaluateBc7Block(block, low, high, best);
+
+    for (int iteration = 0; iteration < BLOCK_REFINE_ITERATIONS && best.error > 0; iteration++)
+    {
+        float weights[16];
+        for (int i = 0; i < 16; i++)
+        {
+            weights[i] = s_Bc7Weights[best.indices[i]] / 64.0f;
+        }
+        float first[4], second[4];
+        const int previousError = best.error;
+        if (!FitEndpoints(block, 4, weights, first, second))
+        {
+            break;
+        }
+        EvaluateBc7Block(block, first, second, best);
+        if (best.error >= previousError)
+        {
+            break;
+        }
+    }
+
+    // The anchor index is stored without its top bit, so it has to be below 8
+    if (best.indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+        }
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (int i = 0; i < 16; i++)
+        {
+            best.indices[i] = 15 - best.indices[i];
+        }
+    }
+
+    Bc7BitWriter writer(out);
+    writer.Write(1 << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        writer.Write(best.endpoints[0][c], 7);
+        writer.Write(best.endpoints[1][c], 7);
+    }
+    writer.Write(best.pbits[0], 1);
+    writer.Write(best.pbits[1], 1);
+    writer.Write(best.indices[0], 3);
+    for (int i = 1; i < 16; i++)
+    {
+        writer.Write(best.indices[i], 4);
+    }
+}
+
+static void DecodeColorBlock(const uint8_t *in, bool allowThreeColor, BlockTexels &block)
+{
+    uint16_t color0, color1;
+    uint32_t indices;
+    memcpy(&color0, in, 2);
+    memcpy(&color1, in + 2, 2);
+    memcpy(&indices, in + 4, 4);
+
+    int palette[4][4];
+    GetColorPalette(color0, color1, !allowThreeColor || color0 > color1, palette);
+    for (int i = 0; i < 16; i++)
+    {
+        const int index = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 4; c++)
+        {
+            block.rgba[i][c] = palette[index][c];
+        }
+    }
+}
+
+static void DecodeAlphaBlock(const uint8_t *in, BlockTexels &block)
+{
+    uint64_t packed;
+    memcpy(&packed, in, 8);
+    const int alpha0 = static_cast<int>(packed & 0xFF);
+    const int alpha1 = static_cast<int>((packed >> 8) & 0xFF);
+
+    int palette[8] = {alpha0, alpha1};
+    if (alpha0 > alpha1)
+    {
+        for (int p = 1; p < 7; p++)
+        {
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        }
+    }
+    else
+    {
+        for (int p = 1; p < 5; p++)
+        {
+            palette[p + 1] = ((5 - p) * alpha0 + p * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        block.rgba[i][3] = palette[(packed >> (16 + 3 * i)) & 7];
+    }
+}
+
+static void DecodeBc7Block(const uint8_t *in, BlockTexels &block)
+{
+    Bc7BitReader reader(in);
+    if (reader.Read(7) != (1 << 6))
+    {
+        // Other modes are never written by the encoder
+        memset(block.rgba, 0, sizeof(block.rgba));
+        return;
+    }
+
+    int values[2][4];
+    for (int c = 0; c < 4; c++)
+    {
+        values[0][c] = reader.Read(7) << 1;
+        values[1][c] = reader.Read(7) << 1;
+    }
+    const int pbit0 = reader.Read(1);
+    const int pbit1 = reader.Read(1);
+    for (int c = 0; c < 4; c++)
+    {
+        values[0][c] |= pbit0;
+        values[1][c] |= pbit1;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        const int weight = s_Bc7Weights[reader.Read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+        {
+            block.rgba[i][c] = ((64 - weight) * values[0][c] + weight * values[1][c] + 32) >> 6;
+        }
+    }
+}
+
+size_t BlockCompressor::GetBlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+vk::Format BlockCompressor::GetVulkanFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return vk::Format::eBc1RgbaSrgbBlock;
+    case BlockFormat::BC3:
+        return vk::Format::eBc3SrgbBlock;
+    default:
+        return vk::Format::eBc7SrgbBlock;
+    }
+}
+
+BlockFormat BlockCompressor::ChooseFormat(const MipChain &chain, bool preferBC7)
+{
+    if (preferBC7)
+    {
+        return BlockFormat::BC7;
+    }
+    const MipLevel &level = chain.levels[0];
+    const size_t size = 4 * size_t(level.width) * level.height;
+    for (size_t i = 3; i < size; i += 4)
+    {
+        if (chain.pixels[level.offset + i] != 255)
+        {
+            return BlockFormat::BC3;
+        }
+    }
+    return BlockFormat::BC1;
+}
+
+// Block rows of every level as one list, so small levels do not serialize the work
+static void GetBlockRows(const std::vector<MipLevel> &levels,
+                         std::vector<std::pair<size_t, uint32_t>> &rows)
+{
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const uint32_t blocksY = (levels[i].height + 3) / 4;
+        for (uint32_t y = 0; y < blocksY; y++)
+        {
+            rows.emplace_back(i, y);
+        }
+    }
+}
+
+void BlockCompressor::Compress(const MipChain &chain, BlockFormat format,
+                               CompressedChain &compressed)
+{
+    const size_t blockSize = GetBlockSize(format);
+    compressed.format = format;
+    compressed.levels = chain.levels;
+    size_t size = 0;
+    for (auto &level : compressed.levels)
+    {
+        level.offset = size;
+        size += blockSize * ((level.width + 3) / 4) * ((level.height + 3) / 4);
+    }
+    compressed.blocks.resize(size);
+
+    std::vector<std::pair<size_t, uint32_t>> rows;
+    GetBlockRows(chain.levels, rows);
+    ThreadPool::Get().ParallelFor(rows.size(), [&](size_t row) {
+        const MipLevel &level = chain.levels[rows[row].first];
+        const uint32_t blockY = rows[row].second;
+        const uint32_t blocksX = (level.width + 3) / 4;
+        uint8_t *out = compressed.blocks.data() + compressed.levels[rows[row].first].offset +
+                       blockSize * blocksX * blockY;
+
+        BlockTexels block;
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++, out += blockSize)
+        {
+            FetchBlock(chain.pixels.data(), level, blockX, blockY, block);
+            switch (format)
+            {
+            case BlockFormat::BC1:
+                EncodeColorBlock(block, out);
+                break;
+            case BlockFormat::BC3:
+                EncodeAlphaBlock(block, out);
+                EncodeColorBlock(block, out + 8);
+                break;
+            case BlockFormat::BC7:
+                EncodeBc7Block(block, out);
+                break;
+            }
+        }
+    });
+}
+
+void BlockCompressor::Decompress(const CompressedChain &compressed, MipChain &chain)
+{
+    const size_t blockSize = GetBlockSize(compressed.format);
+    chain.levels = compressed.levels;
+    size_t size = 0;
+    for (auto &level : chain.levels)
+    {
+        level.offset = size;
+        size += 4 * size_t(level.width) * level.height;
+    }
+    chain.pixels.resize(size);
+
+    std::vector<std::pair<size_t, uint32_t>> rows;
+    GetBlockRows(chain.levels, rows);
+    ThreadPool::Get().ParallelFor(rows.size(), [&](size_t row) {
+        const MipLevel &level = chain.levels[rows[row].first];
+        const uint32_t blockY = rows[row].second;
+        const uint32_t blocksX = (level.width + 3) / 4;
+        const uint8_t *in = compressed.blocks.data() +
+                            compressed.levels[rows[row].first].offset +
+                            blockSize * blocksX * blockY;
+
+        BlockTexels block;
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++, in += blockSize)
+        {
+            switch (compressed.format)
+            {
+            case BlockFormat::BC1:
+                DecodeColorBlock(in, true, block);
+                break;
+            case BlockFormat::BC3:
+                DecodeColorBlock(in + 8, false, block);
+                DecodeAlphaBlock(in, block);
+                break;
+            case BlockFormat::BC7:
+                DecodeBc7Block(in, block);
+                break;
+            }
+            StoreBlock(block, level, blockX, blockY, chain.pixels.data());
+        }
+    });
+}
+
+double BlockCompressor::ComputePsnr(const MipChain &reference, const MipChain &chain)
+{
+    double squaredError = 0.0;
+    for (size_t i = 0; i < reference.pixels.size(); i++)
+    {
+        const double d = double(reference.pixels[i]) - double(chain.pixels[i]);
+        squaredError += d * d;
+    }
+    if (squaredError == 0.0)
+    {
+        return INFINITY;
+    }
+    const double meanSquaredError = squaredError / reference.pixels.size();
+    return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+}
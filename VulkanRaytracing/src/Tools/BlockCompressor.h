@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MipGenerator.h"
+
+#include <vulkan/vulkan.hpp>
+
+enum class BlockFormat
+{
+    BC1,
+    BC3,
+    BC7
+};
+
+// Levels hold block offsets and sizes in texels, largest first
+struct CompressedChain
+{
+    BlockFormat format = BlockFormat::BC1;
+    std::vector<uint8_t> blocks;
+    std::vector<MipLevel> levels;
+};
+
+// CPU encoder for 4x4 block compressed sRGB textures. BC1 and BC3 color endpoints come from the
+// principal axis of the block refined by least squares, BC7 always uses mode 6 (one subset,
+// RGBA endpoints with p-bits, 4 bit indices). Blocks of all levels are spread over the thread
+// pool.
+class BlockCompressor
+{
+  public:
+    static size_t GetBlockSize(BlockFormat format);
+    static vk::Format GetVulkanFormat(BlockFormat format);
+
+    // BC1 for opaque textures and BC3 when any texel has alpha, unless BC7 is preferred
+    static BlockFormat ChooseFormat(const MipChain &chain, bool preferBC7);
+
+    static void Compress(const MipChain &chain, BlockFormat format, CompressedChain &compressed);
+
+    // Only decodes what Compress produces, used to measure the encoding error
+    static void Decompress(const CompressedChain &compressed, MipChain &chain);
+
+    // Over all levels and channels of two chains with the same layout
+    static double ComputePsnr(const MipChain &reference, const MipChain &chain);
+};
@@ -0,0 +1,335 @@
+#include "vkpch.h"
+
+#include "EnvironmentBaker.h"
+
+#include "Core/ThreadPool.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstring>
+
+#define ENVIRONMENT_TEXELS_PER_TASK (1 << 14)
+#define HALF_MAX 65504.0f
+// (511 / 512) * 2^16, the largest value E5B9G9R9 holds
+#define SHARED_EXPONENT_MAX 65408.0f
+
+// Linear RGB, cubemap faces are stacked vertically
+struct FloatImage
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> rgb;
+};
+
+template <typename Func>
+static void ParallelRows(uint32_t width, uint32_t height, const Func &func)
+{
+    const uint32_t rowsPerTask = std::max(ENVIRONMENT_TEXELS_PER_TASK / width, 1u);
+    const size_t taskCount = (height + rowsPerTask - 1) / rowsPerTask;
+    ThreadPool::Get().ParallelFor(taskCount, [&](size_t task) {
+        const uint32_t begin = static_cast<uint32_t>(task) * rowsPerTask;
+        const uint32_t end = std::min(begin + rowsPerTask, height);
+        for (uint32_t y = begin; y < end; y++)
+        {
+            func(y);
+        }
+    });
+}
+
+// 2:1 box filter of one image into dst, which may hold several images stacked vertically
+static void Downsample(const float *src, uint32_t srcWidth, uint32_t srcHeight, float *dst)
+{
+    const uint32_t dstWidth = std::max(srcWidth / 2, 1u);
+    const uint32_t dstHeight = std::max(srcHeight / 2, 1u);
+    ParallelRows(dstWidth, dstHeight, [&](uint32_t y) {
+        const float *row0 = src + 3 * size_t(srcWidth) * std::min(2 * y, srcHeight - 1);
+        const float *row1 = src + 3 * size_t(srcWidth) * std::min(2 * y + 1, srcHeight - 1);
+        float *out = dst + 3 * size_t(dstWidth) * y;
+        for (uint32_t x = 0; x < dstWidth; x++)
+        {
+            const size_t x0 = 3 * size_t(std::min(2 * x, srcWidth - 1));
+            const size_t x1 = 3 * size_t(std::min(2 * x + 1, srcWidth - 1));
+            for (int c = 0; c < 3; c++)
+            {
+                out[3 * x + c] =
+                    0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+            }
+        }
+    });
+}
+
+static void DownsampleFaces(const FloatImage &src, uint32_t faceCount, FloatImage &dst)
+{
+    const uint32_t faceHeight = src.height / faceCount;
+    dst.width = std::max(src.width / 2, 1u);
+    dst.height = std::max(faceHeight / 2, 1u) * faceCount;
+    dst.rgb.resize(3 * size_t(dst.width) * dst.height);
+    const size_t srcFaceSize = 3 * size_t(src.width) * faceHeight;
+    const size_t dstFaceSize = dst.rgb.size() / faceCount;
+    for (uint32_t face = 0; face < faceCount; face++)
+    {
+        Downsample(src.rgb.data() + srcFaceSize * face, src.width, faceHeight,
+                   dst.rgb.data() + dstFaceSize * face);
+    }
+}
+
+// Box filters the source until it is at most maxWidth wide. The source is only copied when it
+// has to be reduced.
+static const float *ReduceSource(const float *rgb, uint32_t &width, uint32_t &height,
+                                 uint32_t maxWidth, FloatImage &reduced)
+{
+    while (width > std::max(maxWidth, 1u))
+    {
+        FloatImage next;
+        next.width = std::max(width / 2, 1u);
+        next.height = std::max(height / 2, 1u);
+        next.rgb.resize(3 * size_t(next.width) * next.height);
+        Downsample(rgb, width, height, next.rgb.data());
+        reduced = std::move(next);
+        rgb = reduced.rgb.data();
+        width = reduced.width;
+        height = reduced.height;
+    }
+    return rgb;
+}
+
+static uint32_t PackSharedExponent(const float *rgb)
+{
+    float color[3];
+    float maxComponent = 0.0f;
+    for (int c = 0; c < 3; c++)
+    {
+        // Also maps NaN to zero
+        color[c] = rgb[c] > 0.0f ? std::min(rgb[c], SHARED_EXPONENT_MAX) : 0.0f;
+        maxComponent = std::max(maxComponent, color[c]);
+    }
+
+    // Biased shared exponent from floor(log2(max)), read from the float's own exponent
+    uint32_t bits;
+    memcpy(&bits, &maxComponent, sizeof(bits));
+    int exponent = std::max(static_cast<int>((bits >> 23) & 0xFF) - 127, -16) + 16;
+    float scale = std::ldexp(1.0f, 24 - exponent);
+    if (static_cast<uint32_t>(maxComponent * scale + 0.5f) == 512)
+    {
+        exponent++;
+        scale *= 0.5f;
+    }
+
+    uint32_t packed = static_cast<uint32_t>(exponent) << 27;
+    for (int c = 0; c < 3; c++)
+    {
+        packed |= static_cast<uint32_t>(color[c] * scale + 0.5f) << (9 * c);
+    }
+    return packed;
+}
+
+static void EncodeTexel(EnvironmentFormat format, const float *rgb, uint8_t *out)
+{
+    if (format == EnvironmentFormat::SharedExponent)
+    {
+        const uint32_t packed = PackSharedExponent(rgb);
+        memcpy(out, &packed, sizeof(packed));
+        return;
+    }
+
+    uint16_t half[4];
+    for (int c = 0; c < 3; c++)
+    {
+        half[c] = glm::packHalf1x16(rgb[c] > 0.0f ? std::min(rgb[c], HALF_MAX) : 0.0f);
+    }
+    half[3] = glm::packHalf1x16(1.0f);
+    memcpy(out, half, sizeof(half));
+}
+
+static void EncodeImage(const float *rgb, uint32_t width, uint32_t height, EnvironmentFormat format,
+                        uint8_t *out)
+{
+    const size_t texelSize = EnvironmentBaker::GetTexelSize(format);
+    ParallelRows(width, height, [&](uint32_t y) {
+        const size_t first = size_t(width) * y;
+        for (size_t i = first; i < first + width; i++)
+        {
+            EncodeTexel(format, rgb + 3 * i, out + texelSize * i);
+        }
+    });
+}
+
+static void LayoutLevels(uint32_t width, uint32_t height, uint32_t faceCount,
+                         EnvironmentFormat format, EnvironmentMap &map)
+{
+    const size_t texelSize = EnvironmentBaker::GetTexelSize(format);
+    map.format = format;
+    map.faceCount = faceCount;
+    map.levels.resize(MipGenerator::GetLevelCount(width, height));
+    size_t size = 0;
+    for (auto &level : map.levels)
+    {
+        level.offset = size;
+        level.width = width;
+        level.height = height;
+        size += texelSize * width * height * faceCount;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    map.texels.resize(size);
+}
+
+// Direction through the center of texel (x, y) of a cubemap face, following the face selection
+// of the Vulkan specification
+static void GetFaceDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size, float dir[3])
+{
+    const float s = 2.0f * (x + 0.5f) / size - 1.0f;
+    const float t = 2.0f * (y + 0.5f) / size - 1.0f;
+    switch (face)
+    {
+    case 0:
+        dir[0] = 1.0f, dir[1] = -t, dir[2] = -s;
+        break;
+    case 1:
+        dir[0] = -1.0f, dir[1] = -t, dir[2] = s;
+        break;
+    case 2:
+        dir[0] = s, dir[1] = 1.0f, dir[2] = t;
+        break;
+    case 3:
+        dir[0] = s, dir[1] = -1.0f, dir[2] = -t;
+        break;
+    case 4:
+        dir[0] = s, dir[1] = -t, dir[2] = 1.0f;
+        break;
+    default:
+        dir[0] = -s, dir[1] = -t, dir[2] = -1.0f;
+        break;
+    }
+}
+
+// Bilinear lookup with the mapping of the miss shader, wrapping around horizontally
+static void SampleEquirect(const float *rgb, uint32_t width, uint32_t height, const float dir[3],
+                           float *out)
+{
+    const float pi = 3.14159265358979f;
+    const float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    const float u = 0.5f + std::atan2(dir[2], dir[0]) / (2.0f * pi);
+    const float v = 0.5f - std::asin(std::min(std::max(dir[1] / length, -1.0f), 1.0f)) / pi;
+
+    const float fx = u * width - 0.5f;
+    const float fy = v * height - 0.5f;
+    const float x0f = std::floor(fx);
+    const float y0f = std::floor(fy);
+    const float tx = fx - x0f;
+    const float ty = fy - y0f;
+    const int64_t x0 = static_cast<int64_t>(x0f);
+    const int64_t y0 = static_cast<int64_t>(y0f);
+    const size_t xs[2] = {size_t((x0 % width + width) % width),
+                          size_t(((x0 + 1) % width + width) % width)};
+    const size_t ys[2] = {size_t(std::min<int64_t>(std::max<int64_t>(y0, 0), height - 1)),
+                          size_t(std::min<int64_t>(std::max<int64_t>(y0 + 1, 0), height - 1))};
+
+    for (int c = 0; c < 3; c++)
+    {
+        const float top = rgb[3 * (ys[0] * width + xs[0]) + c] * (1.0f - tx) +
+                          rgb[3 * (ys[0] * width + xs[1]) + c] * tx;
+        const float bottom = rgb[3 * (ys[1] * width + xs[0]) + c] * (1.0f - tx) +
+                             rgb[3 * (ys[1] * width + xs[1]) + c] * tx;
+        out[c] = top * (1.0f - ty) + bottom * ty;
+    }
+}
+
+size_t EnvironmentBaker::GetTexelSize(EnvironmentFormat format)
+{
+    return format == EnvironmentFormat::Half ? 8 : 4;
+}
+
+vk::Format EnvironmentBaker::GetVulkanFormat(EnvironmentFormat format)
+{
+    return format == EnvironmentFormat::Half ? vk::Format::eR16G16B16A16Sfloat
+                                             : vk::Format::eE5B9G9R9UfloatPack32;
+}
+
+void EnvironmentBaker::BakeEquirect(const float *rgb, uint32_t width, uint32_t height,
+                                    const EnvironmentBakeSettings &settings, EnvironmentMap &map)
+{
+    FloatImage level;
+    rgb = ReduceSource(rgb, width, height, settings.maxWidth, level);
+    LayoutLevels(width, height, 1, settings.format, map);
+
+    for (size_t i = 0; i < map.levels.size(); i++)
+    {
+        EncodeImage(rgb, width, height, settings.format, map.texels.data() + map.levels[i].offset);
+        if (i + 1 < map.levels.size())
+        {
+            FloatImage next;
+            next.width = std::max(width / 2, 1u);
+            next.height = std::max(height / 2, 1u);
+            next.rgb.resize(3 * size_t(next.width) * next.height);
+            Downsample(rgb, width, height, next.rgb.data());
+            level = std::move(next);
+            rgb = level.rgb.data();
+            width = level.width;
+            height = level.height;
+        }
+    }
+}
+
+void EnvironmentBaker::BakeCubemap(const float *rgb, uint32_t width, uint32_t height,
+                                   const EnvironmentBakeSettings &settings, EnvironmentMap &map)
+{
+    // Four faces cover the equator, so a source four times the face size matches the faces'
+    // texel density there
+    const uint32_t faceSize = std::max(settings.cubeFaceSize, 1u);
+    FloatImage reduced;
+    rgb = ReduceSource(rgb, width, height, 4 * faceSize, reduced);
+    LayoutLevels(faceSize, faceSize, 6, settings.format, map);
+
+    FloatImage level;
+    level.width = faceSize;
+    level.height = 6 * faceSize;
+    level.rgb.resize(3 * size_t(level.width) * level.height);
+    ParallelRows(level.width, level.height, [&](uint32_t row) {
+        const uint32_t face = row / faceSize;
+        const uint32_t y = row % faceSize;
+        float *out = level.rgb.data() + 3 * size_t(faceSize) * row;
+        for (uint32_t x = 0; x < faceSize; x++)
+        {
+            float dir[3];
+            GetFaceDirection(face, x, y, faceSize, dir);
+            SampleEquirect(rgb, width, height, dir, out + 3 * size_t(x));
+        }
+    });
+    std::vector<float>().swap(reduced.rgb);
+
+    for (size_t i = 0; i < map.levels.size(); i++)
+    {
+        EncodeImage(level.rgb.data(), level.width, level.height, settings.format,
+                    map.texels.data() + map.levels[i].offset);
+        if (i + 1 < map.levels.size())
+        {
+            FloatImage next;
+            DownsampleFaces(level, 6, next);
+            level = std::move(next);
+        }
+    }
+}
+
+void EnvironmentBaker::DecodeTexel(EnvironmentFormat format, const uint8_t *texel, float rgb[3])
+{
+    if (format == EnvironmentFormat::SharedExponent)
+    {
+        uint32_t packed;
+        memcpy(&packed, texel, sizeof(packed));
+        const float scale = std::ldexp(1.0f, static_cast<int>(packed >> 27) - 24);
+        for (int c = 0; c < 3; c++)
+        {
+            rgb[c] = ((packed >> (9 * c)) & 0x1FF) * scale;
+        }
+        return;
+    }
+
+    uint16_t half[4];
+    memcpy(half, texel, sizeof(half));
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = glm::unpackHalf1x16(half[c]);
+    }
+}
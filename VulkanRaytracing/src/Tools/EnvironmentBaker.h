@@ -0,0 +1,49 @@
+#pragma once
+
+#include "MipGenerator.h"
+
+#include <vulkan/vulkan.hpp>
+
+enum class EnvironmentFormat
+{
+    // RGBA16F, 8 bytes per texel
+    Half,
+    // E5B9G9R9, 4 bytes per texel
+    SharedExponent
+};
+
+struct EnvironmentBakeSettings
+{
+    EnvironmentFormat format = EnvironmentFormat::SharedExponent;
+    // Wider sources are box filtered down to at most this width first
+    uint32_t maxWidth = 8192;
+    // Edge length of the cubemap faces, 0 skips the cubemap
+    uint32_t cubeFaceSize = 2048;
+};
+
+// Levels hold texel offsets and sizes, largest first. The faces of a cubemap level follow each
+// other in +X, -X, +Y, -Y, +Z, -Z order.
+struct EnvironmentMap
+{
+    EnvironmentFormat format = EnvironmentFormat::SharedExponent;
+    uint32_t faceCount = 1;
+    std::vector<uint8_t> texels;
+    std::vector<MipLevel> levels;
+};
+
+// Converts a linear RGB float equirectangular environment into mipmapped half float or shared
+// exponent textures, either equirectangular or as a cubemap. Rows and faces are spread over the
+// thread pool.
+class EnvironmentBaker
+{
+  public:
+    static size_t GetTexelSize(EnvironmentFormat format);
+    static vk::Format GetVulkanFormat(EnvironmentFormat format);
+
+    static void BakeEquirect(const float *rgb, uint32_t width, uint32_t height,
+                             const EnvironmentBakeSettings &settings, EnvironmentMap &map);
+    static void BakeCubemap(const float *rgb, uint32_t width, uint32_t height,
+                            const EnvironmentBakeSettings &settings, EnvironmentMap &map);
+
+    static void DecodeTexel(EnvironmentFormat format, const uint8_t *texel, float rgb[3]);
+};
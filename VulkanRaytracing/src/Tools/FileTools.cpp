@@ -2,19 +2,193 @@
 
 #include "FileTools.h"
 
+#include "AssetArchive.h"
 #include "Core/Core.h"
 
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 std::vector<char> ReadFile(const std::string &filename)
 {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        // Mapping also fails for empty files
+        assert(std::ifstream(filename).is_open());
+        return {};
+    }
+    const char *data = reinterpret_cast<const char *>(file.GetData());
+    return std::vector<char>(data, data + file.GetSize());
+}
+
+uint64_t HashData(const void *data, size_t size, uint64_t seed)
+{
+    // FNV-1a, eight bytes per step so hashing large assets stays memory bound
+    const uint64_t prime = 0x100000001b3ULL;
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash;
+}
 
-    assert(file.is_open());
+bool GetFileStamp(const std::string &filename, FileStamp &stamp)
+{
+    std::error_code error;
+    auto size = std::filesystem::file_size(filename, error);
+    if (error)
+    {
+        return AssetArchive::GetMountedStamp(filename, stamp);
+    }
+    auto writeTime = std::filesystem::last_write_time(filename, error);
+    if (error)
+    {
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(size);
+    stamp.writeTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    return true;
+}
 
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
+MappedFile::~MappedFile()
+{
+    Close();
+}
 
-    return buffer;
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        std::swap(m_Data, other.m_Data);
+        std::swap(m_Size, other.m_Size);
+        std::swap(m_Buffer, other.m_Buffer);
+#ifdef _WIN32
+        std::swap(m_File, other.m_File);
+        std::swap(m_Mapping, other.m_Mapping);
+#endif
+    }
+    return *this;
+}
+
+bool MappedFile::Open(const std::string &filename, size_t readSize)
+{
+    Close();
+    if (Map(filename))
+    {
+        return true;
+    }
+    if (!AssetArchive::ReadMounted(filename, m_Buffer, m_Size, readSize))
+    {
+        return false;
+    }
+    m_Data = m_Buffer.get();
+    return true;
+}
+
+bool MappedFile::Map(const std::string &filename)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_File = file;
+    m_Mapping = mapping;
+    m_Data = static_cast<const uint8_t *>(data);
+    m_Size = static_cast<size_t>(size.QuadPart);
+#else
+    int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    m_Data = static_cast<const uint8_t *>(data);
+    m_Size = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (!m_Data)
+    {
+        return;
+    }
+    if (m_Buffer)
+    {
+        m_Buffer.reset();
+    }
+    else
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_Data);
+        CloseHandle(m_Mapping);
+        CloseHandle(m_File);
+        m_File = nullptr;
+        m_Mapping = nullptr;
+#else
+        munmap(const_cast<uint8_t *>(m_Data), m_Size);
+#endif
+    }
+    m_Data = nullptr;
+    m_Size = 0;
 }
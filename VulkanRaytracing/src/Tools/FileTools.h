@@ -1,6 +1,63 @@
 #pragma once
 
 #include <fstream>
+#include <memory>
 #include <vector>
 
 std::vector<char> ReadFile(const std::string &filename);
+
+uint64_t HashData(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+};
+
+// Falls back to the stamp recorded in the mounted asset archives
+bool GetFileStamp(const std::string &filename, FileStamp &stamp);
+
+// Read only mapping of a file. Files that are not on disk are read from the mounted asset
+// archives into memory owned by the MappedFile instead.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // Files from an archive hold at least their first readSize bytes rather than all of them,
+    // which is enough for readers that only look at a header
+    bool Open(const std::string &filename, size_t readSize = SIZE_MAX);
+    void Close();
+
+    inline bool IsOpen() const
+    {
+        return m_Data != nullptr;
+    }
+
+    inline const uint8_t *GetData() const
+    {
+        return m_Data;
+    }
+
+    inline size_t GetSize() const
+    {
+        return m_Size;
+    }
+
+  private:
+    bool Map(const std::string &filename);
+
+  private:
+    const uint8_t *m_Data = nullptr;
+    size_t m_Size = 0;
+    std::unique_ptr<uint8_t[]> m_Buffer;
+#ifdef _WIN32
+    void *m_File = nullptr;
+    void *m_Mapping = nullptr;
+#endif
+};
@@ -0,0 +1,318 @@
+#include "vkpch.h"
+
+#include "HdrDecoder.h"
+
+#include "Core/ThreadPool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <emmintrin.h>
+
+#define HDR_ROWS_PER_TASK 16
+#define HDR_MAX_SIZE (1 << 24)
+#define HDR_HALF_MAX 65504.0f
+// Scanlines of other widths are always stored flat
+#define HDR_RLE_MIN_WIDTH 8
+#define HDR_RLE_MAX_WIDTH 0x7fff
+
+size_t HdrDecoder::GetTexelSize(HdrFormat format)
+{
+    return format == HdrFormat::Float ? 12 : 8;
+}
+
+bool HdrDecoder::IsHdr(const uint8_t *data, size_t size)
+{
+    static const char radiance[] = "#?RADIANCE\n";
+    static const char rgbe[] = "#?RGBE\n";
+    return (size >= sizeof(radiance) - 1 && memcmp(data, radiance, sizeof(radiance) - 1) == 0) ||
+           (size >= sizeof(rgbe) - 1 && memcmp(data, rgbe, sizeof(rgbe) - 1) == 0);
+}
+
+// Line without its terminating newline, false when the data ends first
+static bool ReadLine(const uint8_t *data, size_t size, size_t &offset, std::string &line)
+{
+    const void *end = memchr(data + offset, '\n', size - offset);
+    if (!end)
+    {
+        return false;
+    }
+    const size_t length = static_cast<const uint8_t *>(end) - (data + offset);
+    line.assign(reinterpret_cast<const char *>(data + offset), length);
+    offset += length + 1;
+    return true;
+}
+
+// Leaves offset at the first scanline
+static bool ParseHeader(const uint8_t *data, size_t size, uint32_t &width, uint32_t &height,
+                        size_t &offset)
+{
+    if (!HdrDecoder::IsHdr(data, size))
+    {
+        return false;
+    }
+
+    offset = 0;
+    std::string line;
+    bool rgbe = false;
+    while (ReadLine(data, size, offset, line) && !line.empty())
+    {
+        rgbe = rgbe || line == "FORMAT=32-bit_rle_rgbe";
+    }
+    int rows, columns;
+    if (!rgbe || !ReadLine(data, size, offset, line) ||
+        sscanf(line.c_str(), "-Y %d +X %d", &rows, &columns) != 2 || rows <= 0 || columns <= 0 ||
+        rows > HDR_MAX_SIZE || columns > HDR_MAX_SIZE)
+    {
+        return false;
+    }
+    width = static_cast<uint32_t>(columns);
+    height = static_cast<uint32_t>(rows);
+    return true;
+}
+
+bool HdrDecoder::ReadHeader(const uint8_t *data, size_t size, uint32_t &width, uint32_t &height)
+{
+    size_t offset;
+    return ParseHeader(data, size, width, height, offset);
+}
+
+// Walks the run headers to find where each scanline starts and checks that the runs stay within
+// the data and the scanline. Images without the run length marker on the first scanline are
+// stored flat and leave rows empty.
+static bool FindScanlines(const uint8_t *data, size_t size, size_t offset, uint32_t width,
+                          uint32_t height, std::vector<size_t> &rows)
+{
+    if (width < HDR_RLE_MIN_WIDTH || width > HDR_RLE_MAX_WIDTH || size - offset < 4 ||
+        data[offset] != 2 || data[offset + 1] != 2 || (data[offset + 2] & 0x80))
+    {
+        return (size - offset) / 4 / width >= height;
+    }
+
+    rows.resize(height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        rows[y] = offset;
+        if (size - offset < 4 || data[offset] != 2 || data[offset + 1] != 2 ||
+            ((uint32_t(data[offset + 2]) << 8) | data[offset + 3]) != width)
+        {
+            return false;
+        }
+        offset += 4;
+        for (uint32_t channel = 0; channel < 4; channel++)
+        {
+            for (uint32_t x = 0; x < width;)
+            {
+                if (offset == size)
+                {
+                    return false;
+                }
+                uint32_t count = data[offset++];
+                size_t stored = count;
+                if (count > 128)
+                {
+                    count -= 128;
+                    stored = 1;
+                }
+                if (count > width - x || size - offset < stored)
+                {
+                    return false;
+                }
+                offset += stored;
+                x += count;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs of a scanline checked by FindScanlines into one plane per channel
+static void DecodeScanline(const uint8_t *scanline, uint32_t width, uint8_t *planes)
+{
+    const uint8_t *source = scanline + 4;
+    for (uint32_t channel = 0; channel < 4; channel++)
+    {
+        uint8_t *plane = planes + size_t(channel) * width;
+        for (uint32_t x = 0; x < width;)
+        {
+            uint32_t count = *source++;
+            if (count > 128)
+            {
+                count -= 128;
+                memset(plane + x, *source++, count);
+            }
+            else
+            {
+                memcpy(plane + x, source, count);
+                source += count;
+            }
+            x += count;
+        }
+    }
+}
+
+// Channels of four texels, one per lane
+struct RgbeTexels
+{
+    __m128i r;
+    __m128i g;
+    __m128i b;
+    __m128i e;
+};
+
+static inline RgbeTexels LoadInterleaved(const uint8_t *rgbe)
+{
+    const __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgbe));
+    const __m128i mask = _mm_set1_epi32(0xff);
+    return {_mm_and_si128(texels, mask), _mm_and_si128(_mm_srli_epi32(texels, 8), mask),
+            _mm_and_si128(_mm_srli_epi32(texels, 16), mask), _mm_srli_epi32(texels, 24)};
+}
+
+static inline __m128i LoadPlane(const uint8_t *plane)
+{
+    int32_t bytes;
+    memcpy(&bytes, plane, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+}
+
+// Non-negative floats up to HDR_HALF_MAX to half bits in the low 16 bits of each lane, rounded
+// to nearest even
+static inline __m128i FloatToHalf(__m128 value)
+{
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+    const __m128i bits = _mm_castps_si128(value);
+    const __m128i subnormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(value, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+    // Adds one more when the lowest kept mantissa bit is odd, so that ties round to even
+    const __m128i odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    const __m128i normal =
+        _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(bits, normalBias), odd), 13);
+    const __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, bits);
+    return _mm_or_si128(_mm_and_si128(isSubnormal, subnormal),
+                        _mm_andnot_si128(isSubnormal, normal));
+}
+
+// Writes four texels, mantissa * 2^(exponent - 136) as stb_image computes them. The mantissas
+// are scaled by 2^-8 first, which is exact, so that 2^(exponent - 128) fits a float for every
+// exponent and the single rounding matches. Exponent 1 gives the subnormal 2^-127.
+static inline void ConvertTexels(const RgbeTexels &texels, HdrFormat format, uint8_t *out)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i normalScale = _mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(texels.e, one), 23),
+                                              _mm_cmpgt_epi32(texels.e, one));
+    const __m128i subnormalScale =
+        _mm_and_si128(_mm_cmpeq_epi32(texels.e, one), _mm_set1_epi32(1 << 22));
+    const __m128 scale = _mm_castsi128_ps(_mm_or_si128(normalScale, subnormalScale));
+    const __m128 mantissaScale = _mm_set1_ps(1.0f / 256.0f);
+    const __m128 r = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(texels.r), mantissaScale), scale);
+    const __m128 g = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(texels.g), mantissaScale), scale);
+    const __m128 b = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(texels.b), mantissaScale), scale);
+
+    if (format == HdrFormat::Float)
+    {
+        // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+        const __m128 rgLow = _mm_unpacklo_ps(r, g);
+        const __m128 rgHigh = _mm_unpackhi_ps(r, g);
+        const __m128 gbLow = _mm_unpacklo_ps(g, b);
+        const __m128 gbHigh = _mm_unpackhi_ps(g, b);
+        const __m128 brLow = _mm_unpacklo_ps(b, r);
+        const __m128 brHigh = _mm_unpackhi_ps(b, r);
+        float *floats = reinterpret_cast<float *>(out);
+        _mm_storeu_ps(floats, _mm_shuffle_ps(rgLow, brLow, _MM_SHUFFLE(3, 0, 1, 0)));
+        _mm_storeu_ps(floats + 4, _mm_shuffle_ps(gbLow, rgHigh, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_ps(floats + 8, _mm_shuffle_ps(brHigh, gbHigh, _MM_SHUFFLE(3, 2, 3, 0)));
+        return;
+    }
+
+    const __m128 halfMax = _mm_set1_ps(HDR_HALF_MAX);
+    const __m128i alpha = _mm_set1_epi32(0x3c00 << 16);
+    const __m128i rg = _mm_or_si128(FloatToHalf(_mm_min_ps(r, halfMax)),
+                                    _mm_slli_epi32(FloatToHalf(_mm_min_ps(g, halfMax)), 16));
+    const __m128i ba = _mm_or_si128(FloatToHalf(_mm_min_ps(b, halfMax)), alpha);
+    __m128i *halves = reinterpret_cast<__m128i *>(out);
+    _mm_storeu_si128(halves, _mm_unpacklo_epi32(rg, ba));
+    _mm_storeu_si128(halves + 1, _mm_unpackhi_epi32(rg, ba));
+}
+
+// Converts a row given as RGBE words or as the four planes DecodeScanline writes. The last
+// texels are staged through zeroed buffers so that nothing outside the row is touched.
+static void ConvertRow(const uint8_t *rgbe, bool planar, uint32_t width, HdrFormat format,
+                       uint8_t *out)
+{
+    const size_t texelSize = HdrDecoder::GetTexelSize(format);
+    auto load = [&](const uint8_t *source, size_t stride) {
+        if (planar)
+        {
+            return RgbeTexels{LoadPlane(source), LoadPlane(source + stride),
+                              LoadPlane(source + 2 * stride), LoadPlane(source + 3 * stride)};
+        }
+        return LoadInterleaved(source);
+    };
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        ConvertTexels(load(planar ? rgbe + x : rgbe + 4 * size_t(x), width), format,
+                      out + x * texelSize);
+    }
+    if (x == width)
+    {
+        return;
+    }
+
+    const uint32_t count = width - x;
+    uint8_t tail[16] = {};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t channel = 0; channel < 4; channel++)
+        {
+            const uint8_t value = planar ? rgbe[size_t(channel) * width + x + i]
+                                         : rgbe[4 * (size_t(x) + i) + channel];
+            tail[planar ? channel * 4 + i : 4 * i + channel] = value;
+        }
+    }
+    uint8_t converted[48];
+    ConvertTexels(load(tail, 4), format, converted);
+    memcpy(out + x * texelSize, converted, count * texelSize);
+}
+
+bool HdrDecoder::Decode(const uint8_t *data, size_t size, HdrFormat format, HdrImage &image)
+{
+    uint32_t width, height;
+    size_t offset;
+    std::vector<size_t> rows;
+    if (!ParseHeader(data, size, width, height, offset) ||
+        !FindScanlines(data, size, offset, width, height, rows))
+    {
+        return false;
+    }
+
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    const size_t rowSize = width * GetTexelSize(format);
+    image.texels.resize(rowSize * height);
+    const size_t taskCount = (height + HDR_ROWS_PER_TASK - 1) / HDR_ROWS_PER_TASK;
+    ThreadPool::Get().ParallelFor(taskCount, [&](size_t task) {
+        std::vector<uint8_t> planes(rows.empty() ? 0 : size_t(width) * 4);
+        const uint32_t first = static_cast<uint32_t>(task) * HDR_ROWS_PER_TASK;
+        const uint32_t last = std::min(first + HDR_ROWS_PER_TASK, height);
+        for (uint32_t y = first; y < last; y++)
+        {
+            uint8_t *out = image.texels.data() + y * rowSize;
+            if (rows.empty())
+            {
+                ConvertRow(data + offset + 4 * size_t(y) * width, false, width, format, out);
+            }
+            else
+            {
+                DecodeScanline(data + rows[y], width, planes.data());
+                ConvertRow(planes.data(), true, width, format, out);
+            }
+        }
+    });
+    return true;
+}
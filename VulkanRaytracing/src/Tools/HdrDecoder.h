@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class HdrFormat
+{
+    // RGB32F, 12 bytes per texel
+    Float,
+    // RGBA16F with alpha 1, 8 bytes per texel
+    Half
+};
+
+struct HdrImage
+{
+    HdrFormat format = HdrFormat::Float;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Rows top to bottom, floats and halves in native byte order
+    std::vector<uint8_t> texels;
+};
+
+// Decoder for Radiance RGBE (.hdr) images with the usual -Y +X orientation, flat or with run
+// length encoded scanlines. The scanline offsets are found in one quick pass over the run
+// headers, then the scanlines are decoded on the thread pool and converted four texels at a time
+// on SSE registers. Floats are the ones stb_image computes, halves are rounded to nearest and
+// clamped to the largest finite half.
+class HdrDecoder
+{
+  public:
+    static size_t GetTexelSize(HdrFormat format);
+
+    // Checks the signature only
+    static bool IsHdr(const uint8_t *data, size_t size);
+    static bool ReadHeader(const uint8_t *data, size_t size, uint32_t &width, uint32_t &height);
+
+    // Fails for truncated or corrupt scanlines and for orientations other than -Y +X
+    static bool Decode(const uint8_t *data, size_t size, HdrFormat format, HdrImage &image);
+};
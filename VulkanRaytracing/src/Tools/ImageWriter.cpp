@@ -0,0 +1,119 @@
+#include "vkpch.h"
+
+#include "ImageWriter.h"
+
+#include <fstream>
+
+// Largest length of a stored deflate block
+#define DEFLATE_STORED_BLOCK_SIZE 65535
+#define ADLER_MODULO 65521
+
+static void AppendBigEndian(std::vector<uint8_t> &bytes, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static uint32_t Crc32(const uint8_t *data, size_t size)
+{
+    static const auto table = []() {
+        std::array<uint32_t, 256> values;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            values[i] = c;
+        }
+        return values;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void AppendChunk(std::vector<uint8_t> &png, const char type[4],
+                        const std::vector<uint8_t> &data)
+{
+    AppendBigEndian(png, static_cast<uint32_t>(data.size()));
+    const size_t typeOffset = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    AppendBigEndian(png, Crc32(png.data() + typeOffset, png.size() - typeOffset));
+}
+
+bool ImageWriter::WritePfm(const std::string &filename, uint32_t width, uint32_t height,
+                           const float *rgb)
+{
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    // A negative scale marks little endian floats
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    const size_t rowSize = size_t(width) * 3 * sizeof(float);
+    for (uint32_t y = height; y-- > 0;)
+    {
+        file.write(reinterpret_cast<const char *>(rgb + size_t(y) * width * 3), rowSize);
+    }
+    return static_cast<bool>(file);
+}
+
+bool ImageWriter::WritePng(const std::string &filename, uint32_t width, uint32_t height,
+                           const uint8_t *rgb)
+{
+    // Scanlines with filter type 0
+    const size_t rowSize = size_t(width) * 3;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgb + y * rowSize, rgb + (y + 1) * rowSize);
+    }
+
+    // zlib stream without compression
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    size_t offset = 0;
+    do
+    {
+        const size_t size = std::min(scanlines.size() - offset, size_t(DEFLATE_STORED_BLOCK_SIZE));
+        const bool last = offset + size == scanlines.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+        offset += size;
+    } while (offset < scanlines.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : scanlines)
+    {
+        a = (a + byte) % ADLER_MODULO;
+        b = (b + a) % ADLER_MODULO;
+    }
+    AppendBigEndian(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, width);
+    AppendBigEndian(header, height);
+    // 8 bit RGB, deflate, standard filtering and no interlacing
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    AppendChunk(png, "IHDR", header);
+    AppendChunk(png, "IDAT", zlib);
+    AppendChunk(png, "IEND", {});
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(png.data()), png.size());
+    return static_cast<bool>(file);
+}
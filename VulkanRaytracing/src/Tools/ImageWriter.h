@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Writers for the images of the CPU ray tracer. Rows are passed top to bottom.
+class ImageWriter
+{
+  public:
+    // Linear RGB floats as a little endian Portable Float Map, which stores the rows bottom up
+    static bool WritePfm(const std::string &filename, uint32_t width, uint32_t height,
+                         const float *rgb);
+    // RGB8 as a PNG with uncompressed deflate blocks, the size matters less than a writer
+    // without dependencies
+    static bool WritePng(const std::string &filename, uint32_t width, uint32_t height,
+                         const uint8_t *rgb);
+};
@@ -0,0 +1,396 @@
+#include "vkpch.h"
+
+#include "Json.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Deeper documents are rejected instead of running out of stack
+#define JSON_MAX_DEPTH 256
+
+static const JsonValue s_Null;
+
+// Recursive descent over a text that need not be null terminated
+class JsonReader
+{
+  public:
+    JsonReader(const char *text, size_t size) : m_Cursor(text), m_End(text + size), m_Begin(text)
+    {
+    }
+
+    bool ReadDocument(JsonValue &value)
+    {
+        if (!ReadValue(value, 0))
+        {
+            return false;
+        }
+        SkipWhitespace();
+        return m_Cursor == m_End || Fail("unexpected data after the document");
+    }
+
+    std::string GetError() const
+    {
+        return m_Error + " at offset " + std::to_string(m_ErrorOffset);
+    }
+
+  private:
+    bool Fail(const char *message)
+    {
+        if (m_Error.empty())
+        {
+            m_Error = message;
+            m_ErrorOffset = static_cast<size_t>(m_Cursor - m_Begin);
+        }
+        return false;
+    }
+
+    void SkipWhitespace()
+    {
+        while (m_Cursor < m_End &&
+               (*m_Cursor == ' ' || *m_Cursor == '\t' || *m_Cursor == '\n' || *m_Cursor == '\r'))
+        {
+            m_Cursor++;
+        }
+    }
+
+    bool Consume(const char *literal)
+    {
+        const size_t length = strlen(literal);
+        if (static_cast<size_t>(m_End - m_Cursor) < length ||
+            memcmp(m_Cursor, literal, length) != 0)
+        {
+            return false;
+        }
+        m_Cursor += length;
+        return true;
+    }
+
+    bool ReadValue(JsonValue &value, uint32_t depth)
+    {
+        if (depth > JSON_MAX_DEPTH)
+        {
+            return Fail("document nested too deeply");
+        }
+        SkipWhitespace();
+        if (m_Cursor == m_End)
+        {
+            return Fail("unexpected end of the document");
+        }
+
+        switch (*m_Cursor)
+        {
+        case '{':
+            return ReadObject(value, depth);
+        case '[':
+            return ReadArray(value, depth);
+        case '"':
+            value.m_Type = JsonType::String;
+            return ReadString(value.m_String);
+        case 't':
+        case 'f':
+            value.m_Type = JsonType::Bool;
+            value.m_Bool = *m_Cursor == 't';
+            return Consume(value.m_Bool ? "true" : "false") || Fail("invalid literal");
+        case 'n':
+            value.m_Type = JsonType::Null;
+            return Consume("null") || Fail("invalid literal");
+        default:
+            value.m_Type = JsonType::Number;
+            return ReadNumber(value.m_Number);
+        }
+    }
+
+    bool ReadObject(JsonValue &value, uint32_t depth)
+    {
+        value.m_Type = JsonType::Object;
+        m_Cursor++;
+        SkipWhitespace();
+        if (m_Cursor < m_End && *m_Cursor == '}')
+        {
+            m_Cursor++;
+            return true;
+        }
+        while (true)
+        {
+            SkipWhitespace();
+            if (m_Cursor == m_End || *m_Cursor != '"')
+            {
+                return Fail("expected a member name");
+            }
+            value.m_Members.emplace_back();
+            auto &member = value.m_Members.back();
+            if (!ReadString(member.first))
+            {
+                return false;
+            }
+            SkipWhitespace();
+            if (m_Cursor == m_End || *m_Cursor++ != ':')
+            {
+                return Fail("expected ':'");
+            }
+            if (!ReadValue(member.second, depth + 1))
+            {
+                return false;
+            }
+            SkipWhitespace();
+            if (m_Cursor < m_End && *m_Cursor == ',')
+            {
+                m_Cursor++;
+                continue;
+            }
+            if (m_Cursor < m_End && *m_Cursor == '}')
+            {
+                m_Cursor++;
+                return true;
+            }
+            return Fail("expected ',' or '}'");
+        }
+    }
+
+    bool ReadArray(JsonValue &value, uint32_t depth)
+    {
+        value.m_Type = JsonType::Array;
+        m_Cursor++;
+        SkipWhitespace();
+        if (m_Cursor < m_End && *m_Cursor == ']')
+        {
+            m_Cursor++;
+            return true;
+        }
+        while (true)
+        {
+            value.m_Elements.emplace_back();
+            if (!ReadValue(value.m_Elements.back(), depth + 1))
+            {
+                return false;
+            }
+            SkipWhitespace();
+            if (m_Cursor < m_End && *m_Cursor == ',')
+            {
+                m_Cursor++;
+                continue;
+            }
+            if (m_Cursor < m_End && *m_Cursor == ']')
+            {
+                m_Cursor++;
+                return true;
+            }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ReadHex4(uint32_t &code)
+    {
+        if (m_End - m_Cursor < 4)
+        {
+            return Fail("truncated escape");
+        }
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            const char c = *m_Cursor++;
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+            {
+                code |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f')
+            {
+                code |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F')
+            {
+                code |= c - 'A' + 10;
+            }
+            else
+            {
+                return Fail("invalid escape");
+            }
+        }
+        return true;
+    }
+
+    static void AppendUtf8(uint32_t code, std::string &out)
+    {
+        if (code < 0x80)
+        {
+            out += static_cast<char>(code);
+        }
+        else if (code < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ReadString(std::string &out)
+    {
+        m_Cursor++;
+        while (true)
+        {
+            // Runs without escapes are copied at once
+            const char *run = m_Cursor;
+            while (m_Cursor < m_End && *m_Cursor != '"' && *m_Cursor != '\\')
+            {
+                m_Cursor++;
+            }
+            out.append(run, m_Cursor);
+            if (m_Cursor == m_End)
+            {
+                return Fail("unterminated string");
+            }
+            if (*m_Cursor++ == '"')
+            {
+                return true;
+            }
+            if (m_Cursor == m_End)
+            {
+                return Fail("unterminated string");
+            }
+
+            const char escape = *m_Cursor++;
+            switch (escape)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out += escape;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                uint32_t code;
+                if (!ReadHex4(code))
+                {
+                    return false;
+                }
+                // Surrogate pairs combine into one code point
+                if (code >= 0xD800 && code < 0xDC00 && Consume("\\u"))
+                {
+                    uint32_t low;
+                    if (!ReadHex4(low))
+                    {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(code, out);
+                break;
+            }
+            default:
+                return Fail("invalid escape");
+            }
+        }
+    }
+
+    bool ReadNumber(double &number)
+    {
+        // strtod needs a terminated copy, numbers longer than the buffer are not valid JSON
+        // written by any exporter
+        char buffer[64];
+        size_t length = 0;
+        while (m_Cursor + length < m_End && length + 1 < sizeof(buffer) &&
+               strchr("+-0123456789.eE", m_Cursor[length]) && m_Cursor[length] != '\0')
+        {
+            buffer[length] = m_Cursor[length];
+            length++;
+        }
+        buffer[length] = '\0';
+        char *end = nullptr;
+        number = strtod(buffer, &end);
+        if (length == 0 || end != buffer + length || !std::isfinite(number))
+        {
+            return Fail("invalid number");
+        }
+        m_Cursor += length;
+        return true;
+    }
+
+  private:
+    const char *m_Cursor;
+    const char *m_End;
+    const char *m_Begin;
+    std::string m_Error;
+    size_t m_ErrorOffset = 0;
+};
+
+bool JsonValue::Parse(const char *text, size_t size, JsonValue &value, std::string &error)
+{
+    value = JsonValue();
+    JsonReader reader(text, size);
+    if (!reader.ReadDocument(value))
+    {
+        error = reader.GetError();
+        value = JsonValue();
+        return false;
+    }
+    return true;
+}
+
+size_t JsonValue::GetSize() const
+{
+    if (m_Type == JsonType::Array)
+    {
+        return m_Elements.size();
+    }
+    return m_Type == JsonType::Object ? m_Members.size() : 0;
+}
+
+const JsonValue &JsonValue::operator[](size_t index) const
+{
+    return m_Type == JsonType::Array && index < m_Elements.size() ? m_Elements[index] : s_Null;
+}
+
+const JsonValue &JsonValue::operator[](const std::string &key) const
+{
+    for (const auto &member : m_Members)
+    {
+        if (member.first == key)
+        {
+            return member.second;
+        }
+    }
+    return s_Null;
+}
+
+bool JsonValue::Has(const std::string &key) const
+{
+    return !(*this)[key].IsNull();
+}
+
+uint32_t JsonValue::GetIndex(uint32_t fallback) const
+{
+    if (m_Type != JsonType::Number || m_Number < 0.0 || m_Number >= 4294967295.0 ||
+        m_Number != std::floor(m_Number))
+    {
+        return fallback;
+    }
+    return static_cast<uint32_t>(m_Number);
+}
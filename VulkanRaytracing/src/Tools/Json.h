@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class JsonType
+{
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+};
+
+// Document tree of a JSON text. Lookups of missing members or elements give a null value, so
+// optional fields read as their default without checks at every level.
+class JsonValue
+{
+  public:
+    static bool Parse(const char *text, size_t size, JsonValue &value, std::string &error);
+
+    JsonType GetType() const
+    {
+        return m_Type;
+    }
+
+    bool IsNull() const
+    {
+        return m_Type == JsonType::Null;
+    }
+
+    // Elements of arrays, members of objects and 0 for everything else
+    size_t GetSize() const;
+    const JsonValue &operator[](size_t index) const;
+    const JsonValue &operator[](const std::string &key) const;
+    bool Has(const std::string &key) const;
+
+    double GetNumber(double fallback = 0.0) const
+    {
+        return m_Type == JsonType::Number ? m_Number : fallback;
+    }
+
+    // Numbers that are not a non-negative integer give the fallback
+    uint32_t GetIndex(uint32_t fallback = UINT32_MAX) const;
+
+    bool GetBool(bool fallback = false) const
+    {
+        return m_Type == JsonType::Bool ? m_Bool : fallback;
+    }
+
+    const std::string &GetString() const
+    {
+        return m_String;
+    }
+
+    const std::vector<std::pair<std::string, JsonValue>> &GetMembers() const
+    {
+        return m_Members;
+    }
+
+  private:
+    friend class JsonReader;
+
+    JsonType m_Type = JsonType::Null;
+    bool m_Bool = false;
+    double m_Number = 0.0;
+    std::string m_String;
+    std::vector<JsonValue> m_Elements;
+    std::vector<std::pair<std::string, JsonValue>> m_Members;
+};
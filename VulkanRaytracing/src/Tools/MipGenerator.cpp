@@ -0,0 +1,254 @@
+#include "vkpch.h"
+
+#include "MipGenerator.h"
+
+#include "Core/ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#define SRGB_ENCODE_TABLE_SIZE (1 << 14)
+#define KAISER_TAPS 6
+#define MIP_PIXELS_PER_TASK (1 << 14)
+
+// Holds an __m128 in containers, which drop the alignment attribute of the vector type itself
+struct alignas(16) Float4
+{
+    float v[4];
+};
+
+struct ColorTables
+{
+    float srgbToLinear[256];
+    float unormToFloat[256];
+    uint8_t linearToSrgb[SRGB_ENCODE_TABLE_SIZE];
+    float kaiserWeights[KAISER_TAPS];
+};
+
+static float SrgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static double BesselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static const ColorTables &GetColorTables()
+{
+    static const ColorTables tables = []() {
+        ColorTables t;
+        for (int i = 0; i < 256; i++)
+        {
+            t.srgbToLinear[i] = SrgbToLinear(i / 255.0f);
+            t.unormToFloat[i] = i / 255.0f;
+        }
+        for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; i++)
+        {
+            float srgb = LinearToSrgb(i / float(SRGB_ENCODE_TABLE_SIZE - 1));
+            t.linearToSrgb[i] = static_cast<uint8_t>(srgb * 255.0f + 0.5f);
+        }
+
+        // Windowed sinc for 2:1 decimation, taps sit 0.5, 1.5 and 2.5 source pixels from the
+        // center of the destination pixel
+        const double pi = 3.14159265358979323846;
+        const double beta = 4.0;
+        const double radius = KAISER_TAPS / 2;
+        double sum = 0.0;
+        double weights[KAISER_TAPS];
+        for (int i = 0; i < KAISER_TAPS; i++)
+        {
+            double d = i - (KAISER_TAPS - 1) / 2.0;
+            double x = pi * d / 2.0;
+            double sinc = std::sin(x) / x;
+            double w = d / radius;
+            weights[i] = sinc * BesselI0(beta * std::sqrt(1.0 - w * w)) / BesselI0(beta);
+            sum += weights[i];
+        }
+        for (int i = 0; i < KAISER_TAPS; i++)
+        {
+            t.kaiserWeights[i] = static_cast<float>(weights[i] / sum);
+        }
+        return t;
+    }();
+    return tables;
+}
+
+static inline __m128 LoadPixel(const uint8_t *pixel, const float *colorTable)
+{
+    return _mm_setr_ps(colorTable[pixel[0]], colorTable[pixel[1]], colorTable[pixel[2]],
+                       pixel[3] * (1.0f / 255.0f));
+}
+
+static inline void StorePixel(__m128 color, uint8_t *pixel, const ColorTables &tables, bool srgb)
+{
+    const __m128 srgbScale = _mm_setr_ps(SRGB_ENCODE_TABLE_SIZE - 1, SRGB_ENCODE_TABLE_SIZE - 1,
+                                         SRGB_ENCODE_TABLE_SIZE - 1, 255.0f);
+    const __m128 unormScale = _mm_set1_ps(255.0f);
+
+    color = _mm_min_ps(_mm_max_ps(color, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    alignas(16) int32_t values[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(values),
+                    _mm_cvtps_epi32(_mm_mul_ps(color, srgb ? srgbScale : unormScale)));
+    if (srgb)
+    {
+        pixel[0] = tables.linearToSrgb[values[0]];
+        pixel[1] = tables.linearToSrgb[values[1]];
+        pixel[2] = tables.linearToSrgb[values[2]];
+    }
+    else
+    {
+        pixel[0] = static_cast<uint8_t>(values[0]);
+        pixel[1] = static_cast<uint8_t>(values[1]);
+        pixel[2] = static_cast<uint8_t>(values[2]);
+    }
+    pixel[3] = static_cast<uint8_t>(values[3]);
+}
+
+static void BoxFilterRow(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst,
+                         uint32_t dstWidth, uint32_t y, const ColorTables &tables, bool srgb)
+{
+    const float *colorTable = srgb ? tables.srgbToLinear : tables.unormToFloat;
+    const uint8_t *row0 = src + 4 * size_t(srcWidth) * std::min(2 * y, srcHeight - 1);
+    const uint8_t *row1 = src + 4 * size_t(srcWidth) * std::min(2 * y + 1, srcHeight - 1);
+    uint8_t *out = dst + 4 * size_t(dstWidth) * y;
+    const __m128 quarter = _mm_set1_ps(0.25f);
+
+    for (uint32_t x = 0; x < dstWidth; x++)
+    {
+        const size_t x0 = 4 * size_t(std::min(2 * x, srcWidth - 1));
+        const size_t x1 = 4 * size_t(std::min(2 * x + 1, srcWidth - 1));
+        __m128 sum = LoadPixel(row0 + x0, colorTable);
+        sum = _mm_add_ps(sum, LoadPixel(row0 + x1, colorTable));
+        sum = _mm_add_ps(sum, LoadPixel(row1 + x0, colorTable));
+        sum = _mm_add_ps(sum, LoadPixel(row1 + x1, colorTable));
+        StorePixel(_mm_mul_ps(sum, quarter), out + 4 * size_t(x), tables, srgb);
+    }
+}
+
+// Separable, every source row is decoded once and filtered horizontally before the vertical
+// pass accumulates it
+static void KaiserFilterRow(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight,
+                            uint8_t *dst, uint32_t dstWidth, uint32_t y, const ColorTables &tables,
+                            bool srgb, std::vector<Float4> &decoded, std::vector<Float4> &sum)
+{
+    const float *colorTable = srgb ? tables.srgbToLinear : tables.unormToFloat;
+    const float *weights = tables.kaiserWeights;
+    const int64_t lastX = int64_t(srcWidth) - 1;
+    const int64_t lastY = int64_t(srcHeight) - 1;
+    decoded.resize(srcWidth);
+    sum.assign(dstWidth, Float4{});
+    __m128 weightsX[KAISER_TAPS];
+    for (int tap = 0; tap < KAISER_TAPS; tap++)
+    {
+        weightsX[tap] = _mm_set1_ps(weights[tap]);
+    }
+
+    for (int tapY = 0; tapY < KAISER_TAPS; tapY++)
+    {
+        int64_t sy = int64_t(2 * y) - (KAISER_TAPS / 2 - 1) + tapY;
+        sy = std::min(std::max<int64_t>(sy, 0), lastY);
+        const uint8_t *row = src + 4 * size_t(srcWidth) * sy;
+        for (uint32_t x = 0; x < srcWidth; x++)
+        {
+            _mm_store_ps(decoded[x].v, LoadPixel(row + 4 * size_t(x), colorTable));
+        }
+
+        const __m128 weightY = _mm_set1_ps(weights[tapY]);
+        for (uint32_t x = 0; x < dstWidth; x++)
+        {
+            const int64_t first = int64_t(2 * x) - (KAISER_TAPS / 2 - 1);
+            __m128 horizontal = _mm_setzero_ps();
+            for (int tapX = 0; tapX < KAISER_TAPS; tapX++)
+            {
+                const int64_t sx = std::min(std::max<int64_t>(first + tapX, 0), lastX);
+                horizontal = _mm_add_ps(horizontal,
+                                        _mm_mul_ps(_mm_load_ps(decoded[sx].v), weightsX[tapX]));
+            }
+            _mm_store_ps(sum[x].v,
+                         _mm_add_ps(_mm_load_ps(sum[x].v), _mm_mul_ps(horizontal, weightY)));
+        }
+    }
+
+    uint8_t *out = dst + 4 * size_t(dstWidth) * y;
+    for (uint32_t x = 0; x < dstWidth; x++)
+    {
+        StorePixel(_mm_load_ps(sum[x].v), out + 4 * size_t(x), tables, srgb);
+    }
+}
+
+uint32_t MipGenerator::GetLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+    {
+        levels++;
+    }
+    return levels;
+}
+
+void MipGenerator::Generate(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb,
+                            MipFilter filter, MipChain &chain)
+{
+    const ColorTables &tables = GetColorTables();
+
+    chain.levels.resize(GetLevelCount(width, height));
+    size_t size = 0;
+    for (auto &level : chain.levels)
+    {
+        level.offset = size;
+        level.width = width;
+        level.height = height;
+        size += 4 * size_t(width) * height;
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    chain.pixels.resize(size);
+    const MipLevel &base = chain.levels[0];
+    memcpy(chain.pixels.data(), pixels, 4 * size_t(base.width) * base.height);
+
+    ThreadPool &pool = ThreadPool::Get();
+    for (size_t i = 1; i < chain.levels.size(); i++)
+    {
+        const MipLevel &srcLevel = chain.levels[i - 1];
+        const MipLevel &dstLevel = chain.levels[i];
+        const uint8_t *src = chain.pixels.data() + srcLevel.offset;
+        uint8_t *dst = chain.pixels.data() + dstLevel.offset;
+
+        const uint32_t rowsPerTask = std::max(MIP_PIXELS_PER_TASK / dstLevel.width, 1u);
+        const size_t taskCount = (dstLevel.height + rowsPerTask - 1) / rowsPerTask;
+        pool.ParallelFor(taskCount, [&](size_t task) {
+            const uint32_t begin = static_cast<uint32_t>(task) * rowsPerTask;
+            const uint32_t end = std::min(begin + rowsPerTask, dstLevel.height);
+            std::vector<Float4> decoded;
+            std::vector<Float4> sum;
+            for (uint32_t y = begin; y < end; y++)
+            {
+                if (filter == MipFilter::Kaiser)
+                {
+                    KaiserFilterRow(src, srcLevel.width, srcLevel.height, dst, dstLevel.width, y,
+                                    tables, srgb, decoded, sum);
+                }
+                else
+                {
+                    BoxFilterRow(src, srcLevel.width, srcLevel.height, dst, dstLevel.width, y,
+                                 tables, srgb);
+                }
+            }
+        });
+    }
+}
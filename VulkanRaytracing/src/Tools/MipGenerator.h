@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct MipLevel
+{
+    size_t offset = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Tightly packed RGBA8 levels, largest first
+struct MipChain
+{
+    std::vector<uint8_t> pixels;
+    std::vector<MipLevel> levels;
+};
+
+enum class MipFilter
+{
+    Box,
+    Kaiser
+};
+
+// Builds full mip chains on the CPU. Filtering runs on SSE registers holding one RGBA pixel,
+// sRGB colors are averaged in linear space and alpha is always linear. Rows of a level are
+// split across the thread pool, each level is filtered from the one above it.
+class MipGenerator
+{
+  public:
+    static uint32_t GetLevelCount(uint32_t width, uint32_t height);
+
+    static void Generate(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb,
+                         MipFilter filter, MipChain &chain);
+};
@@ -0,0 +1,163 @@
+#include "vkpch.h"
+
+#include "TextureAtlas.h"
+
+#include <cstring>
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+static uint32_t GetPadding(const TextureAtlasSettings &settings)
+{
+    uint32_t padding = 1;
+    while (padding * 2 <= settings.padding)
+    {
+        padding *= 2;
+    }
+    return padding;
+}
+
+// Side of the grid cell run holding a texture and its border
+static uint32_t GetCellCount(uint32_t size, uint32_t padding)
+{
+    return (size + 3 * padding - 1) / padding;
+}
+
+bool TextureAtlas::CanPack(uint32_t width, uint32_t height, const TextureAtlasSettings &settings)
+{
+    const uint32_t padding = GetPadding(settings);
+    const uint32_t gridSize = std::min(settings.atlasSize, 1u << 15) / padding;
+    return width > 0 && height > 0 && width <= settings.maxTextureSize &&
+           height <= settings.maxTextureSize && GetCellCount(width, padding) <= gridSize &&
+           GetCellCount(height, padding) <= gridSize;
+}
+
+// Copies the texture into its cells and repeats the edge texels over the rest of them
+static void FillRegion(const MipChain &texture, const stbrp_rect &rect, uint32_t padding,
+                       uint32_t atlasWidth, std::vector<uint8_t> &pixels)
+{
+    const MipLevel &level = texture.levels[0];
+    const uint8_t *source = texture.pixels.data() + level.offset;
+    const uint32_t x0 = rect.x * padding;
+    const uint32_t y0 = rect.y * padding;
+    for (uint32_t y = 0; y < rect.h * padding; y++)
+    {
+        const uint32_t sourceY = std::min(y < padding ? 0 : y - padding, level.height - 1);
+        const uint8_t *sourceRow = source + size_t(sourceY) * level.width * 4;
+        uint8_t *row = pixels.data() + (size_t(y0 + y) * atlasWidth + x0) * 4;
+        for (uint32_t x = 0; x < padding; x++)
+        {
+            memcpy(row + x * 4, sourceRow, 4);
+        }
+        memcpy(row + padding * 4, sourceRow, size_t(level.width) * 4);
+        for (uint32_t x = padding + level.width; x < rect.w * padding; x++)
+        {
+            memcpy(row + x * 4, sourceRow + (level.width - 1) * 4, 4);
+        }
+    }
+}
+
+void TextureAtlas::Build(const std::vector<const MipChain *> &textures,
+                         const TextureAtlasSettings &settings, std::vector<MipChain> &atlases,
+                         std::vector<AtlasRegion> &regions)
+{
+    const uint32_t padding = GetPadding(settings);
+    const uint32_t gridSize = std::min(settings.atlasSize, 1u << 15) / padding;
+    regions.assign(textures.size(), AtlasRegion());
+
+    std::vector<stbrp_rect> remaining;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        const MipLevel &level = textures[i]->levels[0];
+        if (CanPack(level.width, level.height, settings))
+        {
+            stbrp_rect rect = {};
+            rect.id = static_cast<int>(i);
+            rect.w = static_cast<stbrp_coord>(GetCellCount(level.width, padding));
+            rect.h = static_cast<stbrp_coord>(GetCellCount(level.height, padding));
+            remaining.push_back(rect);
+        }
+    }
+
+    std::vector<stbrp_node> nodes(gridSize);
+    while (!remaining.empty())
+    {
+        // Starts from the smallest power of two square that could hold the rects and grows it
+        // until they all fit or the atlas is full, which keeps the cropped atlas dense. Every rect
+        // fits an empty atlas, so each pass packs at least one.
+        uint64_t area = 0;
+        uint32_t side = 1;
+        for (const stbrp_rect &rect : remaining)
+        {
+            area += uint64_t(rect.w) * rect.h;
+            side = std::max(side, uint32_t(std::max(rect.w, rect.h)));
+        }
+        while (uint64_t(side) * side < area)
+        {
+            side *= 2;
+        }
+        while (true)
+        {
+            side = std::min(side, gridSize);
+            stbrp_context context;
+            stbrp_init_target(&context, side, side, nodes.data(), static_cast<int>(side));
+            if (stbrp_pack_rects(&context, remaining.data(), static_cast<int>(remaining.size())) ||
+                side == gridSize)
+            {
+                break;
+            }
+            side *= 2;
+        }
+
+        std::vector<stbrp_rect> packed;
+        std::vector<stbrp_rect> unpacked;
+        uint32_t usedWidth = 0;
+        uint32_t usedHeight = 0;
+        for (const stbrp_rect &rect : remaining)
+        {
+            if (rect.was_packed)
+            {
+                usedWidth = std::max(usedWidth, uint32_t(rect.x + rect.w));
+                usedHeight = std::max(usedHeight, uint32_t(rect.y + rect.h));
+                packed.push_back(rect);
+            }
+            else
+            {
+                unpacked.push_back(rect);
+            }
+        }
+        remaining = std::move(unpacked);
+
+        const uint32_t atlasIndex = static_cast<uint32_t>(atlases.size());
+        const uint32_t width = usedWidth * padding;
+        const uint32_t height = usedHeight * padding;
+        std::vector<uint8_t> pixels(size_t(width) * height * 4);
+        for (const stbrp_rect &rect : packed)
+        {
+            const MipLevel &level = textures[rect.id]->levels[0];
+            FillRegion(*textures[rect.id], rect, padding, width, pixels);
+
+            AtlasRegion &region = regions[rect.id];
+            region.atlas = atlasIndex;
+            region.scale[0] = float(level.width) / width;
+            region.scale[1] = float(level.height) / height;
+            region.offset[0] = float(rect.x * padding + padding) / width;
+            region.offset[1] = float(rect.y * padding + padding) / height;
+        }
+
+        // Box filtered levels of cells aligned to the padding stay within the cells down to the
+        // level where the padding is one texel
+        MipChain atlas;
+        MipGenerator::Generate(pixels.data(), width, height, true, MipFilter::Box, atlas);
+        uint32_t levelCount = 1;
+        while ((1u << (levelCount - 1)) < padding && levelCount < atlas.levels.size())
+        {
+            levelCount++;
+        }
+        const MipLevel &last = atlas.levels[levelCount - 1];
+        atlas.pixels.resize(last.offset + size_t(last.width) * last.height * 4);
+        atlas.levels.resize(levelCount);
+        atlases.push_back(std::move(atlas));
+    }
+}
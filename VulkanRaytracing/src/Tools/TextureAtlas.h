@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MipGenerator.h"
+
+#include <cstdint>
+#include <vector>
+
+struct TextureAtlasSettings
+{
+    // Textures up to this size in both dimensions are packed, 0 turns atlases off
+    uint32_t maxTextureSize = 0;
+    // Largest width and height of an atlas, each one is cropped to the regions it holds
+    uint32_t atlasSize = 2048;
+    // Texels around each texture on the largest level that repeat its edge, rounded down to a
+    // power of two. Atlases get the levels down to the one where the border is a single texel.
+    uint32_t padding = 4;
+};
+
+// Where a texture ended up, texture coordinates in [0, 1] map to offset + scale * uv
+struct AtlasRegion
+{
+    // UINT32_MAX for textures that were not packed
+    uint32_t atlas = UINT32_MAX;
+    float scale[2] = {1.0f, 1.0f};
+    float offset[2] = {0.0f, 0.0f};
+};
+
+// Packs small textures into shared RGBA8 mip chains with stb_rect_pack. Regions are placed on a
+// grid as fine as the padding, so that the mip levels built from the packed atlas never average
+// texels of two regions down to the level where the border is one texel. Coarser levels would
+// mix neighbouring textures and are left out.
+class TextureAtlas
+{
+  public:
+    static bool CanPack(uint32_t width, uint32_t height, const TextureAtlasSettings &settings);
+
+    // Packs the largest level of each texture, those CanPack rejects keep the default region. A
+    // new atlas is started whenever the last one is full.
+    static void Build(const std::vector<const MipChain *> &textures,
+                      const TextureAtlasSettings &settings, std::vector<MipChain> &atlases,
+                      std::vector<AtlasRegion> &regions);
+};
@@ -102,8 +102,23 @@ QueueFamilyIndices FindQueueFamilies(const vk::PhysicalDevice &physicalDevice,
         return {};
     }
 
-    return {static_cast<uint32_t>(graphicsQueueFamilyIndex),
-            static_cast<uint32_t>(presentQueueFamilyIndex)};
+    QueueFamilyIndices indices{static_cast<uint32_t>(graphicsQueueFamilyIndex),
+                               static_cast<uint32_t>(presentQueueFamilyIndex)};
+    // Compute queues support transfers even when they do not report it
+    for (size_t i = 0; i < queueFamilyProperties.size(); i++)
+    {
+        const vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+        if ((flags & vk::QueueFlagBits::eGraphics) ||
+            !(flags & (vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eCompute)))
+        {
+            continue;
+        }
+        if (!indices.transferFamily || !(flags & vk::QueueFlagBits::eCompute))
+        {
+            indices.transferFamily = static_cast<uint32_t>(i);
+        }
+    }
+    return indices;
 }
 
 bool CheckDeviceExtensionSupport(vk::PhysicalDevice physicalDevice)
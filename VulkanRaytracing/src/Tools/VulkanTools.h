@@ -18,6 +18,8 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // A family without graphics support for uploads, preferring one that only transfers
+    std::optional<uint32_t> transferFamily;
 
     inline bool IsComplete() const
     {
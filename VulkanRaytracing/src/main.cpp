@@ -3,11 +3,17 @@
 #include "Renderer/VulkanRenderer.h"
 #include "Window/WindowsWindow.h"
 #include "Application.h"
+#include "Tools/Benchmark.h"
 
-int main()
+int main(int argc, char **argv)
 {
+    if (Benchmark::IsRequested(argc, argv))
+    {
+        return Benchmark::Run(argc, argv);
+    }
+
     Application *app = new Application();
     app->Run();
     delete app;
     return 0;
-}
\ No newline at end of file
+}